@@ -133,8 +133,10 @@ static Walrus_AppError on_init(Walrus_App *app)
             {.x = 0, .y = 0, .width = 1440, .height = 900, .active = true, .framebuffer = {WR_INVALID_HANDLE}});
     ecs_set_name(ecs, camera, "camera");
 
+    walrus_model_system_set_load_flags(model,
+                                       WR_MODEL_LOAD_FLAG_OPTIMIZE | WR_MODEL_LOAD_FLAG_LOD | WR_MODEL_LOAD_FLAG_CACHE);
     walrus_model_system_load_from_file(model, "shibahu", "assets/gltf/shibahu/scene.gltf");
-    walrus_model_system_load_from_file(model, "cubes", "assets/gltf/EmissiveStrengthTest.gltf");
+    walrus_model_system_load_async(model, "cubes", "assets/gltf/EmissiveStrengthTest.gltf", NULL, NULL);
 
     ecs_entity_t character =
         walrus_model_instantiate(model, "shibahu", (vec3){-2, 0, 0}, (versor){0, 0, 0, 1}, (vec3){1, 1, 1});
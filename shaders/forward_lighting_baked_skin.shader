@@ -0,0 +1,7 @@
+#pragma vertex
+
+#include "baked_skinned_mesh.glsl"
+
+#pragma fragment
+
+#include "forward_lighting.glsl"
@@ -11,13 +11,17 @@ in vec2 v_uv;
 in vec3 v_tangent;
 in vec3 v_bitangent;
 
-uniform sampler2D u_albedo;
-uniform vec4 u_albedo_factor;
-uniform sampler2D u_emissive;
-uniform vec3 u_emissive_factor;
-uniform sampler2D u_normal;
-uniform float u_normal_scale;
-uniform float u_alpha_cutoff;
+// Laid out and bound by walrus_model_material_init_default
+layout(binding = 0) uniform sampler2D u_albedo;
+layout(binding = 1) uniform sampler2D u_emissive;
+layout(binding = 2) uniform sampler2D u_normal;
+
+layout(std140, binding = 2) uniform Material {
+    float u_alpha_cutoff;
+    vec4 u_albedo_factor;
+    vec3 u_emissive_factor;
+    float u_normal_scale;
+};
 
 void main() {
     vec3 normal = normalize(v_normal);
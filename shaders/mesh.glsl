@@ -2,6 +2,7 @@ layout(location = 0) in vec3 a_pos;
 layout(location = 1) in vec3 a_normal;
 layout(location = 2) in vec4 a_tangent;
 layout(location = 3) in vec2 a_uv;
+layout(location = 12) in mat4 a_instance_model;
 uniform mat4 u_viewproj;
 uniform mat4 u_model;
 out vec3 v_pos;
@@ -35,11 +36,12 @@ vec3 sample_morph_texture(int layer)
 }
 
 void main() {
-    mat3 nmat = transpose(inverse(mat3(u_model)));
+    mat4 model = u_model * a_instance_model;
+    mat3 nmat = transpose(inverse(mat3(model)));
 
     v_pos = a_pos;
     v_pos += sample_morph_texture(0);
-    v_pos = (u_model * vec4(v_pos, 1)).xyz;
+    v_pos = (model * vec4(v_pos, 1)).xyz;
 
     v_normal = a_normal;
     v_normal += sample_morph_texture(1);
@@ -4,6 +4,7 @@ layout(location = 2) in vec4 a_tangent;
 layout(location = 3) in vec2 a_uv;
 layout(location = 5) in vec4 a_joints;
 layout(location = 6) in vec4 a_weights;
+layout(location = 12) in mat4 a_instance_model;
 uniform mat4 u_viewproj;
 uniform mat4 u_model;
 out vec3 v_pos;
@@ -47,7 +48,7 @@ void main() {
                  a_weights.y * ssbo_joints[int(a_joints.y)] +
                  a_weights.z * ssbo_joints[int(a_joints.z)] +
                  a_weights.w * ssbo_joints[int(a_joints.w)];
-    world = u_model * world;
+    world = u_model * a_instance_model * world;
     mat3 nmat = transpose(inverse(mat3(world)));
 
     v_pos = a_pos;
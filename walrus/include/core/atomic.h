@@ -0,0 +1,155 @@
+#pragma once
+
+#include "macro.h"
+
+#if WR_COMPILER == WR_COMPILER_VC
+#include <intrin.h>
+#endif
+
+WR_INLINE u32 walrus_atomic_load_u32(u32 volatile *ptr)
+{
+#if WR_COMPILER == WR_COMPILER_VC
+    u32 val = *ptr;
+    _ReadWriteBarrier();
+    return val;
+#else
+    return __atomic_load_n(ptr, __ATOMIC_ACQUIRE);
+#endif
+}
+
+WR_INLINE void walrus_atomic_store_u32(u32 volatile *ptr, u32 val)
+{
+#if WR_COMPILER == WR_COMPILER_VC
+    _ReadWriteBarrier();
+    *ptr = val;
+#else
+    __atomic_store_n(ptr, val, __ATOMIC_RELEASE);
+#endif
+}
+
+WR_INLINE u32 walrus_atomic_fetch_add_u32(u32 volatile *ptr, u32 val)
+{
+#if WR_COMPILER == WR_COMPILER_VC
+    return (u32)_InterlockedExchangeAdd((long volatile *)ptr, (long)val);
+#else
+    return __atomic_fetch_add(ptr, val, __ATOMIC_ACQ_REL);
+#endif
+}
+
+WR_INLINE u32 walrus_atomic_fetch_sub_u32(u32 volatile *ptr, u32 val)
+{
+#if WR_COMPILER == WR_COMPILER_VC
+    return (u32)_InterlockedExchangeAdd((long volatile *)ptr, -(long)val);
+#else
+    return __atomic_fetch_sub(ptr, val, __ATOMIC_ACQ_REL);
+#endif
+}
+
+// On failure `expected` is updated with the current value
+WR_INLINE bool walrus_atomic_cas_u32(u32 volatile *ptr, u32 *expected, u32 desired)
+{
+#if WR_COMPILER == WR_COMPILER_VC
+    u32 prev = (u32)_InterlockedCompareExchange((long volatile *)ptr, (long)desired, (long)*expected);
+    if (prev == *expected) {
+        return true;
+    }
+    *expected = prev;
+    return false;
+#else
+    return __atomic_compare_exchange_n(ptr, expected, desired, false, __ATOMIC_ACQ_REL, __ATOMIC_ACQUIRE);
+#endif
+}
+
+// Saturating add, returns the previous value and never goes past `max`
+WR_INLINE u32 walrus_atomic_fetch_add_sat_u32(u32 volatile *ptr, u32 val, u32 max)
+{
+    u32 prev = walrus_atomic_load_u32(ptr);
+    u32 next;
+    do {
+        next = prev + val < prev || prev + val > max ? max : prev + val;
+    } while (!walrus_atomic_cas_u32(ptr, &prev, next));
+    return prev;
+}
+
+WR_INLINE i64 walrus_atomic_load_i64(i64 volatile *ptr)
+{
+#if WR_COMPILER == WR_COMPILER_VC
+    i64 val = *ptr;
+    _ReadWriteBarrier();
+    return val;
+#else
+    return __atomic_load_n(ptr, __ATOMIC_ACQUIRE);
+#endif
+}
+
+WR_INLINE void walrus_atomic_store_i64(i64 volatile *ptr, i64 val)
+{
+#if WR_COMPILER == WR_COMPILER_VC
+    _ReadWriteBarrier();
+    *ptr = val;
+#else
+    __atomic_store_n(ptr, val, __ATOMIC_RELEASE);
+#endif
+}
+
+WR_INLINE i64 walrus_atomic_fetch_add_i64(i64 volatile *ptr, i64 val)
+{
+#if WR_COMPILER == WR_COMPILER_VC
+    return _InterlockedExchangeAdd64(ptr, val);
+#else
+    return __atomic_fetch_add(ptr, val, __ATOMIC_ACQ_REL);
+#endif
+}
+
+WR_INLINE bool walrus_atomic_cas_i64(i64 volatile *ptr, i64 *expected, i64 desired)
+{
+#if WR_COMPILER == WR_COMPILER_VC
+    i64 prev = _InterlockedCompareExchange64(ptr, desired, *expected);
+    if (prev == *expected) {
+        return true;
+    }
+    *expected = prev;
+    return false;
+#else
+    return __atomic_compare_exchange_n(ptr, expected, desired, false, __ATOMIC_SEQ_CST, __ATOMIC_RELAXED);
+#endif
+}
+
+WR_INLINE void *walrus_atomic_load_ptr(void *volatile *ptr)
+{
+#if WR_COMPILER == WR_COMPILER_VC
+    void *val = *ptr;
+    _ReadWriteBarrier();
+    return val;
+#else
+    return __atomic_load_n(ptr, __ATOMIC_ACQUIRE);
+#endif
+}
+
+WR_INLINE void walrus_atomic_store_ptr(void *volatile *ptr, void *val)
+{
+#if WR_COMPILER == WR_COMPILER_VC
+    _ReadWriteBarrier();
+    *ptr = val;
+#else
+    __atomic_store_n(ptr, val, __ATOMIC_RELEASE);
+#endif
+}
+
+WR_INLINE void walrus_atomic_fence(void)
+{
+#if WR_COMPILER == WR_COMPILER_VC
+    _mm_mfence();
+#else
+    __atomic_thread_fence(__ATOMIC_SEQ_CST);
+#endif
+}
+
+WR_INLINE void walrus_cpu_pause(void)
+{
+#if WR_COMPILER == WR_COMPILER_VC
+    _mm_pause();
+#elif defined(__i386__) || defined(__x86_64__)
+    __builtin_ia32_pause();
+#endif
+}
@@ -0,0 +1,49 @@
+#pragma once
+
+#include "type.h"
+
+#ifndef WR_JOB_MAX_THREADS
+#define WR_JOB_MAX_THREADS 32
+#endif
+
+// Jobs are recycled from a per-thread ring, this is the maximum number of jobs a thread can have in flight
+#ifndef WR_JOB_MAX_JOBS
+#define WR_JOB_MAX_JOBS 4096
+#endif
+
+typedef struct Walrus_Job Walrus_Job;
+
+// A job slot is reused once its job is finished, the handle keeps the generation of the slot so that it still reads
+// as finished afterwards
+typedef struct {
+    Walrus_Job *job;
+    u32         generation;
+} Walrus_JobHandle;
+
+typedef void (*Walrus_JobFn)(Walrus_JobHandle job, void *userdata);
+
+typedef void (*Walrus_ParallelForFn)(u32 begin, u32 end, void *userdata);
+
+void walrus_job_init(u8 num_workers);
+
+void walrus_job_shutdown(void);
+
+// Number of threads that can execute jobs, including the caller
+u32 walrus_job_num_threads(void);
+
+// Jobs of a thread left without a slot, or created while the system is down, are run on the spot by
+// walrus_job_run
+Walrus_JobHandle walrus_job_create(Walrus_JobFn fn, void *userdata);
+
+// The parent job is not finished until all of its children are finished
+Walrus_JobHandle walrus_job_create_child(Walrus_JobHandle parent, Walrus_JobFn fn, void *userdata);
+
+void walrus_job_run(Walrus_JobHandle job);
+
+// Executes other jobs while waiting
+void walrus_job_wait(Walrus_JobHandle job);
+
+bool walrus_job_finished(Walrus_JobHandle job);
+
+// Splits [begin, end) into ranges of at most `grain` elements and blocks until all of them are done
+void walrus_parallel_for(u32 begin, u32 end, u32 grain, Walrus_ParallelForFn fn, void *userdata);
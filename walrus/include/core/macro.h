@@ -40,6 +40,7 @@
 #define WR_NO_RETURN                     __attribute__((noreturn))
 #define WR_CONST_FUNC                    __attribute__((pure))
 #define WR_UNREACHABLE                   __builtin_unreachable()
+#define WR_THREAD_LOCAL                  __thread
 
 #elif WR_COMPILER == WR_COMPILER_VC
 #define walrus_assume(_condition)        __assume(_condition)
@@ -50,8 +51,9 @@
 #define walrus_unlikely(_x) (_x)
 #define WR_NO_INLINE        __declspec(noinline)
 #define WR_NO_RETURN
-#define WR_CONST_FUNC  __declspec(noalias)
-#define WR_UNREACHABLE __assume(false)
+#define WR_CONST_FUNC   __declspec(noalias)
+#define WR_UNREACHABLE  __assume(false)
+#define WR_THREAD_LOCAL __declspec(thread)
 #else
 #error "Unknown WR_COMPILER_?"
 #endif
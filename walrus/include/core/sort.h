@@ -9,3 +9,6 @@ void walrus_quick_sort(void* data, u32 num, u32 stride, ComparisonFn fn);
 void walrus_radix_sort(u32* keys, u32* temp_keys, void* values, void* temp_values, u32 size, u32 element_size);
 
 void walrus_radix_sort64(u64* keys, u64* temp_keys, void* values, void* temp_values, u32 size, u32 element_size);
+
+// Specialised for u32 values, splits the passes across the job system for large inputs
+void walrus_radix_sort64_u32(u64* keys, u64* temp_keys, u32* values, u32* temp_values, u32 size);
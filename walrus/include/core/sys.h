@@ -13,3 +13,6 @@ typedef enum {
 
 // Function to get sys time in unit
 u64 walrus_sysclock(Walrus_SysClockUnit unit);
+
+// Size in bytes and last modification time in seconds since the epoch, false if the file can not be queried
+bool walrus_file_stat(char const *path, u64 *size, u64 *mtime);
@@ -13,3 +13,6 @@ void walrus_thread_destroy(Walrus_Thread* thread);
 bool walrus_thread_init(Walrus_Thread* thread, Walrus_ThreadFn fn, void* userdata, u32 stack_size);
 
 void walrus_thread_shutdown(Walrus_Thread* thread);
+
+// Gives the rest of the time slice to another ready thread
+void walrus_thread_yield(void);
@@ -0,0 +1,50 @@
+#pragma once
+
+#include <core/type.h>
+#include <engine/model.h>
+#include <rhi/rhi.h>
+
+// Rows of the atlas sampled from one animation, evenly spaced from its start to its end
+typedef struct {
+    u32 first_frame;
+    u32 num_frames;
+    f32 duration;
+} Walrus_BakedClip;
+
+// Skin matrices of every animation of a model sampled at a fixed rate. A frame is one row of `num_joints` matrices,
+// the joints of every skin one after another from `skin_offsets`, each stored as the three rows of its affine part.
+// `mins` and `maxs` bound every skin over a whole clip, indexed by clip then skin.
+typedef struct {
+    Walrus_BakedClip    *clips;
+    u32                  num_clips;
+    u32                 *skin_offsets;
+    u32                  num_skins;
+    u32                  num_joints;
+    u32                  num_frames;
+    f32                  frame_rate;
+    vec4                *matrices;
+    vec3                *mins;
+    vec3                *maxs;
+    Walrus_TextureHandle texture;
+} Walrus_BakedAnimation;
+
+// Plays a clip of the baked animation of its model, `time_offset` keeps instances playing the same clip apart
+typedef struct {
+    u32 clip;
+    f32 time_offset;
+} Walrus_BakedAnimator;
+
+// Samples every animation of the model on the CPU, nothing is uploaded yet
+void walrus_animation_bake(Walrus_BakedAnimation *baked, Walrus_Model const *model, f32 frame_rate);
+
+// Creates the atlas texture, one RGBA32F texel per matrix row and one texture row per frame. Fails when the atlas is
+// wider or taller than the renderer allows, the animation is then left without a texture.
+bool walrus_baked_animation_upload(Walrus_BakedAnimation *baked);
+
+void walrus_baked_animation_shutdown(Walrus_BakedAnimation *baked);
+
+// Fractional atlas row of the clip at `time`, looping over the clip
+f32 walrus_baked_animation_frame(Walrus_BakedAnimation const *baked, u32 clip, f32 time);
+
+// Skin matrix of the joint at a fractional row, interpolated between the rows around it as the shaders do
+void walrus_baked_animation_joint(Walrus_BakedAnimation const *baked, f32 frame, u32 skin, u32 joint, mat4 matrix);
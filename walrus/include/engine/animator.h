@@ -1,19 +1,55 @@
 #pragma once
 
 #include <core/type.h>
-#include <core/array.h>
 #include <engine/model.h>
 
+#define WR_ANIMATOR_MAX_LAYERS 4
+#define WR_ANIMATOR_MAX_CLIPS  4
+
+typedef enum {
+    WR_ANIMATOR_BLEND_OVERRIDE,
+    // The layer adds its difference from the bind pose onto the layers below
+    WR_ANIMATOR_BLEND_ADDITIVE,
+} Walrus_AnimatorBlend;
+
+// An animation playing on a layer. `weight` moves towards `target_weight` by `fade_speed` per second, a clip faded
+// out to zero leaves the layer.
+typedef struct {
+    u32  index;
+    f32  timestamp;
+    f32  weight;
+    f32  target_weight;
+    f32  fade_speed;
+    bool repeat;
+} Walrus_AnimatorClip;
+
+// The clips of a layer are averaged by weight, then the layer is blended over the layers below it by `weight`,
+// scaled per node by the mask when `masked` is set.
+typedef struct {
+    Walrus_AnimatorClip  clips[WR_ANIMATOR_MAX_CLIPS];
+    u32                  num_clips;
+    Walrus_AnimatorBlend blend;
+    f32                  weight;
+    bool                 masked;
+} Walrus_AnimatorLayer;
+
+// Per model node transforms and morph weights, blended from the cooked tracks of the playing clips. Every buffer is
+// sized at bind: `cursors` caches the last key found for every track of every clip slot, `masks` holds a weight per
+// node for every layer, and `poses` packs the bind pose followed by the scratch poses clips are blended through.
 typedef struct {
-    u32           index;
-    Walrus_Array *keys;
-    Walrus_Array *worlds;
-    Walrus_Array *locals;
-    Walrus_Array *weights;
-    Walrus_Array *weight_offsets;
-    f32           timestamp;
-    bool          repeat;
-    bool          playing;
+    Walrus_AnimatorLayer layers[WR_ANIMATOR_MAX_LAYERS];
+    u32                 *cursors;
+    f32                 *masks;
+    Walrus_Transform    *poses;
+    Walrus_Transform    *worlds;
+    Walrus_Transform    *locals;
+    f32                 *pose_weights;
+    f32                 *weights;
+    u32                 *weight_offsets;
+    u32                  num_nodes;
+    u32                  num_weights;
+    u32                  num_cursors;
+    bool                 playing;
 } Walrus_Animator;
 
 void walrus_animator_init(Walrus_Animator *animator);
@@ -22,8 +58,24 @@ void walrus_animator_shutdown(Walrus_Animator *animator);
 
 void walrus_animator_bind(Walrus_Animator *animator, Walrus_Model const *model);
 
+// Replaces the clips of the base layer with the animation, without a transition
 void walrus_animator_play(Walrus_Animator *animator, u32 index);
 
+// Fades the animation in on the layer and every other clip of the layer out over `duration` seconds
+void walrus_animator_crossfade(Walrus_Animator *animator, u32 layer, u32 index, f32 duration);
+
+// Sets the weight of the animation on the layer right away, adding it if it is not playing yet
+void walrus_animator_blend(Walrus_Animator *animator, u32 layer, u32 index, f32 weight);
+
+void walrus_animator_set_layer(Walrus_Animator *animator, u32 layer, Walrus_AnimatorBlend blend, f32 weight);
+
+// Copies one weight per model node into the layer mask, NULL lets the layer affect every node
+void walrus_animator_set_mask(Walrus_Animator *animator, u32 layer, f32 const *weights);
+
+// Sets the mask weight of the node and its descendants, an unmasked layer starts from a mask of zeros
+void walrus_animator_mask_subtree(Walrus_Animator *animator, Walrus_Model const *model, u32 layer,
+                                  Walrus_ModelNode const *node, f32 weight);
+
 void walrus_animator_tick(Walrus_Animator *animator, Walrus_Model const *model, f32 dt);
 
 void walrus_animator_transform(Walrus_Animator const *animator, Walrus_Model const *model, Walrus_ModelNode const *node,
@@ -0,0 +1,50 @@
+#pragma once
+
+#include <engine/geometry.h>
+
+#define WR_BVH_INVALID_PROXY UINT32_MAX
+
+// Dynamic bounding volume hierarchy over axis aligned boxes. Proxies are stable until removed, moving a proxy only
+// marks it and the ancestors are refit in one pass; a full SAH build restores the tree quality after many changes.
+typedef struct Walrus_Bvh Walrus_Bvh;
+
+typedef void (*Walrus_BvhQueryFunc)(u32 proxy, u64 userdata, void *ctx);
+
+typedef struct {
+    u32 proxy;
+    u64 userdata;
+    f32 t;
+} Walrus_BvhHit;
+
+Walrus_Bvh *walrus_bvh_create(void);
+
+void walrus_bvh_destroy(Walrus_Bvh *bvh);
+
+// Inserts the box next to the sibling with the lowest surface area cost, the tree stays valid without a refit
+u32 walrus_bvh_insert(Walrus_Bvh *bvh, vec3 const min, vec3 const max, u64 userdata);
+
+void walrus_bvh_remove(Walrus_Bvh *bvh, u32 proxy);
+
+// The ancestors of the proxy keep their bounds until walrus_bvh_refit or walrus_bvh_build
+void walrus_bvh_update(Walrus_Bvh *bvh, u32 proxy, vec3 const min, vec3 const max);
+
+void walrus_bvh_refit(Walrus_Bvh *bvh);
+
+// Rebuilds the internal nodes with a binned surface area heuristic, proxies are kept
+void walrus_bvh_build(Walrus_Bvh *bvh);
+
+u32 walrus_bvh_count(Walrus_Bvh const *bvh);
+
+// Proxies are below this bound, so it sizes arrays indexed by proxy
+u32 walrus_bvh_proxy_bound(Walrus_Bvh const *bvh);
+
+u64 walrus_bvh_userdata(Walrus_Bvh const *bvh, u32 proxy);
+
+// Calls `fn` for every proxy whose box intersects the frustum, subtrees fully inside or outside are not tested further.
+// The leaves of the small subtrees made by the last build are tested in batches across the job system, `fn` is still
+// called on the calling thread. Queries and raycasts only read the tree, any number of them can run at once.
+void walrus_bvh_query_frustum(Walrus_Bvh const *bvh, Walrus_Frustum const *frustum, Walrus_BvhQueryFunc fn,
+                              void *ctx);
+
+// Finds the closest proxy whose box is hit by the ray within `max_t`, `dir` does not need to be normalized
+bool walrus_bvh_raycast(Walrus_Bvh const *bvh, vec3 const origin, vec3 const dir, f32 max_t, Walrus_BvhHit *hit);
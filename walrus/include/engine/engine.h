@@ -19,6 +19,7 @@ typedef struct {
     bool              single_thread;
     char const       *shader_folder;
     u8                thread_pool_size;
+    u8                num_frames;
 } Walrus_EngineOption;
 
 typedef struct {
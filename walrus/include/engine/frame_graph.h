@@ -4,6 +4,12 @@
 #include <core/array.h>
 #include <core/list.h>
 #include <core/hash.h>
+#include <rhi/type.h>
+
+#define WR_FG_INVALID_RESOURCE UINT32_MAX
+
+#define WR_FG_MAX_NODE_RESOURCES 16
+#define WR_FG_MAX_ATTACHMENTS    8
 
 typedef struct Walrus_FrameNode Walrus_FrameNode;
 
@@ -13,12 +19,59 @@ typedef struct Walrus_FramePipeline Walrus_FramePipeline;
 
 typedef void (*Walrus_FrameNodeCallback)(Walrus_FrameGraph *graph, Walrus_FrameNode const *node);
 typedef void (*Walrus_PipelineDestroyCallback)(void *userdata);
+typedef void (*Walrus_PipelinePrepareCallback)(Walrus_FrameGraph *graph, void *userdata);
+
+typedef enum {
+    WR_FG_RESOURCE_TEXTURE,
+    WR_FG_RESOURCE_FRAMEBUFFER,
+    // CPU side data one node hands to another, only orders and keeps the nodes
+    WR_FG_RESOURCE_DATA,
+} Walrus_FrameResourceType;
+
+typedef struct {
+    char                    *name;
+    Walrus_FrameResourceType type;
+    // Imported resources are owned by the caller, always live and never culled
+    bool imported;
+    u64  handle;
+
+    union {
+        Walrus_TextureCreateInfo texture;
+        struct {
+            u32 attachments[WR_FG_MAX_ATTACHMENTS];
+            u8  num_attachments;
+        } framebuffer;
+    };
+} Walrus_FrameResource;
+
+// Levels of the schedule of a pipeline that use a resource, and where a transient one lives
+typedef struct {
+    u32 first;
+    u32 last;
+    u32 physical;
+
+    Walrus_FramebufferHandle framebuffer;
+} Walrus_FrameResourceUse;
 
 struct Walrus_FrameNode {
     char *name;
     u32   index;
 
     Walrus_FrameNodeCallback func;
+
+    u32 reads[WR_FG_MAX_NODE_RESOURCES];
+    u32 writes[WR_FG_MAX_NODE_RESOURCES];
+    u8  num_reads;
+    u8  num_writes;
+
+    u8   num_views;
+    bool parallel;
+
+    // Set on the copy a pipeline schedules, a level only depends on the levels before it. A parallel node records
+    // into the encoder of the copy handed to its callback, the others use the immediate api on the executing thread.
+    u16                view_offset;
+    u32                level;
+    Walrus_RhiEncoder *encoder;
 };
 
 struct Walrus_FramePipeline {
@@ -29,13 +82,32 @@ struct Walrus_FramePipeline {
     Walrus_Array *prevs;
     Walrus_Array *nodes;
 
+    // Copies of the nodes left after culling sorted by level, and a Walrus_FrameResourceUse per resource
+    Walrus_Array *schedule;
+    Walrus_Array *uses;
+    u16           num_views;
+    u32           num_levels;
+
     Walrus_PipelineDestroyCallback destroy_func;
+    Walrus_PipelinePrepareCallback prepare_func;
     void                          *userdata;
 };
 
 struct Walrus_FrameGraph {
-    Walrus_HashTable *resources;
     Walrus_HashTable *pipelines;
+
+    // Declared resources by id, their names map to the ids
+    Walrus_Array     *declarations;
+    Walrus_HashTable *declaration_ids;
+
+    // Textures the transient resources of every pipeline alias on
+    Walrus_Array *pool;
+
+    // Value of every declared resource by id, grown at declaration so that passes exchange values without allocating
+    u64 *blackboard;
+
+    Walrus_FramePipeline *current;
+    u16                   first_view;
 };
 
 void walrus_fg_init(Walrus_FrameGraph *graph);
@@ -47,13 +119,62 @@ Walrus_FramePipeline *walrus_fg_add_pipeline_full(Walrus_FrameGraph *graph, char
                                                   Walrus_PipelineDestroyCallback callback, void *uesrdata);
 Walrus_FramePipeline *walrus_fg_lookup_pipeline(Walrus_FrameGraph *graph, char const *name);
 void                  walrus_fg_connect_pipeline(Walrus_FramePipeline *parent, Walrus_FramePipeline *child);
-
-void walrus_fg_add_node(Walrus_FramePipeline *pipeline, Walrus_FrameNodeCallback func, char const *name);
-
-void  walrus_fg_write(Walrus_FrameGraph *graph, char const *name, u64 handle);
-void  walrus_fg_write_ptr(Walrus_FrameGraph *graph, char const *name, void *ptr);
-u64   walrus_fg_read(Walrus_FrameGraph const *graph, char const *name);
-void *walrus_fg_read_ptr(Walrus_FrameGraph const *graph, char const *name);
-
+// Called on the calling thread by walrus_fg_prepare_pipeline, where a pipeline gathers once a frame what its nodes read
+// so that they never touch the world from a job
+void walrus_fg_set_prepare(Walrus_FramePipeline *pipeline, Walrus_PipelinePrepareCallback callback);
+
+u32 walrus_fg_add_node(Walrus_FramePipeline *pipeline, Walrus_FrameNodeCallback func, char const *name);
+
+// A node without any write is kept as if it had side effects, a node whose writes are neither imported nor read
+// later is culled by the compile. Using a framebuffer uses its attachments.
+void walrus_fg_node_read(Walrus_FramePipeline *pipeline, u32 node, u32 resource);
+void walrus_fg_node_write(Walrus_FramePipeline *pipeline, u32 node, u32 resource);
+
+// Views the node submits to, reserved once per pipeline in level order so that their sort order does not depend on
+// timing and a texture shared between levels is done with before the next level draws to it
+void walrus_fg_node_views(Walrus_FramePipeline *pipeline, u32 node, u8 num);
+// The node only records through its encoder and touches nothing another node of its level could, so it may run on
+// a job alongside them
+void walrus_fg_node_parallel(Walrus_FramePipeline *pipeline, u32 node);
+
+// Declaring a name again returns the resource already declared
+u32 walrus_fg_create_texture(Walrus_FrameGraph *graph, char const *name, Walrus_TextureCreateInfo const *info);
+u32 walrus_fg_create_framebuffer(Walrus_FrameGraph *graph, char const *name, u32 const *attachments, u8 num);
+u32 walrus_fg_create_data(Walrus_FrameGraph *graph, char const *name);
+u32 walrus_fg_import_texture(Walrus_FrameGraph *graph, char const *name, Walrus_TextureHandle handle);
+u32 walrus_fg_import_framebuffer(Walrus_FrameGraph *graph, char const *name, Walrus_FramebufferHandle handle,
+                                 u32 const *attachments, u8 num);
+u32 walrus_fg_lookup_resource(Walrus_FrameGraph *graph, char const *name);
+
+// Handles of the resources for the pipeline being executed, invalid for a resource it culled
+Walrus_TextureHandle     walrus_fg_texture(Walrus_FrameGraph *graph, u32 resource);
+Walrus_FramebufferHandle walrus_fg_framebuffer(Walrus_FrameGraph *graph, u32 resource);
+
+// Blackboard values of the resources, ids come from the declaration so the frame never looks a name up
+void  walrus_fg_write(Walrus_FrameGraph *graph, u32 resource, u64 value);
+void  walrus_fg_write_ptr(Walrus_FrameGraph *graph, u32 resource, void *ptr);
+u64   walrus_fg_read(Walrus_FrameGraph const *graph, u32 resource);
+void *walrus_fg_read_ptr(Walrus_FrameGraph const *graph, u32 resource);
+
+// Culls the nodes of every pipeline, computes the lifetime of the resources and creates the transient ones, textures
+// with equal descriptors and disjoint lifetimes sharing one pooled texture
 void walrus_fg_compile(Walrus_FrameGraph *graph);
 void walrus_fg_execute(Walrus_FrameGraph *graph, char const *name);
+// Runs the levels in order, the parallel nodes of a level on the job system. The views of the nodes start at
+// first_view, executions of one pipeline for several cameras use disjoint ranges of num_views.
+void walrus_fg_execute_pipeline(Walrus_FrameGraph *graph, Walrus_FramePipeline *pipeline, u16 first_view);
+
+// Prepares the pipelines the target depends on and itself, in execution order, before its executions of the frame
+void walrus_fg_prepare_pipeline(Walrus_FrameGraph *graph, Walrus_FramePipeline *target);
+// Runs every node of the pipeline in schedule order on the calling thread, all of them recording into `encoder`, so
+// that a job executes the pipeline for one camera. Every node of the schedule has to be parallel.
+void walrus_fg_execute_pipeline_encoder(Walrus_FrameGraph *graph, Walrus_FramePipeline *target, u16 first_view,
+                                        Walrus_RhiEncoder *encoder);
+
+// Readies an execution of the pipelines of the graph with a blackboard of its own, seeded with the values of the
+// graph, so that executions for several cameras run on jobs at once. It shares everything else with the graph and
+// keeps its blackboard from one fork to the next, it starts zeroed and is released before the graph.
+void walrus_fg_fork(Walrus_FrameGraph const *graph, Walrus_FrameGraph *execution);
+void walrus_fg_fork_release(Walrus_FrameGraph *execution);
+
+u16 walrus_fg_view_id(Walrus_FrameGraph const *graph, Walrus_FrameNode const *node);
@@ -8,6 +8,15 @@ typedef struct {
     vec3 extends;
 } Walrus_BoundingBox;
 
+// Boxes stored one component per array, so the culling kernel can test several boxes per instruction. The arrays are
+// padded to a multiple of 32 boxes, one word of the visibility bitset.
+typedef struct {
+    f32 *center[3];
+    f32 *extends[3];
+    u32  count;
+    u32  capacity;
+} Walrus_BoundingBoxSoA;
+
 typedef struct {
     f32  dist;
     vec3 normal;
@@ -33,3 +42,21 @@ bool walrus_bounding_box_intersect_or_front_plane(Walrus_BoundingBox const *box,
 bool walrus_bounding_box_intersects_frustum(Walrus_BoundingBox const *box, Walrus_Frustum const *frustum);
 
 void walrus_bounding_box_transform(Walrus_BoundingBox *box, mat4 const transform);
+
+void walrus_bounding_box_soa_init(Walrus_BoundingBoxSoA *boxes);
+
+void walrus_bounding_box_soa_free(Walrus_BoundingBoxSoA *boxes);
+
+// Boxes keep their values when the count shrinks and grows again, boxes never set before are zero
+void walrus_bounding_box_soa_resize(Walrus_BoundingBoxSoA *boxes, u32 count);
+
+void walrus_bounding_box_soa_set(Walrus_BoundingBoxSoA *boxes, u32 index, Walrus_BoundingBox const *box);
+
+// Writes the visibility of the boxes in [begin, end) to `visibility`, one bit per box. `begin` must be a multiple of 32
+// so that ranges never share a word of the bitset.
+void walrus_frustum_cull_boxes(Walrus_Frustum const *frustum, Walrus_BoundingBoxSoA const *boxes, u32 begin, u32 end,
+                               u32 *visibility);
+
+// Culls all the boxes in chunks spread over the job system, `visibility` holds at least (count + 31) / 32 words
+void walrus_frustum_cull_boxes_parallel(Walrus_Frustum const *frustum, Walrus_BoundingBoxSoA const *boxes,
+                                        u32 *visibility);
@@ -6,9 +6,16 @@
 
 #define WR_MATERIAL_MAX_PROPERTIES 32
 
+// A value takes at most one 16 bytes slot of the block
+#define WR_MATERIAL_BLOCK_SIZE (WR_MATERIAL_MAX_PROPERTIES * 16)
+
+// Uniform block binding of the `Material` block, after the weights and joints storage buffers
+#define WR_MATERIAL_BLOCK_BINDING 2
+
 typedef enum {
     WR_MATERIAL_PROPERTY_BOOL,
     WR_MATERIAL_PROPERTY_FLOAT,
+    WR_MATERIAL_PROPERTY_VEC3,
     WR_MATERIAL_PROPERTY_VEC4,
     WR_MATERIAL_PROPERTY_TEXTURE2D,
 } Walrus_MaterialPropertyType;
@@ -27,7 +34,8 @@ typedef struct {
 typedef struct {
     char                       *name;
     Walrus_MaterialPropertyType type;
-    Walrus_UniformHandle        uni;
+    // Byte offset in the block of a value, texture unit of a texture
+    u32                         offset;
 
     union {
         bool           boolean;
@@ -36,19 +44,46 @@ typedef struct {
     };
 } Walrus_MaterialProperty;
 
-typedef struct {
+typedef struct Walrus_Material Walrus_Material;
+
+struct Walrus_Material {
     bool                    double_sided;
     Walrus_AlphaMode        alpha_mode;
     u32                     num_properties;
     Walrus_MaterialProperty properties[WR_MATERIAL_MAX_PROPERTIES];
 
+    // Reserved values keep the offset and the texture unit they were given, the others are packed with the std140
+    // rules after them in the order they are first set. A setter only marks the bytes it changed, they are uploaded
+    // to the persistent uniform buffer by the next walrus_material_flush, so that a submit only reads the material.
+    u32                 block_size;
+    u32                 num_textures;
+    Walrus_BufferHandle buffer;
+    u8                  block[WR_MATERIAL_BLOCK_SIZE];
+
+    // Bytes of the block changed since the last flush, none when they are equal
+    u32              dirty_begin;
+    u32              dirty_end;
+    Walrus_Material *next_dirty;
+
     Walrus_HashTable *table;
-} Walrus_Material;
+};
 
 void walrus_material_init(Walrus_Material *material);
 void walrus_material_shutdown(Walrus_Material *material);
 
-void walrus_material_submit(Walrus_Material *material);
+// Places a property at a fixed byte offset of the block, or texture unit, whatever order it is set in. The layout of a
+// shader block is reserved before any value is set.
+void walrus_material_reserve(Walrus_Material *material, char const *name, Walrus_MaterialPropertyType type,
+                             u32 offset);
+
+// Uploads the changed bytes of every material set since the last call, once a frame on the main thread before the
+// materials are submitted. The setters are main thread only as well.
+void walrus_material_flush(void);
+
+// Sets the state, binds the block at WR_MATERIAL_BLOCK_BINDING and the textures, no uniform is set
+void walrus_material_submit(Walrus_Material const *material);
+// Same as walrus_material_submit, recorded into an encoder
+void walrus_material_encoder_submit(Walrus_RhiEncoder *encoder, Walrus_Material const *material);
 
 typedef enum {
     WR_COLOR_TEXTURE_WHITE,
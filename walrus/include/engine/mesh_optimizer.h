@@ -0,0 +1,53 @@
+#pragma once
+
+#include <core/type.h>
+
+#define WR_MESH_UNUSED_VERTEX UINT32_MAX
+
+// FIFO post-transform cache the orderings are tuned for and ACMR is measured with
+#define WR_MESH_CACHE_SIZE 16
+
+// One attribute of every vertex, `size` bytes read every `stride` bytes
+typedef struct {
+    void const *data;
+    u32         size;
+    u32         stride;
+} Walrus_MeshStream;
+
+// Average cache miss per triangle of a FIFO cache of `cache_size` vertices, from 0.5 for an ideal grid to 3
+f32 walrus_mesh_acmr(u32 const *indices, u32 num_indices, u32 num_vertices, u32 cache_size);
+
+// Merges the vertices equal in every stream, new indices are given in the order the vertices are first used. Unused
+// vertices map to WR_MESH_UNUSED_VERTEX. Returns the number of unique vertices.
+u32 walrus_mesh_generate_remap(u32 *remap, u32 const *indices, u32 num_indices, u32 num_vertices,
+                               Walrus_MeshStream const *streams, u32 num_streams);
+
+// `dst` may be `indices`
+void walrus_mesh_remap_indices(u32 *dst, u32 const *indices, u32 num_indices, u32 const *remap);
+
+// Writes every used vertex of the stream at its new index, `dst_stride` bytes apart
+void walrus_mesh_remap_vertices(void *dst, u32 dst_stride, Walrus_MeshStream const *stream, u32 num_vertices,
+                                u32 const *remap);
+
+// Tipsify: fans the triangles around the vertices still in the cache, jumping to a recently used vertex at a dead
+// end. `dst` must not be `indices`.
+void walrus_mesh_optimize_vertex_cache(u32 *dst, u32 const *indices, u32 num_indices, u32 num_vertices,
+                                       u32 cache_size);
+
+// Splits the cache optimized triangles into clusters, where the cache restarts or where the ACMR of a cluster stays
+// within `threshold` of its whole run, then draws the clusters facing away from the center of the mesh first.
+// Positions are three floats. `dst` must not be `indices`.
+void walrus_mesh_optimize_overdraw(u32 *dst, u32 const *indices, u32 num_indices, f32 const *positions,
+                                   u32 position_stride, u32 num_vertices, u32 cache_size, f32 threshold);
+
+// Numbers the vertices in the order the indices first use them, the remap is applied as the one of
+// walrus_mesh_generate_remap. Returns the number of used vertices.
+u32 walrus_mesh_optimize_vertex_fetch_remap(u32 *remap, u32 const *indices, u32 num_indices, u32 num_vertices);
+
+// Collapses edges by their quadric error until `target_index_count` indices are left or the next collapse would move
+// the surface further than `target_error`, relative to the extent of the mesh. Vertices on open borders and on
+// attribute seams, where several vertices share a position, stay in place. Only the indices change, the result indexes
+// a subset of the vertices. `result_error` receives the relative error reached, may be NULL. Returns the number of
+// indices written to `dst`, which may be `indices`.
+u32 walrus_mesh_simplify(u32 *dst, u32 const *indices, u32 num_indices, f32 const *positions, u32 position_stride,
+                         u32 num_vertices, u32 target_index_count, f32 target_error, f32 *result_error);
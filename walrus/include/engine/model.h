@@ -18,6 +18,16 @@ typedef struct {
     bool                index32;
 } Walrus_MeshIndices;
 
+#define WR_MESH_MAX_LODS 4
+
+// A range of the index buffer of the primitive. `error` is how far the simplified surface strays from the full
+// detail one, relative to the extent of the primitive.
+typedef struct {
+    u32 offset;
+    u32 num_indices;
+    f32 error;
+} Walrus_MeshLod;
+
 typedef enum {
     WR_MESH_ALBEDO,
     WR_MESH_ALBEDO_FACTOR,
@@ -44,6 +54,10 @@ typedef struct {
 
     Walrus_MeshIndices indices;
 
+    // Level 0 is the full index range, none unless the model was loaded with WR_MODEL_LOAD_FLAG_LOD
+    Walrus_MeshLod lods[WR_MESH_MAX_LODS];
+    u32            num_lods;
+
     Walrus_Material     *material;
     Walrus_TextureHandle morph_target;
 
@@ -60,6 +74,8 @@ typedef struct {
     u32  num_weights;
 } Walrus_Mesh;
 
+#define WR_MODEL_INVALID_NODE UINT32_MAX
+
 typedef struct Walrus_ModelNode Walrus_ModelNode;
 
 typedef struct {
@@ -116,6 +132,33 @@ typedef struct {
     Walrus_AnimationPath     path;
 } Walrus_AnimationChannel;
 
+// A channel cooked for sampling, its keys point into the packed arrays of the stream holding it. Cubic spline keys
+// hold the in tangent, the value and the out tangent. Compressed tracks store three u16 per key in `quantized`
+// instead of `values`: rotations keep their smallest three components, translations and scales are quantized
+// within `range_min` and `range_extent`.
+typedef struct {
+    Walrus_AnimationInterpolation interpolation;
+
+    f32 const *timestamps;
+    f32 const *values;
+    u16 const *quantized;
+    vec3       range_min;
+    vec3       range_extent;
+    u32        node;
+    u32        num_components;
+    u32        num_keys;
+} Walrus_AnimationTrack;
+
+// All the tracks of one path, sorted by node, with their keys packed track after track
+typedef struct {
+    Walrus_AnimationTrack *tracks;
+    u32                    num_tracks;
+
+    f32 *timestamps;
+    f32 *values;
+    u16 *quantized;
+} Walrus_AnimationStream;
+
 typedef struct {
     Walrus_AnimationChannel *channels;
     u32                      num_channels;
@@ -123,6 +166,9 @@ typedef struct {
     Walrus_AnimationSampler *samplers;
     u32                      num_samplers;
 
+    Walrus_AnimationStream streams[WR_ANIMATION_PATH_COUNT];
+    u32                    num_tracks;
+
     f32 duration;
 } Walrus_Animation;
 
@@ -130,7 +176,8 @@ typedef struct {
     Walrus_BufferHandle *buffers;
     u32                  num_buffers;
 
-    Walrus_BufferHandle tangent_buffer;
+    // Vertices generated at load, tangents and optimized primitives
+    Walrus_BufferHandle vertex_buffer;
 
     Walrus_Mesh *meshes;
     u32          num_meshes;
@@ -147,6 +194,10 @@ typedef struct {
     Walrus_ModelNode **roots;
     u32                num_roots;
 
+    // Node indices with every parent before its children, and the parent index of every node
+    u32 *hierarchy;
+    u32 *parents;
+
     Walrus_Animation *animations;
     u32               num_animations;
 
@@ -163,11 +214,49 @@ typedef enum {
     WR_MODEL_UNKNOWN_ERROR = -1
 } Walrus_ModelResult;
 
+typedef enum {
+    WR_MODEL_LOAD_FLAG_NONE = 0,
+
+    // Merges the duplicated vertices of triangle primitives, reorders their triangles for the post-transform cache
+    // then for overdraw, and lays their vertices out in the order they are fetched
+    WR_MODEL_LOAD_FLAG_OPTIMIZE = 1 << 0,
+
+    // Simplifies the optimized triangle primitives into levels of detail sharing their vertices, implies
+    // WR_MODEL_LOAD_FLAG_OPTIMIZE
+    WR_MODEL_LOAD_FLAG_LOD = 1 << 1,
+
+    // Reads the model from `<model>.cooked` next to it when that file is fresh, and writes it there after a decode
+    // from glTF whose images all loaded
+    WR_MODEL_LOAD_FLAG_CACHE = 1 << 2,
+} Walrus_ModelLoadFlag;
+
 typedef void (*PrimitiveSubmitCallback)(Walrus_MeshPrimitive const *primitive, void *userdata);
 typedef void (*NodeSubmitCallback)(Walrus_Model const *model, Walrus_ModelNode const *node, void *userdata);
 
+// CPU side of a model between its decode and its upload: the glTF document, its images and the generated vertex data
+typedef struct Walrus_ModelData Walrus_ModelData;
+
 Walrus_ModelResult walrus_model_load_from_file(Walrus_Model *model, char const *filename);
 
+// `flags` is a combination of Walrus_ModelLoadFlag
+Walrus_ModelResult walrus_model_load_from_file_full(Walrus_Model *model, char const *filename, u32 flags);
+
+// Parses the file, loads its buffers and images, generates tangents and morph targets and builds the nodes, animations
+// and skins. Nothing touches the RHI, so it can run on any thread. The model must be uploaded before it is used or
+// shut down.
+Walrus_ModelResult walrus_model_decode_from_file(Walrus_Model *model, Walrus_ModelData **data, char const *filename,
+                                                 u32 flags);
+
+// Creates the buffers, textures, materials and vertex layouts of a decoded model on the API thread, then frees `data`
+void walrus_model_upload(Walrus_Model *model, Walrus_ModelData *data);
+
 void walrus_model_shutdown(Walrus_Model *model);
 
+// Drops the linear and step keys that the remaining keys reproduce within `tolerance`, then quantizes the
+// translation, rotation and scale tracks. Cubic spline and morph weight tracks are kept as they are.
+void walrus_animation_compress(Walrus_Animation *animation, f32 tolerance);
+
+// Writes the translation, rotation or scale of a key of a compressed track
+void walrus_animation_track_decode(Walrus_AnimationTrack const *track, u32 key, f32 *value);
+
 void walrus_model_material_init_default(Walrus_Material *material);
@@ -24,4 +24,15 @@ void walrus_renderer_shutdown(void);
 void walrus_renderer_submit_mesh(u16 view_id, Walrus_ProgramHandle shader, mat4 const world,
                                  Walrus_MeshPrimitive const *mesh);
 
+// Draws the index range of a level of detail, the full one when the primitive has fewer levels
+void walrus_renderer_submit_mesh_lod(u16 view_id, Walrus_ProgramHandle shader, mat4 const world,
+                                     Walrus_MeshPrimitive const *mesh, u32 lod);
+
+// Same as walrus_renderer_submit_mesh_lod, recorded into an encoder
+void walrus_renderer_encoder_submit_mesh_lod(Walrus_RhiEncoder *encoder, u16 view_id, Walrus_ProgramHandle shader,
+                                             mat4 const world, Walrus_MeshPrimitive const *mesh, u32 lod);
+
 void walrus_renderer_submit_quad(u16 view_id, Walrus_ProgramHandle shader);
+
+// Same as walrus_renderer_submit_quad, recorded into an encoder so that it can run off the main thread
+void walrus_renderer_encoder_submit_quad(Walrus_RhiEncoder *encoder, u16 view_id, Walrus_ProgramHandle shader);
@@ -5,9 +5,15 @@
 typedef struct {
     Walrus_MeshPrimitive *mesh;
 
-    bool culled;
+    // Given by the culling pipeline every frame, the visibility of an execution is looked up with it
+    u32 index;
 } Walrus_RenderMesh;
 
+// Meshes refer to the material of their model, so that a change to it is seen by all of them and uploaded once
+typedef struct {
+    Walrus_Material *material;
+} Walrus_RenderMaterial;
+
 typedef struct {
     Walrus_ModelNode      *node;
     Walrus_TransientBuffer weight_buffer;
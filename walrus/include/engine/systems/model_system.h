@@ -3,7 +3,13 @@
 #include <flecs.h>
 #include <cglm/cglm.h>
 #include <engine/model.h>
+#include <engine/animation_baker.h>
 #include <engine/system.h>
+#include <core/array.h>
+#include <core/mutex.h>
+#include <core/queue.h>
+#include <core/semaphore.h>
+#include <core/thread.h>
 
 typedef struct {
     char        *name;
@@ -14,15 +20,46 @@ typedef struct {
 
 typedef struct {
     Walrus_HashTable *table;
+
+    // Files waiting for the loader thread, and every asynchronous load not finished yet
+    Walrus_Thread    *loader;
+    Walrus_Mutex     *mutex;
+    Walrus_Semaphore *sem;
+    Walrus_Queue     *requests;
+    Walrus_Array     *loads;
+
+    // Walrus_ModelLoadFlag every model is loaded with
+    u32 load_flags;
 } ModelSystem;
 
+// Called on the main thread when an asynchronous load finishes. On failure the model entity is deleted right after.
+typedef void (*Walrus_ModelLoadCallback)(ecs_world_t *ecs, ecs_entity_t model, Walrus_ModelResult result,
+                                         void *userdata);
+
 POLY_DECLARE_DERIVED(Walrus_System, ModelSystem, model_system_create)
 
 extern ECS_COMPONENT_DECLARE(Walrus_ModelRef);
+extern ECS_COMPONENT_DECLARE(Walrus_BakedAnimation);
+
+// Added to a model once its resources are created, instances are only populated from loaded models
+extern ECS_TAG_DECLARE(Walrus_ModelLoaded);
+
+// Applies to the models requested afterwards
+void walrus_model_system_set_load_flags(Walrus_System *sys, u32 flags);
 
 void walrus_model_system_load_from_file(Walrus_System *sys, char const *name, char const *filename);
 
+// Returns the model entity right away, it can be instantiated before the file is loaded. The file is decoded on the
+// loader thread, then its resources are created on the main thread and the entity gets Walrus_ModelLoaded. A name
+// already in use returns its entity, and the callback is not called.
+ecs_entity_t walrus_model_system_load_async(Walrus_System *sys, char const *name, char const *filename,
+                                            Walrus_ModelLoadCallback callback, void *userdata);
+
 bool walrus_model_system_unload(Walrus_System *sys, char const *name);
 
+// Bakes every animation of the model into a joint matrix atlas shared by its instances. Instances given a
+// Walrus_BakedAnimator are then drawn from the atlas instead of being animated one by one.
+bool walrus_model_system_bake(Walrus_System *sys, char const *name, f32 frame_rate);
+
 ecs_entity_t walrus_model_instantiate(Walrus_System *sys, char const *name, vec3 const trans, versor const rot,
                                       vec3 const scale);
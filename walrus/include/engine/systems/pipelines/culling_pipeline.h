@@ -1,5 +1,20 @@
 #pragma once
 
 #include <engine/frame_graph.h>
+#include <cglm/cglm.h>
+#include <flecs.h>
+
+// What the culling pass of an execution leaves in its "Visibility" data, by the index of the render meshes
+typedef struct {
+    u32 *visible;
+    u8  *lods;
+} Walrus_Visibility;
 
 Walrus_FramePipeline *walrus_culling_pipeline_add(Walrus_FrameGraph *graph, char const *name);
+
+// Whether an execution draws the mesh of that index and at which level of detail, without a culling pass every mesh
+// is drawn in full
+bool walrus_visibility_test(Walrus_Visibility const *visibility, u32 index, u32 *lod);
+
+// Picks the static mesh whose world box is closest along the ray, as of the last prepared frame
+bool walrus_culling_raycast(vec3 const origin, vec3 const dir, f32 max_t, ecs_entity_t *entity, f32 *t);
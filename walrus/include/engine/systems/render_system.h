@@ -3,10 +3,11 @@
 #include <engine/renderer_mesh.h>
 #include <engine/frame_graph.h>
 #include <engine/system.h>
+#include <core/array.h>
 #include <flecs.h>
 
 extern ECS_COMPONENT_DECLARE(Walrus_RenderMesh);
-extern ECS_COMPONENT_DECLARE(Walrus_Material);
+extern ECS_COMPONENT_DECLARE(Walrus_RenderMaterial);
 extern ECS_COMPONENT_DECLARE(Walrus_WeightResource);
 extern ECS_COMPONENT_DECLARE(Walrus_SkinResource);
 
@@ -14,6 +15,17 @@ typedef struct {
     Walrus_FrameGraph        render_graph;
     Walrus_FramebufferHandle backrt;
     Walrus_Material          default_material;
+    Walrus_Array            *skin_jobs;
+    Walrus_Array            *weight_jobs;
+
+    // Active cameras of the frame, each executed by a job on a fork of the graph kept from frame to frame
+    Walrus_Array *camera_jobs;
+    Walrus_Array *executions;
+
+    // Resolved at init, a frame only writes its values to the graph blackboard
+    Walrus_FramePipeline *output_pipeline;
+    u32                   renderer_slot;
+    u32                   camera_slot;
 } RenderSystem;
 
 POLY_DECLARE_DERIVED(Walrus_System, RenderSystem, render_system_create)
@@ -71,6 +71,7 @@ void walrus_rhi_set_index32_buffer(Walrus_BufferHandle handle, u32 offset, u32 n
 void walrus_rhi_set_transient_index_buffer(Walrus_TransientBuffer* buffer, u32 offset, u32 num_indices);
 
 void walrus_rhi_set_transient_buffer(u8 binding, Walrus_TransientBuffer const* buffer);
+void walrus_rhi_set_block_buffer(u8 binding, Walrus_BufferHandle handle, u32 offset, u32 size);
 
 Walrus_TextureHandle walrus_rhi_create_texture(Walrus_TextureCreateInfo const* info, void const* data);
 Walrus_TextureHandle walrus_rhi_create_texture2d(u32 width, u32 height, Walrus_PixelFormat format, u8 mipmaps,
@@ -97,4 +98,55 @@ void walrus_rhi_set_framebuffer(u16 view_id, Walrus_FramebufferHandle handle);
 
 Walrus_RhiCapabilities const* walrus_rhi_get_caps(void);
 
+Walrus_RhiStats const* walrus_rhi_get_stats(void);
+
 void walrus_rhi_set_debug(u16 debug);
+
+// Encoders let several threads submit at once, an encoder and the walrus_rhi_encoder_* calls on it belong to one
+// thread until it is ended, and transient buffers can be allocated from any thread. Everything else, creating and
+// destroying resources, setting up views and the immediate api, is still for the main thread only.
+Walrus_RhiEncoder* walrus_rhi_begin_encoder(void);
+void               walrus_rhi_end_encoder(Walrus_RhiEncoder* encoder);
+
+// The encoder behind the immediate api, for the main thread to record with when no other encoder is left
+Walrus_RhiEncoder* walrus_rhi_immediate_encoder(void);
+
+void walrus_rhi_encoder_touch(Walrus_RhiEncoder* encoder, u16 view_id);
+void walrus_rhi_encoder_submit(Walrus_RhiEncoder* encoder, u16 view_id, Walrus_ProgramHandle program, u32 depth,
+                               u8 flags);
+void walrus_rhi_encoder_dispatch(Walrus_RhiEncoder* encoder, u16 view_id, Walrus_ProgramHandle program, u32 num_x,
+                                 u32 num_y, u32 num_z, u8 flags);
+
+void walrus_rhi_encoder_set_state(Walrus_RhiEncoder* encoder, u64 state, u32 rgba);
+void walrus_rhi_encoder_set_stencil(Walrus_RhiEncoder* encoder, u32 fstencil, u32 bstencil);
+void walrus_rhi_encoder_set_scissor(Walrus_RhiEncoder* encoder, i32 x, i32 y, u32 width, u32 height);
+void walrus_rhi_encoder_set_transform(Walrus_RhiEncoder* encoder, mat4 const transform);
+void walrus_rhi_encoder_set_uniform(Walrus_RhiEncoder* encoder, Walrus_UniformHandle handle, u32 offset, u32 size,
+                                    void const* data);
+
+void walrus_rhi_encoder_set_vertex_count(Walrus_RhiEncoder* encoder, u32 num_vertices);
+void walrus_rhi_encoder_set_vertex_buffer(Walrus_RhiEncoder* encoder, u8 stream_id, Walrus_BufferHandle handle,
+                                          Walrus_LayoutHandle layout_handle, u32 offset, u32 num_vertices);
+void walrus_rhi_encoder_set_transient_vertex_buffer(Walrus_RhiEncoder* encoder, u8 stream_id,
+                                                    Walrus_TransientBuffer* buffer, Walrus_LayoutHandle layout_handle,
+                                                    u32 offset, u32 num_vertices);
+void walrus_rhi_encoder_set_instance_buffer(Walrus_RhiEncoder* encoder, Walrus_BufferHandle handle,
+                                            Walrus_LayoutHandle layout_handle, u32 offset, u32 num_instance);
+void walrus_rhi_encoder_set_transient_instance_buffer(Walrus_RhiEncoder* encoder, Walrus_TransientBuffer* buffer,
+                                                      Walrus_LayoutHandle layout_handle, u32 offset, u32 num_instance);
+
+void walrus_rhi_encoder_set_index_buffer(Walrus_RhiEncoder* encoder, Walrus_BufferHandle handle, u32 offset,
+                                         u32 num_indices);
+void walrus_rhi_encoder_set_index32_buffer(Walrus_RhiEncoder* encoder, Walrus_BufferHandle handle, u32 offset,
+                                           u32 num_indices);
+void walrus_rhi_encoder_set_transient_index_buffer(Walrus_RhiEncoder* encoder, Walrus_TransientBuffer* buffer,
+                                                   u32 offset, u32 num_indices);
+
+void walrus_rhi_encoder_set_transient_buffer(Walrus_RhiEncoder* encoder, u8 binding,
+                                             Walrus_TransientBuffer const* buffer);
+void walrus_rhi_encoder_set_block_buffer(Walrus_RhiEncoder* encoder, u8 binding, Walrus_BufferHandle handle,
+                                         u32 offset, u32 size);
+
+void walrus_rhi_encoder_set_texture(Walrus_RhiEncoder* encoder, u8 unit, Walrus_TextureHandle texture);
+void walrus_rhi_encoder_set_image(Walrus_RhiEncoder* encoder, uint8_t unit, Walrus_TextureHandle handle, u8 mip,
+                                  Walrus_DataAccess access, Walrus_PixelFormat format);
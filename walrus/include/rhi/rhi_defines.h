@@ -16,6 +16,14 @@
 #define WR_RHI_MAX_VIEWS (256)
 #endif
 
+#ifndef WR_RHI_MAX_ENCODERS
+#define WR_RHI_MAX_ENCODERS (8)
+#endif
+
+#ifndef WR_RHI_MAX_FRAMES
+#define WR_RHI_MAX_FRAMES (3)
+#endif
+
 #ifndef WR_RHI_MAX_DRAW_CALLS
 #define WR_RHI_MAX_DRAW_CALLS (65536)
 #endif
@@ -52,6 +60,11 @@
 #define WR_RHI_MAX_VERTEX_ATTRIBUTES (16)
 #endif
 
+// First of the four attribute locations holding the per instance model matrix of automatically instanced draws
+#ifndef WR_RHI_INSTANCE_MODEL_ATTRIBUTE
+#define WR_RHI_INSTANCE_MODEL_ATTRIBUTE (12)
+#endif
+
 #ifndef WR_RHI_MAX_TEXTURES
 #define WR_RHI_MAX_TEXTURES (4096)
 #endif
@@ -25,6 +25,7 @@ typedef enum {
     WR_RHI_FLAG_NONE = 0,
 
     WR_RHI_FLAG_OPENGL = 1 << 0,
+    WR_RHI_FLAG_NULL   = 1 << 1,
 } Walrus_RhiFlag;
 
 typedef enum {
@@ -151,6 +152,9 @@ typedef enum {
     WR_RHI_VIEWMODE_SEQUENTIAL,
     WR_RHI_VIEWMODE_DEPTH_ASCENDING,
     WR_RHI_VIEWMODE_DEPTH_DESCENDING,
+    // Sorted by program like the default mode, runs of identical draws that only differ in their transform are
+    // merged into one instanced draw with the transforms in WR_RHI_INSTANCE_MODEL_ATTRIBUTE
+    WR_RHI_VIEWMODE_INSTANCING,
 
     WR_RHI_VIEWMODE_COUNT
 } Walrus_ViewMode;
@@ -172,6 +176,8 @@ typedef struct {
     Walrus_Resolution resolution;
     Walrus_RhiFlag    flags;
     bool              single_thread;
+    // Frames in the pipeline between the api and render thread, clamped to [2, WR_RHI_MAX_FRAMES]
+    u8                num_frames;
 } Walrus_RhiCreateInfo;
 
 typedef struct {
@@ -188,4 +194,33 @@ typedef struct {
     u32 ubo_align;
     u32 max_msaa;
     u32 max_texture_unit;
+    // Largest width or height of a 2d texture
+    u32 max_texture_size;
 } Walrus_RhiCapabilities;
+
+typedef struct Walrus_RhiEncoder Walrus_RhiEncoder;
+
+typedef struct {
+    u32 draw_calls;
+    u32 compute_calls;
+    u32 num_vertices;
+    u32 num_indices;
+    u32 num_instances;
+
+    u32 view_changes;
+    u32 program_changes;
+    u32 uniform_updates;
+    u32 texture_binds;
+    u32 block_binds;
+    u32 state_changes;
+    u32 attribute_binds;
+    u32 index_binds;
+    // Draws folded into the instanced draw of a preceding identical draw
+    u32 merged_draws;
+
+    // Distinct bind sets and vertex streams stored by the frame
+    u32 num_bind_sets;
+    u32 num_streams;
+    // Memory held by the frame for render items, bind sets, streams, matrices, uniforms and commands
+    u64 frame_memory;
+} Walrus_RhiStats;
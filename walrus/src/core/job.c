@@ -0,0 +1,404 @@
+#include <core/job.h>
+#include <core/atomic.h>
+#include <core/thread.h>
+#include <core/semaphore.h>
+#include <core/memory.h>
+#include <core/macro.h>
+#include <core/assert.h>
+#include <core/math.h>
+#include <core/log.h>
+
+#include <string.h>
+
+#define JOB_SIZE 64
+#define JOB_MASK (WR_JOB_MAX_JOBS - 1)
+
+// Rounds of exponential pause a waiter spins before yielding its time slice
+#define JOB_WAIT_SPINS 8
+
+struct Walrus_Job {
+    Walrus_JobFn fn;
+    Walrus_Job  *parent;
+    void        *userdata;
+    // Inline payload so small jobs don't need an allocation
+    u8           data[JOB_SIZE - sizeof(Walrus_JobFn) - sizeof(Walrus_Job *) - sizeof(void *) - sizeof(u32) * 2];
+    u32 volatile unfinished;
+    // Bumped every time the slot is handed out, before `unfinished` is set
+    u32 volatile generation;
+};
+
+// Chase-Lev deque, the owner pushes and pops at the bottom, others steal from the top
+typedef struct {
+    i64 volatile top;
+    i64 volatile bottom;
+    Walrus_Job  *jobs[WR_JOB_MAX_JOBS];
+} JobDeque;
+
+typedef struct {
+    JobDeque   deque;
+    Walrus_Job pool[WR_JOB_MAX_JOBS];
+    u32        num_allocated;
+    u32        victim;
+} JobThread;
+
+typedef struct {
+    Walrus_Thread   **workers;
+    u8                num_workers;
+    Walrus_Semaphore *sem;
+    u32 volatile      stop;
+
+    JobThread *volatile threads[WR_JOB_MAX_THREADS];
+    u32 volatile        num_threads;
+} JobSystem;
+
+typedef struct {
+    Walrus_ParallelForFn fn;
+    void                *userdata;
+    u32                  begin;
+    u32                  end;
+    u32                  grain;
+} ParallelForData;
+
+static JobSystem *s_sys        = NULL;
+static u32        s_generation = 0;
+
+static WR_THREAD_LOCAL JobThread *s_thread     = NULL;
+static WR_THREAD_LOCAL u32        s_thread_gen = 0;
+
+// Jobs of the threads without a slot, they are shared by these threads and run on the spot
+static Walrus_Job   s_inline_pool[WR_JOB_MAX_JOBS];
+static u32 volatile s_inline_next = 0;
+
+// Returns false when the deque is full
+static bool deque_push(JobDeque *deque, Walrus_Job *job)
+{
+    i64 b = deque->bottom;
+    if (b - walrus_atomic_load_i64(&deque->top) >= WR_JOB_MAX_JOBS) {
+        return false;
+    }
+    deque->jobs[b & JOB_MASK] = job;
+    walrus_atomic_store_i64(&deque->bottom, b + 1);
+    return true;
+}
+
+static Walrus_Job *deque_pop(JobDeque *deque)
+{
+    i64 b = deque->bottom - 1;
+    walrus_atomic_store_i64(&deque->bottom, b);
+    walrus_atomic_fence();
+    i64 t = walrus_atomic_load_i64(&deque->top);
+
+    if (t > b) {
+        walrus_atomic_store_i64(&deque->bottom, t);
+        return NULL;
+    }
+
+    Walrus_Job *job = deque->jobs[b & JOB_MASK];
+    if (t != b) {
+        return job;
+    }
+
+    // Last job, race against stealers
+    if (!walrus_atomic_cas_i64(&deque->top, &t, t + 1)) {
+        job = NULL;
+    }
+    walrus_atomic_store_i64(&deque->bottom, b + 1);
+    return job;
+}
+
+static Walrus_Job *deque_steal(JobDeque *deque)
+{
+    i64 t = walrus_atomic_load_i64(&deque->top);
+    walrus_atomic_fence();
+    i64 b = walrus_atomic_load_i64(&deque->bottom);
+
+    if (t >= b) {
+        return NULL;
+    }
+
+    Walrus_Job *job = deque->jobs[t & JOB_MASK];
+    if (!walrus_atomic_cas_i64(&deque->top, &t, t + 1)) {
+        return NULL;
+    }
+    return job;
+}
+
+// Returns NULL while the system is down or once every slot is taken
+static JobThread *thread_get(void)
+{
+    if (walrus_likely(s_thread != NULL && s_thread_gen == s_generation)) {
+        return s_thread;
+    }
+    if (s_sys == NULL || walrus_atomic_load_u32(&s_sys->num_threads) >= WR_JOB_MAX_THREADS) {
+        return NULL;
+    }
+
+    u32 index = walrus_atomic_fetch_add_sat_u32(&s_sys->num_threads, 1, WR_JOB_MAX_THREADS);
+    if (index >= WR_JOB_MAX_THREADS) {
+        walrus_warn("Too many threads using the job system, the jobs of this one run on the spot");
+        return NULL;
+    }
+
+    JobThread *thread = walrus_malloc0(sizeof(JobThread));
+    walrus_atomic_store_ptr((void *volatile *)&s_sys->threads[index], thread);
+
+    s_thread     = thread;
+    s_thread_gen = s_generation;
+    return thread;
+}
+
+static Walrus_Job *job_get(JobThread *thread)
+{
+    Walrus_Job *job = deque_pop(&thread->deque);
+    if (job != NULL) {
+        return job;
+    }
+
+    u32 num_threads = walrus_atomic_load_u32(&s_sys->num_threads);
+    num_threads     = walrus_min(num_threads, WR_JOB_MAX_THREADS);
+    for (u32 i = 0; i < num_threads; ++i) {
+        JobThread *victim = walrus_atomic_load_ptr((void *volatile *)&s_sys->threads[thread->victim % num_threads]);
+        ++thread->victim;
+        if (victim == NULL || victim == thread) {
+            continue;
+        }
+        job = deque_steal(&victim->deque);
+        if (job != NULL) {
+            return job;
+        }
+    }
+
+    return NULL;
+}
+
+static void job_finish(Walrus_Job *job)
+{
+    // Walk up the parents iteratively, job trees from parallel_for can get deep. The parent is read before the
+    // decrement, a finished job is free and its slot can be handed out again right away.
+    while (job != NULL) {
+        Walrus_Job *parent = job->parent;
+        if (walrus_atomic_fetch_sub_u32(&job->unfinished, 1) != 1) {
+            break;
+        }
+        job = parent;
+    }
+}
+
+static void job_execute(Walrus_Job *job)
+{
+    if (job->fn) {
+        job->fn((Walrus_JobHandle){job, job->generation}, job->userdata);
+    }
+    job_finish(job);
+}
+
+static i32 worker_fn(Walrus_Thread *self, void *userdata)
+{
+    walrus_unused(self);
+
+    // Workers get their slot from walrus_job_init, other threads can't take them
+    JobThread *thread = userdata;
+    s_thread          = thread;
+    s_thread_gen      = s_generation;
+    while (!walrus_atomic_load_u32(&s_sys->stop)) {
+        Walrus_Job *job = job_get(thread);
+        if (job != NULL) {
+            job_execute(job);
+        }
+        else {
+            walrus_semaphore_wait(s_sys->sem, -1);
+        }
+    }
+    return 0;
+}
+
+void walrus_job_init(u8 num_workers)
+{
+    walrus_assert_msg(num_workers < WR_JOB_MAX_THREADS, "Too many job workers");
+    num_workers = walrus_min(num_workers, WR_JOB_MAX_THREADS - 1);
+
+    s_sys              = walrus_new0(JobSystem, 1);
+    s_sys->workers     = walrus_new(Walrus_Thread *, num_workers);
+    s_sys->num_workers = num_workers;
+    s_sys->sem         = walrus_semaphore_create();
+    s_sys->num_threads = num_workers;
+    ++s_generation;
+
+    for (u8 i = 0; i < num_workers; ++i) {
+        s_sys->threads[i] = walrus_malloc0(sizeof(JobThread));
+        s_sys->workers[i] = walrus_thread_create();
+        walrus_thread_init(s_sys->workers[i], worker_fn, s_sys->threads[i], 0);
+    }
+}
+
+void walrus_job_shutdown(void)
+{
+    walrus_atomic_store_u32(&s_sys->stop, 1);
+    walrus_semaphore_post(s_sys->sem, s_sys->num_workers);
+
+    for (u8 i = 0; i < s_sys->num_workers; ++i) {
+        walrus_thread_shutdown(s_sys->workers[i]);
+        walrus_thread_destroy(s_sys->workers[i]);
+    }
+
+    for (u32 i = 0; i < WR_JOB_MAX_THREADS; ++i) {
+        walrus_free(s_sys->threads[i]);
+    }
+
+    walrus_semaphore_destroy(s_sys->sem);
+    walrus_free(s_sys->workers);
+    walrus_free(s_sys);
+    s_sys = NULL;
+    // Drops the slots cached by the threads
+    ++s_generation;
+}
+
+u32 walrus_job_num_threads(void)
+{
+    return s_sys ? s_sys->num_workers + 1 : 1;
+}
+
+// Next free slot of the ring. With more than WR_JOB_MAX_JOBS jobs in flight the thread runs queued jobs until one
+// of its slots is released.
+static Walrus_Job *job_alloc(JobThread *thread)
+{
+    while (true) {
+        for (u32 i = 0; i < WR_JOB_MAX_JOBS; ++i) {
+            Walrus_Job *job = &thread->pool[thread->num_allocated++ & JOB_MASK];
+            if (walrus_atomic_load_u32(&job->unfinished) == 0) {
+                return job;
+            }
+        }
+        Walrus_Job *next = job_get(thread);
+        if (next != NULL) {
+            job_execute(next);
+        }
+        else {
+            walrus_thread_yield();
+        }
+    }
+}
+
+// Slots are claimed with a compare and swap, the threads sharing the pool race for them. A handle of the previous
+// job of a slot can read as unfinished between the claim and the new generation.
+static Walrus_Job *job_alloc_inline(void)
+{
+    while (true) {
+        Walrus_Job *job  = &s_inline_pool[walrus_atomic_fetch_add_u32(&s_inline_next, 1) & JOB_MASK];
+        u32         free = 0;
+        if (walrus_atomic_cas_u32(&job->unfinished, &free, 1)) {
+            return job;
+        }
+    }
+}
+
+Walrus_JobHandle walrus_job_create(Walrus_JobFn fn, void *userdata)
+{
+    JobThread  *thread = thread_get();
+    Walrus_Job *job    = thread ? job_alloc(thread) : job_alloc_inline();
+
+    job->fn       = fn;
+    job->parent   = NULL;
+    job->userdata = userdata;
+
+    // A handle of the previous job of the slot sees the new generation once it sees the slot unfinished again
+    u32 const generation = job->generation + 1;
+    walrus_atomic_store_u32(&job->generation, generation);
+    walrus_atomic_store_u32(&job->unfinished, 1);
+
+    return (Walrus_JobHandle){job, generation};
+}
+
+Walrus_JobHandle walrus_job_create_child(Walrus_JobHandle parent, Walrus_JobFn fn, void *userdata)
+{
+    walrus_atomic_fetch_add_u32(&parent.job->unfinished, 1);
+
+    Walrus_JobHandle child = walrus_job_create(fn, userdata);
+    child.job->parent      = parent.job;
+
+    return child;
+}
+
+void walrus_job_run(Walrus_JobHandle job)
+{
+    // A full deque, or a thread without a deque, runs the job on the spot rather than dropping it
+    JobThread *thread = thread_get();
+    if (thread == NULL || !deque_push(&thread->deque, job.job)) {
+        job_execute(job.job);
+        return;
+    }
+    walrus_semaphore_post(s_sys->sem, 1);
+}
+
+void walrus_job_wait(Walrus_JobHandle job)
+{
+    JobThread *thread = thread_get();
+    u32        spins  = 0;
+    while (!walrus_job_finished(job)) {
+        Walrus_Job *next = thread ? job_get(thread) : NULL;
+        if (next != NULL) {
+            job_execute(next);
+            spins = 0;
+        }
+        else if (spins < JOB_WAIT_SPINS) {
+            for (u32 i = 0; i < (1u << spins); ++i) {
+                walrus_cpu_pause();
+            }
+            ++spins;
+        }
+        else {
+            // The remaining jobs run elsewhere, leave the core to them
+            walrus_thread_yield();
+        }
+    }
+}
+
+bool walrus_job_finished(Walrus_JobHandle job)
+{
+    if (walrus_atomic_load_u32(&job.job->unfinished) == 0) {
+        return true;
+    }
+    // The slot went to another job since
+    return walrus_atomic_load_u32(&job.job->generation) != job.generation;
+}
+
+static void parallel_for_job(Walrus_JobHandle job, void *userdata)
+{
+    ParallelForData *data = userdata;
+    u32 const        num  = data->end - data->begin;
+
+    if (num <= data->grain) {
+        data->fn(data->begin, data->end, data->userdata);
+        return;
+    }
+
+    ParallelForData split[2] = {*data, *data};
+    split[0].end             = data->begin + num / 2;
+    split[1].begin           = split[0].end;
+
+    for (u32 i = 0; i < 2; ++i) {
+        walrus_assert(sizeof(ParallelForData) <= sizeof(job.job->data));
+        Walrus_JobHandle child = walrus_job_create_child(job, parallel_for_job, NULL);
+        memcpy(child.job->data, &split[i], sizeof(ParallelForData));
+        child.job->userdata = child.job->data;
+        walrus_job_run(child);
+    }
+}
+
+void walrus_parallel_for(u32 begin, u32 end, u32 grain, Walrus_ParallelForFn fn, void *userdata)
+{
+    if (begin >= end) {
+        return;
+    }
+
+    if (s_sys == NULL || s_sys->num_workers == 0) {
+        fn(begin, end, userdata);
+        return;
+    }
+
+    ParallelForData data = {fn, userdata, begin, end, walrus_max(grain, 1)};
+
+    Walrus_JobHandle root = walrus_job_create(parallel_for_job, &data);
+    walrus_job_run(root);
+    walrus_job_wait(root);
+}
@@ -1,5 +1,7 @@
 #include <core/sort.h>
 #include <core/memory.h>
+#include <core/math.h>
+#include <core/job.h>
 
 #include <string.h>
 void swap_byte(u8* a, u8* b)
@@ -189,3 +191,135 @@ void walrus_radix_sort64(u64* keys, u64* temp_keys, void* values, void* temp_val
         }
     }
 }
+
+// Minimal number of keys per block before the sort is split across threads
+#define RADIX_SORT_MIN_BLOCK_SIZE (4096)
+
+typedef struct {
+    u64 const* keys;
+    u64*       temp_keys;
+    u32 const* values;
+    u32*       temp_values;
+    u32*       histograms;
+    u32        size;
+    u32        block_size;
+    u16        shift;
+} RadixSortPass;
+
+static void radix_sort_histogram(u32 begin, u32 end, void* userdata)
+{
+    RadixSortPass const* pass = userdata;
+    for (u32 block = begin; block < end; ++block) {
+        u32*      histogram = &pass->histograms[block * RADIX_SORT_HISTOGRAM_SIZE];
+        u32 const first     = block * pass->block_size;
+        u32 const last      = walrus_min(first + pass->block_size, pass->size);
+        memset(histogram, 0, sizeof(u32) * RADIX_SORT_HISTOGRAM_SIZE);
+        for (u32 ii = first; ii < last; ++ii) {
+            ++histogram[(pass->keys[ii] >> pass->shift) & RADIX_SORT_BIT_MASK];
+        }
+    }
+}
+
+static void radix_sort_scatter(u32 begin, u32 end, void* userdata)
+{
+    RadixSortPass const* pass = userdata;
+    for (u32 block = begin; block < end; ++block) {
+        u32*      offsets = &pass->histograms[block * RADIX_SORT_HISTOGRAM_SIZE];
+        u32 const first   = block * pass->block_size;
+        u32 const last    = walrus_min(first + pass->block_size, pass->size);
+        for (u32 ii = first; ii < last; ++ii) {
+            u64 key                 = pass->keys[ii];
+            u32 dest                = offsets[(key >> pass->shift) & RADIX_SORT_BIT_MASK]++;
+            pass->temp_keys[dest]   = key;
+            pass->temp_values[dest] = pass->values[ii];
+        }
+    }
+}
+
+void walrus_radix_sort64_u32(u64* keys, u64* temp_keys, u32* values, u32* temp_values, u32 size)
+{
+    if (size < 2) {
+        return;
+    }
+
+    // Digits where every key agrees don't need a pass
+    u64  diff   = 0;
+    bool sorted = true;
+    for (u32 ii = 1; ii < size; ++ii) {
+        diff |= keys[ii] ^ keys[0];
+        sorted &= keys[ii - 1] <= keys[ii];
+    }
+    if (sorted) {
+        return;
+    }
+
+    u32 num_blocks = walrus_min(walrus_job_num_threads(), size / RADIX_SORT_MIN_BLOCK_SIZE);
+    num_blocks     = walrus_max(num_blocks, 1);
+
+    u32  stack_histogram[RADIX_SORT_HISTOGRAM_SIZE];
+    u32* histograms = stack_histogram;
+    if (num_blocks > 1) {
+        histograms = walrus_malloc(sizeof(u32) * RADIX_SORT_HISTOGRAM_SIZE * num_blocks);
+    }
+
+    RadixSortPass pass;
+    pass.keys        = keys;
+    pass.temp_keys   = temp_keys;
+    pass.values      = values;
+    pass.temp_values = temp_values;
+    pass.histograms  = histograms;
+    pass.size        = size;
+    pass.block_size  = (size + num_blocks - 1) / num_blocks;
+
+    u32 num_passes = 0;
+    for (u16 shift = 0; shift < 64; shift += RADIX_SORT_BITS) {
+        if (((diff >> shift) & RADIX_SORT_BIT_MASK) == 0) {
+            continue;
+        }
+        pass.shift = shift;
+
+        if (num_blocks > 1) {
+            walrus_parallel_for(0, num_blocks, 1, radix_sort_histogram, &pass);
+        }
+        else {
+            radix_sort_histogram(0, 1, &pass);
+        }
+
+        // Blocks of the same digit are laid out in order to keep the sort stable
+        u32 offset = 0;
+        for (u32 ii = 0; ii < RADIX_SORT_HISTOGRAM_SIZE; ++ii) {
+            for (u32 block = 0; block < num_blocks; ++block) {
+                u32* histogram = &histograms[block * RADIX_SORT_HISTOGRAM_SIZE + ii];
+                u32  count     = *histogram;
+                *histogram     = offset;
+                offset += count;
+            }
+        }
+
+        if (num_blocks > 1) {
+            walrus_parallel_for(0, num_blocks, 1, radix_sort_scatter, &pass);
+        }
+        else {
+            radix_sort_scatter(0, 1, &pass);
+        }
+
+        u64* swap_keys   = pass.temp_keys;
+        pass.temp_keys   = (u64*)pass.keys;
+        pass.keys        = swap_keys;
+        u32* swap_values = pass.temp_values;
+        pass.temp_values = (u32*)pass.values;
+        pass.values      = swap_values;
+
+        ++num_passes;
+    }
+
+    if (0 != (num_passes & 1)) {
+        // Odd number of passes needs to do copy to the destination.
+        memcpy(keys, temp_keys, size * sizeof(u64));
+        memcpy(values, temp_values, size * sizeof(u32));
+    }
+
+    if (histograms != stack_histogram) {
+        walrus_free(histograms);
+    }
+}
@@ -1,7 +1,9 @@
 #include <core/sys.h>
+#include <core/platform.h>
 
 #include <math.h>
 #include <time.h>
+#include <sys/stat.h>
 
 typedef struct timespec timespec;
 
@@ -36,3 +38,21 @@ u64 walrus_sysclock(Walrus_SysClockUnit unit)
     }
     return 0;
 }
+
+bool walrus_file_stat(char const *path, u64 *size, u64 *mtime)
+{
+#if WR_PLATFORM == WR_PLATFORM_WINDOWS
+    struct _stat64 info;
+    if (_stat64(path, &info) != 0) {
+        return false;
+    }
+#else
+    struct stat info;
+    if (stat(path, &info) != 0) {
+        return false;
+    }
+#endif
+    *size  = info.st_size;
+    *mtime = info.st_mtime;
+    return true;
+}
@@ -0,0 +1,121 @@
+#include <core/job.h>
+#include <core/atomic.h>
+#include <core/macro.h>
+
+#include <stdio.h>
+#include <string.h>
+
+#define EXPECT(e)                                                          \
+    if (!(e)) {                                                            \
+        printf("%s:%d: expectation failed: %s\n", __FILE__, __LINE__, #e); \
+        return 1;                                                          \
+    }
+
+// More than a thread ring holds, so that allocating and queueing go through the overflow paths
+#define NUM_JOBS     (WR_JOB_MAX_JOBS * 3)
+#define NUM_CHILDREN 16
+#define NUM_RANGE    100000
+
+static u32 volatile s_runs[NUM_JOBS];
+static u32 volatile s_count;
+
+static Walrus_JobHandle s_held[WR_JOB_MAX_JOBS];
+
+static void count_job(Walrus_JobHandle job, void *userdata)
+{
+    walrus_unused(job);
+    walrus_atomic_fetch_add_u32(&s_runs[walrus_ptr_to_val(userdata)], 1);
+}
+
+// Every job spawns children of its own down to a depth, the parent only finishes with its whole subtree
+static void tree_job(Walrus_JobHandle job, void *userdata)
+{
+    u32 const depth = walrus_ptr_to_val(userdata);
+    walrus_atomic_fetch_add_u32(&s_count, 1);
+    if (depth == 0) {
+        return;
+    }
+    for (u32 i = 0; i < 2; ++i) {
+        walrus_job_run(walrus_job_create_child(job, tree_job, walrus_val_to_ptr(depth - 1)));
+    }
+}
+
+static void range_fn(u32 begin, u32 end, void *userdata)
+{
+    walrus_unused(userdata);
+    for (u32 i = begin; i < end; ++i) {
+        walrus_atomic_fetch_add_u32(&s_runs[i % NUM_JOBS], 1);
+    }
+}
+
+static i32 job_test(void)
+{
+    // Jobs pushed by one thread and stolen by the others run exactly once
+    memset((void *)s_runs, 0, sizeof(s_runs));
+    Walrus_JobHandle root = walrus_job_create(NULL, NULL);
+    for (u32 i = 0; i < NUM_JOBS; ++i) {
+        walrus_job_run(walrus_job_create_child(root, count_job, walrus_val_to_ptr(i)));
+    }
+    walrus_job_run(root);
+    walrus_job_wait(root);
+    EXPECT(walrus_job_finished(root));
+    for (u32 i = 0; i < NUM_JOBS; ++i) {
+        EXPECT(s_runs[i] == 1);
+    }
+
+    // A parent is not finished while a grandchild is still running
+    for (u32 round = 0; round < NUM_CHILDREN; ++round) {
+        s_count         = 0;
+        Walrus_JobHandle top = walrus_job_create(tree_job, walrus_val_to_ptr(10));
+        walrus_job_run(top);
+        walrus_job_wait(top);
+        EXPECT(s_count == (1u << 11) - 1);
+    }
+
+    memset((void *)s_runs, 0, sizeof(s_runs));
+    walrus_parallel_for(0, NUM_RANGE, 64, range_fn, NULL);
+    u32 total = 0;
+    for (u32 i = 0; i < NUM_JOBS; ++i) {
+        total += s_runs[i];
+    }
+    EXPECT(total == NUM_RANGE);
+
+    // A finished job stays finished for its handle once another job takes its slot
+    Walrus_JobHandle done = walrus_job_create(NULL, NULL);
+    walrus_job_run(done);
+    walrus_job_wait(done);
+    u32 num_held = 0;
+    do {
+        s_held[num_held] = walrus_job_create(NULL, NULL);
+    } while (s_held[num_held++].job != done.job && num_held < WR_JOB_MAX_JOBS);
+    EXPECT(s_held[num_held - 1].job == done.job);
+    EXPECT(walrus_job_finished(done));
+    EXPECT(!walrus_job_finished(s_held[num_held - 1]));
+    for (u32 i = 0; i < num_held; ++i) {
+        walrus_job_run(s_held[i]);
+        walrus_job_wait(s_held[i]);
+    }
+
+    return 0;
+}
+
+i32 main(void)
+{
+    walrus_job_init(3);
+    i32 r = job_test();
+    walrus_job_shutdown();
+
+    // Without workers everything runs on the caller
+    if (r == 0) {
+        walrus_job_init(0);
+        r = job_test();
+        walrus_job_shutdown();
+    }
+
+    // Without the system every job runs on the spot
+    if (r == 0) {
+        r = job_test();
+    }
+
+    return r;
+}
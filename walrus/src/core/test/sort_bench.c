@@ -0,0 +1,118 @@
+#include <core/sort.h>
+#include <core/job.h>
+#include <core/sys.h>
+#include <core/memory.h>
+
+#include <stdio.h>
+#include <string.h>
+
+#define NUM_ITERATIONS 100
+
+static u64 s_rng = 0x9e3779b97f4a7c15ull;
+
+static u64 rand64(void)
+{
+    s_rng ^= s_rng << 13;
+    s_rng ^= s_rng >> 7;
+    s_rng ^= s_rng << 17;
+    return s_rng;
+}
+
+typedef struct {
+    u64* keys;
+    u64* temp_keys;
+    u32* values;
+    u32* temp_values;
+    u64* src_keys;
+} SortBuffer;
+
+static void fill_keys(SortBuffer* buffer, u32 size, u64 mask)
+{
+    for (u32 i = 0; i < size; ++i) {
+        buffer->src_keys[i] = rand64() & mask;
+    }
+}
+
+static void reset(SortBuffer* buffer, u32 size)
+{
+    memcpy(buffer->keys, buffer->src_keys, size * sizeof(u64));
+    for (u32 i = 0; i < size; ++i) {
+        buffer->values[i] = i;
+    }
+}
+
+static bool verify(SortBuffer const* buffer, u32 size)
+{
+    for (u32 i = 0; i < size; ++i) {
+        if (buffer->keys[i] != buffer->src_keys[buffer->values[i]]) {
+            return false;
+        }
+        if (i > 0 && buffer->keys[i - 1] > buffer->keys[i]) {
+            return false;
+        }
+    }
+    return true;
+}
+
+static bool bench(SortBuffer* buffer, u32 size, u64 mask, char const* name)
+{
+    fill_keys(buffer, size, mask);
+
+    u64 generic = 0;
+    u64 special = 0;
+    for (u32 i = 0; i < NUM_ITERATIONS; ++i) {
+        reset(buffer, size);
+        u64 start = walrus_sysclock(WR_SYS_CLOCK_UNIT_MICROSEC);
+        walrus_radix_sort64(buffer->keys, buffer->temp_keys, buffer->values, buffer->temp_values, size, sizeof(u32));
+        generic += walrus_sysclock(WR_SYS_CLOCK_UNIT_MICROSEC) - start;
+        if (!verify(buffer, size)) {
+            printf("walrus_radix_sort64 failed on %u %s keys\n", size, name);
+            return false;
+        }
+
+        reset(buffer, size);
+        start = walrus_sysclock(WR_SYS_CLOCK_UNIT_MICROSEC);
+        walrus_radix_sort64_u32(buffer->keys, buffer->temp_keys, buffer->values, buffer->temp_values, size);
+        special += walrus_sysclock(WR_SYS_CLOCK_UNIT_MICROSEC) - start;
+        if (!verify(buffer, size)) {
+            printf("walrus_radix_sort64_u32 failed on %u %s keys\n", size, name);
+            return false;
+        }
+    }
+
+    printf("%6u %-8s keys: radix_sort64 %8.2fus radix_sort64_u32 %8.2fus\n", size, name,
+           (f64)generic / NUM_ITERATIONS, (f64)special / NUM_ITERATIONS);
+    return true;
+}
+
+i32 main(void)
+{
+    u32 const sizes[]  = {1 << 10, 1 << 14, 1 << 16};
+    u32 const max_size = 1 << 16;
+
+    SortBuffer buffer;
+    buffer.keys        = walrus_new(u64, max_size);
+    buffer.temp_keys   = walrus_new(u64, max_size);
+    buffer.values      = walrus_new(u32, max_size);
+    buffer.temp_values = walrus_new(u32, max_size);
+    buffer.src_keys    = walrus_new(u64, max_size);
+
+    walrus_job_init(7);
+
+    bool success = true;
+    for (u32 i = 0; i < 3 && success; ++i) {
+        success &= bench(&buffer, sizes[i], UINT64_MAX, "random");
+        // Render sort keys mostly differ in the low bits
+        success &= bench(&buffer, sizes[i], 0xffffffull, "sortkey");
+    }
+
+    walrus_job_shutdown();
+
+    walrus_free(buffer.keys);
+    walrus_free(buffer.temp_keys);
+    walrus_free(buffer.values);
+    walrus_free(buffer.temp_values);
+    walrus_free(buffer.src_keys);
+
+    return success ? 0 : 1;
+}
@@ -104,3 +104,12 @@ void walrus_thread_shutdown(Walrus_Thread* thread)
 
     thread->running = false;
 }
+
+void walrus_thread_yield(void)
+{
+#if WR_PLATFORM == WR_PLATFORM_WINDOWS
+    SwitchToThread();
+#else
+#error "Unsupported platform"
+#endif
+}
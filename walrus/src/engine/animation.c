@@ -0,0 +1,270 @@
+#include <engine/model.h>
+#include <core/macro.h>
+#include <core/math.h>
+#include <core/memory.h>
+
+#include <math.h>
+#include <string.h>
+
+// The three smallest components of a unit quaternion are within +-1/sqrt(2)
+#define ROTATION_RANGE 0.70710678f
+#define ROTATION_MAX   0x7fff
+#define RANGE_MAX      0xffff
+
+// Most keys a reduced span covers
+#define KEYS_MAX_SPAN 32
+
+static u16 quantize(f32 value, f32 min, f32 extent, u32 max)
+{
+    if (extent <= 0) {
+        return 0;
+    }
+    f32 const q = (value - min) / extent * max + 0.5f;
+    return walrus_clamp(q, 0.0f, (f32)max);
+}
+
+static f32 dequantize(u32 q, f32 min, f32 extent, u32 max)
+{
+    return min + extent * ((f32)q / max);
+}
+
+// The largest component is dropped and rebuilt from the others, its index is kept in the top bits of the first two
+// components. The sign of the quaternion is flipped so that the largest component is positive.
+static void rotation_encode(f32 const *rot, u16 *q)
+{
+    u32 largest = 0;
+    for (u32 c = 1; c < 4; ++c) {
+        if (fabsf(rot[c]) > fabsf(rot[largest])) {
+            largest = c;
+        }
+    }
+
+    f32 len = 0;
+    for (u32 c = 0; c < 4; ++c) {
+        len += rot[c] * rot[c];
+    }
+    f32 const scale = (rot[largest] < 0 ? -1.0f : 1.0f) / sqrtf(len);
+
+    for (u32 c = 0, j = 0; c < 4; ++c) {
+        if (c != largest) {
+            q[j++] = quantize(rot[c] * scale, -ROTATION_RANGE, ROTATION_RANGE * 2, ROTATION_MAX);
+        }
+    }
+    q[0] |= (largest & 1) << 15;
+    q[1] |= (largest >> 1) << 15;
+}
+
+static void rotation_decode(u16 const *q, f32 *rot)
+{
+    u32 const largest = (q[0] >> 15) | ((q[1] >> 15) << 1);
+
+    f32 sum = 0;
+    for (u32 c = 0, j = 0; c < 4; ++c) {
+        if (c != largest) {
+            rot[c] = dequantize(q[j++] & ROTATION_MAX, -ROTATION_RANGE, ROTATION_RANGE * 2, ROTATION_MAX);
+            sum += rot[c] * rot[c];
+        }
+    }
+    rot[largest] = sqrtf(walrus_max(1 - sum, 0.0f));
+}
+
+void walrus_animation_track_decode(Walrus_AnimationTrack const *track, u32 key, f32 *value)
+{
+    u16 const *q = &track->quantized[key * 3];
+    if (track->num_components == 4) {
+        rotation_decode(q, value);
+    }
+    else {
+        for (u32 c = 0; c < 3; ++c) {
+            value[c] = dequantize(q[c], track->range_min[c], track->range_extent[c], RANGE_MAX);
+        }
+    }
+}
+
+// Whether interpolating the keys `first` and `last` reproduces every key between them within `tolerance`
+static bool keys_reducible(Walrus_AnimationTrack const *track, u32 first, u32 last, f32 tolerance)
+{
+    u32 const  n    = track->num_components;
+    f32 const *ts   = track->timestamps;
+    f32 const *from = &track->values[first * n];
+    f32 const *to   = &track->values[last * n];
+
+    f32 sign = 1;
+    if (n == 4) {
+        f32 const dot = from[0] * to[0] + from[1] * to[1] + from[2] * to[2] + from[3] * to[3];
+        sign          = dot < 0 ? -1 : 1;
+    }
+
+    for (u32 k = first + 1; k < last; ++k) {
+        f32 factor = 0;
+        if (track->interpolation != WR_ANIMATION_INTERPOLATION_STEP && ts[last] > ts[first]) {
+            factor = (ts[k] - ts[first]) / (ts[last] - ts[first]);
+        }
+
+        f32 value[4];
+        f32 len = 0;
+        for (u32 c = 0; c < n; ++c) {
+            value[c] = from[c] + (to[c] * sign - from[c]) * factor;
+            len += value[c] * value[c];
+        }
+
+        // Rotations are compared on the same hemisphere as the interpolated one
+        f32 const *key        = &track->values[k * n];
+        f32        key_sign   = 1;
+        f32        value_norm = 1;
+        if (n == 4) {
+            value_norm    = 1 / sqrtf(len);
+            f32 const dot = value[0] * key[0] + value[1] * key[1] + value[2] * key[2] + value[3] * key[3];
+            key_sign      = dot < 0 ? -1 : 1;
+        }
+        for (u32 c = 0; c < n; ++c) {
+            if (fabsf(value[c] * value_norm - key[c] * key_sign) > tolerance) {
+                return false;
+            }
+        }
+    }
+    return true;
+}
+
+// Keeps the first and the last key, and greedily extends every span between kept keys while the keys inside it are
+// reproduced within `tolerance`. The kept keys are written in one pass over the track, spans are capped at
+// `KEYS_MAX_SPAN` keys so that every key is checked against a bounded number of spans.
+static u32 keys_reduce(Walrus_AnimationTrack const *track, f32 tolerance, u32 *keys)
+{
+    u32 num_keys     = 0;
+    keys[num_keys++] = 0;
+
+    u32 anchor = 0;
+    for (u32 k = 2; k < track->num_keys; ++k) {
+        if (k - anchor > KEYS_MAX_SPAN || !keys_reducible(track, anchor, k, tolerance)) {
+            anchor           = k - 1;
+            keys[num_keys++] = anchor;
+        }
+    }
+    if (track->num_keys > 1) {
+        keys[num_keys++] = track->num_keys - 1;
+    }
+    return num_keys;
+}
+
+static bool track_compressible(Walrus_AnimationTrack const *track)
+{
+    return track->quantized == NULL && track->interpolation != WR_ANIMATION_INTERPOLATION_CUBIC_SPLINE;
+}
+
+static u32 num_keys_total(Walrus_AnimationStream const *stream)
+{
+    u32 num_keys = 0;
+    for (u32 i = 0; i < stream->num_tracks; ++i) {
+        num_keys += stream->tracks[i].num_keys;
+    }
+    return num_keys;
+}
+
+static void stream_compress(Walrus_AnimationStream *stream, f32 tolerance)
+{
+    u32 num_keys   = 0;
+    u32 num_values = 0;
+    for (u32 i = 0; i < stream->num_tracks; ++i) {
+        Walrus_AnimationTrack const *track = &stream->tracks[i];
+        if (!track_compressible(track)) {
+            num_keys += track->num_keys;
+            num_values += track->num_keys * track->num_components * 3;
+        }
+    }
+
+    // Kept keys are listed at the offset of the keys of their track
+    u32 *kept          = walrus_new(u32, walrus_max(num_keys_total(stream), 1u));
+    u32 *num_kept      = walrus_new(u32, walrus_max(stream->num_tracks, 1u));
+    u32  num_quantized = 0;
+    for (u32 i = 0; i < stream->num_tracks; ++i) {
+        Walrus_AnimationTrack const *track = &stream->tracks[i];
+        if (track_compressible(track)) {
+            num_kept[i] = keys_reduce(track, tolerance, kept + (track->timestamps - stream->timestamps));
+            num_keys += num_kept[i];
+            num_quantized += num_kept[i];
+        }
+    }
+
+    f32 *timestamps = walrus_new(f32, walrus_max(num_keys, 1u));
+    f32 *values     = num_values > 0 ? walrus_new(f32, num_values) : NULL;
+    u16 *quantized  = walrus_new(u16, walrus_max(num_quantized, 1u) * 3);
+
+    num_keys      = 0;
+    num_values    = 0;
+    num_quantized = 0;
+    for (u32 i = 0; i < stream->num_tracks; ++i) {
+        Walrus_AnimationTrack *track = &stream->tracks[i];
+        f32                   *ts    = timestamps + num_keys;
+        if (!track_compressible(track)) {
+            u32 const size = track->num_keys * track->num_components * 3;
+            memcpy(ts, track->timestamps, track->num_keys * sizeof(f32));
+            memcpy(values + num_values, track->values, size * sizeof(f32));
+            track->timestamps = ts;
+            track->values     = values + num_values;
+            num_keys += track->num_keys;
+            num_values += size;
+            continue;
+        }
+
+        u32 const *keys = kept + (track->timestamps - stream->timestamps);
+        u32 const  n    = track->num_components;
+        u16       *q    = quantized + num_quantized * 3;
+        if (n == 4) {
+            for (u32 k = 0; k < num_kept[i]; ++k) {
+                rotation_encode(&track->values[keys[k] * 4], q + k * 3);
+            }
+        }
+        else {
+            vec3 max;
+            for (u32 c = 0; c < 3; ++c) {
+                track->range_min[c] = track->values[keys[0] * n + c];
+                max[c]              = track->range_min[c];
+            }
+            for (u32 k = 1; k < num_kept[i]; ++k) {
+                for (u32 c = 0; c < 3; ++c) {
+                    track->range_min[c] = walrus_min(track->range_min[c], track->values[keys[k] * n + c]);
+                    max[c]              = walrus_max(max[c], track->values[keys[k] * n + c]);
+                }
+            }
+            for (u32 c = 0; c < 3; ++c) {
+                track->range_extent[c] = max[c] - track->range_min[c];
+            }
+            for (u32 k = 0; k < num_kept[i]; ++k) {
+                for (u32 c = 0; c < 3; ++c) {
+                    q[k * 3 + c] = quantize(track->values[keys[k] * n + c], track->range_min[c],
+                                            track->range_extent[c], RANGE_MAX);
+                }
+            }
+        }
+        for (u32 k = 0; k < num_kept[i]; ++k) {
+            ts[k] = track->timestamps[keys[k]];
+        }
+
+        track->timestamps = ts;
+        track->values     = NULL;
+        track->quantized  = q;
+        track->num_keys   = num_kept[i];
+        num_keys += num_kept[i];
+        num_quantized += num_kept[i];
+    }
+
+    walrus_free(kept);
+    walrus_free(num_kept);
+
+    walrus_free(stream->timestamps);
+    walrus_free(stream->values);
+    stream->timestamps = timestamps;
+    stream->values     = values;
+    stream->quantized  = quantized;
+}
+
+void walrus_animation_compress(Walrus_Animation *animation, f32 tolerance)
+{
+    for (u32 path = 0; path < WR_ANIMATION_PATH_COUNT; ++path) {
+        Walrus_AnimationStream *stream = &animation->streams[path];
+        if (path != WR_ANIMATION_PATH_WEIGHTS && stream->quantized == NULL && stream->num_tracks > 0) {
+            stream_compress(stream, tolerance);
+        }
+    }
+}
@@ -0,0 +1,177 @@
+#include <engine/animation_baker.h>
+#include <engine/animator.h>
+#include <engine/geometry.h>
+#include <core/macro.h>
+#include <core/math.h>
+#include <core/memory.h>
+#include <core/log.h>
+#include <rhi/rhi.h>
+
+#include <float.h>
+#include <math.h>
+
+static vec4 *frame_matrices(Walrus_BakedAnimation const *baked, u32 frame, u32 skin, u32 joint)
+{
+    return &baked->matrices[((u64)frame * baked->num_joints + baked->skin_offsets[skin] + joint) * 3];
+}
+
+static void joint_bounds(Walrus_SkinJoint const *joint, mat4 world, vec3 min, vec3 max)
+{
+    Walrus_BoundingBox box;
+    walrus_bounding_box_from_min_max(&box, joint->min, joint->max);
+    walrus_bounding_box_transform(&box, world);
+
+    vec3 box_min, box_max;
+    glm_vec3_sub(box.center, box.extends, box_min);
+    glm_vec3_add(box.center, box.extends, box_max);
+    glm_vec3_minv(min, box_min, min);
+    glm_vec3_maxv(max, box_max, max);
+}
+
+// Writes the skin matrices of the current pose into the frame, and grows the bounds of the clip by it
+static void frame_bake(Walrus_BakedAnimation *baked, Walrus_Animator const *animator, Walrus_Model const *model,
+                       u32 clip, u32 frame)
+{
+    for (u32 s = 0; s < model->num_skins; ++s) {
+        Walrus_ModelSkin const *skin = &model->skins[s];
+        f32                    *min  = baked->mins[clip * baked->num_skins + s];
+        f32                    *max  = baked->maxs[clip * baked->num_skins + s];
+        for (u32 j = 0; j < skin->num_joints; ++j) {
+            Walrus_SkinJoint const *joint = &skin->joints[j];
+
+            mat4 world, m;
+            walrus_animator_transform(animator, model, joint->node, world);
+            glm_mat4_mul(world, (vec4 *)joint->inverse_bind_matrix, m);
+
+            vec4 *rows = frame_matrices(baked, frame, s, j);
+            for (u32 r = 0; r < 3; ++r) {
+                glm_vec4_copy((vec4){m[0][r], m[1][r], m[2][r], m[3][r]}, rows[r]);
+            }
+
+            joint_bounds(joint, world, min, max);
+        }
+    }
+}
+
+void walrus_animation_bake(Walrus_BakedAnimation *baked, Walrus_Model const *model, f32 frame_rate)
+{
+    baked->num_clips    = model->num_animations;
+    baked->num_skins    = model->num_skins;
+    baked->frame_rate   = frame_rate;
+    baked->clips        = walrus_new(Walrus_BakedClip, walrus_max(baked->num_clips, 1u));
+    baked->skin_offsets = walrus_new(u32, walrus_max(baked->num_skins, 1u));
+    baked->texture.id   = WR_INVALID_HANDLE;
+
+    baked->num_joints = 0;
+    for (u32 i = 0; i < model->num_skins; ++i) {
+        baked->skin_offsets[i] = baked->num_joints;
+        baked->num_joints += model->skins[i].num_joints;
+    }
+
+    // Frames are spread evenly so that the last one lands on the end of the clip
+    baked->num_frames = 0;
+    for (u32 i = 0; i < baked->num_clips; ++i) {
+        Walrus_BakedClip *clip = &baked->clips[i];
+        clip->duration         = model->animations[i].duration;
+        clip->first_frame      = baked->num_frames;
+        clip->num_frames       = clip->duration > 0 ? (u32)ceilf(clip->duration * frame_rate) + 1 : 1;
+        baked->num_frames += clip->num_frames;
+    }
+
+    u32 const num_bounds = walrus_max(baked->num_clips * baked->num_skins, 1u);
+    baked->matrices      = walrus_new(vec4, walrus_max(baked->num_frames * baked->num_joints * 3, 1u));
+    baked->mins          = walrus_new(vec3, num_bounds);
+    baked->maxs          = walrus_new(vec3, num_bounds);
+    for (u32 i = 0; i < num_bounds; ++i) {
+        glm_vec3_fill(baked->mins[i], FLT_MAX);
+        glm_vec3_fill(baked->maxs[i], -FLT_MAX);
+    }
+
+    Walrus_Animator animator;
+    walrus_animator_init(&animator);
+    walrus_animator_bind(&animator, model);
+    for (u32 i = 0; i < baked->num_clips; ++i) {
+        Walrus_BakedClip const *clip = &baked->clips[i];
+
+        walrus_animator_play(&animator, i);
+        animator.layers[0].clips[0].repeat = false;
+        for (u32 f = 0; f < clip->num_frames; ++f) {
+            f32 const time = clip->num_frames > 1 ? clip->duration * f / (clip->num_frames - 1) : 0;
+
+            animator.layers[0].clips[0].timestamp = time;
+            walrus_animator_tick(&animator, model, 0);
+            frame_bake(baked, &animator, model, i, clip->first_frame + f);
+        }
+    }
+    walrus_animator_shutdown(&animator);
+}
+
+bool walrus_baked_animation_upload(Walrus_BakedAnimation *baked)
+{
+    if (baked->num_joints == 0 || baked->num_frames == 0) {
+        return true;
+    }
+
+    u32 const max_size = walrus_rhi_get_caps()->max_texture_size;
+    if (baked->num_joints * 3 > max_size || baked->num_frames > max_size) {
+        walrus_error("Baked animation atlas of %u joints and %u frames exceeds the maximum texture size %u",
+                     baked->num_joints, baked->num_frames, max_size);
+        return false;
+    }
+
+    Walrus_TextureCreateInfo info;
+    info.width       = baked->num_joints * 3;
+    info.height      = baked->num_frames;
+    info.depth       = 1;
+    info.ratio       = WR_RHI_RATIO_COUNT;
+    info.num_layers  = 1;
+    info.num_mipmaps = 1;
+    info.format      = WR_RHI_FORMAT_RGBA32F;
+    info.flags       = 0;
+    info.cube_map    = false;
+    baked->texture   = walrus_rhi_create_texture(&info, baked->matrices);
+
+    return true;
+}
+
+void walrus_baked_animation_shutdown(Walrus_BakedAnimation *baked)
+{
+    if (baked->texture.id != WR_INVALID_HANDLE) {
+        walrus_rhi_destroy_texture(baked->texture);
+    }
+    walrus_free(baked->clips);
+    walrus_free(baked->skin_offsets);
+    walrus_free(baked->matrices);
+    walrus_free(baked->mins);
+    walrus_free(baked->maxs);
+}
+
+f32 walrus_baked_animation_frame(Walrus_BakedAnimation const *baked, u32 clip_index, f32 time)
+{
+    Walrus_BakedClip const *clip = &baked->clips[clip_index];
+    if (clip->num_frames < 2) {
+        return clip->first_frame;
+    }
+
+    f32 t = fmodf(time, clip->duration);
+    if (t < 0) {
+        t += clip->duration;
+    }
+    return clip->first_frame + walrus_min(t / clip->duration * (clip->num_frames - 1), clip->num_frames - 1.0f);
+}
+
+void walrus_baked_animation_joint(Walrus_BakedAnimation const *baked, f32 frame, u32 skin, u32 joint, mat4 matrix)
+{
+    u32 const first  = floorf(frame);
+    u32 const second = ceilf(frame);
+    f32 const t      = frame - first;
+    vec4     *from   = frame_matrices(baked, first, skin, joint);
+    vec4     *to     = frame_matrices(baked, second, skin, joint);
+
+    glm_mat4_identity(matrix);
+    for (u32 r = 0; r < 3; ++r) {
+        for (u32 c = 0; c < 4; ++c) {
+            matrix[c][r] = from[r][c] + (to[r][c] - from[r][c]) * t;
+        }
+    }
+}
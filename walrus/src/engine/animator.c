@@ -1,241 +1,768 @@
 #include <engine/animator.h>
 #include <core/macro.h>
 #include <core/assert.h>
+#include <core/math.h>
+#include <core/memory.h>
 
 #include <cglm/cglm.h>
 #include <string.h>
 
-static void node_traverse(Walrus_Animator *animator, Walrus_Model const *model, Walrus_ModelNode *root,
-                          Walrus_Transform *worlds, Walrus_Transform *locals)
+#if defined(__AVX__)
+#include <immintrin.h>
+#define ANIMATION_SIMD_WIDTH 8
+#elif defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+#include <emmintrin.h>
+#define ANIMATION_SIMD_WIDTH 4
+#else
+#define ANIMATION_SIMD_WIDTH 1
+#endif
+
+// Tracks sampled together, one lane per track. Must be a multiple of the simd width.
+#define ANIMATION_BATCH 32
+
+// The two keys around the sample time of every track in the batch, one array per component. The interpolated value
+// is written back to `prev`.
+typedef struct {
+    f32 prev[4][ANIMATION_BATCH];
+    f32 next[4][ANIMATION_BATCH];
+    f32 factor[ANIMATION_BATCH];
+} SampleBatch;
+
+static void batch_lerp(SampleBatch *batch, u32 num_components, u32 count)
 {
-    for (u32 i = 0; i < root->num_children; ++i) {
-        Walrus_ModelNode *child       = root->children[i];
-        u32               root_index  = root - &model->nodes[0];
-        u32               child_index = child - &model->nodes[0];
-        walrus_transform_mul(&worlds[root_index], &locals[child_index], &worlds[child_index]);
-        node_traverse(animator, model, root->children[i], worlds, locals);
+#if ANIMATION_SIMD_WIDTH == 8
+    for (u32 i = 0; i < count; i += 8) {
+        __m256 const f = _mm256_loadu_ps(batch->factor + i);
+        for (u32 c = 0; c < num_components; ++c) {
+            __m256 const a = _mm256_loadu_ps(batch->prev[c] + i);
+            __m256 const b = _mm256_loadu_ps(batch->next[c] + i);
+            _mm256_storeu_ps(batch->prev[c] + i, _mm256_add_ps(a, _mm256_mul_ps(_mm256_sub_ps(b, a), f)));
+        }
+    }
+#elif ANIMATION_SIMD_WIDTH == 4
+    for (u32 i = 0; i < count; i += 4) {
+        __m128 const f = _mm_loadu_ps(batch->factor + i);
+        for (u32 c = 0; c < num_components; ++c) {
+            __m128 const a = _mm_loadu_ps(batch->prev[c] + i);
+            __m128 const b = _mm_loadu_ps(batch->next[c] + i);
+            _mm_storeu_ps(batch->prev[c] + i, _mm_add_ps(a, _mm_mul_ps(_mm_sub_ps(b, a), f)));
+        }
+    }
+#else
+    for (u32 i = 0; i < count; ++i) {
+        for (u32 c = 0; c < num_components; ++c) {
+            batch->prev[c][i] += (batch->next[c][i] - batch->prev[c][i]) * batch->factor[i];
+        }
+    }
+#endif
+}
+
+// Normalized lerp along the shorter arc, close enough to a slerp between neighbouring keys
+static void batch_nlerp(SampleBatch *batch, u32 count)
+{
+#if ANIMATION_SIMD_WIDTH == 8
+    __m256 const sign_bit = _mm256_set1_ps(-0.0f);
+    for (u32 i = 0; i < count; i += 8) {
+        __m256 const f = _mm256_loadu_ps(batch->factor + i);
+
+        __m256 a[4], b[4];
+        __m256 dot = _mm256_setzero_ps();
+        for (u32 c = 0; c < 4; ++c) {
+            a[c] = _mm256_loadu_ps(batch->prev[c] + i);
+            b[c] = _mm256_loadu_ps(batch->next[c] + i);
+            dot  = _mm256_add_ps(dot, _mm256_mul_ps(a[c], b[c]));
+        }
+        __m256 const flip = _mm256_and_ps(dot, sign_bit);
+
+        __m256 len = _mm256_setzero_ps();
+        for (u32 c = 0; c < 4; ++c) {
+            b[c] = _mm256_xor_ps(b[c], flip);
+            a[c] = _mm256_add_ps(a[c], _mm256_mul_ps(_mm256_sub_ps(b[c], a[c]), f));
+            len  = _mm256_add_ps(len, _mm256_mul_ps(a[c], a[c]));
+        }
+        __m256 const inv_len = _mm256_div_ps(_mm256_set1_ps(1.0f), _mm256_sqrt_ps(len));
+        for (u32 c = 0; c < 4; ++c) {
+            _mm256_storeu_ps(batch->prev[c] + i, _mm256_mul_ps(a[c], inv_len));
+        }
+    }
+#elif ANIMATION_SIMD_WIDTH == 4
+    __m128 const sign_bit = _mm_set1_ps(-0.0f);
+    for (u32 i = 0; i < count; i += 4) {
+        __m128 const f = _mm_loadu_ps(batch->factor + i);
+
+        __m128 a[4], b[4];
+        __m128 dot = _mm_setzero_ps();
+        for (u32 c = 0; c < 4; ++c) {
+            a[c] = _mm_loadu_ps(batch->prev[c] + i);
+            b[c] = _mm_loadu_ps(batch->next[c] + i);
+            dot  = _mm_add_ps(dot, _mm_mul_ps(a[c], b[c]));
+        }
+        __m128 const flip = _mm_and_ps(dot, sign_bit);
+
+        __m128 len = _mm_setzero_ps();
+        for (u32 c = 0; c < 4; ++c) {
+            b[c] = _mm_xor_ps(b[c], flip);
+            a[c] = _mm_add_ps(a[c], _mm_mul_ps(_mm_sub_ps(b[c], a[c]), f));
+            len  = _mm_add_ps(len, _mm_mul_ps(a[c], a[c]));
+        }
+        __m128 const inv_len = _mm_div_ps(_mm_set1_ps(1.0f), _mm_sqrt_ps(len));
+        for (u32 c = 0; c < 4; ++c) {
+            _mm_storeu_ps(batch->prev[c] + i, _mm_mul_ps(a[c], inv_len));
+        }
+    }
+#else
+    for (u32 i = 0; i < count; ++i) {
+        f32 dot = 0;
+        for (u32 c = 0; c < 4; ++c) {
+            dot += batch->prev[c][i] * batch->next[c][i];
+        }
+        f32 const sign = dot < 0 ? -1.0f : 1.0f;
+
+        f32 len = 0;
+        for (u32 c = 0; c < 4; ++c) {
+            batch->prev[c][i] += (batch->next[c][i] * sign - batch->prev[c][i]) * batch->factor[i];
+            len += batch->prev[c][i] * batch->prev[c][i];
+        }
+        f32 const inv_len = 1.0f / sqrtf(len);
+        for (u32 c = 0; c < 4; ++c) {
+            batch->prev[c][i] *= inv_len;
+        }
+    }
+#endif
+}
+
+// Returns the last key at or before `time`. Playback moves forward by less than a key most frames, so the cached key
+// and the one after it are tried before searching.
+static u32 track_seek(Walrus_AnimationTrack const *track, u32 cursor, f32 time)
+{
+    f32 const *timestamps = track->timestamps;
+    u32 const  num_keys   = track->num_keys;
+
+    if (cursor < num_keys && timestamps[cursor] <= time) {
+        if (cursor + 1 >= num_keys || time < timestamps[cursor + 1]) {
+            return cursor;
+        }
+        if (cursor + 2 >= num_keys || time < timestamps[cursor + 2]) {
+            return cursor + 1;
+        }
+    }
+
+    u32 low  = 0;
+    u32 high = num_keys;
+    while (low < high) {
+        u32 const mid = low + (high - low) / 2;
+        if (timestamps[mid] <= time) {
+            low = mid + 1;
+        }
+        else {
+            high = mid;
+        }
     }
+    return low > 0 ? low - 1 : 0;
 }
 
-static void interpolate_frame_rot(Walrus_AnimationInterpolation mode, versor prev, versor next, f32 factor, versor out)
+// Finds the key at or before `time` and returns the factor towards the key after it, times outside the keys clamp to
+// the first or last key
+static f32 track_keys(Walrus_AnimationTrack const *track, u32 *cursor, f32 time)
 {
-    switch (mode) {
-        case WR_ANIMATION_INTERPOLATION_STEP:
-            if (factor < 1.0) {
-                glm_quat_copy(prev, out);
+    u32 const key = track_seek(track, *cursor, time);
+    *cursor       = key;
+    if (key + 1 >= track->num_keys || time <= track->timestamps[key] ||
+        track->interpolation == WR_ANIMATION_INTERPOLATION_STEP) {
+        return 0;
+    }
+
+    f32 const factor = (time - track->timestamps[key]) / (track->timestamps[key + 1] - track->timestamps[key]);
+    return walrus_clamp(factor, 0.0f, 1.0f);
+}
+
+// Cubic spline keys store their value between the in and the out tangent
+static f32 const *track_value(Walrus_AnimationTrack const *track, u32 key)
+{
+    u32 const n = track->num_components;
+    if (track->interpolation == WR_ANIMATION_INTERPOLATION_CUBIC_SPLINE) {
+        return &track->values[key * n * 3 + n];
+    }
+    return &track->values[key * n];
+}
+
+// Hermite spline from the key to the next one, with the tangents scaled by the time between them
+static void track_hermite(Walrus_AnimationTrack const *track, u32 key, f32 t, f32 *value)
+{
+    u32 const  n        = track->num_components;
+    f32 const *from     = track_value(track, key);
+    f32 const *to       = track_value(track, key + 1);
+    f32 const *out_tan  = from + n;
+    f32 const *in_tan   = to - n;
+    f32 const  duration = track->timestamps[key + 1] - track->timestamps[key];
+
+    f32 const t2  = t * t;
+    f32 const t3  = t2 * t;
+    f32 const h00 = 2 * t3 - 3 * t2 + 1;
+    f32 const h10 = (t3 - 2 * t2 + t) * duration;
+    f32 const h01 = -2 * t3 + 3 * t2;
+    f32 const h11 = (t3 - t2) * duration;
+    for (u32 c = 0; c < n; ++c) {
+        value[c] = h00 * from[c] + h10 * out_tan[c] + h01 * to[c] + h11 * in_tan[c];
+    }
+}
+
+// Writes the keys around `time` to a lane of the batch. Compressed keys are decoded on the fly, and cubic splines are
+// evaluated here and passed on with a zero factor, which still normalizes rotations.
+static void track_gather(Walrus_AnimationTrack const *track, u32 *cursor, f32 time, SampleBatch *batch, u32 lane)
+{
+    f32 const factor = track_keys(track, cursor, time);
+    u32 const key    = *cursor;
+    u32 const next   = factor > 0 ? key + 1 : key;
+
+    f32        prev_value[4];
+    f32        next_value[4];
+    f32 const *prev = prev_value;
+    f32 const *to   = next_value;
+    if (track->quantized) {
+        walrus_animation_track_decode(track, key, prev_value);
+        if (next != key) {
+            walrus_animation_track_decode(track, next, next_value);
+        }
+        else {
+            to = prev_value;
+        }
+        batch->factor[lane] = factor;
+    }
+    else if (track->interpolation == WR_ANIMATION_INTERPOLATION_CUBIC_SPLINE && next != key) {
+        track_hermite(track, key, factor, prev_value);
+        to                  = prev_value;
+        batch->factor[lane] = 0;
+    }
+    else {
+        prev                = track_value(track, key);
+        to                  = track_value(track, next);
+        batch->factor[lane] = factor;
+    }
+
+    for (u32 c = 0; c < track->num_components; ++c) {
+        batch->prev[c][lane] = prev[c];
+        batch->next[c][lane] = to[c];
+    }
+}
+
+static f32 *local_component(Walrus_Transform *local, Walrus_AnimationPath path)
+{
+    switch (path) {
+        case WR_ANIMATION_PATH_TRANSLATION:
+            return local->trans;
+        case WR_ANIMATION_PATH_ROTATION:
+            return local->rot;
+        case WR_ANIMATION_PATH_SCALE:
+            return local->scale;
+        default:
+            break;
+    }
+    walrus_assert(false);
+    return NULL;
+}
+
+static void sample_transforms(Walrus_AnimationStream const *stream, Walrus_AnimationPath path, f32 time, u32 *cursors,
+                              Walrus_Transform *pose)
+{
+    u32 const num_components = path == WR_ANIMATION_PATH_ROTATION ? 4 : 3;
+
+    for (u32 first = 0; first < stream->num_tracks; first += ANIMATION_BATCH) {
+        u32 const count  = walrus_min(stream->num_tracks - first, (u32)ANIMATION_BATCH);
+        u32 const padded = walrus_stride_align(count, ANIMATION_SIMD_WIDTH);
+
+        SampleBatch batch;
+        for (u32 i = 0; i < count; ++i) {
+            track_gather(&stream->tracks[first + i], &cursors[first + i], time, &batch, i);
+        }
+        // Unused lanes hold identities so that no lane divides by zero
+        for (u32 i = count; i < padded; ++i) {
+            batch.factor[i] = 0;
+            for (u32 c = 0; c < num_components; ++c) {
+                batch.prev[c][i] = c == 3 ? 1 : 0;
+                batch.next[c][i] = c == 3 ? 1 : 0;
             }
-            else {
-                glm_quat_copy(next, out);
+        }
+
+        if (path == WR_ANIMATION_PATH_ROTATION) {
+            batch_nlerp(&batch, padded);
+        }
+        else {
+            batch_lerp(&batch, num_components, padded);
+        }
+
+        for (u32 i = 0; i < count; ++i) {
+            f32 *dst = local_component(&pose[stream->tracks[first + i].node], path);
+            for (u32 c = 0; c < num_components; ++c) {
+                dst[c] = batch.prev[c][i];
             }
-            break;
-        case WR_ANIMATION_INTERPOLATION_LINEAR:
-            glm_quat_slerp(prev, next, factor, out);
-            break;
-        case WR_ANIMATION_INTERPOLATION_CUBIC_SPLINE:
-            walrus_assert(false);
-            break;
+        }
     }
 }
 
-static void interpolate_frame(Walrus_AnimationInterpolation mode, f32 *prev, f32 *next, f32 factor, f32 *out, u32 cnt)
+static void sample_weights(Walrus_Animator const *animator, Walrus_AnimationStream const *stream, f32 time,
+                           u32 *cursors, f32 *pose_weights)
 {
-    switch (mode) {
-        case WR_ANIMATION_INTERPOLATION_STEP:
-            if (factor < 1.0) {
-                for (u32 i = 0; i < cnt; ++i) {
-                    out[i] = prev[i];
+    for (u32 i = 0; i < stream->num_tracks; ++i) {
+        Walrus_AnimationTrack const *track = &stream->tracks[i];
+
+        f32 const factor  = track_keys(track, &cursors[i], time);
+        u32 const key     = cursors[i];
+        f32      *weights = pose_weights + animator->weight_offsets[track->node];
+        if (factor > 0 && track->interpolation == WR_ANIMATION_INTERPOLATION_CUBIC_SPLINE) {
+            track_hermite(track, key, factor, weights);
+            continue;
+        }
+
+        f32 const *prev = track_value(track, key);
+        f32 const *next = factor > 0 ? track_value(track, key + 1) : prev;
+        for (u32 c = 0; c < track->num_components; ++c) {
+            weights[c] = prev[c] + (next[c] - prev[c]) * factor;
+        }
+    }
+}
+
+// Nodes without tracks in the animation keep their values in the pose
+static void clip_sample(Walrus_Animator const *animator, Walrus_Animation const *animation, f32 time, u32 *cursors,
+                        Walrus_Transform *pose, f32 *pose_weights)
+{
+    for (u32 path = 0; path < WR_ANIMATION_PATH_COUNT; ++path) {
+        Walrus_AnimationStream const *stream = &animation->streams[path];
+        if (path == WR_ANIMATION_PATH_WEIGHTS) {
+            sample_weights(animator, stream, time, cursors, pose_weights);
+        }
+        else {
+            sample_transforms(stream, path, time, cursors, pose);
+        }
+        cursors += stream->num_tracks;
+    }
+}
+
+static u32 *clip_cursors(Walrus_Animator *animator, u32 layer, u32 slot)
+{
+    return animator->cursors + (layer * WR_ANIMATOR_MAX_CLIPS + slot) * animator->num_cursors;
+}
+
+static void clip_remove(Walrus_Animator *animator, u32 layer_index, u32 slot)
+{
+    Walrus_AnimatorLayer *layer = &animator->layers[layer_index];
+    for (u32 i = slot + 1; i < layer->num_clips; ++i) {
+        layer->clips[i - 1] = layer->clips[i];
+        memcpy(clip_cursors(animator, layer_index, i - 1), clip_cursors(animator, layer_index, i),
+               animator->num_cursors * sizeof(u32));
+    }
+    --layer->num_clips;
+}
+
+// Returns the clip of the animation on the layer, a new clip starts from the beginning with no weight. A full layer
+// gives the slot of its faintest clip away.
+static Walrus_AnimatorClip *clip_acquire(Walrus_Animator *animator, u32 layer_index, u32 index)
+{
+    Walrus_AnimatorLayer *layer = &animator->layers[layer_index];
+    for (u32 i = 0; i < layer->num_clips; ++i) {
+        if (layer->clips[i].index == index) {
+            return &layer->clips[i];
+        }
+    }
+
+    if (layer->num_clips == WR_ANIMATOR_MAX_CLIPS) {
+        u32 faintest = 0;
+        for (u32 i = 1; i < layer->num_clips; ++i) {
+            if (layer->clips[i].weight < layer->clips[faintest].weight) {
+                faintest = i;
+            }
+        }
+        clip_remove(animator, layer_index, faintest);
+    }
+
+    u32 const            slot = layer->num_clips++;
+    Walrus_AnimatorClip *clip = &layer->clips[slot];
+    clip->index               = index;
+    clip->timestamp           = 0;
+    clip->weight              = 0;
+    clip->target_weight       = 0;
+    clip->fade_speed          = 0;
+    clip->repeat              = true;
+    memset(clip_cursors(animator, layer_index, slot), 0, animator->num_cursors * sizeof(u32));
+
+    return clip;
+}
+
+// Moves the timestamps and the fading weights of the layer forward
+static void layer_advance(Walrus_Animator *animator, Walrus_Model const *model, u32 layer_index, f32 dt)
+{
+    Walrus_AnimatorLayer *layer = &animator->layers[layer_index];
+    for (u32 i = 0; i < layer->num_clips;) {
+        Walrus_AnimatorClip *clip = &layer->clips[i];
+        if (clip->index < model->num_animations) {
+            f32 const duration = model->animations[clip->index].duration;
+            clip->timestamp += dt;
+            if (clip->timestamp > duration) {
+                if (clip->repeat && duration > 0) {
+                    clip->timestamp = fmodf(clip->timestamp, duration);
+                }
+                else {
+                    clip->timestamp = duration;
                 }
             }
-            else {
-                for (u32 i = 0; i < cnt; ++i) {
-                    out[i] = next[i];
+        }
+
+        f32 const step = clip->fade_speed * dt;
+        if (clip->weight < clip->target_weight) {
+            clip->weight = walrus_min(clip->weight + step, clip->target_weight);
+        }
+        else if (clip->weight > clip->target_weight) {
+            clip->weight = walrus_max(clip->weight - step, clip->target_weight);
+        }
+
+        if (clip->fade_speed > 0 && clip->weight <= 0 && clip->target_weight <= 0) {
+            clip_remove(animator, layer_index, i);
+        }
+        else {
+            ++i;
+        }
+    }
+}
+
+static void quat_nlerp(versor const from, versor const to, f32 t, versor dst)
+{
+    f32 const dot  = from[0] * to[0] + from[1] * to[1] + from[2] * to[2] + from[3] * to[3];
+    f32 const sign = dot < 0 ? -1.0f : 1.0f;
+    for (u32 c = 0; c < 4; ++c) {
+        dst[c] = from[c] + (to[c] * sign - from[c]) * t;
+    }
+    glm_quat_normalize(dst);
+}
+
+static u32 node_num_weights(Walrus_Animator const *animator, u32 node)
+{
+    u32 const end = node + 1 < animator->num_nodes ? animator->weight_offsets[node + 1] : animator->num_weights;
+    return end - animator->weight_offsets[node];
+}
+
+// Blends `src` over `dst` by `weight`, scaled per node by `mask` if there is one
+static void pose_override(Walrus_Animator const *animator, Walrus_Transform *dst, f32 *dst_weights,
+                          Walrus_Transform const *src, f32 const *src_weights, f32 const *mask, f32 weight)
+{
+    for (u32 i = 0; i < animator->num_nodes; ++i) {
+        f32 const t = mask ? weight * mask[i] : weight;
+        if (t <= 0) {
+            continue;
+        }
+        for (u32 c = 0; c < 3; ++c) {
+            dst[i].trans[c] += (src[i].trans[c] - dst[i].trans[c]) * t;
+            dst[i].scale[c] += (src[i].scale[c] - dst[i].scale[c]) * t;
+        }
+        quat_nlerp(dst[i].rot, src[i].rot, t, dst[i].rot);
+
+        u32 const offset = animator->weight_offsets[i];
+        for (u32 j = offset; j < offset + node_num_weights(animator, i); ++j) {
+            dst_weights[j] += (src_weights[j] - dst_weights[j]) * t;
+        }
+    }
+}
+
+// Adds the difference of `src` from the bind pose onto `dst`, scaled by `weight` and per node by `mask`
+static void pose_add(Walrus_Animator const *animator, Walrus_Transform *dst, f32 *dst_weights,
+                     Walrus_Transform const *src, f32 const *src_weights, f32 const *mask, f32 weight)
+{
+    Walrus_Transform const *bind         = animator->poses;
+    f32 const              *bind_weights = animator->pose_weights;
+
+    versor identity;
+    glm_quat_identity(identity);
+    for (u32 i = 0; i < animator->num_nodes; ++i) {
+        f32 const t = mask ? weight * mask[i] : weight;
+        if (t <= 0) {
+            continue;
+        }
+        for (u32 c = 0; c < 3; ++c) {
+            dst[i].trans[c] += (src[i].trans[c] - bind[i].trans[c]) * t;
+            if (bind[i].scale[c] != 0) {
+                dst[i].scale[c] *= 1 + (src[i].scale[c] / bind[i].scale[c] - 1) * t;
+            }
+        }
+
+        versor inverse, delta, rot;
+        glm_quat_inv((f32 *)bind[i].rot, inverse);
+        glm_quat_mul((f32 *)src[i].rot, inverse, delta);
+        quat_nlerp(identity, delta, t, delta);
+        glm_quat_mul(delta, dst[i].rot, rot);
+        glm_quat_copy(rot, dst[i].rot);
+
+        u32 const offset = animator->weight_offsets[i];
+        for (u32 j = offset; j < offset + node_num_weights(animator, i); ++j) {
+            dst_weights[j] += (src_weights[j] - bind_weights[j]) * t;
+        }
+    }
+}
+
+// Blends every layer over the bind pose into `locals`. The clips of a layer are averaged one at a time through the
+// scratch poses; the first full weight, unmasked override layer is sampled straight into `locals` instead.
+static void animator_evaluate(Walrus_Animator *animator, Walrus_Model const *model)
+{
+    u32 const               num_nodes     = animator->num_nodes;
+    u32 const               num_weights   = animator->num_weights;
+    Walrus_Transform const *bind          = animator->poses;
+    Walrus_Transform       *layer_pose    = animator->poses + num_nodes;
+    Walrus_Transform       *clip_pose     = animator->poses + num_nodes * 2;
+    f32 const              *bind_weights  = animator->pose_weights;
+    f32                    *layer_weights = animator->pose_weights + num_weights;
+    f32                    *clip_weights  = animator->pose_weights + num_weights * 2;
+
+    memcpy(animator->locals, bind, num_nodes * sizeof(Walrus_Transform));
+    memcpy(animator->weights, bind_weights, num_weights * sizeof(f32));
+
+    bool untouched = true;
+    for (u32 l = 0; l < WR_ANIMATOR_MAX_LAYERS; ++l) {
+        Walrus_AnimatorLayer const *layer = &animator->layers[l];
+        if (layer->weight <= 0) {
+            continue;
+        }
+
+        bool const direct = untouched && layer->blend == WR_ANIMATOR_BLEND_OVERRIDE && layer->weight >= 1 &&
+                            !layer->masked;
+        Walrus_Transform *pose         = direct ? animator->locals : layer_pose;
+        f32              *pose_weights = direct ? animator->weights : layer_weights;
+
+        f32 total = 0;
+        for (u32 i = 0; i < layer->num_clips; ++i) {
+            Walrus_AnimatorClip const *clip = &layer->clips[i];
+            if (clip->weight <= 0 || clip->index >= model->num_animations) {
+                continue;
+            }
+            Walrus_Animation const *animation = &model->animations[clip->index];
+            u32                    *cursors   = clip_cursors(animator, l, i);
+            if (total == 0) {
+                if (!direct) {
+                    memcpy(pose, bind, num_nodes * sizeof(Walrus_Transform));
+                    memcpy(pose_weights, bind_weights, num_weights * sizeof(f32));
                 }
+                clip_sample(animator, animation, clip->timestamp, cursors, pose, pose_weights);
             }
-            break;
-        case WR_ANIMATION_INTERPOLATION_LINEAR:
-            for (u32 i = 0; i < cnt; ++i) {
-                out[i] = prev[i] * (1.0 - factor) + next[i] * factor;
+            else {
+                memcpy(clip_pose, bind, num_nodes * sizeof(Walrus_Transform));
+                memcpy(clip_weights, bind_weights, num_weights * sizeof(f32));
+                clip_sample(animator, animation, clip->timestamp, cursors, clip_pose, clip_weights);
+                pose_override(animator, pose, pose_weights, clip_pose, clip_weights, NULL,
+                              clip->weight / (total + clip->weight));
             }
-            break;
-        case WR_ANIMATION_INTERPOLATION_CUBIC_SPLINE:
-            walrus_assert(false);
-            break;
+            total += clip->weight;
+        }
+        if (total == 0) {
+            continue;
+        }
+        untouched = false;
+        if (direct) {
+            continue;
+        }
+
+        f32 const *mask = layer->masked ? animator->masks + l * num_nodes : NULL;
+        if (layer->blend == WR_ANIMATOR_BLEND_ADDITIVE) {
+            pose_add(animator, animator->locals, animator->weights, pose, pose_weights, mask, layer->weight);
+        }
+        else {
+            pose_override(animator, animator->locals, animator->weights, pose, pose_weights, mask, layer->weight);
+        }
     }
 }
 
+// The hierarchy lists parents before their children, so one pass derives every world transform
 static void animator_apply(Walrus_Animator *animator, Walrus_Model const *model)
 {
-    Walrus_Transform *worlds = walrus_array_get(animator->worlds, 0);
-    Walrus_Transform *locals = walrus_array_get(animator->locals, 0);
-
     for (u32 i = 0; i < model->num_nodes; ++i) {
-        Walrus_ModelNode *node = &model->nodes[i];
-        if (node->parent == NULL) {
-            node_traverse(animator, model, node, worlds, locals);
+        u32 const node   = model->hierarchy[i];
+        u32 const parent = model->parents[node];
+        if (parent == WR_MODEL_INVALID_NODE) {
+            animator->worlds[node] = animator->locals[node];
+        }
+        else {
+            walrus_transform_mul(&animator->worlds[parent], &animator->locals[node], &animator->worlds[node]);
         }
     }
 }
 
 void walrus_animator_init(Walrus_Animator *animator)
 {
-    animator->keys           = walrus_array_create(sizeof(u32), 0);
-    animator->worlds         = walrus_array_create(sizeof(Walrus_Transform), 0);
-    animator->locals         = walrus_array_create(sizeof(Walrus_Transform), 0);
-    animator->weights        = walrus_array_create(sizeof(f32), 0);
-    animator->weight_offsets = walrus_array_create(sizeof(u32), 0);
+    for (u32 i = 0; i < WR_ANIMATOR_MAX_LAYERS; ++i) {
+        Walrus_AnimatorLayer *layer = &animator->layers[i];
+        layer->num_clips            = 0;
+        layer->blend                = WR_ANIMATOR_BLEND_OVERRIDE;
+        layer->weight               = 1;
+        layer->masked               = false;
+    }
+    animator->cursors        = NULL;
+    animator->masks          = NULL;
+    animator->poses          = NULL;
+    animator->worlds         = NULL;
+    animator->locals         = NULL;
+    animator->pose_weights   = NULL;
+    animator->weights        = NULL;
+    animator->weight_offsets = NULL;
+    animator->num_nodes      = 0;
+    animator->num_weights    = 0;
+    animator->num_cursors    = 0;
+    animator->playing        = false;
 }
 
 void walrus_animator_shutdown(Walrus_Animator *animator)
 {
-    walrus_array_destroy(animator->keys);
-    walrus_array_destroy(animator->worlds);
-    walrus_array_destroy(animator->locals);
-    walrus_array_destroy(animator->weights);
-    walrus_array_destroy(animator->weight_offsets);
+    walrus_free(animator->cursors);
+    walrus_free(animator->masks);
+    walrus_free(animator->poses);
+    walrus_free(animator->worlds);
+    walrus_free(animator->locals);
+    walrus_free(animator->pose_weights);
+    walrus_free(animator->weights);
+    walrus_free(animator->weight_offsets);
 }
 
-static void animator_reset(Walrus_Animator *animator, Walrus_Model const *model)
+void walrus_animator_bind(Walrus_Animator *animator, Walrus_Model const *model)
 {
-    animator->timestamp = 0;
-
-    Walrus_Animation const *animation = &model->animations[animator->index];
-    for (u32 i = 0; i < animation->num_channels; ++i) {
-        *(u32 *)walrus_array_get(animator->keys, i) = 0;
+    u32 num_tracks = 0;
+    for (u32 i = 0; i < model->num_animations; ++i) {
+        num_tracks = walrus_max(num_tracks, model->animations[i].num_tracks);
     }
+    animator->num_cursors = walrus_max(num_tracks, 1u);
+
+    u32 const cursors_size = sizeof(u32) * animator->num_cursors * WR_ANIMATOR_MAX_LAYERS * WR_ANIMATOR_MAX_CLIPS;
+    animator->cursors      = walrus_realloc(animator->cursors, cursors_size);
+    memset(animator->cursors, 0, cursors_size);
+
+    u32 const num_nodes = walrus_max(model->num_nodes, 1u);
 
-    Walrus_Transform *locals = walrus_array_get(animator->locals, 0);
-    Walrus_Transform *worlds = walrus_array_get(animator->worlds, 0);
+    animator->num_nodes      = model->num_nodes;
+    animator->masks          = walrus_realloc(animator->masks, sizeof(f32) * num_nodes * WR_ANIMATOR_MAX_LAYERS);
+    animator->poses          = walrus_realloc(animator->poses, sizeof(Walrus_Transform) * num_nodes * 3);
+    animator->worlds         = walrus_realloc(animator->worlds, sizeof(Walrus_Transform) * num_nodes);
+    animator->locals         = walrus_realloc(animator->locals, sizeof(Walrus_Transform) * num_nodes);
+    animator->weight_offsets = walrus_realloc(animator->weight_offsets, sizeof(u32) * num_nodes);
 
-    f32 *weights = walrus_array_get(animator->weights, 0);
-    u32 *offsets = walrus_array_get(animator->weight_offsets, 0);
+    u32 num_weights = 0;
     for (u32 i = 0; i < model->num_nodes; ++i) {
-        Walrus_ModelNode *node = &model->nodes[i];
-        locals[i]              = node->local_transform;
-        worlds[i]              = node->world_transform;
+        animator->weight_offsets[i] = num_weights;
+        if (model->nodes[i].mesh) {
+            num_weights += model->nodes[i].mesh->num_weights;
+        }
+    }
+    animator->num_weights  = num_weights;
+    animator->pose_weights = walrus_realloc(animator->pose_weights, sizeof(f32) * walrus_max(num_weights, 1u) * 3);
+    animator->weights      = walrus_realloc(animator->weights, sizeof(f32) * walrus_max(num_weights, 1u));
+
+    for (u32 i = 0; i < model->num_nodes; ++i) {
+        Walrus_ModelNode const *node = &model->nodes[i];
+        animator->poses[i]           = node->local_transform;
         if (node->mesh) {
-            memcpy(weights + offsets[i], node->mesh->weights, node->mesh->num_weights * sizeof(f32));
+            memcpy(animator->pose_weights + animator->weight_offsets[i], node->mesh->weights,
+                   node->mesh->num_weights * sizeof(f32));
+        }
+    }
+
+    for (u32 i = 0; i < WR_ANIMATOR_MAX_LAYERS; ++i) {
+        Walrus_AnimatorLayer *layer = &animator->layers[i];
+        layer->masked               = false;
+        for (u32 j = 0; j < layer->num_clips; ++j) {
+            layer->clips[j].timestamp = 0;
         }
     }
+
+    animator_evaluate(animator, model);
     animator_apply(animator, model);
 }
 
-void walrus_animator_bind(Walrus_Animator *animator, Walrus_Model const *model)
+void walrus_animator_play(Walrus_Animator *animator, u32 index)
 {
-    if (animator->index < model->num_animations) {
-        Walrus_Animation const *animation = &model->animations[animator->index];
-        walrus_array_resize(animator->keys, animation->num_channels);
+    animator->layers[0].num_clips = 0;
 
-        walrus_array_resize(animator->worlds, model->num_nodes);
-        walrus_array_resize(animator->locals, model->num_nodes);
-        walrus_array_resize(animator->weight_offsets, model->num_nodes);
+    Walrus_AnimatorClip *clip = clip_acquire(animator, 0, index);
+    clip->weight              = 1;
+    clip->target_weight       = 1;
+    animator->playing         = true;
+}
 
-        u32  num_weights = 0;
-        u32 *offsets     = walrus_array_get(animator->weight_offsets, 0);
-        for (u32 i = 0; i < model->num_nodes; ++i) {
-            offsets[i] = num_weights;
-            if (model->nodes[i].mesh) {
-                num_weights += model->nodes[i].mesh->num_weights;
-            }
+void walrus_animator_crossfade(Walrus_Animator *animator, u32 layer, u32 index, f32 duration)
+{
+    walrus_assert(layer < WR_ANIMATOR_MAX_LAYERS);
+
+    Walrus_AnimatorClip *target = clip_acquire(animator, layer, index);
+    for (u32 i = 0; i < animator->layers[layer].num_clips; ++i) {
+        Walrus_AnimatorClip *clip = &animator->layers[layer].clips[i];
+        clip->target_weight       = clip == target ? 1 : 0;
+        if (duration > 0) {
+            clip->fade_speed = 1 / duration;
+        }
+        else {
+            clip->weight     = clip->target_weight;
+            clip->fade_speed = 1;
         }
-
-        walrus_array_resize(animator->weights, num_weights);
-
-        animator_reset(animator, model);
     }
+    animator->playing = true;
 }
 
-void walrus_animator_play(Walrus_Animator *animator, u32 index)
+void walrus_animator_blend(Walrus_Animator *animator, u32 layer, u32 index, f32 weight)
 {
-    animator->index   = index;
-    animator->playing = true;
-    animator->repeat  = true;
+    walrus_assert(layer < WR_ANIMATOR_MAX_LAYERS);
+
+    Walrus_AnimatorClip *clip = clip_acquire(animator, layer, index);
+    clip->weight              = weight;
+    clip->target_weight       = weight;
+    clip->fade_speed          = 0;
+    animator->playing         = true;
 }
 
-static bool animator_update_animation(Walrus_Animator *animator, Walrus_Model const *model)
+void walrus_animator_set_layer(Walrus_Animator *animator, u32 layer, Walrus_AnimatorBlend blend, f32 weight)
 {
-    Walrus_Animation const *animation = &model->animations[animator->index];
-    bool                    update    = false;
-    u32                    *keys      = walrus_array_get(animator->keys, 0);
-    for (u32 i = 0; i < animation->num_channels; ++i) {
-        Walrus_AnimationChannel *channel = &animation->channels[i];
-        Walrus_AnimationSampler *sampler = channel->sampler;
+    walrus_assert(layer < WR_ANIMATOR_MAX_LAYERS);
 
-        u32 const node_index = channel->node - &model->nodes[0];
+    animator->layers[layer].blend  = blend;
+    animator->layers[layer].weight = weight;
+}
 
-        Walrus_Transform *t = walrus_array_get(animator->locals, node_index);
+void walrus_animator_set_mask(Walrus_Animator *animator, u32 layer, f32 const *weights)
+{
+    walrus_assert(layer < WR_ANIMATOR_MAX_LAYERS);
 
-        u32  offset  = *(u32 *)walrus_array_get(animator->weight_offsets, node_index);
-        f32 *weights = walrus_array_get(animator->weights, offset);
+    animator->layers[layer].masked = weights != NULL;
+    if (weights) {
+        memcpy(animator->masks + layer * animator->num_nodes, weights, animator->num_nodes * sizeof(f32));
+    }
+}
 
-        u32 next_frame = keys[i] + 1;
-        for (; next_frame < sampler->num_frames; ++next_frame) {
-            f32 timestamp = sampler->timestamps[next_frame];
-            if (timestamp > animator->timestamp) {
-                break;
-            }
-        }
-        if (next_frame > 0 && next_frame < sampler->num_frames) {
-            u32 prev_frame = next_frame - 1;
-            if (keys[i] != prev_frame) {
-                keys[i] = prev_frame;
-            }
+void walrus_animator_mask_subtree(Walrus_Animator *animator, Walrus_Model const *model, u32 layer,
+                                  Walrus_ModelNode const *node, f32 weight)
+{
+    walrus_assert(layer < WR_ANIMATOR_MAX_LAYERS);
+    u32 const root = node - &model->nodes[0];
+    walrus_assert(root < model->num_nodes);
+
+    f32 *mask = animator->masks + layer * animator->num_nodes;
+    if (!animator->layers[layer].masked) {
+        memset(mask, 0, animator->num_nodes * sizeof(f32));
+        animator->layers[layer].masked = true;
+    }
 
-            f32  prev_timestamp = sampler->timestamps[prev_frame];
-            f32  next_timestamp = sampler->timestamps[next_frame];
-            f32 *prev_data      = &sampler->data[prev_frame * sampler->num_components];
-            f32 *next_data      = &sampler->data[next_frame * sampler->num_components];
-
-            f32 factor = (animator->timestamp - prev_timestamp) / (next_timestamp - prev_timestamp);
-            if (factor > 0) {
-                switch (channel->path) {
-                    case WR_ANIMATION_PATH_TRANSLATION:
-                        interpolate_frame(sampler->interpolation, prev_data, next_data, factor, t->trans,
-                                          sampler->num_components);
-                        update = true;
-                        break;
-                    case WR_ANIMATION_PATH_ROTATION:
-                        interpolate_frame_rot(sampler->interpolation, prev_data, next_data, factor, t->rot);
-                        update = true;
-                        break;
-                    case WR_ANIMATION_PATH_SCALE:
-                        interpolate_frame(sampler->interpolation, prev_data, next_data, factor, t->scale,
-                                          sampler->num_components);
-                        update = true;
-                        break;
-                    case WR_ANIMATION_PATH_WEIGHTS:
-                        interpolate_frame(sampler->interpolation, prev_data, next_data, factor, weights,
-                                          sampler->num_components);
-                        break;
-                    default:
-                        break;
-                }
+    for (u32 i = 0; i < model->num_nodes; ++i) {
+        for (u32 ancestor = i; ancestor != WR_MODEL_INVALID_NODE; ancestor = model->parents[ancestor]) {
+            if (ancestor == root) {
+                mask[i] = weight;
+                break;
             }
         }
     }
-    return update;
 }
 
 void walrus_animator_tick(Walrus_Animator *animator, Walrus_Model const *model, f32 dt)
 {
-    if (animator->index >= model->num_animations) {
+    if (!animator->playing) {
         return;
     }
-    Walrus_Animation const *animation = &model->animations[animator->index];
 
-    if (animator->playing) {
-        if (animator->timestamp > animation->duration) {
-            if (animator->repeat) {
-                animator_reset(animator, model);
-            }
-        }
-        else {
-            animator->timestamp += dt;
-        }
-
-        if (animator_update_animation(animator, model)) {
-            animator_apply(animator, model);
-        }
+    for (u32 i = 0; i < WR_ANIMATOR_MAX_LAYERS; ++i) {
+        layer_advance(animator, model, i, dt);
     }
+
+    animator_evaluate(animator, model);
+    animator_apply(animator, model);
 }
 
 void walrus_animator_transform(Walrus_Animator const *animator, Walrus_Model const *model, Walrus_ModelNode const *node,
@@ -244,7 +771,7 @@ void walrus_animator_transform(Walrus_Animator const *animator, Walrus_Model con
     u32 index = node - &model->nodes[0];
     walrus_assert(index < model->num_nodes);
 
-    walrus_transform_compose(walrus_array_get(animator->worlds, index), transform);
+    walrus_transform_compose(&animator->worlds[index], transform);
 }
 
 void walrus_animator_weights(Walrus_Animator const *animator, Walrus_Model const *model, Walrus_ModelNode const *node,
@@ -253,7 +780,5 @@ void walrus_animator_weights(Walrus_Animator const *animator, Walrus_Model const
     u32 index = node - &model->nodes[0];
     walrus_assert(index < model->num_nodes);
 
-    u32  offset  = *(u32 *)walrus_array_get(animator->weight_offsets, index);
-    f32 *weights = walrus_array_get(animator->weights, offset);
-    memcpy(out_weights, weights, node->mesh->num_weights * sizeof(f32));
+    memcpy(out_weights, animator->weights + animator->weight_offsets[index], node->mesh->num_weights * sizeof(f32));
 }
@@ -0,0 +1,712 @@
+#include <engine/bvh.h>
+#include <core/assert.h>
+#include <core/job.h>
+#include <core/math.h>
+#include <core/memory.h>
+
+#include <float.h>
+#include <string.h>
+
+#define BVH_NULL     UINT32_MAX
+#define BVH_NUM_BINS 16
+
+// Most leaves of a cluster, one word of the visibility bitset
+#define BVH_CLUSTER_SIZE 32
+// Clusters culled by one job
+#define BVH_CLUSTER_GRAIN 16
+// Entries a traversal keeps on the stack of the caller before moving to the heap
+#define BVH_STACK_SIZE 64
+
+enum {
+    BVH_NODE_LEAF    = 1 << 0,
+    BVH_NODE_FREE    = 1 << 1,
+    BVH_NODE_MOVED   = 1 << 2,
+    BVH_NODE_CLUSTER = 1 << 3,
+};
+
+// Leaves are nodes too and never move in the node array, so the index of a leaf is its proxy. A cluster is a subtree
+// whose leaves were given consecutive slots in the box arrays by the last build, starting at `slot`; a leaf keeps its
+// own slot there so that moving it updates the box.
+typedef struct {
+    vec3 min;
+    vec3 max;
+    u32  parent; // Next free node while the node is free
+    u32  children[2];
+    u32  flags;
+    u32  slot;
+    u32  num_leaves;
+    u64  userdata;
+} BvhNode;
+
+// Planes of the frustum still intersecting the node are kept in `mask`, a node fully inside has none left
+typedef struct {
+    u32 node;
+    u32 mask;
+} BvhStackEntry;
+
+// Traversals keep their own stack so that queries on the same tree can run at the same time, a deep tree spills it to
+// the heap
+typedef struct {
+    BvhStackEntry *entries;
+    u32            top;
+    u32            capacity;
+    BvhStackEntry  local[BVH_STACK_SIZE];
+} BvhStack;
+
+struct Walrus_Bvh {
+    BvhNode *nodes;
+    u32      capacity;
+    u32      free_list;
+    u32      root;
+    u32      count;
+
+    u32 *moved;
+    u32  num_moved;
+    u32  moved_capacity;
+
+    // Boxes of the clustered leaves, with the proxy in every slot
+    Walrus_BoundingBoxSoA boxes;
+    u32                  *slot_proxies;
+    u32                   slot_capacity;
+};
+
+static void stack_init(BvhStack *stack)
+{
+    stack->entries  = stack->local;
+    stack->top      = 0;
+    stack->capacity = BVH_STACK_SIZE;
+}
+
+static void stack_release(BvhStack *stack)
+{
+    if (stack->entries != stack->local) {
+        walrus_free(stack->entries);
+    }
+}
+
+static void stack_push(BvhStack *stack, u32 node, u32 mask)
+{
+    if (stack->top == stack->capacity) {
+        u32 const      capacity = stack->capacity * 2;
+        BvhStackEntry *entries  = walrus_new(BvhStackEntry, capacity);
+        memcpy(entries, stack->entries, sizeof(BvhStackEntry) * stack->top);
+        stack_release(stack);
+        stack->entries  = entries;
+        stack->capacity = capacity;
+    }
+    stack->entries[stack->top++] = (BvhStackEntry){node, mask};
+}
+
+static f32 box_area(vec3 const min, vec3 const max)
+{
+    f32 const x = max[0] - min[0];
+    f32 const y = max[1] - min[1];
+    f32 const z = max[2] - min[2];
+    return x * y + y * z + z * x;
+}
+
+static void box_union(vec3 const min0, vec3 const max0, vec3 const min1, vec3 const max1, vec3 min, vec3 max)
+{
+    for (u32 i = 0; i < 3; ++i) {
+        min[i] = walrus_min(min0[i], min1[i]);
+        max[i] = walrus_max(max0[i], max1[i]);
+    }
+}
+
+static f32 union_area(BvhNode const *a, BvhNode const *b)
+{
+    vec3 min, max;
+    box_union(a->min, a->max, b->min, b->max, min, max);
+    return box_area(min, max);
+}
+
+static bool is_leaf(BvhNode const *node)
+{
+    return node->flags & BVH_NODE_LEAF;
+}
+
+static u32 node_alloc(Walrus_Bvh *bvh)
+{
+    if (bvh->free_list == BVH_NULL) {
+        u32 const capacity = walrus_max(bvh->capacity * 2, 64u);
+        bvh->nodes         = walrus_realloc(bvh->nodes, sizeof(BvhNode) * capacity);
+        for (u32 i = bvh->capacity; i < capacity; ++i) {
+            bvh->nodes[i].parent = i + 1 < capacity ? i + 1 : BVH_NULL;
+            bvh->nodes[i].flags  = BVH_NODE_FREE;
+        }
+        bvh->free_list = bvh->capacity;
+        bvh->capacity  = capacity;
+    }
+    u32 const id      = bvh->free_list;
+    BvhNode  *node    = &bvh->nodes[id];
+    bvh->free_list    = node->parent;
+    node->parent      = BVH_NULL;
+    node->children[0] = BVH_NULL;
+    node->children[1] = BVH_NULL;
+    node->flags       = 0;
+    node->slot        = BVH_NULL;
+    node->num_leaves  = 0;
+    node->userdata    = 0;
+    return id;
+}
+
+static void node_free(Walrus_Bvh *bvh, u32 id)
+{
+    bvh->nodes[id].parent = bvh->free_list;
+    bvh->nodes[id].flags  = BVH_NODE_FREE;
+    bvh->free_list        = id;
+}
+
+// Recomputes the bounds of an internal node, returns whether they changed
+static bool node_fit(Walrus_Bvh *bvh, u32 id)
+{
+    BvhNode       *node  = &bvh->nodes[id];
+    BvhNode const *left  = &bvh->nodes[node->children[0]];
+    BvhNode const *right = &bvh->nodes[node->children[1]];
+
+    vec3 min, max;
+    box_union(left->min, left->max, right->min, right->max, min, max);
+    if (glm_vec3_eqv(min, node->min) && glm_vec3_eqv(max, node->max)) {
+        return false;
+    }
+    glm_vec3_copy(min, node->min);
+    glm_vec3_copy(max, node->max);
+    return true;
+}
+
+// Called once a leaf was added or removed below `id`, the clusters above it no longer match their slots
+static void refit_ancestors(Walrus_Bvh *bvh, u32 id)
+{
+    while (id != BVH_NULL) {
+        node_fit(bvh, id);
+        bvh->nodes[id].flags &= ~BVH_NODE_CLUSTER;
+        id = bvh->nodes[id].parent;
+    }
+}
+
+static void insert_leaf(Walrus_Bvh *bvh, u32 leaf)
+{
+    if (bvh->root == BVH_NULL) {
+        bvh->root               = leaf;
+        bvh->nodes[leaf].parent = BVH_NULL;
+        return;
+    }
+
+    // Descend to the sibling with the lowest cost, the area of the new parent plus the growth of its ancestors
+    u32 sibling = bvh->root;
+    while (!is_leaf(&bvh->nodes[sibling])) {
+        BvhNode const *node = &bvh->nodes[sibling];
+        BvhNode const *box  = &bvh->nodes[leaf];
+
+        f32 const area     = box_area(node->min, node->max);
+        f32 const combined = union_area(node, box);
+        f32 const cost     = 2 * combined;
+        f32 const inherit  = 2 * (combined - area);
+
+        f32 child_costs[2];
+        for (u32 i = 0; i < 2; ++i) {
+            BvhNode const *child = &bvh->nodes[node->children[i]];
+            child_costs[i]       = union_area(child, box) + inherit;
+            if (!is_leaf(child)) {
+                child_costs[i] -= box_area(child->min, child->max);
+            }
+        }
+        if (cost < child_costs[0] && cost < child_costs[1]) {
+            break;
+        }
+        sibling = child_costs[0] <= child_costs[1] ? node->children[0] : node->children[1];
+    }
+
+    u32 const old_parent = bvh->nodes[sibling].parent;
+    u32 const new_parent = node_alloc(bvh);
+    BvhNode  *node       = &bvh->nodes[new_parent];
+    node->parent         = old_parent;
+    node->children[0]    = sibling;
+    node->children[1]    = leaf;
+    box_union(bvh->nodes[sibling].min, bvh->nodes[sibling].max, bvh->nodes[leaf].min, bvh->nodes[leaf].max, node->min,
+              node->max);
+
+    if (old_parent == BVH_NULL) {
+        bvh->root = new_parent;
+    }
+    else {
+        BvhNode *parent = &bvh->nodes[old_parent];
+        parent->children[parent->children[0] == sibling ? 0 : 1] = new_parent;
+    }
+    bvh->nodes[sibling].parent = new_parent;
+    bvh->nodes[leaf].parent    = new_parent;
+
+    refit_ancestors(bvh, old_parent);
+}
+
+static void remove_leaf(Walrus_Bvh *bvh, u32 leaf)
+{
+    if (leaf == bvh->root) {
+        bvh->root = BVH_NULL;
+        return;
+    }
+
+    u32 const parent      = bvh->nodes[leaf].parent;
+    u32 const grandparent = bvh->nodes[parent].parent;
+    u32 const sibling     = bvh->nodes[parent].children[bvh->nodes[parent].children[0] == leaf ? 1 : 0];
+
+    bvh->nodes[sibling].parent = grandparent;
+    if (grandparent == BVH_NULL) {
+        bvh->root = sibling;
+    }
+    else {
+        BvhNode *node = &bvh->nodes[grandparent];
+        node->children[node->children[0] == parent ? 0 : 1] = sibling;
+        refit_ancestors(bvh, grandparent);
+    }
+    node_free(bvh, parent);
+}
+
+Walrus_Bvh *walrus_bvh_create(void)
+{
+    Walrus_Bvh *bvh = walrus_new0(Walrus_Bvh, 1);
+    bvh->free_list  = BVH_NULL;
+    bvh->root       = BVH_NULL;
+    return bvh;
+}
+
+void walrus_bvh_destroy(Walrus_Bvh *bvh)
+{
+    walrus_free(bvh->nodes);
+    walrus_free(bvh->moved);
+    walrus_free(bvh->slot_proxies);
+    walrus_bounding_box_soa_free(&bvh->boxes);
+    walrus_free(bvh);
+}
+
+u32 walrus_bvh_insert(Walrus_Bvh *bvh, vec3 const min, vec3 const max, u64 userdata)
+{
+    u32 const leaf = node_alloc(bvh);
+    BvhNode  *node = &bvh->nodes[leaf];
+    glm_vec3_copy((f32 *)min, node->min);
+    glm_vec3_copy((f32 *)max, node->max);
+    node->flags    = BVH_NODE_LEAF;
+    node->userdata = userdata;
+
+    insert_leaf(bvh, leaf);
+    ++bvh->count;
+
+    return leaf;
+}
+
+void walrus_bvh_remove(Walrus_Bvh *bvh, u32 proxy)
+{
+    walrus_assert(proxy < bvh->capacity && is_leaf(&bvh->nodes[proxy]));
+
+    remove_leaf(bvh, proxy);
+    node_free(bvh, proxy);
+    --bvh->count;
+}
+
+void walrus_bvh_update(Walrus_Bvh *bvh, u32 proxy, vec3 const min, vec3 const max)
+{
+    walrus_assert(proxy < bvh->capacity && is_leaf(&bvh->nodes[proxy]));
+
+    BvhNode *node = &bvh->nodes[proxy];
+    glm_vec3_copy((f32 *)min, node->min);
+    glm_vec3_copy((f32 *)max, node->max);
+    if (node->slot != BVH_NULL) {
+        Walrus_BoundingBox box;
+        walrus_bounding_box_from_min_max(&box, min, max);
+        walrus_bounding_box_soa_set(&bvh->boxes, node->slot, &box);
+    }
+    if (node->flags & BVH_NODE_MOVED) {
+        return;
+    }
+    node->flags |= BVH_NODE_MOVED;
+
+    if (bvh->num_moved == bvh->moved_capacity) {
+        bvh->moved_capacity = walrus_max(bvh->moved_capacity * 2, 64u);
+        bvh->moved          = walrus_realloc(bvh->moved, sizeof(u32) * bvh->moved_capacity);
+    }
+    bvh->moved[bvh->num_moved++] = proxy;
+}
+
+void walrus_bvh_refit(Walrus_Bvh *bvh)
+{
+    for (u32 i = 0; i < bvh->num_moved; ++i) {
+        BvhNode *leaf = &bvh->nodes[bvh->moved[i]];
+        // The proxy was removed, or already refit through an earlier entry
+        if ((leaf->flags & (BVH_NODE_LEAF | BVH_NODE_MOVED)) != (BVH_NODE_LEAF | BVH_NODE_MOVED)) {
+            continue;
+        }
+        leaf->flags &= ~BVH_NODE_MOVED;
+
+        // Ancestors above an unchanged node were already fit from its current bounds
+        for (u32 id = leaf->parent; id != BVH_NULL && node_fit(bvh, id); id = bvh->nodes[id].parent) {
+        }
+    }
+    bvh->num_moved = 0;
+}
+
+static f32 leaf_centroid(BvhNode const *node, u32 axis)
+{
+    return (node->min[axis] + node->max[axis]) * 0.5f;
+}
+
+static u32 bin_index(f32 centroid, f32 min, f32 scale)
+{
+    u32 const bin = (u32)((centroid - min) * scale);
+    return walrus_min(bin, BVH_NUM_BINS - 1u);
+}
+
+// Gives the leaves consecutive slots from a new word of the box arrays
+static u32 cluster_assign(Walrus_Bvh *bvh, u32 const *leaves, u32 count)
+{
+    u32 const first = bvh->boxes.count;
+    walrus_bounding_box_soa_resize(&bvh->boxes, first + BVH_CLUSTER_SIZE);
+    if (bvh->boxes.count > bvh->slot_capacity) {
+        bvh->slot_capacity = bvh->boxes.capacity;
+        bvh->slot_proxies  = walrus_realloc(bvh->slot_proxies, sizeof(u32) * bvh->slot_capacity);
+    }
+
+    for (u32 i = 0; i < count; ++i) {
+        BvhNode *leaf = &bvh->nodes[leaves[i]];
+        leaf->slot    = first + i;
+
+        Walrus_BoundingBox box;
+        walrus_bounding_box_from_min_max(&box, leaf->min, leaf->max);
+        walrus_bounding_box_soa_set(&bvh->boxes, leaf->slot, &box);
+        bvh->slot_proxies[leaf->slot] = leaves[i];
+    }
+    return first;
+}
+
+// The first subtree small enough on the way down becomes a cluster, the subtrees below it are built inside it
+static u32 build_range(Walrus_Bvh *bvh, u32 *leaves, u32 count, bool clustered)
+{
+    if (count == 1) {
+        return leaves[0];
+    }
+
+    u32 slot = BVH_NULL;
+    if (!clustered && count <= BVH_CLUSTER_SIZE) {
+        slot      = cluster_assign(bvh, leaves, count);
+        clustered = true;
+    }
+
+    vec3 centroid_min = {FLT_MAX, FLT_MAX, FLT_MAX};
+    vec3 centroid_max = {-FLT_MAX, -FLT_MAX, -FLT_MAX};
+    for (u32 i = 0; i < count; ++i) {
+        for (u32 axis = 0; axis < 3; ++axis) {
+            f32 const c        = leaf_centroid(&bvh->nodes[leaves[i]], axis);
+            centroid_min[axis] = walrus_min(centroid_min[axis], c);
+            centroid_max[axis] = walrus_max(centroid_max[axis], c);
+        }
+    }
+
+    // Binned surface area heuristic, the split minimizes the areas of both sides weighted by their leaf counts
+    u32 best_axis  = 3;
+    u32 best_split = 0;
+    f32 best_cost  = FLT_MAX;
+    for (u32 axis = 0; axis < 3; ++axis) {
+        f32 const extent = centroid_max[axis] - centroid_min[axis];
+        if (extent <= 0) {
+            continue;
+        }
+        f32 const scale = BVH_NUM_BINS / extent;
+
+        struct {
+            vec3 min;
+            vec3 max;
+            u32  count;
+        } bins[BVH_NUM_BINS];
+        for (u32 i = 0; i < BVH_NUM_BINS; ++i) {
+            glm_vec3_fill(bins[i].min, FLT_MAX);
+            glm_vec3_fill(bins[i].max, -FLT_MAX);
+            bins[i].count = 0;
+        }
+        for (u32 i = 0; i < count; ++i) {
+            BvhNode const *node = &bvh->nodes[leaves[i]];
+
+            u32 const bin = bin_index(leaf_centroid(node, axis), centroid_min[axis], scale);
+            box_union(bins[bin].min, bins[bin].max, node->min, node->max, bins[bin].min, bins[bin].max);
+            ++bins[bin].count;
+        }
+
+        f32  right_costs[BVH_NUM_BINS - 1];
+        vec3 min = {FLT_MAX, FLT_MAX, FLT_MAX};
+        vec3 max = {-FLT_MAX, -FLT_MAX, -FLT_MAX};
+        u32  num = 0;
+        for (u32 i = BVH_NUM_BINS - 1; i > 0; --i) {
+            box_union(min, max, bins[i].min, bins[i].max, min, max);
+            num += bins[i].count;
+            right_costs[i - 1] = num > 0 ? box_area(min, max) * num : 0;
+        }
+
+        glm_vec3_fill(min, FLT_MAX);
+        glm_vec3_fill(max, -FLT_MAX);
+        num = 0;
+        for (u32 i = 0; i < BVH_NUM_BINS - 1; ++i) {
+            box_union(min, max, bins[i].min, bins[i].max, min, max);
+            num += bins[i].count;
+            f32 const cost = (num > 0 ? box_area(min, max) * num : 0) + right_costs[i];
+            if (num > 0 && num < count && cost < best_cost) {
+                best_cost  = cost;
+                best_axis  = axis;
+                best_split = i;
+            }
+        }
+    }
+
+    u32 mid = count / 2;
+    if (best_axis < 3) {
+        f32 const scale = BVH_NUM_BINS / (centroid_max[best_axis] - centroid_min[best_axis]);
+
+        mid = 0;
+        for (u32 i = 0; i < count; ++i) {
+            f32 const c = leaf_centroid(&bvh->nodes[leaves[i]], best_axis);
+            if (bin_index(c, centroid_min[best_axis], scale) <= best_split) {
+                u32 const tmp = leaves[i];
+                leaves[i]     = leaves[mid];
+                leaves[mid++] = tmp;
+            }
+        }
+    }
+
+    u32 const id    = node_alloc(bvh);
+    u32 const left  = build_range(bvh, leaves, mid, clustered);
+    u32 const right = build_range(bvh, leaves + mid, count - mid, clustered);
+
+    BvhNode *node            = &bvh->nodes[id];
+    node->children[0]        = left;
+    node->children[1]        = right;
+    node->slot               = slot;
+    node->num_leaves         = count;
+    node->flags              = slot != BVH_NULL ? BVH_NODE_CLUSTER : 0;
+    bvh->nodes[left].parent  = id;
+    bvh->nodes[right].parent = id;
+    box_union(bvh->nodes[left].min, bvh->nodes[left].max, bvh->nodes[right].min, bvh->nodes[right].max, node->min,
+              node->max);
+
+    return id;
+}
+
+void walrus_bvh_build(Walrus_Bvh *bvh)
+{
+    bvh->root        = BVH_NULL;
+    bvh->num_moved   = 0;
+    bvh->boxes.count = 0;
+    if (bvh->count == 0) {
+        return;
+    }
+
+    u32 *leaves = walrus_new(u32, bvh->count);
+    u32  num    = 0;
+    for (u32 i = 0; i < bvh->capacity; ++i) {
+        BvhNode *node = &bvh->nodes[i];
+        if (is_leaf(node)) {
+            node->flags &= ~BVH_NODE_MOVED;
+            node->slot    = BVH_NULL;
+            leaves[num++] = i;
+        }
+        else if (!(node->flags & BVH_NODE_FREE)) {
+            node_free(bvh, i);
+        }
+    }
+    walrus_assert(num == bvh->count);
+
+    bvh->root                    = build_range(bvh, leaves, num, false);
+    bvh->nodes[bvh->root].parent = BVH_NULL;
+
+    walrus_free(leaves);
+}
+
+u32 walrus_bvh_count(Walrus_Bvh const *bvh)
+{
+    return bvh->count;
+}
+
+u32 walrus_bvh_proxy_bound(Walrus_Bvh const *bvh)
+{
+    return bvh->capacity;
+}
+
+u64 walrus_bvh_userdata(Walrus_Bvh const *bvh, u32 proxy)
+{
+    walrus_assert(proxy < bvh->capacity && is_leaf(&bvh->nodes[proxy]));
+
+    return bvh->nodes[proxy].userdata;
+}
+
+// Returns false when the node is behind one of the planes, the planes the node is fully in front of are removed from
+// `mask`
+static bool frustum_classify(BvhNode const *node, Walrus_Plane const *planes, u32 *mask)
+{
+    vec3 center, extends;
+    glm_vec3_add((f32 *)node->min, (f32 *)node->max, center);
+    glm_vec3_scale(center, 0.5f, center);
+    glm_vec3_sub((f32 *)node->max, center, extends);
+
+    for (u32 i = 0, bits = *mask; bits != 0; bits >>= 1, ++i) {
+        u32 const ntz = walrus_u32cnttz(bits);
+        bits >>= ntz;
+        i += ntz;
+
+        Walrus_Plane const *plane = &planes[i];
+
+        f32 const d = walrus_plane_p_dist(plane, center);
+        f32 const r = extends[0] * walrus_abs(plane->normal[0]) + extends[1] * walrus_abs(plane->normal[1]) +
+                      extends[2] * walrus_abs(plane->normal[2]);
+        if (-r > d) {
+            return false;
+        }
+        if (r <= d) {
+            *mask &= ~(1u << i);
+        }
+    }
+    return true;
+}
+
+typedef struct {
+    Walrus_Bvh const     *bvh;
+    Walrus_Frustum const *frustum;
+    BvhStackEntry const  *clusters;
+    u32                  *visibility;
+} ClusterCull;
+
+static void cluster_cull_range(u32 begin, u32 end, void *userdata)
+{
+    ClusterCull const *job = userdata;
+    for (u32 i = begin; i < end; ++i) {
+        BvhNode const *node = &job->bvh->nodes[job->clusters[i].node];
+        walrus_frustum_cull_boxes(job->frustum, &job->bvh->boxes, node->slot, node->slot + node->num_leaves,
+                                  job->visibility);
+    }
+}
+
+// Clusters crossing the frustum are culled leaf by leaf in batches over the box arrays after the traversal, spread
+// over the job system, then reported in the order they were found
+static void cluster_report(Walrus_Bvh const *bvh, Walrus_Frustum const *frustum, BvhStack const *clusters,
+                           Walrus_BvhQueryFunc fn, void *ctx)
+{
+    u32 *visibility = walrus_new(u32, bvh->boxes.count / 32);
+
+    ClusterCull job = {bvh, frustum, clusters->entries, visibility};
+    walrus_parallel_for(0, clusters->top, BVH_CLUSTER_GRAIN, cluster_cull_range, &job);
+
+    for (u32 i = 0; i < clusters->top; ++i) {
+        u32 const first = bvh->nodes[clusters->entries[i].node].slot;
+        for (u32 bits = visibility[first >> 5]; bits != 0; bits &= bits - 1) {
+            u32 const proxy = bvh->slot_proxies[first + walrus_u32cnttz(bits)];
+            fn(proxy, bvh->nodes[proxy].userdata, ctx);
+        }
+    }
+
+    walrus_free(visibility);
+}
+
+void walrus_bvh_query_frustum(Walrus_Bvh const *bvh, Walrus_Frustum const *frustum, Walrus_BvhQueryFunc fn,
+                              void *ctx)
+{
+    if (bvh->root == BVH_NULL) {
+        return;
+    }
+
+    Walrus_Plane const planes[6] = {frustum->left,   frustum->right, frustum->top,
+                                    frustum->bottom, frustum->near,  frustum->far};
+
+    BvhStack stack;
+    BvhStack clusters;
+    stack_init(&stack);
+    stack_init(&clusters);
+
+    stack_push(&stack, bvh->root, 0x3f);
+    while (stack.top > 0) {
+        BvhStackEntry  entry = stack.entries[--stack.top];
+        BvhNode const *node  = &bvh->nodes[entry.node];
+
+        if (entry.mask != 0 && !frustum_classify(node, planes, &entry.mask)) {
+            continue;
+        }
+        if (is_leaf(node)) {
+            fn(entry.node, node->userdata, ctx);
+        }
+        else if ((node->flags & BVH_NODE_CLUSTER) && entry.mask == 0) {
+            for (u32 i = 0; i < node->num_leaves; ++i) {
+                u32 const proxy = bvh->slot_proxies[node->slot + i];
+                fn(proxy, bvh->nodes[proxy].userdata, ctx);
+            }
+        }
+        else if (node->flags & BVH_NODE_CLUSTER) {
+            stack_push(&clusters, entry.node, entry.mask);
+        }
+        else {
+            stack_push(&stack, node->children[1], entry.mask);
+            stack_push(&stack, node->children[0], entry.mask);
+        }
+    }
+
+    if (clusters.top > 0) {
+        cluster_report(bvh, frustum, &clusters, fn, ctx);
+    }
+
+    stack_release(&stack);
+    stack_release(&clusters);
+}
+
+static bool ray_intersect_box(BvhNode const *node, vec3 const origin, vec3 const inv_dir, f32 max_t, f32 *t)
+{
+    f32 t_min = 0;
+    f32 t_max = max_t;
+    for (u32 i = 0; i < 3; ++i) {
+        f32 const t0 = (node->min[i] - origin[i]) * inv_dir[i];
+        f32 const t1 = (node->max[i] - origin[i]) * inv_dir[i];
+        t_min        = walrus_max(t_min, walrus_min(t0, t1));
+        t_max        = walrus_min(t_max, walrus_max(t0, t1));
+    }
+    *t = t_min;
+    return t_min <= t_max;
+}
+
+bool walrus_bvh_raycast(Walrus_Bvh const *bvh, vec3 const origin, vec3 const dir, f32 max_t, Walrus_BvhHit *hit)
+{
+    hit->proxy = WR_BVH_INVALID_PROXY;
+    hit->t     = max_t;
+    if (bvh->root == BVH_NULL) {
+        return false;
+    }
+
+    vec3 const inv_dir = {1.0f / dir[0], 1.0f / dir[1], 1.0f / dir[2]};
+
+    BvhStack stack;
+    stack_init(&stack);
+
+    stack_push(&stack, bvh->root, 0);
+    while (stack.top > 0) {
+        BvhNode const *node = &bvh->nodes[stack.entries[--stack.top].node];
+
+        f32 t;
+        if (!ray_intersect_box(node, origin, inv_dir, hit->t, &t)) {
+            continue;
+        }
+        if (is_leaf(node)) {
+            hit->proxy    = (u32)(node - bvh->nodes);
+            hit->userdata = node->userdata;
+            hit->t        = t;
+            continue;
+        }
+
+        // The nearer child is visited first so that the farther one is more likely to be pruned by the closer hit
+        f32  ts[2];
+        bool hits[2];
+        for (u32 i = 0; i < 2; ++i) {
+            hits[i] = ray_intersect_box(&bvh->nodes[node->children[i]], origin, inv_dir, hit->t, &ts[i]);
+        }
+        u32 const near = hits[0] && hits[1] && ts[1] < ts[0] ? 1 : 0;
+        if (hits[1 - near]) {
+            stack_push(&stack, node->children[1 - near], 0);
+        }
+        if (hits[near]) {
+            stack_push(&stack, node->children[near], 0);
+        }
+    }
+
+    stack_release(&stack);
+    return hit->proxy != WR_BVH_INVALID_PROXY;
+}
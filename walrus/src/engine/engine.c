@@ -2,7 +2,6 @@
 #include <engine/event.h>
 #include <engine/batch_renderer.h>
 #include <engine/shader_library.h>
-#include <engine/thread_pool.h>
 #include <engine/imgui.h>
 #include <engine/system.h>
 #include <engine/systems/transform_system.h>
@@ -22,6 +21,7 @@
 #include <core/memory.h>
 #include <core/thread.h>
 #include <core/mutex.h>
+#include <core/job.h>
 #include <core/string.h>
 
 #include "window_private.h"
@@ -96,7 +96,7 @@ static Walrus_EngineError register_service(void)
         walrus_log_add_fp(s_engine->log_file, opt->log_file_level);
     }
 
-    walrus_thread_pool_init(opt->thread_pool_size);
+    walrus_job_init(opt->thread_pool_size);
 
     walrus_event_init();
 
@@ -120,10 +120,15 @@ static Walrus_EngineError register_service(void)
 
     Walrus_RhiCreateInfo info;
     info.resolution = opt->resolution;
+    info.flags      = WR_RHI_FLAG_NONE;
     if (opt->window_flags & WR_WINDOW_FLAG_OPENGL) {
         info.flags |= WR_RHI_FLAG_OPENGL;
     }
+    else {
+        info.flags |= WR_RHI_FLAG_NULL;
+    }
     info.single_thread = opt->single_thread;
+    info.num_frames    = opt->num_frames;
 
     if (walrus_rhi_init(&info) != WR_RHI_SUCCESS) {
         return WR_ENGINE_INIT_RHI_ERROR;
@@ -167,7 +172,7 @@ static void release_service(void)
 
     walrus_event_shutdown();
 
-    walrus_thread_pool_shutdown();
+    walrus_job_shutdown();
 
     walrus_mutex_destroy(s_engine->log_mutex);
 
@@ -312,6 +317,7 @@ Walrus_AppError walrus_engine_init_run(char const *title, u32 width, u32 height,
     opt.log_file_level    = 0;
     opt.single_thread     = false;
     opt.thread_pool_size  = 8;
+    opt.num_frames        = 3;
 
     Walrus_EngineError err = walrus_engine_init(&opt);
 
@@ -4,6 +4,16 @@
 #include <core/string.h>
 #include <core/log.h>
 #include <core/assert.h>
+#include <core/math.h>
+#include <core/job.h>
+#include <rhi/rhi.h>
+
+#include <string.h>
+
+typedef struct {
+    Walrus_TextureCreateInfo info;
+    Walrus_TextureHandle     handle;
+} PooledTexture;
 
 void node_free(void *ptr)
 {
@@ -11,13 +21,37 @@ void node_free(void *ptr)
     walrus_str_free(node->name);
 }
 
+static void resource_free(void *ptr)
+{
+    Walrus_FrameResource *resource = ptr;
+    walrus_str_free(resource->name);
+}
+
+static void pipeline_release(Walrus_FramePipeline *pipeline)
+{
+    u32 const len = walrus_array_len(pipeline->uses);
+    for (u32 i = 0; i < len; ++i) {
+        Walrus_FrameResourceUse *use = walrus_array_get(pipeline->uses, i);
+        if (use->framebuffer.id != WR_INVALID_HANDLE) {
+            walrus_rhi_destroy_framebuffer(use->framebuffer);
+        }
+    }
+    walrus_array_clear(pipeline->uses);
+    walrus_array_clear(pipeline->schedule);
+    pipeline->num_views  = 0;
+    pipeline->num_levels = 0;
+}
+
 void pipeline_free(void *ptr)
 {
     Walrus_FramePipeline *pipeline = ptr;
+    pipeline_release(pipeline);
     walrus_str_free(pipeline->name);
     walrus_list_free(pipeline->command_list);
     walrus_array_destroy(pipeline->prevs);
     walrus_array_destroy(pipeline->nodes);
+    walrus_array_destroy(pipeline->schedule);
+    walrus_array_destroy(pipeline->uses);
     if (pipeline->destroy_func) {
         pipeline->destroy_func(pipeline->userdata);
     }
@@ -26,15 +60,34 @@ void pipeline_free(void *ptr)
 
 void walrus_fg_init(Walrus_FrameGraph *graph)
 {
-    graph->resources =
-        walrus_hash_table_create_full(walrus_str_hash, walrus_str_equal, (Walrus_KeyDestroyFunc)walrus_str_free, NULL);
     graph->pipelines = walrus_hash_table_create_full(walrus_str_hash, walrus_str_equal, NULL, pipeline_free);
+
+    graph->declarations    = walrus_array_create_full(sizeof(Walrus_FrameResource), 0, resource_free);
+    graph->declaration_ids = walrus_hash_table_create(walrus_str_hash, walrus_str_equal);
+    graph->pool            = walrus_array_create(sizeof(PooledTexture), 0);
+    graph->blackboard      = NULL;
+    graph->current         = NULL;
+    graph->first_view      = 0;
+}
+
+static void pool_release(Walrus_FrameGraph *graph)
+{
+    u32 const len = walrus_array_len(graph->pool);
+    for (u32 i = 0; i < len; ++i) {
+        PooledTexture *texture = walrus_array_get(graph->pool, i);
+        walrus_rhi_destroy_texture(texture->handle);
+    }
+    walrus_array_clear(graph->pool);
 }
 
 void walrus_fg_shutdown(Walrus_FrameGraph *graph)
 {
-    walrus_hash_table_destroy(graph->resources);
     walrus_hash_table_destroy(graph->pipelines);
+    pool_release(graph);
+    walrus_array_destroy(graph->pool);
+    walrus_hash_table_destroy(graph->declaration_ids);
+    walrus_array_destroy(graph->declarations);
+    walrus_free(graph->blackboard);
 }
 
 Walrus_FramePipeline *walrus_fg_add_pipeline(Walrus_FrameGraph *graph, char const *name)
@@ -50,7 +103,12 @@ Walrus_FramePipeline *walrus_fg_add_pipeline_full(Walrus_FrameGraph *graph, char
     pipeline->prevs                = walrus_array_create(sizeof(Walrus_FramePipeline *), 0);
     pipeline->command_list         = walrus_list_alloc();
     pipeline->nodes                = walrus_array_create_full(sizeof(Walrus_FrameNode), 0, node_free);
+    pipeline->schedule             = walrus_array_create(sizeof(Walrus_FrameNode), 0);
+    pipeline->num_views            = 0;
+    pipeline->num_levels           = 0;
+    pipeline->uses                 = walrus_array_create(sizeof(Walrus_FrameResourceUse), 0);
     pipeline->destroy_func         = callback;
+    pipeline->prepare_func         = NULL;
     pipeline->userdata             = userdata;
 
     walrus_hash_table_insert(graph->pipelines, pipeline->name, pipeline);
@@ -72,37 +130,195 @@ void walrus_fg_connect_pipeline(Walrus_FramePipeline *parent, Walrus_FramePipeli
     walrus_array_append(child->prevs, &parent);
 }
 
-void walrus_fg_add_node(Walrus_FramePipeline *pipeline, Walrus_FrameNodeCallback func, char const *name)
+void walrus_fg_set_prepare(Walrus_FramePipeline *pipeline, Walrus_PipelinePrepareCallback callback)
+{
+    pipeline->prepare_func = callback;
+}
+
+u32 walrus_fg_add_node(Walrus_FramePipeline *pipeline, Walrus_FrameNodeCallback func, char const *name)
 {
     Walrus_FrameNode node = {.name = walrus_str_dup(name), .index = walrus_array_len(pipeline->nodes), .func = func};
 
     walrus_array_append(pipeline->nodes, &node);
+
+    return node.index;
+}
+
+void walrus_fg_node_read(Walrus_FramePipeline *pipeline, u32 node, u32 resource)
+{
+    Walrus_FrameNode *n = walrus_array_get(pipeline->nodes, node);
+    walrus_assert_msg(n->num_reads < WR_FG_MAX_NODE_RESOURCES, "frame node %s reads too many resources", n->name);
+    n->reads[n->num_reads++] = resource;
+}
+
+void walrus_fg_node_write(Walrus_FramePipeline *pipeline, u32 node, u32 resource)
+{
+    Walrus_FrameNode *n = walrus_array_get(pipeline->nodes, node);
+    walrus_assert_msg(n->num_writes < WR_FG_MAX_NODE_RESOURCES, "frame node %s writes too many resources", n->name);
+    n->writes[n->num_writes++] = resource;
+}
+
+void walrus_fg_node_views(Walrus_FramePipeline *pipeline, u32 node, u8 num)
+{
+    Walrus_FrameNode *n = walrus_array_get(pipeline->nodes, node);
+    n->num_views        = num;
+}
+
+void walrus_fg_node_parallel(Walrus_FramePipeline *pipeline, u32 node)
+{
+    Walrus_FrameNode *n = walrus_array_get(pipeline->nodes, node);
+    n->parallel         = true;
+}
+
+static u32 declare_resource(Walrus_FrameGraph *graph, char const *name, Walrus_FrameResourceType type,
+                            Walrus_FrameResource **resource)
+{
+    if (walrus_hash_table_contains(graph->declaration_ids, name)) {
+        u32 const id = walrus_ptr_to_val(walrus_hash_table_lookup(graph->declaration_ids, name));
+        *resource    = walrus_array_get(graph->declarations, id);
+        walrus_assert_msg((*resource)->type == type, "frame resource %s is declared with another type", name);
+        return id;
+    }
+
+    u32 const            id       = walrus_array_len(graph->declarations);
+    Walrus_FrameResource declared = {.name = walrus_str_dup(name), .type = type};
+    walrus_array_append(graph->declarations, &declared);
+    graph->blackboard     = walrus_realloc(graph->blackboard, (id + 1) * sizeof(u64));
+    graph->blackboard[id] = 0;
+    *resource = walrus_array_get(graph->declarations, id);
+    walrus_hash_table_insert(graph->declaration_ids, (*resource)->name, walrus_val_to_ptr(id));
+    return id;
+}
+
+u32 walrus_fg_create_texture(Walrus_FrameGraph *graph, char const *name, Walrus_TextureCreateInfo const *info)
+{
+    Walrus_FrameResource *resource;
+    u32 const             id = declare_resource(graph, name, WR_FG_RESOURCE_TEXTURE, &resource);
+    resource->imported       = false;
+    resource->texture        = *info;
+    return id;
+}
+
+u32 walrus_fg_create_framebuffer(Walrus_FrameGraph *graph, char const *name, u32 const *attachments, u8 num)
+{
+    walrus_assert(num <= WR_FG_MAX_ATTACHMENTS);
+
+    Walrus_FrameResource *resource;
+    u32 const             id = declare_resource(graph, name, WR_FG_RESOURCE_FRAMEBUFFER, &resource);
+    resource->imported       = false;
+    memcpy(resource->framebuffer.attachments, attachments, num * sizeof(u32));
+    resource->framebuffer.num_attachments = num;
+    return id;
+}
+
+u32 walrus_fg_create_data(Walrus_FrameGraph *graph, char const *name)
+{
+    Walrus_FrameResource *resource;
+    return declare_resource(graph, name, WR_FG_RESOURCE_DATA, &resource);
+}
+
+u32 walrus_fg_import_texture(Walrus_FrameGraph *graph, char const *name, Walrus_TextureHandle handle)
+{
+    Walrus_FrameResource *resource;
+    u32 const             id = declare_resource(graph, name, WR_FG_RESOURCE_TEXTURE, &resource);
+    resource->imported       = true;
+    resource->handle         = handle.id;
+    return id;
+}
+
+u32 walrus_fg_import_framebuffer(Walrus_FrameGraph *graph, char const *name, Walrus_FramebufferHandle handle,
+                                 u32 const *attachments, u8 num)
+{
+    walrus_assert(num <= WR_FG_MAX_ATTACHMENTS);
+
+    Walrus_FrameResource *resource;
+    u32 const             id = declare_resource(graph, name, WR_FG_RESOURCE_FRAMEBUFFER, &resource);
+    resource->imported       = true;
+    resource->handle         = handle.id;
+    if (num > 0) {
+        memcpy(resource->framebuffer.attachments, attachments, num * sizeof(u32));
+    }
+    resource->framebuffer.num_attachments = num;
+    return id;
+}
+
+u32 walrus_fg_lookup_resource(Walrus_FrameGraph *graph, char const *name)
+{
+    if (walrus_hash_table_contains(graph->declaration_ids, name)) {
+        return walrus_ptr_to_val(walrus_hash_table_lookup(graph->declaration_ids, name));
+    }
+    else {
+        return WR_FG_INVALID_RESOURCE;
+    }
+}
+
+static Walrus_FrameResourceUse *resource_use(Walrus_FramePipeline *pipeline, u32 resource)
+{
+    if (pipeline == NULL || resource >= walrus_array_len(pipeline->uses)) {
+        return NULL;
+    }
+    return walrus_array_get(pipeline->uses, resource);
+}
+
+static Walrus_TextureHandle texture_of(Walrus_FrameGraph *graph, Walrus_FramePipeline *pipeline, u32 resource)
+{
+    Walrus_FrameResource *declared = walrus_array_get(graph->declarations, resource);
+    walrus_assert(declared->type == WR_FG_RESOURCE_TEXTURE);
+    if (declared->imported) {
+        return (Walrus_TextureHandle){declared->handle};
+    }
+
+    Walrus_FrameResourceUse *use = resource_use(pipeline, resource);
+    if (use == NULL || use->physical == WR_FG_INVALID_RESOURCE) {
+        return (Walrus_TextureHandle){WR_INVALID_HANDLE};
+    }
+    return ((PooledTexture *)walrus_array_get(graph->pool, use->physical))->handle;
+}
+
+Walrus_TextureHandle walrus_fg_texture(Walrus_FrameGraph *graph, u32 resource)
+{
+    return texture_of(graph, graph->current, resource);
+}
+
+Walrus_FramebufferHandle walrus_fg_framebuffer(Walrus_FrameGraph *graph, u32 resource)
+{
+    Walrus_FrameResource *declared = walrus_array_get(graph->declarations, resource);
+    walrus_assert(declared->type == WR_FG_RESOURCE_FRAMEBUFFER);
+    if (declared->imported) {
+        return (Walrus_FramebufferHandle){declared->handle};
+    }
+
+    Walrus_FrameResourceUse *use = resource_use(graph->current, resource);
+    return use == NULL ? (Walrus_FramebufferHandle){WR_INVALID_HANDLE} : use->framebuffer;
 }
 
 void walrus_fg_clear(Walrus_FrameGraph *graph)
 {
     walrus_hash_table_remove_all(graph->pipelines);
-    walrus_hash_table_remove_all(graph->resources);
+    pool_release(graph);
+    walrus_hash_table_remove_all(graph->declaration_ids);
+    walrus_array_clear(graph->declarations);
+    graph->current = NULL;
 }
 
-void walrus_fg_write(Walrus_FrameGraph *graph, char const *name, u64 handle)
+void walrus_fg_write(Walrus_FrameGraph *graph, u32 resource, u64 value)
 {
-    walrus_hash_table_insert(graph->resources, walrus_str_dup(name), walrus_val_to_ptr(handle));
+    graph->blackboard[resource] = value;
 }
 
-void walrus_fg_write_ptr(Walrus_FrameGraph *graph, char const *name, void *ptr)
+void walrus_fg_write_ptr(Walrus_FrameGraph *graph, u32 resource, void *ptr)
 {
-    walrus_hash_table_insert(graph->resources, walrus_str_dup(name), ptr);
+    graph->blackboard[resource] = walrus_ptr_to_val(ptr);
 }
 
-u64 walrus_fg_read(Walrus_FrameGraph const *graph, char const *name)
+u64 walrus_fg_read(Walrus_FrameGraph const *graph, u32 resource)
 {
-    return walrus_ptr_to_val(walrus_hash_table_lookup(graph->resources, name));
+    return graph->blackboard[resource];
 }
 
-void *walrus_fg_read_ptr(Walrus_FrameGraph const *graph, char const *name)
+void *walrus_fg_read_ptr(Walrus_FrameGraph const *graph, u32 resource)
 {
-    return walrus_hash_table_lookup(graph->resources, name);
+    return walrus_val_to_ptr(graph->blackboard[resource]);
 }
 
 static Walrus_List *insert_pipeline_to_list(Walrus_List *command_list, Walrus_FramePipeline *p)
@@ -122,40 +338,397 @@ static Walrus_List *insert_pipeline_to_list(Walrus_List *command_list, Walrus_Fr
     return command_list;
 }
 
+// The resource and, for a framebuffer, its attachments
+static u8 expand_access(Walrus_FrameGraph *graph, u32 resource, u32 *ids)
+{
+    Walrus_FrameResource *declared = walrus_array_get(graph->declarations, resource);
+    u8                    num      = 0;
+    ids[num++]                     = resource;
+    if (declared->type == WR_FG_RESOURCE_FRAMEBUFFER) {
+        for (u8 i = 0; i < declared->framebuffer.num_attachments; ++i) {
+            ids[num++] = declared->framebuffer.attachments[i];
+        }
+    }
+    return num;
+}
+
+static bool texture_info_equal(Walrus_TextureCreateInfo const *a, Walrus_TextureCreateInfo const *b)
+{
+    if (a->ratio != b->ratio) {
+        return false;
+    }
+    // Ratio sized textures follow the back buffer whatever their size says
+    if (a->ratio == WR_RHI_RATIO_COUNT &&
+        (a->width != b->width || a->height != b->height || a->depth != b->depth || a->num_layers != b->num_layers ||
+         a->cube_map != b->cube_map)) {
+        return false;
+    }
+    return a->format == b->format && a->num_mipmaps == b->num_mipmaps && a->flags == b->flags;
+}
+
+static void schedule_levels(Walrus_FrameGraph *graph, Walrus_Array *schedule)
+{
+    u32 const num_resources = walrus_array_len(graph->declarations);
+    u32 const len           = walrus_array_len(schedule);
+
+    // Level + 1 of the last node writing every resource, and of the last one reading it since then
+    u32 *written = walrus_new0(u32, num_resources + 1);
+    u32 *read    = walrus_new0(u32, num_resources + 1);
+    u32  ids[WR_FG_MAX_ATTACHMENTS + 1];
+    for (u32 i = 0; i < len; ++i) {
+        Walrus_FrameNode *node = walrus_array_get(schedule, i);
+
+        node->level = 0;
+        for (u8 j = 0; j < node->num_reads; ++j) {
+            u8 const num = expand_access(graph, node->reads[j], ids);
+            for (u8 k = 0; k < num; ++k) {
+                node->level = walrus_max(node->level, written[ids[k]]);
+            }
+        }
+        for (u8 j = 0; j < node->num_writes; ++j) {
+            u8 const num = expand_access(graph, node->writes[j], ids);
+            for (u8 k = 0; k < num; ++k) {
+                node->level = walrus_max(node->level, walrus_max(written[ids[k]], read[ids[k]]));
+            }
+        }
+
+        for (u8 j = 0; j < node->num_reads; ++j) {
+            u8 const num = expand_access(graph, node->reads[j], ids);
+            for (u8 k = 0; k < num; ++k) {
+                read[ids[k]] = walrus_max(read[ids[k]], node->level + 1);
+            }
+        }
+        for (u8 j = 0; j < node->num_writes; ++j) {
+            u8 const num = expand_access(graph, node->writes[j], ids);
+            for (u8 k = 0; k < num; ++k) {
+                written[ids[k]] = node->level + 1;
+                read[ids[k]]    = 0;
+            }
+        }
+    }
+    walrus_free(written);
+    walrus_free(read);
+
+    // Stable so that a level keeps the order the nodes were declared in
+    for (u32 i = 1; i < len; ++i) {
+        Walrus_FrameNode node = *(Walrus_FrameNode *)walrus_array_get(schedule, i);
+        u32              j    = i;
+        for (; j > 0 && ((Walrus_FrameNode *)walrus_array_get(schedule, j - 1))->level > node.level; --j) {
+            *(Walrus_FrameNode *)walrus_array_get(schedule, j) = *(Walrus_FrameNode *)walrus_array_get(schedule, j - 1);
+        }
+        *(Walrus_FrameNode *)walrus_array_get(schedule, j) = node;
+    }
+}
+
+static void pipeline_schedule(Walrus_FrameGraph *graph, Walrus_FramePipeline *pipeline)
+{
+    u32 const num_resources = walrus_array_len(graph->declarations);
+
+    Walrus_Array *nodes = walrus_array_create(sizeof(Walrus_FrameNode *), 0);
+    for (Walrus_List *p = pipeline->command_list; p != NULL; p = p->next) {
+        Walrus_FramePipeline *cur = p->data;
+        u32 const             len = walrus_array_len(cur->nodes);
+        for (u32 i = 0; i < len; ++i) {
+            Walrus_FrameNode *node = walrus_array_get(cur->nodes, i);
+            walrus_array_append(nodes, &node);
+        }
+    }
+
+    // Walk backward from the imported resources, a node is needed once a later needed node reads what it writes
+    u32 const num_nodes = walrus_array_len(nodes);
+    bool     *keep      = walrus_new0(bool, num_nodes);
+    bool     *needed    = walrus_new0(bool, num_resources + 1);
+    u32       ids[WR_FG_MAX_ATTACHMENTS + 1];
+    for (u32 i = num_nodes; i-- > 0;) {
+        Walrus_FrameNode *node = *(Walrus_FrameNode **)walrus_array_get(nodes, i);
+
+        keep[i] = node->num_writes == 0;
+        for (u8 j = 0; j < node->num_writes && !keep[i]; ++j) {
+            u8 const num = expand_access(graph, node->writes[j], ids);
+            for (u8 k = 0; k < num && !keep[i]; ++k) {
+                Walrus_FrameResource *declared = walrus_array_get(graph->declarations, ids[k]);
+                keep[i]                        = declared->imported || needed[ids[k]];
+            }
+        }
+        for (u8 j = 0; j < node->num_reads && keep[i]; ++j) {
+            u8 const num = expand_access(graph, node->reads[j], ids);
+            for (u8 k = 0; k < num; ++k) {
+                needed[ids[k]] = true;
+            }
+        }
+    }
+
+    // Every pipeline runs its own copy of the nodes
+    for (u32 i = 0; i < num_nodes; ++i) {
+        Walrus_FrameNode *node = *(Walrus_FrameNode **)walrus_array_get(nodes, i);
+        if (!keep[i]) {
+            walrus_trace("frame graph culls node %s from pipeline %s", node->name, pipeline->name);
+            continue;
+        }
+        Walrus_FrameNode copy = *node;
+        copy.encoder          = NULL;
+        walrus_array_append(pipeline->schedule, &copy);
+    }
+    schedule_levels(graph, pipeline->schedule);
+
+    walrus_array_resize(pipeline->uses, num_resources);
+    for (u32 i = 0; i < num_resources; ++i) {
+        Walrus_FrameResourceUse *use = walrus_array_get(pipeline->uses, i);
+        *use = (Walrus_FrameResourceUse){UINT32_MAX, 0, WR_FG_INVALID_RESOURCE, {WR_INVALID_HANDLE}};
+    }
+
+    // Views are reserved in level order, the gpu runs them by id and a texture shared by two levels must see all the
+    // views of the first one before those of the second
+    u32 const len        = walrus_array_len(pipeline->schedule);
+    pipeline->num_levels = 0;
+    pipeline->num_views  = 0;
+    for (u32 i = 0; i < len; ++i) {
+        Walrus_FrameNode *node = walrus_array_get(pipeline->schedule, i);
+        pipeline->num_levels   = node->level + 1;
+        node->view_offset      = pipeline->num_views;
+        pipeline->num_views += node->num_views;
+        for (u8 j = 0; j < node->num_reads + node->num_writes; ++j) {
+            u32 const resource = j < node->num_reads ? node->reads[j] : node->writes[j - node->num_reads];
+            u8 const  num      = expand_access(graph, resource, ids);
+            for (u8 k = 0; k < num; ++k) {
+                Walrus_FrameResourceUse *use = walrus_array_get(pipeline->uses, ids[k]);
+                use->first                   = walrus_min(use->first, node->level);
+                use->last                    = walrus_max(use->last, node->level);
+            }
+        }
+    }
+
+    walrus_free(needed);
+    walrus_free(keep);
+    walrus_array_destroy(nodes);
+}
+
+// Transient textures in order of first use take the first pooled texture with the same descriptor that no live
+// texture of this pipeline holds, the pool is shared between pipelines since they never execute interleaved.
+// Lifetimes count in levels, so that nodes running together never share a texture.
+static void pipeline_allocate(Walrus_FrameGraph *graph, Walrus_FramePipeline *pipeline)
+{
+    u32 const num_resources = walrus_array_len(graph->declarations);
+
+    // Level after the last use of every pooled texture by this pipeline
+    Walrus_Array *busy = walrus_array_create(sizeof(u32), walrus_array_len(graph->pool));
+    for (u32 i = 0; i < walrus_array_len(busy); ++i) {
+        *(u32 *)walrus_array_get(busy, i) = 0;
+    }
+
+    for (u32 level = 0; level < pipeline->num_levels; ++level) {
+        for (u32 i = 0; i < num_resources; ++i) {
+            Walrus_FrameResource    *declared = walrus_array_get(graph->declarations, i);
+            Walrus_FrameResourceUse *use      = walrus_array_get(pipeline->uses, i);
+            if (use->first != level || declared->imported || declared->type != WR_FG_RESOURCE_TEXTURE) {
+                continue;
+            }
+
+            u32 const len = walrus_array_len(graph->pool);
+            for (u32 j = 0; j < len && use->physical == WR_FG_INVALID_RESOURCE; ++j) {
+                PooledTexture *texture = walrus_array_get(graph->pool, j);
+                u32 const      end     = *(u32 *)walrus_array_get(busy, j);
+                if (end <= level && texture_info_equal(&texture->info, &declared->texture)) {
+                    use->physical = j;
+                }
+            }
+            if (use->physical == WR_FG_INVALID_RESOURCE) {
+                PooledTexture texture = {declared->texture, walrus_rhi_create_texture(&declared->texture, NULL)};
+                u32           end     = 0;
+                use->physical         = len;
+                walrus_array_append(graph->pool, &texture);
+                walrus_array_append(busy, &end);
+            }
+            *(u32 *)walrus_array_get(busy, use->physical) = use->last + 1;
+        }
+    }
+    walrus_array_destroy(busy);
+
+    for (u32 i = 0; i < num_resources; ++i) {
+        Walrus_FrameResource    *declared = walrus_array_get(graph->declarations, i);
+        Walrus_FrameResourceUse *use      = walrus_array_get(pipeline->uses, i);
+        if (use->first == UINT32_MAX || declared->imported || declared->type != WR_FG_RESOURCE_FRAMEBUFFER) {
+            continue;
+        }
+
+        Walrus_Attachment attachments[WR_FG_MAX_ATTACHMENTS] = {0};
+        for (u8 j = 0; j < declared->framebuffer.num_attachments; ++j) {
+            attachments[j].handle = texture_of(graph, pipeline, declared->framebuffer.attachments[j]);
+            attachments[j].access = WR_RHI_ACCESS_WRITE;
+        }
+        use->framebuffer = walrus_rhi_create_framebuffer(attachments, declared->framebuffer.num_attachments);
+    }
+}
+
 static void construct_pipeline_command(void const *key, void *value, void *userdata)
 {
     walrus_unused(key);
-    walrus_unused(userdata);
     Walrus_FramePipeline *target = value;
+    Walrus_FrameGraph    *graph  = userdata;
 
     walrus_list_free(target->command_list);
     target->command_list = insert_pipeline_to_list(NULL, target);
+
+    pipeline_release(target);
+    pipeline_schedule(graph, target);
+    pipeline_allocate(graph, target);
 }
 
 void walrus_fg_compile(Walrus_FrameGraph *graph)
 {
-    // TODO: some prerender optimization?
+    pool_release(graph);
+
+    walrus_hash_table_foreach(graph->pipelines, construct_pipeline_command, graph);
+}
+
+void walrus_fg_execute(Walrus_FrameGraph *graph, char const *name)
+{
+    walrus_fg_execute_pipeline(graph, walrus_fg_lookup_pipeline(graph, name), 0);
+}
+
+// Copies of the parallel nodes of a level that got an encoder, the jobs of a batch run them
+typedef struct {
+    Walrus_FrameGraph *graph;
+    Walrus_FrameNode   nodes[WR_RHI_MAX_ENCODERS - 1];
+    u32                num_nodes;
+} ParallelBatch;
 
-    walrus_hash_table_foreach(graph->pipelines, construct_pipeline_command, NULL);
+static void execute_parallel(u32 begin, u32 end, void *userdata)
+{
+    ParallelBatch *batch = userdata;
+    for (u32 i = begin; i < end; ++i) {
+        batch->nodes[i].func(batch->graph, &batch->nodes[i]);
+    }
 }
 
-static void foreach_node_execute(void *ptr, void *userdata)
+// Begins the encoders of the parallel nodes from `begin` in schedule order and returns the end of the nodes that got
+// one. Taking them before the jobs start gives every node the same slot each frame, and recording into a copy of the
+// node leaves the schedule to the other executions of the pipeline.
+static u32 encoders_begin(Walrus_FrameGraph *graph, ParallelBatch *batch, u32 begin, u32 end)
 {
-    Walrus_FrameNode  *node  = ptr;
-    Walrus_FrameGraph *graph = userdata;
-    node->func(graph, node);
+    batch->graph     = graph;
+    batch->num_nodes = 0;
+    // Encoder 0 belongs to the immediate api
+    for (; begin < end && batch->num_nodes < walrus_count_of(batch->nodes); ++begin) {
+        Walrus_FrameNode const *node = walrus_array_get(graph->current->schedule, begin);
+        if (node->parallel) {
+            Walrus_RhiEncoder *encoder = walrus_rhi_begin_encoder();
+            if (encoder == NULL) {
+                break;
+            }
+            batch->nodes[batch->num_nodes]           = *node;
+            batch->nodes[batch->num_nodes++].encoder = encoder;
+        }
+    }
+    return begin;
 }
 
-void walrus_fg_execute(Walrus_FrameGraph *graph, char const *name)
+static void encoders_end(ParallelBatch *batch)
+{
+    for (u32 i = 0; i < batch->num_nodes; ++i) {
+        walrus_rhi_end_encoder(batch->nodes[i].encoder);
+    }
+}
+
+static void execute_serial(Walrus_FrameGraph *graph, u32 begin, u32 end, Walrus_RhiEncoder *encoder)
 {
-    Walrus_FramePipeline *target = walrus_fg_lookup_pipeline(graph, name);
+    for (; begin < end; ++begin) {
+        Walrus_FrameNode node = *(Walrus_FrameNode *)walrus_array_get(graph->current->schedule, begin);
+        if (node.parallel) {
+            node.encoder = encoder;
+            node.func(graph, &node);
+        }
+    }
+}
 
-    Walrus_List *p = target->command_list;
-    walrus_assert(p != NULL);
+void walrus_fg_execute_pipeline(Walrus_FrameGraph *graph, Walrus_FramePipeline *target, u16 first_view)
+{
+    walrus_assert(target->command_list != NULL);
 
-    while (p != NULL) {
-        Walrus_FramePipeline *cur = p->data;
-        walrus_array_foreach(cur->nodes, foreach_node_execute, graph);
-        p = p->next;
+    graph->current    = target;
+    graph->first_view = first_view;
+
+    ParallelBatch batch;
+    u32 const     len = walrus_array_len(target->schedule);
+    for (u32 begin = 0, end = 0; begin < len; begin = end) {
+        u32 const level        = ((Walrus_FrameNode *)walrus_array_get(target->schedule, begin))->level;
+        bool      has_parallel = false;
+        for (; end < len; ++end) {
+            Walrus_FrameNode *node = walrus_array_get(target->schedule, end);
+            if (node->level != level) {
+                break;
+            }
+            has_parallel |= node->parallel;
+        }
+
+        for (u32 i = begin, next = begin; has_parallel && i < end; i = next) {
+            next = encoders_begin(graph, &batch, i, end);
+            if (batch.num_nodes == 0) {
+                // No encoder is free, the rest of the level records on the caller's one by one
+                execute_serial(graph, i, end, walrus_rhi_immediate_encoder());
+                break;
+            }
+            walrus_parallel_for(0, batch.num_nodes, 1, execute_parallel, &batch);
+            encoders_end(&batch);
+        }
+        for (u32 i = begin; i < end; ++i) {
+            Walrus_FrameNode *node = walrus_array_get(target->schedule, i);
+            if (!node->parallel) {
+                node->func(graph, node);
+            }
+        }
     }
+
+    graph->current = NULL;
+}
+
+void walrus_fg_execute_pipeline_encoder(Walrus_FrameGraph *graph, Walrus_FramePipeline *target, u16 first_view,
+                                        Walrus_RhiEncoder *encoder)
+{
+    walrus_assert(target->command_list != NULL);
+
+    graph->current    = target;
+    graph->first_view = first_view;
+
+    u32 const len = walrus_array_len(target->schedule);
+    for (u32 i = 0; i < len; ++i) {
+        Walrus_FrameNode node = *(Walrus_FrameNode *)walrus_array_get(target->schedule, i);
+        walrus_assert_msg(node.parallel, "frame node %s does not record through its encoder", node.name);
+        node.encoder = encoder;
+        node.func(graph, &node);
+    }
+
+    graph->current = NULL;
+}
+
+void walrus_fg_prepare_pipeline(Walrus_FrameGraph *graph, Walrus_FramePipeline *target)
+{
+    for (Walrus_List *p = target->command_list; p != NULL; p = p->next) {
+        Walrus_FramePipeline *pipeline = p->data;
+        if (pipeline->prepare_func) {
+            pipeline->prepare_func(graph, pipeline->userdata);
+        }
+    }
+}
+
+void walrus_fg_fork(Walrus_FrameGraph const *graph, Walrus_FrameGraph *execution)
+{
+    u32 const num_resources = walrus_array_len(graph->declarations);
+    u64      *blackboard    = walrus_realloc(execution->blackboard, walrus_max(num_resources, 1) * sizeof(u64));
+    memcpy(blackboard, graph->blackboard, num_resources * sizeof(u64));
+
+    *execution            = *graph;
+    execution->blackboard = blackboard;
+    execution->current    = NULL;
+}
+
+void walrus_fg_fork_release(Walrus_FrameGraph *execution)
+{
+    walrus_free(execution->blackboard);
+    execution->blackboard = NULL;
+}
+
+u16 walrus_fg_view_id(Walrus_FrameGraph const *graph, Walrus_FrameNode const *node)
+{
+    return graph->first_view + node->view_offset;
 }
@@ -1,5 +1,23 @@
 #include <engine/geometry.h>
+#include <core/assert.h>
+#include <core/job.h>
 #include <core/math.h>
+#include <core/memory.h>
+
+#include <string.h>
+
+#if defined(__AVX__)
+#include <immintrin.h>
+#define CULL_SIMD_WIDTH 8
+#elif defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+#include <emmintrin.h>
+#define CULL_SIMD_WIDTH 4
+#else
+#define CULL_SIMD_WIDTH 1
+#endif
+
+// Boxes per chunk of the parallel culling, in words of the visibility bitset
+#define CULL_GRAIN_WORDS 32
 
 f32 walrus_plane_p_dist(Walrus_Plane const *plane, vec3 const p)
 {
@@ -50,3 +68,184 @@ void walrus_bounding_box_transform(Walrus_BoundingBox *box, mat4 const transform
     };
     glm_vec3_copy(extends, box->extends);
 }
+
+void walrus_bounding_box_soa_init(Walrus_BoundingBoxSoA *boxes)
+{
+    memset(boxes, 0, sizeof(Walrus_BoundingBoxSoA));
+}
+
+void walrus_bounding_box_soa_free(Walrus_BoundingBoxSoA *boxes)
+{
+    walrus_free(boxes->center[0]);
+    walrus_bounding_box_soa_init(boxes);
+}
+
+void walrus_bounding_box_soa_resize(Walrus_BoundingBoxSoA *boxes, u32 count)
+{
+    if (count > boxes->capacity) {
+        // All six arrays share one allocation that starts at center[0]
+        u32 const capacity = walrus_stride_align(walrus_max(count, boxes->capacity * 2), 32);
+        f32      *data     = walrus_new0(f32, capacity * 6);
+        f32      *old      = boxes->center[0];
+        for (u32 i = 0; i < 3; ++i) {
+            f32 *center  = data + capacity * i;
+            f32 *extends = data + capacity * (i + 3);
+            if (boxes->capacity > 0) {
+                memcpy(center, boxes->center[i], sizeof(f32) * boxes->capacity);
+                memcpy(extends, boxes->extends[i], sizeof(f32) * boxes->capacity);
+            }
+            boxes->center[i]  = center;
+            boxes->extends[i] = extends;
+        }
+        walrus_free(old);
+        boxes->capacity = capacity;
+    }
+    boxes->count = count;
+}
+
+void walrus_bounding_box_soa_set(Walrus_BoundingBoxSoA *boxes, u32 index, Walrus_BoundingBox const *box)
+{
+    for (u32 i = 0; i < 3; ++i) {
+        boxes->center[i][index]  = box->center[i];
+        boxes->extends[i][index] = box->extends[i];
+    }
+}
+
+typedef struct {
+    f32 normal[3];
+    f32 abs_normal[3];
+    f32 dist;
+} CullPlane;
+
+static void cull_planes(Walrus_Frustum const *frustum, CullPlane *planes)
+{
+    Walrus_Plane const *src[6] = {&frustum->left, &frustum->right,  &frustum->top,
+                                  &frustum->bottom, &frustum->near, &frustum->far};
+    for (u32 i = 0; i < 6; ++i) {
+        for (u32 j = 0; j < 3; ++j) {
+            planes[i].normal[j]     = src[i]->normal[j];
+            planes[i].abs_normal[j] = walrus_abs(src[i]->normal[j]);
+        }
+        planes[i].dist = src[i]->dist;
+    }
+}
+
+// Same test as walrus_bounding_box_intersect_or_front_plane, a box is visible if it is not fully behind any plane
+static u32 cull_word(CullPlane const *planes, Walrus_BoundingBoxSoA const *boxes, u32 first)
+{
+    f32 const *cx = boxes->center[0] + first;
+    f32 const *cy = boxes->center[1] + first;
+    f32 const *cz = boxes->center[2] + first;
+    f32 const *ex = boxes->extends[0] + first;
+    f32 const *ey = boxes->extends[1] + first;
+    f32 const *ez = boxes->extends[2] + first;
+
+    u32 bits = 0;
+#if CULL_SIMD_WIDTH == 8
+    for (u32 i = 0; i < 32; i += 8) {
+        __m256 const x  = _mm256_loadu_ps(cx + i);
+        __m256 const y  = _mm256_loadu_ps(cy + i);
+        __m256 const z  = _mm256_loadu_ps(cz + i);
+        __m256 const hx = _mm256_loadu_ps(ex + i);
+        __m256 const hy = _mm256_loadu_ps(ey + i);
+        __m256 const hz = _mm256_loadu_ps(ez + i);
+
+        __m256 visible = _mm256_castsi256_ps(_mm256_set1_epi32(-1));
+        for (u32 p = 0; p < 6; ++p) {
+            CullPlane const *plane = &planes[p];
+
+            __m256 d = _mm256_mul_ps(x, _mm256_set1_ps(plane->normal[0]));
+            d        = _mm256_add_ps(d, _mm256_mul_ps(y, _mm256_set1_ps(plane->normal[1])));
+            d        = _mm256_add_ps(d, _mm256_mul_ps(z, _mm256_set1_ps(plane->normal[2])));
+            d        = _mm256_sub_ps(d, _mm256_set1_ps(plane->dist));
+
+            __m256 r = _mm256_mul_ps(hx, _mm256_set1_ps(plane->abs_normal[0]));
+            r        = _mm256_add_ps(r, _mm256_mul_ps(hy, _mm256_set1_ps(plane->abs_normal[1])));
+            r        = _mm256_add_ps(r, _mm256_mul_ps(hz, _mm256_set1_ps(plane->abs_normal[2])));
+
+            __m256 const neg_r = _mm256_sub_ps(_mm256_setzero_ps(), r);
+            visible            = _mm256_and_ps(visible, _mm256_cmp_ps(neg_r, d, _CMP_LE_OQ));
+        }
+        bits |= (u32)_mm256_movemask_ps(visible) << i;
+    }
+#elif CULL_SIMD_WIDTH == 4
+    for (u32 i = 0; i < 32; i += 4) {
+        __m128 const x  = _mm_loadu_ps(cx + i);
+        __m128 const y  = _mm_loadu_ps(cy + i);
+        __m128 const z  = _mm_loadu_ps(cz + i);
+        __m128 const hx = _mm_loadu_ps(ex + i);
+        __m128 const hy = _mm_loadu_ps(ey + i);
+        __m128 const hz = _mm_loadu_ps(ez + i);
+
+        __m128 visible = _mm_castsi128_ps(_mm_set1_epi32(-1));
+        for (u32 p = 0; p < 6; ++p) {
+            CullPlane const *plane = &planes[p];
+
+            __m128 d = _mm_mul_ps(x, _mm_set1_ps(plane->normal[0]));
+            d        = _mm_add_ps(d, _mm_mul_ps(y, _mm_set1_ps(plane->normal[1])));
+            d        = _mm_add_ps(d, _mm_mul_ps(z, _mm_set1_ps(plane->normal[2])));
+            d        = _mm_sub_ps(d, _mm_set1_ps(plane->dist));
+
+            __m128 r = _mm_mul_ps(hx, _mm_set1_ps(plane->abs_normal[0]));
+            r        = _mm_add_ps(r, _mm_mul_ps(hy, _mm_set1_ps(plane->abs_normal[1])));
+            r        = _mm_add_ps(r, _mm_mul_ps(hz, _mm_set1_ps(plane->abs_normal[2])));
+
+            __m128 const neg_r = _mm_sub_ps(_mm_setzero_ps(), r);
+            visible            = _mm_and_ps(visible, _mm_cmple_ps(neg_r, d));
+        }
+        bits |= (u32)_mm_movemask_ps(visible) << i;
+    }
+#else
+    for (u32 i = 0; i < 32; ++i) {
+        bool visible = true;
+        for (u32 p = 0; p < 6 && visible; ++p) {
+            CullPlane const *plane = &planes[p];
+
+            f32 const d = cx[i] * plane->normal[0] + cy[i] * plane->normal[1] + cz[i] * plane->normal[2] - plane->dist;
+            f32 const r = ex[i] * plane->abs_normal[0] + ey[i] * plane->abs_normal[1] + ez[i] * plane->abs_normal[2];
+            visible     = -r <= d;
+        }
+        bits |= (u32)visible << i;
+    }
+#endif
+    return bits;
+}
+
+void walrus_frustum_cull_boxes(Walrus_Frustum const *frustum, Walrus_BoundingBoxSoA const *boxes, u32 begin, u32 end,
+                               u32 *visibility)
+{
+    walrus_assert_msg((begin & 31) == 0, "Culling range must start on a word of the bitset");
+    walrus_assert(end <= boxes->count);
+
+    CullPlane planes[6];
+    cull_planes(frustum, planes);
+
+    // The arrays are padded to whole words, the bits past `end` are cleared instead of testing a partial word
+    for (u32 first = begin; first < end; first += 32) {
+        u32 bits = cull_word(planes, boxes, first);
+        if (end - first < 32) {
+            bits &= (1u << (end - first)) - 1;
+        }
+        visibility[first >> 5] = bits;
+    }
+}
+
+typedef struct {
+    Walrus_Frustum const        *frustum;
+    Walrus_BoundingBoxSoA const *boxes;
+    u32                         *visibility;
+} CullJob;
+
+static void cull_words(u32 begin, u32 end, void *userdata)
+{
+    CullJob const *job = userdata;
+    walrus_frustum_cull_boxes(job->frustum, job->boxes, begin * 32, walrus_min(end * 32, job->boxes->count),
+                              job->visibility);
+}
+
+void walrus_frustum_cull_boxes_parallel(Walrus_Frustum const *frustum, Walrus_BoundingBoxSoA const *boxes,
+                                        u32 *visibility)
+{
+    CullJob job = {frustum, boxes, visibility};
+    walrus_parallel_for(0, (boxes->count + 31) / 32, CULL_GRAIN_WORDS, cull_words, &job);
+}
@@ -4,59 +4,127 @@
 #include <core/log.h>
 #include <core/string.h>
 #include <core/memory.h>
+#include <core/math.h>
 #include <rhi/rhi.h>
 
 #include <string.h>
 
-static Walrus_MaterialProperty *property_get_or_create(Walrus_Material *material, char const *name,
-                                                       Walrus_MaterialPropertyType type)
+// std140 size and alignment of a value, a bool is stored as a 4 bytes integer
+static u32 property_size(Walrus_MaterialPropertyType type)
 {
-    Walrus_MaterialProperty *p = NULL;
-    if (walrus_hash_table_contains(material->table, name)) {
-        u32 id = walrus_ptr_to_val(walrus_hash_table_lookup(material->table, name));
-        p      = &material->properties[id];
+    switch (type) {
+        case WR_MATERIAL_PROPERTY_BOOL:
+        case WR_MATERIAL_PROPERTY_FLOAT:
+            return 4;
+        case WR_MATERIAL_PROPERTY_VEC3:
+            return 12;
+        case WR_MATERIAL_PROPERTY_VEC4:
+            return 16;
+        case WR_MATERIAL_PROPERTY_TEXTURE2D:
+            break;
+    }
+    return 0;
+}
+
+static u32 property_align(Walrus_MaterialPropertyType type)
+{
+    return type == WR_MATERIAL_PROPERTY_VEC3 ? 16 : property_size(type);
+}
+
+// Materials with bytes left to upload, linked through their next_dirty
+static Walrus_Material *s_dirty = NULL;
+
+static void material_mark_dirty(Walrus_Material *material, u32 begin, u32 end)
+{
+    if (material->dirty_begin == material->dirty_end) {
+        material->dirty_begin = begin;
+        material->dirty_end   = end;
+        material->next_dirty  = s_dirty;
+        s_dirty               = material;
     }
     else {
-        u32 id  = material->num_properties++;
-        p       = &material->properties[id];
-        p->name = walrus_str_dup(name);
-        p->type = type;
-
-        Walrus_UniformType utype;
-        switch (p->type) {
-            case WR_MATERIAL_PROPERTY_BOOL:
-                utype = WR_RHI_UNIFORM_BOOL;
-                break;
-            case WR_MATERIAL_PROPERTY_FLOAT:
-                utype = WR_RHI_UNIFORM_FLOAT;
-                break;
-            case WR_MATERIAL_PROPERTY_VEC4:
-                utype = WR_RHI_UNIFORM_VEC4;
-                break;
-            case WR_MATERIAL_PROPERTY_TEXTURE2D:
-                utype = WR_RHI_UNIFORM_SAMPLER;
-                break;
-        }
-        p->uni = walrus_rhi_create_uniform(name, utype, 1);
+        material->dirty_begin = walrus_min(material->dirty_begin, begin);
+        material->dirty_end   = walrus_max(material->dirty_end, end);
+    }
+}
+
+// Copies the value into the block and marks the bytes it covers for the next flush
+static void property_write(Walrus_Material *material, Walrus_MaterialProperty const *p)
+{
+    u32 const size = property_size(p->type);
+    u8       *dst  = &material->block[p->offset];
+    switch (p->type) {
+        case WR_MATERIAL_PROPERTY_BOOL: {
+            u32 const value = p->boolean;
+            memcpy(dst, &value, sizeof(u32));
+        } break;
+        case WR_MATERIAL_PROPERTY_FLOAT:
+        case WR_MATERIAL_PROPERTY_VEC3:
+        case WR_MATERIAL_PROPERTY_VEC4:
+            memcpy(dst, p->vector, size);
+            break;
+        case WR_MATERIAL_PROPERTY_TEXTURE2D:
+            return;
+    }
+    material_mark_dirty(material, p->offset, p->offset + size);
+}
+
+// Reserves the slot of the property, after every slot taken so far unless it is given one
+static void property_place(Walrus_Material *material, Walrus_MaterialProperty *p, u32 offset)
+{
+    if (p->type == WR_MATERIAL_PROPERTY_TEXTURE2D) {
+        p->offset              = offset == UINT32_MAX ? material->num_textures : offset;
+        material->num_textures = walrus_max(material->num_textures, p->offset + 1);
+    }
+    else {
+        u32 const align = property_align(p->type);
+        p->offset       = offset == UINT32_MAX ? (material->block_size + align - 1) / align * align : offset;
+        walrus_assert_msg(p->offset % align == 0 && p->offset + property_size(p->type) <= WR_MATERIAL_BLOCK_SIZE,
+                          "material property %s does not fit the block at %u", p->name, p->offset);
+        material->block_size = walrus_max(material->block_size, p->offset + property_size(p->type));
+    }
+}
+
+static Walrus_MaterialProperty *property_create(Walrus_Material *material, char const *name,
+                                                Walrus_MaterialPropertyType type, u32 offset)
+{
+    walrus_assert_msg(material->num_properties < WR_MATERIAL_MAX_PROPERTIES, "too many material properties");
 
-        walrus_hash_table_insert(material->table, p->name, walrus_val_to_ptr(id));
+    u32                      id = material->num_properties++;
+    Walrus_MaterialProperty *p  = &material->properties[id];
+    p->name                     = walrus_str_dup(name);
+    p->type                     = type;
+    memset(p->vector, 0, sizeof(vec4));
+    if (type == WR_MATERIAL_PROPERTY_TEXTURE2D) {
+        p->texture.handle.id = WR_INVALID_HANDLE;
     }
+    property_place(material, p, offset);
+
+    walrus_hash_table_insert(material->table, p->name, walrus_val_to_ptr(id));
 
     return p;
 }
 
+static Walrus_MaterialProperty *property_get_or_create(Walrus_Material *material, char const *name,
+                                                       Walrus_MaterialPropertyType type)
+{
+    if (walrus_hash_table_contains(material->table, name)) {
+        u32 id = walrus_ptr_to_val(walrus_hash_table_lookup(material->table, name));
+        return &material->properties[id];
+    }
+    return property_create(material, name, type, UINT32_MAX);
+}
+
 static void property_destroy(Walrus_MaterialProperty *p)
 {
     walrus_str_free(p->name);
-    walrus_rhi_destroy_uniform(p->uni);
 }
 
 static void refresh_table(Walrus_Material *material)
 {
     walrus_hash_table_remove_all(material->table);
     for (u32 i = 0; i < material->num_properties; ++i) {
-        Walrus_MaterialProperty *p = &material->properties[i];
-        walrus_hash_table_insert(material->table, p->name, walrus_val_to_ptr(i));
+        walrus_hash_table_insert(material->table, material->properties[i].name, walrus_val_to_ptr(i));
     }
 }
 
@@ -64,6 +132,21 @@ void walrus_material_init(Walrus_Material *material)
 {
     material->table          = walrus_hash_table_create(walrus_str_hash, walrus_str_equal);
     material->num_properties = 0;
+    material->block_size     = 0;
+    material->num_textures   = 0;
+    material->dirty_begin    = 0;
+    material->dirty_end      = 0;
+    material->next_dirty     = NULL;
+    memset(material->block, 0, sizeof(material->block));
+    material->buffer = walrus_rhi_create_buffer(material->block, sizeof(material->block), WR_RHI_BUFFER_UNIFORM_BLOCK);
+}
+
+void walrus_material_reserve(Walrus_Material *material, char const *name, Walrus_MaterialPropertyType type,
+                             u32 offset)
+{
+    walrus_assert_msg(!walrus_hash_table_contains(material->table, name), "material property %s is already placed",
+                      name);
+    property_create(material, name, type, offset);
 }
 
 void walrus_material_shutdown(Walrus_Material *material)
@@ -72,6 +155,26 @@ void walrus_material_shutdown(Walrus_Material *material)
         property_destroy(&material->properties[i]);
     }
     walrus_hash_table_destroy(material->table);
+    walrus_rhi_destroy_buffer(material->buffer);
+
+    if (material->dirty_begin != material->dirty_end) {
+        Walrus_Material **link = &s_dirty;
+        while (*link != material) {
+            link = &(*link)->next_dirty;
+        }
+        *link = material->next_dirty;
+    }
+}
+
+void walrus_material_flush(void)
+{
+    for (Walrus_Material *material = s_dirty; material != NULL; material = material->next_dirty) {
+        walrus_rhi_update_buffer(material->buffer, material->dirty_begin,
+                                 material->dirty_end - material->dirty_begin, &material->block[material->dirty_begin]);
+        material->dirty_begin = 0;
+        material->dirty_end   = 0;
+    }
+    s_dirty = NULL;
 }
 
 void walrus_material_set_texture(Walrus_Material *material, char const *name, Walrus_TextureHandle texture, bool srgb)
@@ -118,30 +221,41 @@ void walrus_material_set_bool(Walrus_Material *material, char const *name, bool
 {
     Walrus_MaterialProperty *p = property_get_or_create(material, name, WR_MATERIAL_PROPERTY_BOOL);
     p->boolean                 = value;
+    property_write(material, p);
 }
 
 void walrus_material_set_float(Walrus_Material *material, char const *name, f32 value)
 {
     Walrus_MaterialProperty *p = property_get_or_create(material, name, WR_MATERIAL_PROPERTY_FLOAT);
     p->vector[0]               = value;
+    property_write(material, p);
 }
 
 void walrus_material_set_vec3(Walrus_Material *material, char const *name, vec3 value)
 {
-    Walrus_MaterialProperty *p = property_get_or_create(material, name, WR_MATERIAL_PROPERTY_VEC4);
+    Walrus_MaterialProperty *p = property_get_or_create(material, name, WR_MATERIAL_PROPERTY_VEC3);
     glm_vec3_copy(value, p->vector);
+    property_write(material, p);
 }
 
 void walrus_material_set_vec4(Walrus_Material *material, char const *name, vec4 value)
 {
     Walrus_MaterialProperty *p = property_get_or_create(material, name, WR_MATERIAL_PROPERTY_VEC4);
     glm_vec4_copy(value, p->vector);
+    property_write(material, p);
 }
 
 bool walrus_material_remove(Walrus_Material *material, char const *name)
 {
+    // The other properties keep their slots, the value only leaves zeros behind
     if (walrus_hash_table_contains(material->table, name)) {
-        u32 id = walrus_ptr_to_val(walrus_hash_table_lookup(material->table, name));
+        u32                      id = walrus_ptr_to_val(walrus_hash_table_lookup(material->table, name));
+        Walrus_MaterialProperty *p  = &material->properties[id];
+        if (p->type != WR_MATERIAL_PROPERTY_TEXTURE2D) {
+            memset(p->vector, 0, sizeof(vec4));
+            property_write(material, p);
+        }
+        property_destroy(p);
         memcpy(&material->properties[id], &material->properties[material->num_properties - 1],
                sizeof(Walrus_MaterialProperty));
 
@@ -154,12 +268,7 @@ bool walrus_material_remove(Walrus_Material *material, char const *name)
     return false;
 }
 
-typedef struct {
-    u32              unit;
-    Walrus_Material *material;
-} SubmitData;
-
-void walrus_material_submit(Walrus_Material *material)
+static u64 material_state(Walrus_Material const *material)
 {
     u64 flags = WR_RHI_STATE_DEFAULT;
 
@@ -169,25 +278,44 @@ void walrus_material_submit(Walrus_Material *material)
     if (material->alpha_mode == WR_ALPHA_MODE_BLEND) {
         flags |= WR_RHI_STATE_BLEND_ALPHA;
     }
-    walrus_rhi_set_state(flags, 0);
-    u32 unit = 0;
+    return flags;
+}
+
+// std140 rounds the size of a block up to a vec4
+static u32 material_block_size(Walrus_Material const *material)
+{
+    return (material->block_size + 15) & ~15u;
+}
+
+void walrus_material_submit(Walrus_Material const *material)
+{
+    walrus_rhi_set_state(material_state(material), 0);
+
+    if (material->block_size > 0) {
+        walrus_rhi_set_block_buffer(WR_MATERIAL_BLOCK_BINDING, material->buffer, 0, material_block_size(material));
+    }
+
+    for (u32 i = 0; i < material->num_properties; ++i) {
+        Walrus_MaterialProperty const *p = &material->properties[i];
+        if (p->type == WR_MATERIAL_PROPERTY_TEXTURE2D && p->texture.handle.id != WR_INVALID_HANDLE) {
+            walrus_rhi_set_texture(p->offset, p->texture.handle);
+        }
+    }
+}
+
+void walrus_material_encoder_submit(Walrus_RhiEncoder *encoder, Walrus_Material const *material)
+{
+    walrus_rhi_encoder_set_state(encoder, material_state(material), 0);
+
+    if (material->block_size > 0) {
+        walrus_rhi_encoder_set_block_buffer(encoder, WR_MATERIAL_BLOCK_BINDING, material->buffer, 0,
+                                            material_block_size(material));
+    }
+
     for (u32 i = 0; i < material->num_properties; ++i) {
-        Walrus_MaterialProperty *p = &material->properties[i];
-        switch (p->type) {
-            case WR_MATERIAL_PROPERTY_BOOL:
-                walrus_rhi_set_uniform(p->uni, 0, sizeof(bool), &p->boolean);
-                break;
-            case WR_MATERIAL_PROPERTY_FLOAT:
-                walrus_rhi_set_uniform(p->uni, 0, sizeof(f32), p->vector);
-                break;
-            case WR_MATERIAL_PROPERTY_VEC4:
-                walrus_rhi_set_uniform(p->uni, 0, sizeof(vec4), p->vector);
-                break;
-            case WR_MATERIAL_PROPERTY_TEXTURE2D:
-                walrus_rhi_set_uniform(p->uni, 0, sizeof(u32), &unit);
-                walrus_rhi_set_texture(unit, p->texture.handle);
-                ++unit;
-                break;
+        Walrus_MaterialProperty const *p = &material->properties[i];
+        if (p->type == WR_MATERIAL_PROPERTY_TEXTURE2D && p->texture.handle.id != WR_INVALID_HANDLE) {
+            walrus_rhi_encoder_set_texture(encoder, p->offset, p->texture.handle);
         }
     }
 }
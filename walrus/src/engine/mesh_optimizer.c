@@ -0,0 +1,734 @@
+#include <engine/mesh_optimizer.h>
+#include <core/math.h>
+#include <core/memory.h>
+#include <core/sort.h>
+
+#include <float.h>
+#include <math.h>
+#include <string.h>
+
+#define MESH_NONE UINT32_MAX
+
+// A vertex is in the cache if it was added by one of the last `cache_size` misses
+typedef struct {
+    u32 *stamps;
+    u32  time;
+    u32  size;
+} VertexCache;
+
+static void cache_init(VertexCache *cache, u32 num_vertices, u32 cache_size)
+{
+    cache->stamps = walrus_new0(u32, walrus_max(num_vertices, 1u));
+    cache->size   = cache_size;
+    cache->time   = cache_size + 1;
+}
+
+static void cache_reset(VertexCache *cache)
+{
+    cache->time += cache->size + 1;
+}
+
+static u32 cache_access(VertexCache *cache, u32 vertex)
+{
+    if (cache->time - cache->stamps[vertex] > cache->size) {
+        cache->stamps[vertex] = cache->time++;
+        return 1;
+    }
+    return 0;
+}
+
+static u32 cache_triangle(VertexCache *cache, u32 const *triangle)
+{
+    return cache_access(cache, triangle[0]) + cache_access(cache, triangle[1]) + cache_access(cache, triangle[2]);
+}
+
+f32 walrus_mesh_acmr(u32 const *indices, u32 num_indices, u32 num_vertices, u32 cache_size)
+{
+    u32 const num_triangles = num_indices / 3;
+    if (num_triangles == 0) {
+        return 0;
+    }
+
+    VertexCache cache;
+    cache_init(&cache, num_vertices, cache_size);
+    u32 misses = 0;
+    for (u32 i = 0; i < num_triangles; ++i) {
+        misses += cache_triangle(&cache, &indices[i * 3]);
+    }
+    walrus_free(cache.stamps);
+
+    return (f32)misses / num_triangles;
+}
+
+static u64 vertex_hash(Walrus_MeshStream const *streams, u32 num_streams, u32 vertex)
+{
+    u64 hash = 0xcbf29ce484222325ull;
+    for (u32 i = 0; i < num_streams; ++i) {
+        u8 const *bytes = (u8 const *)streams[i].data + (u64)vertex * streams[i].stride;
+        for (u32 j = 0; j < streams[i].size; ++j) {
+            hash = (hash ^ bytes[j]) * 0x100000001b3ull;
+        }
+    }
+    return hash;
+}
+
+static bool vertex_equal(Walrus_MeshStream const *streams, u32 num_streams, u32 a, u32 b)
+{
+    for (u32 i = 0; i < num_streams; ++i) {
+        u8 const *data = streams[i].data;
+        if (memcmp(data + (u64)a * streams[i].stride, data + (u64)b * streams[i].stride, streams[i].size) != 0) {
+            return false;
+        }
+    }
+    return true;
+}
+
+u32 walrus_mesh_generate_remap(u32 *remap, u32 const *indices, u32 num_indices, u32 num_vertices,
+                               Walrus_MeshStream const *streams, u32 num_streams)
+{
+    for (u32 i = 0; i < num_vertices; ++i) {
+        remap[i] = WR_MESH_UNUSED_VERTEX;
+    }
+
+    // Open addressing over the first vertex of every unique value
+    u32 capacity = 1;
+    while (capacity < num_vertices * 2) {
+        capacity <<= 1;
+    }
+    u32 *table = walrus_new(u32, capacity);
+    for (u32 i = 0; i < capacity; ++i) {
+        table[i] = MESH_NONE;
+    }
+
+    u32 num_unique = 0;
+    for (u32 i = 0; i < num_indices; ++i) {
+        u32 const vertex = indices[i];
+        if (remap[vertex] != WR_MESH_UNUSED_VERTEX) {
+            continue;
+        }
+
+        u32 slot = vertex_hash(streams, num_streams, vertex) & (capacity - 1);
+        while (table[slot] != MESH_NONE && !vertex_equal(streams, num_streams, table[slot], vertex)) {
+            slot = (slot + 1) & (capacity - 1);
+        }
+        if (table[slot] == MESH_NONE) {
+            table[slot]   = vertex;
+            remap[vertex] = num_unique++;
+        }
+        else {
+            remap[vertex] = remap[table[slot]];
+        }
+    }
+    walrus_free(table);
+
+    return num_unique;
+}
+
+void walrus_mesh_remap_indices(u32 *dst, u32 const *indices, u32 num_indices, u32 const *remap)
+{
+    for (u32 i = 0; i < num_indices; ++i) {
+        dst[i] = remap[indices[i]];
+    }
+}
+
+void walrus_mesh_remap_vertices(void *dst, u32 dst_stride, Walrus_MeshStream const *stream, u32 num_vertices,
+                                u32 const *remap)
+{
+    u8       *out = dst;
+    u8 const *in  = stream->data;
+    for (u32 i = 0; i < num_vertices; ++i) {
+        if (remap[i] != WR_MESH_UNUSED_VERTEX) {
+            memcpy(out + (u64)remap[i] * dst_stride, in + (u64)i * stream->stride, stream->size);
+        }
+    }
+}
+
+// Triangles around every vertex, `live` counts those not emitted yet
+typedef struct {
+    u32 *offsets;
+    u32 *triangles;
+    u32 *live;
+} Adjacency;
+
+static void adjacency_init(Adjacency *adjacency, u32 const *indices, u32 num_indices, u32 num_vertices)
+{
+    adjacency->offsets   = walrus_new0(u32, (num_vertices + 1));
+    adjacency->triangles = walrus_new(u32, walrus_max(num_indices, 1u));
+    adjacency->live      = walrus_new0(u32, walrus_max(num_vertices, 1u));
+
+    for (u32 i = 0; i < num_indices; ++i) {
+        ++adjacency->live[indices[i]];
+    }
+    for (u32 i = 0; i < num_vertices; ++i) {
+        adjacency->offsets[i + 1] = adjacency->offsets[i] + adjacency->live[i];
+    }
+
+    // Filled through the starts of the lists, then shifted back
+    for (u32 i = 0; i < num_indices; ++i) {
+        adjacency->triangles[adjacency->offsets[indices[i]]++] = i / 3;
+    }
+    for (u32 i = num_vertices; i > 0; --i) {
+        adjacency->offsets[i] = adjacency->offsets[i - 1];
+    }
+    adjacency->offsets[0] = 0;
+}
+
+static void adjacency_shutdown(Adjacency *adjacency)
+{
+    walrus_free(adjacency->offsets);
+    walrus_free(adjacency->triangles);
+    walrus_free(adjacency->live);
+}
+
+// The candidate that stays in the cache the longest after its own fan, then the latest vertex left with triangles
+static u32 next_fan(Adjacency const *adjacency, VertexCache const *cache, u32 const *candidates, u32 num_candidates,
+                    u32 *dead_ends, u32 *num_dead_ends, u32 *cursor, u32 num_vertices)
+{
+    u32 best     = MESH_NONE;
+    i64 priority = -1;
+    for (u32 i = 0; i < num_candidates; ++i) {
+        u32 const vertex = candidates[i];
+        u32 const live   = adjacency->live[vertex];
+        if (live == 0) {
+            continue;
+        }
+        u32 const age = cache->time - cache->stamps[vertex];
+        i64 const p   = age + 2 * live <= cache->size ? age : 0;
+        if (p > priority) {
+            priority = p;
+            best     = vertex;
+        }
+    }
+    if (best != MESH_NONE) {
+        return best;
+    }
+
+    while (*num_dead_ends > 0) {
+        u32 const vertex = dead_ends[--*num_dead_ends];
+        if (adjacency->live[vertex] > 0) {
+            return vertex;
+        }
+    }
+
+    for (; *cursor < num_vertices; ++*cursor) {
+        if (adjacency->live[*cursor] > 0) {
+            return *cursor;
+        }
+    }
+    return MESH_NONE;
+}
+
+void walrus_mesh_optimize_vertex_cache(u32 *dst, u32 const *indices, u32 num_indices, u32 num_vertices,
+                                       u32 cache_size)
+{
+    u32 const num_triangles = num_indices / 3;
+    num_indices             = num_triangles * 3;
+
+    Adjacency adjacency;
+    adjacency_init(&adjacency, indices, num_indices, num_vertices);
+    VertexCache cache;
+    cache_init(&cache, num_vertices, cache_size);
+
+    bool *emitted       = walrus_new0(bool, walrus_max(num_triangles, 1u));
+    u32  *dead_ends     = walrus_new(u32, walrus_max(num_indices, 1u));
+    u32  *candidates    = walrus_new(u32, walrus_max(num_indices, 1u));
+    u32   num_dead_ends = 0;
+    u32   cursor        = 0;
+    u32   num_emitted   = 0;
+
+    u32 fan = num_vertices > 0 ? 0 : MESH_NONE;
+    while (fan != MESH_NONE) {
+        u32 num_candidates = 0;
+        for (u32 i = adjacency.offsets[fan]; i < adjacency.offsets[fan + 1]; ++i) {
+            u32 const triangle = adjacency.triangles[i];
+            if (emitted[triangle]) {
+                continue;
+            }
+            emitted[triangle] = true;
+            for (u32 j = 0; j < 3; ++j) {
+                u32 const vertex = indices[triangle * 3 + j];
+
+                dst[num_emitted++]           = vertex;
+                dead_ends[num_dead_ends++]   = vertex;
+                candidates[num_candidates++] = vertex;
+                --adjacency.live[vertex];
+                cache_access(&cache, vertex);
+            }
+        }
+        fan = next_fan(&adjacency, &cache, candidates, num_candidates, dead_ends, &num_dead_ends, &cursor,
+                       num_vertices);
+    }
+
+    walrus_free(emitted);
+    walrus_free(dead_ends);
+    walrus_free(candidates);
+    walrus_free(cache.stamps);
+    adjacency_shutdown(&adjacency);
+}
+
+typedef struct {
+    f32 key;
+    u32 cluster;
+} ClusterKey;
+
+static i32 cluster_compare(void const *lhs, void const *rhs)
+{
+    ClusterKey const *a = lhs;
+    ClusterKey const *b = rhs;
+    if (a->key != b->key) {
+        return a->key > b->key ? -1 : 1;
+    }
+    return (i32)(a->cluster > b->cluster) - (i32)(a->cluster < b->cluster);
+}
+
+static f32 const *vertex_position(f32 const *positions, u32 stride, u32 vertex)
+{
+    return (f32 const *)((u8 const *)positions + (u64)vertex * stride);
+}
+
+// Starts of the clusters, a triangle missing all its vertices starts a new one as the cache has run dry
+static u32 clusters_split(u32 *clusters, u32 const *indices, u32 num_triangles, u32 num_vertices, u32 cache_size,
+                          f32 threshold)
+{
+    VertexCache cache;
+    cache_init(&cache, num_vertices, cache_size);
+
+    u32 num_hard = 0;
+    for (u32 i = 0; i < num_triangles; ++i) {
+        if (cache_triangle(&cache, &indices[i * 3]) == 3 || i == 0) {
+            clusters[num_hard++] = i;
+        }
+    }
+    clusters[num_hard] = num_triangles;
+
+    // Each run is cut again where its ACMR from the last cut stays close enough to the ACMR of the whole run. The
+    // cache restarts at every cut, as a cluster may follow any other once sorted.
+    u32 *hard = walrus_new(u32, (num_hard + 1));
+    memcpy(hard, clusters, (num_hard + 1) * sizeof(u32));
+
+    u32 num_clusters = 0;
+    for (u32 c = 0; c < num_hard; ++c) {
+        u32 const begin = hard[c];
+        u32 const end   = hard[c + 1];
+
+        cache_reset(&cache);
+        u32 misses = 0;
+        for (u32 i = begin; i < end; ++i) {
+            misses += cache_triangle(&cache, &indices[i * 3]);
+        }
+        f32 const target = threshold * misses / (end - begin);
+
+        cache_reset(&cache);
+        clusters[num_clusters++] = begin;
+        u32 start                = begin;
+        misses                   = 0;
+        for (u32 i = begin; i < end; ++i) {
+            misses += cache_triangle(&cache, &indices[i * 3]);
+            if (i + 1 < end && misses <= target * (i + 1 - start)) {
+                clusters[num_clusters++] = i + 1;
+                start                    = i + 1;
+                misses                   = 0;
+                cache_reset(&cache);
+            }
+        }
+    }
+    clusters[num_clusters] = num_triangles;
+
+    walrus_free(hard);
+    walrus_free(cache.stamps);
+
+    return num_clusters;
+}
+
+void walrus_mesh_optimize_overdraw(u32 *dst, u32 const *indices, u32 num_indices, f32 const *positions,
+                                   u32 position_stride, u32 num_vertices, u32 cache_size, f32 threshold)
+{
+    u32 const num_triangles = num_indices / 3;
+    if (num_triangles == 0) {
+        return;
+    }
+
+    u32      *clusters     = walrus_new(u32, (num_triangles + 1));
+    u32 const num_clusters = clusters_split(clusters, indices, num_triangles, num_vertices, cache_size, threshold);
+
+    f32 center[3] = {0, 0, 0};
+    for (u32 i = 0; i < num_triangles * 3; ++i) {
+        f32 const *p = vertex_position(positions, position_stride, indices[i]);
+        for (u32 j = 0; j < 3; ++j) {
+            center[j] += p[j];
+        }
+    }
+    for (u32 j = 0; j < 3; ++j) {
+        center[j] /= num_triangles * 3;
+    }
+
+    // Clusters whose area weighted normal points away from the center are more likely to hide the others
+    ClusterKey *keys = walrus_new(ClusterKey, num_clusters);
+    for (u32 c = 0; c < num_clusters; ++c) {
+        f32 centroid[3] = {0, 0, 0};
+        f32 normal[3]   = {0, 0, 0};
+        f32 area        = 0;
+        for (u32 i = clusters[c]; i < clusters[c + 1]; ++i) {
+            f32 const *p0 = vertex_position(positions, position_stride, indices[i * 3]);
+            f32 const *p1 = vertex_position(positions, position_stride, indices[i * 3 + 1]);
+            f32 const *p2 = vertex_position(positions, position_stride, indices[i * 3 + 2]);
+
+            f32 const e1[3] = {p1[0] - p0[0], p1[1] - p0[1], p1[2] - p0[2]};
+            f32 const e2[3] = {p2[0] - p0[0], p2[1] - p0[1], p2[2] - p0[2]};
+            f32 const n[3]  = {
+                e1[1] * e2[2] - e1[2] * e2[1],
+                e1[2] * e2[0] - e1[0] * e2[2],
+                e1[0] * e2[1] - e1[1] * e2[0],
+            };
+            f32 const a = sqrtf(n[0] * n[0] + n[1] * n[1] + n[2] * n[2]);
+            for (u32 j = 0; j < 3; ++j) {
+                centroid[j] += (p0[j] + p1[j] + p2[j]) / 3 * a;
+                normal[j] += n[j];
+            }
+            area += a;
+        }
+
+        f32 const length = sqrtf(normal[0] * normal[0] + normal[1] * normal[1] + normal[2] * normal[2]);
+        f32       key    = 0;
+        if (area > 0 && length > 0) {
+            for (u32 j = 0; j < 3; ++j) {
+                key += (centroid[j] / area - center[j]) * normal[j] / length;
+            }
+        }
+        keys[c].key     = key;
+        keys[c].cluster = c;
+    }
+    walrus_quick_sort(keys, num_clusters, sizeof(ClusterKey), cluster_compare);
+
+    u32 num_emitted = 0;
+    for (u32 c = 0; c < num_clusters; ++c) {
+        u32 const cluster = keys[c].cluster;
+        u32 const begin   = clusters[cluster] * 3;
+        u32 const end     = clusters[cluster + 1] * 3;
+        memcpy(dst + num_emitted, indices + begin, (end - begin) * sizeof(u32));
+        num_emitted += end - begin;
+    }
+
+    walrus_free(keys);
+    walrus_free(clusters);
+}
+
+u32 walrus_mesh_optimize_vertex_fetch_remap(u32 *remap, u32 const *indices, u32 num_indices, u32 num_vertices)
+{
+    for (u32 i = 0; i < num_vertices; ++i) {
+        remap[i] = WR_MESH_UNUSED_VERTEX;
+    }
+
+    u32 num_used = 0;
+    for (u32 i = 0; i < num_indices; ++i) {
+        if (remap[indices[i]] == WR_MESH_UNUSED_VERTEX) {
+            remap[indices[i]] = num_used++;
+        }
+    }
+    return num_used;
+}
+
+// Weighted sum of the squared distances to a set of planes, the upper half of a symmetric 4x4 matrix and the sum of the
+// weights, so that the error is a mean squared distance
+typedef struct {
+    f32 a00, a01, a02, a03;
+    f32 a11, a12, a13;
+    f32 a22, a23;
+    f32 a33;
+    f32 weight;
+} Quadric;
+
+static void quadric_add_plane(Quadric *q, f32 const *n, f32 d, f32 weight)
+{
+    q->a00 += n[0] * n[0] * weight;
+    q->a01 += n[0] * n[1] * weight;
+    q->a02 += n[0] * n[2] * weight;
+    q->a03 += n[0] * d * weight;
+    q->a11 += n[1] * n[1] * weight;
+    q->a12 += n[1] * n[2] * weight;
+    q->a13 += n[1] * d * weight;
+    q->a22 += n[2] * n[2] * weight;
+    q->a23 += n[2] * d * weight;
+    q->a33 += d * d * weight;
+    q->weight += weight;
+}
+
+static void quadric_add(Quadric *q, Quadric const *other)
+{
+    f32       *dst = &q->a00;
+    f32 const *src = &other->a00;
+    for (u32 i = 0; i < sizeof(Quadric) / sizeof(f32); ++i) {
+        dst[i] += src[i];
+    }
+}
+
+static f32 quadric_error(Quadric const *q, f32 const *p)
+{
+    f32 const x = p[0], y = p[1], z = p[2];
+
+    f32 const e = q->a00 * x * x + 2 * q->a01 * x * y + 2 * q->a02 * x * z + 2 * q->a03 * x + q->a11 * y * y +
+                  2 * q->a12 * y * z + 2 * q->a13 * y + q->a22 * z * z + 2 * q->a23 * z + q->a33;
+    return q->weight > 0 && e > 0 ? e / q->weight : 0;
+}
+
+static void triangle_normal(f32 const *p0, f32 const *p1, f32 const *p2, f32 *n)
+{
+    f32 const e1[3] = {p1[0] - p0[0], p1[1] - p0[1], p1[2] - p0[2]};
+    f32 const e2[3] = {p2[0] - p0[0], p2[1] - p0[1], p2[2] - p0[2]};
+
+    n[0] = e1[1] * e2[2] - e1[2] * e2[1];
+    n[1] = e1[2] * e2[0] - e1[0] * e2[2];
+    n[2] = e1[0] * e2[1] - e1[1] * e2[0];
+}
+
+// Vertices that must not move: those sharing their position with another vertex, and those on an edge used by a single
+// triangle once the vertices sharing a position are merged
+static void simplify_lock(bool *locked, u32 const *indices, u32 num_indices, f32 const *positions, u32 num_vertices)
+{
+    Walrus_MeshStream stream = {positions, sizeof(f32) * 3, sizeof(f32) * 3};
+
+    u32 *wedges = walrus_new(u32, num_vertices);
+    u32 *count  = walrus_new0(u32, num_vertices);
+    walrus_mesh_generate_remap(wedges, indices, num_indices, num_vertices, &stream, 1);
+    for (u32 i = 0; i < num_vertices; ++i) {
+        if (wedges[i] != WR_MESH_UNUSED_VERTEX) {
+            ++count[wedges[i]];
+        }
+    }
+    for (u32 i = 0; i < num_vertices; ++i) {
+        locked[i] = wedges[i] != WR_MESH_UNUSED_VERTEX && count[wedges[i]] > 1;
+    }
+
+    // Directed edges between positions, an edge without its reverse is on a border
+    u32 capacity = 1;
+    while (capacity < num_indices * 2) {
+        capacity <<= 1;
+    }
+    u64 *edges = walrus_new(u64, capacity);
+    memset(edges, 0xff, capacity * sizeof(u64));
+    for (u32 i = 0; i < num_indices; ++i) {
+        u64 const a    = wedges[indices[i]];
+        u64 const b    = wedges[indices[i - i % 3 + (i + 1) % 3]];
+        u64 const edge = a << 32 | b;
+
+        u32 slot = (edge * 0x9e3779b97f4a7c15ull) >> 32 & (capacity - 1);
+        while (edges[slot] != UINT64_MAX && edges[slot] != edge) {
+            slot = (slot + 1) & (capacity - 1);
+        }
+        edges[slot] = edge;
+    }
+    for (u32 i = 0; i < num_indices; ++i) {
+        u32 const a       = indices[i];
+        u32 const b       = indices[i - i % 3 + (i + 1) % 3];
+        u64 const reverse = (u64)wedges[b] << 32 | wedges[a];
+
+        u32 slot = (reverse * 0x9e3779b97f4a7c15ull) >> 32 & (capacity - 1);
+        while (edges[slot] != UINT64_MAX && edges[slot] != reverse) {
+            slot = (slot + 1) & (capacity - 1);
+        }
+        if (edges[slot] == UINT64_MAX) {
+            locked[a] = true;
+            locked[b] = true;
+        }
+    }
+
+    walrus_free(edges);
+    walrus_free(count);
+    walrus_free(wedges);
+}
+
+typedef struct {
+    f32 cost;
+    u32 from;
+    u32 to;
+} Collapse;
+
+static i32 collapse_compare(void const *lhs, void const *rhs)
+{
+    Collapse const *a = lhs;
+    Collapse const *b = rhs;
+    if (a->cost != b->cost) {
+        return a->cost < b->cost ? -1 : 1;
+    }
+    if (a->from != b->from) {
+        return a->from < b->from ? -1 : 1;
+    }
+    return (i32)(a->to > b->to) - (i32)(a->to < b->to);
+}
+
+// Moving `from` onto `to` must not turn any of the triangles left around it over
+static bool collapse_valid(Adjacency const *adjacency, u32 const *indices, f32 const *positions, u32 from, u32 to)
+{
+    for (u32 i = adjacency->offsets[from]; i < adjacency->offsets[from + 1]; ++i) {
+        u32 const *triangle = &indices[adjacency->triangles[i] * 3];
+        if (triangle[0] == to || triangle[1] == to || triangle[2] == to) {
+            continue;
+        }
+
+        f32 const *p[3];
+        f32 const *q[3];
+        for (u32 j = 0; j < 3; ++j) {
+            p[j] = &positions[triangle[j] * 3];
+            q[j] = triangle[j] == from ? &positions[to * 3] : p[j];
+        }
+        f32 before[3], after[3];
+        triangle_normal(p[0], p[1], p[2], before);
+        triangle_normal(q[0], q[1], q[2], after);
+        if (before[0] * after[0] + before[1] * after[1] + before[2] * after[2] <= 0) {
+            return false;
+        }
+    }
+    return true;
+}
+
+u32 walrus_mesh_simplify(u32 *dst, u32 const *indices, u32 num_indices, f32 const *positions, u32 position_stride,
+                         u32 num_vertices, u32 target_index_count, f32 target_error, f32 *result_error)
+{
+    num_indices -= num_indices % 3;
+    memmove(dst, indices, num_indices * sizeof(u32));
+    if (result_error) {
+        *result_error = 0;
+    }
+    if (num_indices <= target_index_count || num_vertices == 0) {
+        return num_indices;
+    }
+
+    // Positions scaled into the unit cube, so that errors are relative to the extent of the mesh
+    f32 min[3] = {FLT_MAX, FLT_MAX, FLT_MAX};
+    f32 max[3] = {-FLT_MAX, -FLT_MAX, -FLT_MAX};
+    for (u32 i = 0; i < num_indices; ++i) {
+        f32 const *p = vertex_position(positions, position_stride, dst[i]);
+        for (u32 j = 0; j < 3; ++j) {
+            min[j] = walrus_min(min[j], p[j]);
+            max[j] = walrus_max(max[j], p[j]);
+        }
+    }
+    f32 extent = walrus_max(max[0] - min[0], max[1] - min[1]);
+    extent     = walrus_max(extent, max[2] - min[2]);
+    f32 const scale = extent > 0 ? 1 / extent : 0;
+
+    f32 *points = walrus_new0(f32, num_vertices * 3);
+    for (u32 i = 0; i < num_vertices; ++i) {
+        f32 const *p = vertex_position(positions, position_stride, i);
+        for (u32 j = 0; j < 3; ++j) {
+            points[i * 3 + j] = (p[j] - min[j]) * scale;
+        }
+    }
+
+    bool *locked = walrus_new(bool, num_vertices);
+    simplify_lock(locked, dst, num_indices, points, num_vertices);
+
+    // Planes of the triangles around every vertex, weighted by their area
+    Quadric *quadrics = walrus_new0(Quadric, num_vertices);
+    for (u32 i = 0; i < num_indices; i += 3) {
+        f32 n[3];
+        triangle_normal(&points[dst[i] * 3], &points[dst[i + 1] * 3], &points[dst[i + 2] * 3], n);
+        f32 const area = sqrtf(n[0] * n[0] + n[1] * n[1] + n[2] * n[2]);
+        if (area == 0) {
+            continue;
+        }
+        for (u32 j = 0; j < 3; ++j) {
+            n[j] /= area;
+        }
+        f32 const *p = &points[dst[i] * 3];
+        f32 const  d = -(n[0] * p[0] + n[1] * p[1] + n[2] * p[2]);
+        for (u32 j = 0; j < 3; ++j) {
+            quadric_add_plane(&quadrics[dst[i + j]], n, d, area * 0.5f);
+        }
+    }
+
+    Collapse *collapses = walrus_new(Collapse, num_indices);
+    bool     *touched   = walrus_new(bool, num_vertices);
+    u32      *remap     = walrus_new(u32, num_vertices);
+    f32 const limit     = target_error * target_error;
+    f32       error     = 0;
+
+    // Every pass collapses the cheapest edges whose neighbourhoods do not overlap, then drops the degenerate triangles
+    while (num_indices > target_index_count) {
+        Adjacency adjacency;
+        adjacency_init(&adjacency, dst, num_indices, num_vertices);
+
+        u32 num_collapses = 0;
+        for (u32 i = 0; i < num_indices; ++i) {
+            u32 const a = dst[i];
+            u32 const b = dst[i - i % 3 + (i + 1) % 3];
+            if (a >= b || (locked[a] && locked[b])) {
+                continue;
+            }
+
+            Quadric q = quadrics[a];
+            quadric_add(&q, &quadrics[b]);
+
+            Collapse collapse;
+            if (locked[a] || (!locked[b] && quadric_error(&q, &points[a * 3]) < quadric_error(&q, &points[b * 3]))) {
+                collapse = (Collapse){quadric_error(&q, &points[a * 3]), b, a};
+            }
+            else {
+                collapse = (Collapse){quadric_error(&q, &points[b * 3]), a, b};
+            }
+            collapses[num_collapses++] = collapse;
+        }
+        walrus_quick_sort(collapses, num_collapses, sizeof(Collapse), collapse_compare);
+
+        for (u32 i = 0; i < num_vertices; ++i) {
+            remap[i]   = i;
+            touched[i] = false;
+        }
+
+        // An inner edge collapse removes two triangles
+        u32 const needed    = (num_indices - target_index_count) / 3;
+        u32       removed   = 0;
+        u32       collapsed = 0;
+        for (u32 i = 0; i < num_collapses && removed < needed; ++i) {
+            Collapse const *collapse = &collapses[i];
+            if (collapse->cost > limit) {
+                break;
+            }
+            if (touched[collapse->from] || touched[collapse->to] ||
+                !collapse_valid(&adjacency, dst, points, collapse->from, collapse->to)) {
+                continue;
+            }
+
+            for (u32 j = adjacency.offsets[collapse->from]; j < adjacency.offsets[collapse->from + 1]; ++j) {
+                u32 const *triangle = &dst[adjacency.triangles[j] * 3];
+                touched[triangle[0]] = touched[triangle[1]] = touched[triangle[2]] = true;
+            }
+            remap[collapse->from] = collapse->to;
+            quadric_add(&quadrics[collapse->to], &quadrics[collapse->from]);
+            error = walrus_max(error, collapse->cost);
+            removed += 2;
+            ++collapsed;
+        }
+        adjacency_shutdown(&adjacency);
+
+        if (collapsed == 0) {
+            break;
+        }
+
+        u32 num_kept = 0;
+        for (u32 i = 0; i < num_indices; i += 3) {
+            u32 const a = remap[dst[i]];
+            u32 const b = remap[dst[i + 1]];
+            u32 const c = remap[dst[i + 2]];
+            if (a != b && b != c && c != a) {
+                dst[num_kept++] = a;
+                dst[num_kept++] = b;
+                dst[num_kept++] = c;
+            }
+        }
+        num_indices = num_kept;
+    }
+
+    if (result_error) {
+        *result_error = sqrtf(error);
+    }
+
+    walrus_free(remap);
+    walrus_free(touched);
+    walrus_free(collapses);
+    walrus_free(quadrics);
+    walrus_free(locked);
+    walrus_free(points);
+
+    return num_indices;
+}
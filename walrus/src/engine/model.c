@@ -1,5 +1,7 @@
 #include <engine/model.h>
-#include <engine/thread_pool.h>
+#include <engine/mesh_optimizer.h>
+#include "model_private.h"
+#include <core/job.h>
 #include <core/memory.h>
 #include <core/hash.h>
 #include <core/log.h>
@@ -21,6 +23,7 @@
 
 #include <mikktspace.h>
 
+#include <stdlib.h>
 #include <string.h>
 
 typedef struct {
@@ -235,6 +238,23 @@ static char const *s_property_names[WR_MESH_PROPERTY_COUNT] = {"u_albedo",
                                                                "u_occlusion",
                                                                "u_alpha_cutoff"};
 
+typedef struct {
+    Walrus_MeshMaterialProperty name;
+    Walrus_MaterialPropertyType type;
+    u32                         offset;
+} MeshLayoutSlot;
+
+// The Material block and the texture units declared by the mesh shaders
+static MeshLayoutSlot const s_mesh_layout[] = {
+    {WR_MESH_ALPHA_CUTOFF, WR_MATERIAL_PROPERTY_FLOAT, 0},
+    {WR_MESH_ALBEDO_FACTOR, WR_MATERIAL_PROPERTY_VEC4, 16},
+    {WR_MESH_EMISSIVE_FACTOR, WR_MATERIAL_PROPERTY_VEC3, 32},
+    {WR_MESH_NORMAL_SCALE, WR_MATERIAL_PROPERTY_FLOAT, 44},
+    {WR_MESH_ALBEDO, WR_MATERIAL_PROPERTY_TEXTURE2D, 0},
+    {WR_MESH_EMISSIVE, WR_MATERIAL_PROPERTY_TEXTURE2D, 1},
+    {WR_MESH_NORMAL, WR_MATERIAL_PROPERTY_TEXTURE2D, 2},
+};
+
 static void model_reset(Walrus_Model *model)
 {
     model->num_nodes = 0;
@@ -243,8 +263,15 @@ static void model_reset(Walrus_Model *model)
     model->num_roots = 0;
     model->roots     = NULL;
 
-    model->buffers     = NULL;
-    model->num_buffers = 0;
+    model->hierarchy = NULL;
+    model->parents   = NULL;
+
+    model->buffers           = NULL;
+    model->num_buffers       = 0;
+    model->vertex_buffer.id = WR_INVALID_HANDLE;
+
+    model->textures     = NULL;
+    model->num_textures = 0;
 
     model->materials     = NULL;
     model->num_materials = 0;
@@ -266,6 +293,11 @@ void walrus_model_material_init_default(Walrus_Material *material)
     material->double_sided = false;
     material->alpha_mode   = WR_ALPHA_MODE_OPAQUE;
 
+    for (u32 i = 0; i < walrus_count_of(s_mesh_layout); ++i) {
+        walrus_material_reserve(material, s_property_names[s_mesh_layout[i].name], s_mesh_layout[i].type,
+                                s_mesh_layout[i].offset);
+    }
+
     walrus_material_set_float(material, s_property_names[WR_MESH_ALPHA_CUTOFF], 0);
 
     walrus_material_set_texture_color(material, s_property_names[WR_MESH_ALBEDO], WR_COLOR_TEXTURE_BLACK);
@@ -286,7 +318,7 @@ static void model_allocate(Walrus_Model *model, cgltf_data *gltf)
     for (u32 i = 0; i < model->num_buffers; ++i) {
         model->buffers[i].id = WR_INVALID_HANDLE;
     }
-    model->tangent_buffer.id = WR_INVALID_HANDLE;
+    model->vertex_buffer.id = WR_INVALID_HANDLE;
 
     model->num_meshes = gltf->meshes_count;
     model->meshes     = resource_new(Walrus_Mesh, model->num_meshes);
@@ -316,10 +348,6 @@ static void model_allocate(Walrus_Model *model, cgltf_data *gltf)
 
     model->num_materials = gltf->materials_count;
     model->materials     = resource_new(Walrus_Material, model->num_materials);
-    for (u32 i = 0; i < model->num_materials; ++i) {
-        Walrus_Material *material = &model->materials[i];
-        walrus_model_material_init_default(material);
-    }
 
     model->num_textures = gltf->textures_count;
     model->textures     = resource_new(Walrus_TextureHandle, model->num_textures);
@@ -346,6 +374,9 @@ static void model_allocate(Walrus_Model *model, cgltf_data *gltf)
     model->num_roots = gltf->scene->nodes_count;
     model->roots     = resource_new(Walrus_ModelNode *, gltf->scene->nodes_count);
 
+    model->hierarchy = resource_new(u32, model->num_nodes);
+    model->parents   = resource_new(u32, model->num_nodes);
+
     model->num_animations = gltf->animations_count;
     model->animations     = resource_new(Walrus_Animation, model->num_animations);
     for (u32 i = 0; i < model->num_animations; ++i) {
@@ -356,6 +387,9 @@ static void model_allocate(Walrus_Model *model, cgltf_data *gltf)
         model->animations[i].num_samplers = animation->samplers_count;
         model->animations[i].samplers     = resource_new(Walrus_AnimationSampler, animation->samplers_count);
 
+        memset(model->animations[i].streams, 0, sizeof(model->animations[i].streams));
+        model->animations[i].num_tracks = 0;
+
         for (u32 j = 0; j < animation->samplers_count; ++j) {
             cgltf_animation_sampler *sampler = &animation->samplers[j];
 
@@ -383,7 +417,7 @@ static void model_allocate(Walrus_Model *model, cgltf_data *gltf)
     }
 }
 
-static void model_deallocate(Walrus_Model *model)
+void walrus_model_deallocate(Walrus_Model *model)
 {
     for (u32 i = 0; i < model->num_animations; ++i) {
         Walrus_Animation *animation = &model->animations[i];
@@ -393,6 +427,12 @@ static void model_deallocate(Walrus_Model *model)
             walrus_free(animation->samplers[j].data);
         }
         walrus_free(animation->samplers);
+        for (u32 j = 0; j < WR_ANIMATION_PATH_COUNT; ++j) {
+            walrus_free(animation->streams[j].tracks);
+            walrus_free(animation->streams[j].timestamps);
+            walrus_free(animation->streams[j].values);
+            walrus_free(animation->streams[j].quantized);
+        }
     }
     walrus_free(model->animations);
 
@@ -413,6 +453,10 @@ static void model_deallocate(Walrus_Model *model)
 
     walrus_free(model->roots);
 
+    walrus_free(model->hierarchy);
+
+    walrus_free(model->parents);
+
     walrus_free(model->buffers);
 
     walrus_free(model->meshes);
@@ -430,50 +474,431 @@ typedef struct {
     u64              offset;
 } TangentTask;
 
-static i32 tangent_create_task(void *userdata)
+static void tangent_create_task(u32 begin, u32 end, void *userdata)
 {
-    TangentTask *data = userdata;
-    create_tangents(data->prim, (u8 *)data->buffer + data->offset);
-    return 0;
+    Walrus_Array *task_list = userdata;
+    for (u32 i = begin; i < end; ++i) {
+        TangentTask *data = walrus_array_get(task_list, i);
+        create_tangents(data->prim, (u8 *)data->buffer + data->offset);
+    }
 }
 
-static Walrus_TextureHandle create_morph_texture(cgltf_primitive *primitive, u32 num_vertices)
+static MorphData morph_decode(cgltf_primitive *primitive, u32 num_vertices)
 {
-    Walrus_TextureHandle handle = {WR_INVALID_HANDLE};
+    MorphData morph = {NULL, num_vertices, primitive->targets_count};
     if (primitive->targets_count > 0) {
         u32 const num_attributes = 4;
 
-        f32 *buffer = walrus_malloc0(num_attributes * num_vertices * primitive->targets_count * sizeof(vec3));
+        morph.offsets = walrus_malloc0(num_attributes * num_vertices * primitive->targets_count * sizeof(vec3));
         for (u32 i = 0; i < primitive->targets_count; ++i) {
             cgltf_morph_target *target = &primitive->targets[i];
             for (u32 j = 0; j < target->attributes_count; ++j) {
                 cgltf_attribute *attribute = &target->attributes[j];
                 for (u32 k = 0; k < num_vertices; ++k) {
                     u64 offset = (i + (attribute->type - 1) * primitive->targets_count) * num_vertices + k;
-                    cgltf_accessor_read_float(attribute->data, k, buffer + offset * 3, sizeof(vec3));
+                    cgltf_accessor_read_float(attribute->data, k, morph.offsets + offset * 3, sizeof(vec3));
                 }
             }
         }
+    }
+    return morph;
+}
+
+static Walrus_TextureHandle create_morph_texture(MorphData const *morph)
+{
+    Walrus_TextureHandle handle = {WR_INVALID_HANDLE};
+    if (morph->offsets) {
         Walrus_TextureCreateInfo info;
-        info.width       = num_vertices;
-        info.height      = primitive->targets_count;
+        info.width       = morph->num_vertices;
+        info.height      = morph->num_targets;
         info.depth       = 1;
         info.ratio       = WR_RHI_RATIO_COUNT;
-        info.num_layers  = num_attributes;
+        info.num_layers  = 4;
         info.num_mipmaps = 1;
         info.format      = WR_RHI_FORMAT_RGB32F;
         info.flags       = 0;
         info.cube_map    = false;
-        handle           = walrus_rhi_create_texture(&info, buffer);
-
-        walrus_free(buffer);
+        handle           = walrus_rhi_create_texture(&info, morph->offsets);
     }
     return handle;
 }
 
-static void meshes_init(Walrus_Model *model, cgltf_data *gltf)
+#define MODEL_OVERDRAW_THRESHOLD 1.05f
+
+// Every level of detail aims at this fraction of the triangles of the previous one, and stops short of this relative
+// error
+#define MODEL_LOD_RATIO     0.5f
+#define MODEL_LOD_MAX_ERROR 0.05f
+
+// A primitive optimized at load gets its streams and indices rewritten into the generated vertices
+typedef struct {
+    cgltf_primitive      *prim;
+    Walrus_MeshPrimitive *primitive;
+    u32                   first_layout;
+    u32                   morph;
+
+    // Per stream, the accessor is NULL for generated tangents
+    cgltf_accessor *accessors[WR_RHI_MAX_VERTEX_STREAM];
+    u32             locs[WR_RHI_MAX_VERTEX_STREAM];
+    u32             sizes[WR_RHI_MAX_VERTEX_STREAM];
+    u32             strides[WR_RHI_MAX_VERTEX_STREAM];
+    u32             position;
+
+    // Packed streams then indices, 16 bytes aligned, the last offset is the one of the indices
+    u8  *vertices;
+    u64  size;
+    u64  offsets[WR_RHI_MAX_VERTEX_STREAM + 1];
+    u32  num_vertices;
+    u32  num_unique;
+    u32  num_indices;
+    bool index32;
+    f32  acmr_before;
+    f32  acmr_after;
+
+    // Simplified index ranges after the indices, level 0 is the full one
+    u32 *lods[WR_MESH_MAX_LODS];
+    u64  lod_offsets[WR_MESH_MAX_LODS];
+    u32  lod_counts[WR_MESH_MAX_LODS];
+    f32  lod_errors[WR_MESH_MAX_LODS];
+    u32  num_lods;
+} OptimizeTask;
+
+typedef struct {
+    Walrus_ModelData *data;
+    Walrus_Array     *task_list;
+    u32               num_buffers;
+} OptimizeContext;
+
+static u64 align16(u64 size)
+{
+    return (size + 15) & ~(u64)15;
+}
+
+static void stream_layout(Walrus_VertexLayout *layout, cgltf_accessor const *accessor, u32 loc, u32 stride)
+{
+    walrus_vertex_layout_begin(layout);
+    if (accessor->type == cgltf_type_mat4) {
+        walrus_vertex_layout_add_mat4_override(layout, loc, 0, stride);
+    }
+    else if (accessor->type == cgltf_type_mat3) {
+        walrus_vertex_layout_add_mat3_override(layout, loc, 0, stride);
+    }
+    else {
+        walrus_vertex_layout_add_override(layout, loc, s_component_num[accessor->type],
+                                          s_components[accessor->component_type], accessor->normalized, 0, stride);
+    }
+    walrus_vertex_layout_end(layout);
+}
+
+static bool primitive_optimizable(cgltf_primitive const *prim, Walrus_MeshPrimitive const *primitive)
+{
+    if (prim->type != cgltf_primitive_type_triangles || primitive->num_streams == 0) {
+        return false;
+    }
+    for (u32 k = 1; k < primitive->num_streams; ++k) {
+        if (primitive->streams[k].num_vertices != primitive->streams[0].num_vertices) {
+            return false;
+        }
+    }
+    return true;
+}
+
+// Every level is simplified from the previous one, until one barely shrinks. Errors add up along the chain so that
+// each is measured against the full detail.
+static void primitive_simplify(OptimizeTask *task, u32 const *indices, u32 num_indices, f32 const *positions,
+                               u32 position_stride, u32 num_vertices)
+{
+    u32 *scratch = walrus_new(u32, num_indices);
+    task->num_lods = 1;
+    while (task->num_lods < WR_MESH_MAX_LODS) {
+        u32 const *source = task->num_lods > 1 ? task->lods[task->num_lods - 1] : indices;
+        u32 const  count  = task->num_lods > 1 ? task->lod_counts[task->num_lods - 1] : num_indices;
+        f32 const  error  = task->num_lods > 1 ? task->lod_errors[task->num_lods - 1] : 0;
+
+        f32       lod_error  = 0;
+        u32 const target     = (u32)(count * MODEL_LOD_RATIO) / 3 * 3;
+        u32 const simplified = walrus_mesh_simplify(scratch, source, count, positions, position_stride, num_vertices,
+                                                    target, MODEL_LOD_MAX_ERROR - error, &lod_error);
+        if (simplified == 0 || (u64)simplified * 5 > (u64)count * 4) {
+            break;
+        }
+
+        u32 *lod = walrus_new(u32, simplified);
+        walrus_mesh_optimize_vertex_cache(lod, scratch, simplified, num_vertices, WR_MESH_CACHE_SIZE);
+        task->lods[task->num_lods]       = lod;
+        task->lod_counts[task->num_lods] = simplified;
+        task->lod_errors[task->num_lods] = error + lod_error;
+        ++task->num_lods;
+    }
+    walrus_free(scratch);
+}
+
+// Merges the vertices equal in every stream and every morph target, orders the triangles for the post-transform
+// cache then for overdraw, and lays the vertices out in fetch order. Primitives with out of range indices are left as
+// authored.
+static void primitive_optimize(OptimizeTask *task, Walrus_ModelData *data, u32 num_buffers)
 {
-    Walrus_Array *task_list = walrus_array_create(sizeof(TangentTask), 0);
+    Walrus_MeshPrimitive *primitive    = task->primitive;
+    cgltf_accessor       *accessor     = task->prim->indices;
+    u32 const             num_streams  = primitive->num_streams;
+    u32 const             num_vertices = primitive->streams[0].num_vertices;
+
+    u32 num_indices = accessor ? accessor->count : num_vertices;
+    num_indices -= num_indices % 3;
+    if (num_indices == 0) {
+        return;
+    }
+    u32 *indices = walrus_new(u32, num_indices);
+    for (u32 i = 0; i < num_indices; ++i) {
+        indices[i] = accessor ? cgltf_accessor_read_index(accessor, i) : i;
+        if (indices[i] >= num_vertices) {
+            walrus_free(indices);
+            return;
+        }
+    }
+
+    MorphData *morph       = walrus_array_get(data->morphs, task->morph);
+    u32 const  num_planes  = morph->offsets ? 4 * morph->num_targets : 0;
+    u32 const  num_sources = num_streams + num_planes;
+
+    Walrus_MeshStream *sources = walrus_new(Walrus_MeshStream, num_sources);
+    for (u32 k = 0; k < num_streams; ++k) {
+        Walrus_PrimitiveStream const *stream   = &primitive->streams[k];
+        bool const                    authored = stream->buffer.id < num_buffers;
+        u8 const                     *base     = authored ? data->buffers[stream->buffer.id].data : data->vertices;
+        sources[k] = (Walrus_MeshStream){base + stream->offset, task->sizes[k], task->strides[k]};
+    }
+    for (u32 k = 0; k < num_planes; ++k) {
+        f32 const *plane         = morph->offsets + (u64)k * num_vertices * 3;
+        sources[num_streams + k] = (Walrus_MeshStream){plane, sizeof(vec3), sizeof(vec3)};
+    }
+
+    task->acmr_before = walrus_mesh_acmr(indices, num_indices, num_vertices, WR_MESH_CACHE_SIZE);
+
+    u32      *remap      = walrus_new(u32, num_vertices);
+    u32 const num_unique = walrus_mesh_generate_remap(remap, indices, num_indices, num_vertices, sources, num_sources);
+    walrus_mesh_remap_indices(indices, indices, num_indices, remap);
+
+    u8 **unique = walrus_new(u8 *, num_sources);
+    for (u32 k = 0; k < num_sources; ++k) {
+        u32 const stride = walrus_align_up(sources[k].size, 4);
+        unique[k]        = walrus_malloc0((u64)num_unique * stride);
+        walrus_mesh_remap_vertices(unique[k], stride, &sources[k], num_vertices, remap);
+        sources[k] = (Walrus_MeshStream){unique[k], sources[k].size, stride};
+    }
+
+    u32 *ordered = walrus_new(u32, num_indices);
+    walrus_mesh_optimize_vertex_cache(ordered, indices, num_indices, num_unique, WR_MESH_CACHE_SIZE);
+    if (task->position < num_streams) {
+        walrus_mesh_optimize_overdraw(indices, ordered, num_indices, (f32 const *)unique[task->position],
+                                      sources[task->position].stride, num_unique, WR_MESH_CACHE_SIZE,
+                                      MODEL_OVERDRAW_THRESHOLD);
+    }
+    else {
+        memcpy(indices, ordered, num_indices * sizeof(u32));
+    }
+
+    if ((data->flags & WR_MODEL_LOAD_FLAG_LOD) && task->position < num_streams) {
+        primitive_simplify(task, indices, num_indices, (f32 const *)unique[task->position],
+                           sources[task->position].stride, num_unique);
+    }
+
+    // Levels of detail use a subset of the vertices of the full one
+    u32 const num_used = walrus_mesh_optimize_vertex_fetch_remap(remap, indices, num_indices, num_unique);
+    walrus_mesh_remap_indices(indices, indices, num_indices, remap);
+    for (u32 l = 1; l < task->num_lods; ++l) {
+        walrus_mesh_remap_indices(task->lods[l], task->lods[l], task->lod_counts[l], remap);
+    }
+    task->acmr_after = walrus_mesh_acmr(indices, num_indices, num_used, WR_MESH_CACHE_SIZE);
+
+    task->lods[0]       = indices;
+    task->lod_counts[0] = num_indices;
+
+    task->index32        = num_used > UINT16_MAX;
+    u32 const index_size = task->index32 ? sizeof(u32) : sizeof(u16);
+    u64       size       = 0;
+    for (u32 k = 0; k < num_streams; ++k) {
+        task->offsets[k] = size;
+        size             = align16(size + (u64)num_used * sources[k].stride);
+    }
+    task->offsets[num_streams] = size;
+    for (u32 l = 0; l < walrus_max(task->num_lods, 1u); ++l) {
+        task->lod_offsets[l] = size;
+        size += (u64)task->lod_counts[l] * index_size;
+    }
+
+    task->vertices = walrus_malloc0(size);
+    task->size     = size;
+    for (u32 k = 0; k < num_streams; ++k) {
+        walrus_mesh_remap_vertices(task->vertices + task->offsets[k], sources[k].stride, &sources[k], num_unique,
+                                   remap);
+    }
+    for (u32 l = 0; l < walrus_max(task->num_lods, 1u); ++l) {
+        u8 *dst = task->vertices + task->lod_offsets[l];
+        if (task->index32) {
+            memcpy(dst, task->lods[l], task->lod_counts[l] * sizeof(u32));
+        }
+        else {
+            for (u32 i = 0; i < task->lod_counts[l]; ++i) {
+                ((u16 *)dst)[i] = task->lods[l][i];
+            }
+        }
+    }
+    for (u32 l = 1; l < task->num_lods; ++l) {
+        walrus_free(task->lods[l]);
+    }
+
+    if (num_planes > 0) {
+        f32 *offsets = walrus_malloc0((u64)num_planes * num_used * sizeof(vec3));
+        for (u32 k = 0; k < num_planes; ++k) {
+            walrus_mesh_remap_vertices(offsets + (u64)k * num_used * 3, sizeof(vec3), &sources[num_streams + k],
+                                       num_unique, remap);
+        }
+        walrus_free(morph->offsets);
+        morph->offsets      = offsets;
+        morph->num_vertices = num_used;
+    }
+
+    task->num_vertices = num_vertices;
+    task->num_unique   = num_used;
+    task->num_indices  = num_indices;
+
+    for (u32 k = 0; k < num_sources; ++k) {
+        walrus_free(unique[k]);
+    }
+    walrus_free(unique);
+    walrus_free(ordered);
+    walrus_free(remap);
+    walrus_free(sources);
+    walrus_free(indices);
+}
+
+static void primitive_optimize_task(u32 begin, u32 end, void *userdata)
+{
+    OptimizeContext *ctx = userdata;
+    for (u32 i = begin; i < end; ++i) {
+        primitive_optimize(walrus_array_get(ctx->task_list, i), ctx->data, ctx->num_buffers);
+    }
+}
+
+// Lays out the generated vertices in primitive order, the tangents of the primitives left as authored and the
+// optimized primitives. Only measures when `dst` is NULL, otherwise copies and points the primitives at the copy.
+static u64 vertices_pack(Walrus_Model *model, Walrus_ModelData *data, Walrus_Array *task_list, u8 *dst)
+{
+    u32 const num_tasks = walrus_array_len(task_list);
+    u32       next_task = 0;
+    u32       layout_id = 0;
+    u64       size      = 0;
+    for (u32 i = 0; i < model->num_meshes; ++i) {
+        Walrus_Mesh *mesh = &model->meshes[i];
+        for (u32 j = 0; j < mesh->num_primitives; ++j) {
+            Walrus_MeshPrimitive *primitive = &mesh->primitives[j];
+
+            OptimizeTask *task = next_task < num_tasks ? walrus_array_get(task_list, next_task) : NULL;
+            if (task && task->primitive == primitive) {
+                ++next_task;
+            }
+            else {
+                task = NULL;
+            }
+
+            if (task && task->vertices) {
+                u32 const num_streams = primitive->num_streams;
+                if (dst) {
+                    memcpy(dst + size, task->vertices, task->size);
+                    for (u32 k = 0; k < num_streams; ++k) {
+                        Walrus_PrimitiveStream *stream = &primitive->streams[k];
+                        stream->buffer.id              = model->num_buffers;
+                        stream->offset                 = size + task->offsets[k];
+                        stream->num_vertices           = task->num_unique;
+                        if (task->accessors[k]) {
+                            Walrus_VertexLayout *layout = walrus_array_get(data->layouts, layout_id + k);
+                            stream_layout(layout, task->accessors[k], task->locs[k],
+                                          walrus_align_up(task->sizes[k], 4));
+                        }
+                    }
+                    primitive->indices.buffer.id   = model->num_buffers;
+                    primitive->indices.offset      = size + task->offsets[num_streams];
+                    primitive->indices.num_indices = task->num_indices;
+                    primitive->indices.index32     = task->index32;
+                    for (u32 l = 0; l < task->num_lods; ++l) {
+                        primitive->lods[l].offset      = size + task->lod_offsets[l];
+                        primitive->lods[l].num_indices = task->lod_counts[l];
+                        primitive->lods[l].error       = task->lod_errors[l];
+                    }
+                    primitive->num_lods = task->num_lods;
+                }
+                size = align16(size + task->size);
+            }
+            else {
+                for (u32 k = 0; k < primitive->num_streams; ++k) {
+                    Walrus_PrimitiveStream *stream = &primitive->streams[k];
+                    if (stream->buffer.id < model->num_buffers) {
+                        continue;
+                    }
+                    u64 const bytes = (u64)stream->num_vertices * sizeof(vec4);
+                    if (dst) {
+                        memcpy(dst + size, (u8 *)data->vertices + stream->offset, bytes);
+                        stream->offset = size;
+                    }
+                    size = align16(size + bytes);
+                }
+            }
+            layout_id += primitive->num_streams;
+        }
+    }
+    return size;
+}
+
+static void meshes_optimize(Walrus_Model *model, Walrus_ModelData *data, Walrus_Array *task_list)
+{
+    u64 const start     = walrus_sysclock(WR_SYS_CLOCK_UNIT_MICROSEC);
+    u32 const num_tasks = walrus_array_len(task_list);
+
+    OptimizeContext ctx = {data, task_list, model->num_buffers};
+    walrus_parallel_for(0, num_tasks, 1, primitive_optimize_task, &ctx);
+
+    u64 const size     = vertices_pack(model, data, task_list, NULL);
+    u8       *vertices = size > 0 ? walrus_malloc(size) : NULL;
+    vertices_pack(model, data, task_list, vertices);
+    walrus_free(data->vertices);
+    data->vertices      = vertices;
+    data->vertices_size = size;
+
+    u32 num_optimized = 0;
+    u64 num_triangles = 0;
+    u32 num_before    = 0;
+    u32 num_after     = 0;
+    f64 misses_before = 0;
+    f64 misses_after  = 0;
+    for (u32 i = 0; i < num_tasks; ++i) {
+        OptimizeTask *task = walrus_array_get(task_list, i);
+        if (task->vertices) {
+            u32 const count = task->num_indices / 3;
+            ++num_optimized;
+            num_triangles += count;
+            num_before += task->num_vertices;
+            num_after += task->num_unique;
+            misses_before += (f64)task->acmr_before * count;
+            misses_after += (f64)task->acmr_after * count;
+            walrus_free(task->vertices);
+        }
+    }
+    data->optimize_time = walrus_sysclock(WR_SYS_CLOCK_UNIT_MICROSEC) - start;
+
+    if (num_optimized > 0) {
+        walrus_info("model %s: %u primitives optimized, ACMR %.3f -> %.3f, %u -> %u vertices", data->filename,
+                    num_optimized, misses_before / num_triangles, misses_after / num_triangles, num_before, num_after);
+    }
+}
+
+// Buffer handles of the primitives hold the index of their glTF buffer until the upload, generated streams and
+// indices hold the index past the last glTF buffer
+static void meshes_decode(Walrus_Model *model, Walrus_ModelData *data)
+{
+    cgltf_data   *gltf          = data->gltf;
+    Walrus_Array *task_list     = walrus_array_create(sizeof(TangentTask), 0);
+    Walrus_Array *optimize_list = walrus_array_create(sizeof(OptimizeTask), 0);
 
     u64 tangent_buffer_size = 0;
     for (u32 i = 0; i < gltf->meshes_count; ++i) {
@@ -490,8 +915,7 @@ static void meshes_init(Walrus_Model *model, cgltf_data *gltf)
 
             cgltf_accessor *indices = prim->indices;
             if (indices) {
-                model->meshes[i].primitives[j].indices.buffer =
-                    model->buffers[indices->buffer_view->buffer - &gltf->buffers[0]];
+                model->meshes[i].primitives[j].indices.buffer.id = indices->buffer_view->buffer - &gltf->buffers[0];
                 model->meshes[i].primitives[j].indices.index32 = indices->component_type == cgltf_component_type_r_32u;
                 model->meshes[i].primitives[j].indices.offset  = indices->offset + indices->buffer_view->offset;
                 model->meshes[i].primitives[j].indices.num_indices = indices->count;
@@ -501,6 +925,14 @@ static void meshes_init(Walrus_Model *model, cgltf_data *gltf)
                 model->meshes[i].primitives[j].material = &model->materials[prim->material - &gltf->materials[0]];
             }
 
+            OptimizeTask optimize;
+            memset(&optimize, 0, sizeof(optimize));
+            optimize.prim         = prim;
+            optimize.primitive    = &model->meshes[i].primitives[j];
+            optimize.first_layout = walrus_array_len(data->layouts);
+            optimize.morph        = walrus_array_len(data->morphs);
+            optimize.position     = UINT32_MAX;
+
             u32 num_verticies                          = 0;
             model->meshes[i].primitives[j].num_streams = 0;
             for (u32 k = 0; k < prim->attributes_count; ++k) {
@@ -524,24 +956,21 @@ static void meshes_init(Walrus_Model *model, cgltf_data *gltf)
                 u32                     id          = model->meshes[i].primitives[j].num_streams;
                 Walrus_PrimitiveStream *stream      = &model->meshes[i].primitives[j].streams[id];
                 stream->offset                      = buffer_view->offset + accessor->offset;
-                stream->buffer                      = model->buffers[buffer_view->buffer - &gltf->buffers[0]];
+                stream->buffer.id                   = buffer_view->buffer - &gltf->buffers[0];
                 stream->num_vertices                = accessor->count;
                 num_verticies                       = accessor->count;
-                walrus_vertex_layout_begin(&layout);
-                if (accessor->type == cgltf_type_mat4) {
-                    walrus_vertex_layout_add_mat4_override(&layout, loc, 0, buffer_view->stride);
-                }
-                else if (accessor->type == cgltf_type_mat3) {
-                    walrus_vertex_layout_add_mat3_override(&layout, loc, 0, buffer_view->stride);
-                }
-                else {
-                    walrus_vertex_layout_add_override(&layout, loc, s_component_num[accessor->type],
-                                                      s_components[accessor->component_type], accessor->normalized, 0,
-                                                      buffer_view->stride);
-                }
-                walrus_vertex_layout_end(&layout);
-                stream->layout_handle = walrus_rhi_create_vertex_layout(&layout);
+                stream_layout(&layout, accessor, loc, buffer_view->stride);
+                walrus_array_append(data->layouts, &layout);
                 ++model->meshes[i].primitives[j].num_streams;
+
+                optimize.accessors[id] = accessor;
+                optimize.locs[id]      = loc;
+                optimize.sizes[id]     = cgltf_calc_size(accessor->type, accessor->component_type);
+                optimize.strides[id]   = accessor->stride;
+                if (attribute->type == cgltf_attribute_type_position && accessor->type == cgltf_type_vec3 &&
+                    accessor->component_type == cgltf_component_type_r_32f) {
+                    optimize.position = id;
+                }
             }
 
             if (!has_tangent && model->meshes[i].primitives[j].num_streams > 0) {
@@ -549,64 +978,95 @@ static void meshes_init(Walrus_Model *model, cgltf_data *gltf)
                 u64 size         = num_vertices * sizeof(vec4);
                 u32 stream_id    = model->meshes[i].primitives[j].num_streams;
 
-                TangentTask data;
-                data.prim   = prim;
-                data.buffer = NULL;
-                data.offset = tangent_buffer_size;
-                walrus_array_append(task_list, &data);
+                TangentTask task;
+                task.prim   = prim;
+                task.buffer = NULL;
+                task.offset = tangent_buffer_size;
+                walrus_array_append(task_list, &task);
 
                 Walrus_PrimitiveStream *stream = &model->meshes[i].primitives[j].streams[stream_id];
                 stream->offset                 = tangent_buffer_size;
                 stream->num_vertices           = num_vertices;
-                stream->buffer.id              = WR_INVALID_HANDLE;  // ready for following tangent buffer
+                stream->buffer.id              = model->num_buffers;
                 Walrus_VertexLayout layout;
                 walrus_vertex_layout_begin(&layout);
                 walrus_vertex_layout_add_override(&layout, cgltf_attribute_type_tangent - 1, 4, WR_RHI_COMPONENT_FLOAT,
                                                   false, 0, sizeof(vec4));
                 walrus_vertex_layout_end(&layout);
-                stream->layout_handle = walrus_rhi_create_vertex_layout(&layout);
+                walrus_array_append(data->layouts, &layout);
                 model->meshes[i].primitives[j].num_streams++;
                 tangent_buffer_size += size;
+
+                optimize.sizes[stream_id]   = sizeof(vec4);
+                optimize.strides[stream_id] = sizeof(vec4);
             }
 
-            model->meshes[i].primitives[j].morph_target = create_morph_texture(prim, num_verticies);
+            MorphData morph = morph_decode(prim, num_verticies);
+            walrus_array_append(data->morphs, &morph);
+
+            if ((data->flags & (WR_MODEL_LOAD_FLAG_OPTIMIZE | WR_MODEL_LOAD_FLAG_LOD)) &&
+                primitive_optimizable(prim, &model->meshes[i].primitives[j])) {
+                walrus_array_append(optimize_list, &optimize);
+            }
         }
     }
-    // Allocate the buffer, push task to thread pool
+    // Allocate the buffer, generate tangents in parallel
     if (tangent_buffer_size > 0) {
-        void *tangent_buffer = walrus_malloc(tangent_buffer_size);
+        data->vertices      = walrus_malloc(tangent_buffer_size);
+        data->vertices_size = tangent_buffer_size;
 
-        u32                  num_task = walrus_array_len(task_list);
-        Walrus_ThreadResult *threads  = walrus_new(Walrus_ThreadResult, num_task);
+        u32 num_task = walrus_array_len(task_list);
         for (u32 i = 0; i < num_task; ++i) {
             TangentTask *task = walrus_array_get(task_list, i);
-            task->buffer      = tangent_buffer;
-            walrus_thread_pool_queue(tangent_create_task, task, &threads[i]);
+            task->buffer      = data->vertices;
         }
-        // Wait for all the tasks to finish
-        for (u32 i = 0; i < num_task; ++i) {
-            walrus_thread_pool_result_get(&threads[i], -1);
-        }
-        walrus_free(threads);
+        u64 const start = walrus_sysclock(WR_SYS_CLOCK_UNIT_MICROSEC);
+        walrus_parallel_for(0, num_task, 1, tangent_create_task, task_list);
+        data->tangent_time = walrus_sysclock(WR_SYS_CLOCK_UNIT_MICROSEC) - start;
+    }
 
-        model->tangent_buffer = walrus_rhi_create_buffer(tangent_buffer, tangent_buffer_size, 0);
-        walrus_free(tangent_buffer);
+    // Tangents are generated from the authored vertices, then optimized along with the other streams
+    if (walrus_array_len(optimize_list) > 0) {
+        meshes_optimize(model, data, optimize_list);
     }
 
+    walrus_array_destroy(optimize_list);
     walrus_array_destroy(task_list);
+}
 
-    // Assgin  buffer handle
-    for (u32 i = 0; i < gltf->meshes_count; ++i) {
-        cgltf_mesh *mesh = &gltf->meshes[i];
-        for (u32 j = 0; j < mesh->primitives_count; ++j) {
-            if (model->meshes[i].primitives[j].num_streams == 0) {
-                continue;
+// Creates the vertex layouts and morph textures in the order they were decoded, and resolves the buffer handles
+static void meshes_upload(Walrus_Model *model, Walrus_ModelData *data)
+{
+    if (data->vertices_size > 0) {
+        model->vertex_buffer = walrus_rhi_create_buffer(data->vertices, data->vertices_size, 0);
+    }
+
+    u32 num_layouts = 0;
+    u32 num_morphs  = 0;
+    for (u32 i = 0; i < model->num_meshes; ++i) {
+        Walrus_Mesh *mesh = &model->meshes[i];
+        for (u32 j = 0; j < mesh->num_primitives; ++j) {
+            Walrus_MeshPrimitive *primitive = &mesh->primitives[j];
+            if (primitive->indices.num_indices > 0) {
+                if (primitive->indices.buffer.id < model->num_buffers) {
+                    primitive->indices.buffer = model->buffers[primitive->indices.buffer.id];
+                }
+                else {
+                    primitive->indices.buffer = model->vertex_buffer;
+                }
             }
-            Walrus_PrimitiveStream *stream =
-                &model->meshes[i].primitives[j].streams[model->meshes[i].primitives[j].num_streams - 1];
-            if (stream->buffer.id == WR_INVALID_HANDLE) {
-                stream->buffer = model->tangent_buffer;
+            for (u32 k = 0; k < primitive->num_streams; ++k) {
+                Walrus_PrimitiveStream *stream = &primitive->streams[k];
+                Walrus_VertexLayout    *layout = walrus_array_get(data->layouts, num_layouts++);
+                stream->layout_handle          = walrus_rhi_create_vertex_layout(layout);
+                if (stream->buffer.id < model->num_buffers) {
+                    stream->buffer = model->buffers[stream->buffer.id];
+                }
+                else {
+                    stream->buffer = model->vertex_buffer;
+                }
             }
+            primitive->morph_target = create_morph_texture(walrus_array_get(data->morphs, num_morphs++));
         }
     }
 }
@@ -683,6 +1143,22 @@ static void nodes_init(Walrus_Model *model, cgltf_data *gltf)
         }
     }
 
+    // Breadth first from every parentless node, the children of a node are appended after it
+    u32 num_sorted = 0;
+    for (u32 i = 0; i < model->num_nodes; ++i) {
+        Walrus_ModelNode *node = &model->nodes[i];
+        model->parents[i]      = node->parent ? node->parent - &model->nodes[0] : WR_MODEL_INVALID_NODE;
+        if (node->parent == NULL) {
+            model->hierarchy[num_sorted++] = i;
+        }
+    }
+    for (u32 i = 0; i < num_sorted; ++i) {
+        Walrus_ModelNode *node = &model->nodes[model->hierarchy[i]];
+        for (u32 j = 0; j < node->num_children; ++j) {
+            model->hierarchy[num_sorted++] = node->children[j] - &model->nodes[0];
+        }
+    }
+
     for (u32 i = 0; i < gltf->scene->nodes_count; ++i) {
         model->roots[i] = &model->nodes[gltf->scene->nodes[i] - &gltf->nodes[0]];
     }
@@ -720,6 +1196,76 @@ static Walrus_AnimationInterpolation translate_interpolation(cgltf_interpolation
     return WR_ANIMATION_INTERPOLATION_LINEAR;
 }
 
+static i32 track_compare(void const *lhs, void const *rhs)
+{
+    Walrus_AnimationTrack const *a = lhs;
+    Walrus_AnimationTrack const *b = rhs;
+    return (i32)(a->node > b->node) - (i32)(a->node < b->node);
+}
+
+// Copies the keys of every channel into the stream of its path
+static void animation_cook(Walrus_Model const *model, Walrus_Animation *animation)
+{
+    animation->num_tracks = 0;
+    for (u32 path = 0; path < WR_ANIMATION_PATH_COUNT; ++path) {
+        Walrus_AnimationStream *stream = &animation->streams[path];
+
+        u32 num_tracks = 0;
+        u32 num_keys   = 0;
+        u32 num_values = 0;
+        for (u32 i = 0; i < animation->num_channels; ++i) {
+            Walrus_AnimationChannel const *channel = &animation->channels[i];
+            if (channel->path == path) {
+                ++num_tracks;
+                num_keys += channel->sampler->num_frames;
+                num_values += channel->sampler->num_frames * channel->sampler->num_components;
+            }
+        }
+
+        stream->num_tracks = num_tracks;
+        stream->tracks     = resource_new(Walrus_AnimationTrack, num_tracks);
+        stream->timestamps = resource_new(f32, num_keys);
+        stream->values     = resource_new(f32, num_values);
+        stream->quantized  = NULL;
+
+        u32 track  = 0;
+        num_keys   = 0;
+        num_values = 0;
+        for (u32 i = 0; i < animation->num_channels; ++i) {
+            Walrus_AnimationChannel const *channel = &animation->channels[i];
+            Walrus_AnimationSampler const *sampler = channel->sampler;
+            if (channel->path != path) {
+                continue;
+            }
+            bool const cubic = sampler->interpolation == WR_ANIMATION_INTERPOLATION_CUBIC_SPLINE;
+
+            f32 *timestamps = stream->timestamps + num_keys;
+            f32 *values     = stream->values + num_values;
+            memcpy(timestamps, sampler->timestamps, sampler->num_frames * sizeof(f32));
+            memcpy(values, sampler->data, sampler->num_frames * sampler->num_components * sizeof(f32));
+
+            Walrus_AnimationTrack *dst = &stream->tracks[track++];
+
+            dst->interpolation  = sampler->interpolation;
+            dst->timestamps     = timestamps;
+            dst->values         = values;
+            dst->quantized      = NULL;
+            dst->node           = channel->node - &model->nodes[0];
+            dst->num_components = sampler->num_components / (cubic ? 3 : 1);
+            dst->num_keys       = sampler->num_frames;
+
+            num_keys += sampler->num_frames;
+            num_values += sampler->num_frames * sampler->num_components;
+        }
+
+        // Tracks sorted by node write the local transforms in order
+        if (num_tracks > 1) {
+            walrus_quick_sort(stream->tracks, num_tracks, sizeof(Walrus_AnimationTrack), track_compare);
+        }
+        animation->num_tracks += num_tracks;
+    }
+}
+
 static void animations_init(Walrus_Model *model, cgltf_data *gltf)
 {
     for (u32 i = 0; i < gltf->animations_count; ++i) {
@@ -755,6 +1301,8 @@ static void animations_init(Walrus_Model *model, cgltf_data *gltf)
             }
         }
         model->animations[i].duration = duration;
+
+        animation_cook(model, &model->animations[i]);
     }
 }
 
@@ -789,49 +1337,112 @@ static void skins_init(Walrus_Model *model, cgltf_data *gltf)
 }
 
 typedef struct {
-    Walrus_Image *image;
-    char         *path;
+    Walrus_Image      *image;
+    cgltf_image       *source;
+    char const        *parent_path;
+    Walrus_ModelResult res;
 } ImageTask;
 
-static i32 image_load_task(void *userdata)
+typedef struct {
+    Walrus_JobHandle root;
+    ImageTask       *tasks;
+    u32              num_tasks;
+    char            *parent_path;
+} ImageLoad;
+
+static Walrus_ImageResult image_load_from_data_uri(Walrus_Image *image, char const *uri)
 {
-    ImageTask *data = userdata;
-    walrus_trace("loading image: %s", data->path);
-    if (walrus_image_load_from_file_full(data->image, data->path, 4) != WR_IMAGE_SUCCESS) {
-        return WR_MODEL_IMAGE_ERROR;
+    char const *base64 = strstr(uri, ";base64,");
+    if (base64 == NULL) {
+        return WR_IMAGE_LOAD_ERROR;
     }
-    return WR_MODEL_SUCCESS;
+    base64 += strlen(";base64,");
+
+    u64 const len     = strlen(base64);
+    u64 const padding = (len > 0 && base64[len - 1] == '=') + (len > 1 && base64[len - 2] == '=');
+    u64 const size    = len * 3 / 4 - padding;
+
+    cgltf_options      opt  = {0};
+    void              *data = NULL;
+    Walrus_ImageResult res  = WR_IMAGE_LOAD_ERROR;
+    if (cgltf_load_buffer_base64(&opt, size, base64, &data) == cgltf_result_success) {
+        res = walrus_image_load_from_memory_full(image, data, size, 4);
+        // Allocated by the default allocator of cgltf
+        free(data);
+    }
+    return res;
 }
 
-static Walrus_ModelResult images_load_from_file(Walrus_Image *images, cgltf_data *gltf, char const *filename)
+// Images are decoded from their buffer view in a .glb, from a data URI or from a file next to the model
+static void image_load_task(Walrus_JobHandle job, void *userdata)
 {
-    Walrus_ModelResult res         = WR_MODEL_SUCCESS;
-    u32 const          num_images  = gltf->images_count;
-    char              *parent_path = walrus_str_substr(filename, 0, walrus_str_last_of(filename, '/'));
+    walrus_unused(job);
+    ImageTask   *task  = userdata;
+    cgltf_image *image = task->source;
+
+    Walrus_ImageResult res = WR_IMAGE_LOAD_ERROR;
+    if (image->buffer_view) {
+        cgltf_buffer_view *view = image->buffer_view;
+        u8                *data = (u8 *)view->buffer->data + view->offset;
+        res                     = walrus_image_load_from_memory_full(task->image, data, view->size, 4);
+    }
+    else if (image->uri && strncmp(image->uri, "data:", strlen("data:")) == 0) {
+        res = image_load_from_data_uri(task->image, image->uri);
+    }
+    else if (image->uri) {
+        u64 const parent = strlen(task->parent_path);
+        u64 const len    = strlen(image->uri);
+        char     *path   = walrus_str_alloc(parent + 1 + len);
+        walrus_str_nappend(&path, task->parent_path, parent);
+        walrus_str_nappend(&path, "/", 1);
+        walrus_str_nappend(&path, image->uri, len);
+        // Only the URI is percent-encoded
+        cgltf_decode_uri(path + parent + 1);
+        walrus_trace("loading image: %s", path);
+        res = walrus_image_load_from_file_full(task->image, path, 4);
+        walrus_str_free(path);
+    }
 
-    ImageTask           *tasks    = walrus_new(ImageTask, num_images);
-    Walrus_ThreadResult *task_res = walrus_new(Walrus_ThreadResult, num_images);
-    for (u32 i = 0; i < num_images; ++i) {
-        cgltf_image *image = &gltf->images[i];
-        char         path[255];
-        snprintf(path, 255, "%s/%s", parent_path, image->uri);
-        tasks[i].image = &images[i];
-        tasks[i].path  = walrus_str_dup(path);
-        walrus_thread_pool_queue(image_load_task, &tasks[i], &task_res[i]);
+    task->res = res == WR_IMAGE_SUCCESS ? WR_MODEL_SUCCESS : WR_MODEL_IMAGE_ERROR;
+}
+
+// Starts decoding every image on the job system, the caller keeps decoding the model meanwhile
+static void images_load_begin(ImageLoad *load, Walrus_Image *images, cgltf_data *gltf, char const *filename)
+{
+    load->num_tasks   = gltf->images_count;
+    load->tasks       = walrus_new(ImageTask, walrus_max(load->num_tasks, 1u));
+    load->parent_path = walrus_str_substr(filename, 0, walrus_str_last_of(filename, '/'));
+    load->root        = walrus_job_create(NULL, NULL);
+    for (u32 i = 0; i < load->num_tasks; ++i) {
+        load->tasks[i].image       = &images[i];
+        load->tasks[i].source      = &gltf->images[i];
+        load->tasks[i].parent_path = load->parent_path;
+        walrus_job_run(walrus_job_create_child(load->root, image_load_task, &load->tasks[i]));
     }
+    walrus_job_run(load->root);
+}
 
-    for (u32 i = 0; i < num_images; ++i) {
-        if (walrus_thread_pool_result_get(&task_res[i], -1) != WR_MODEL_SUCCESS) {
-            walrus_error("fail to load image from %s", tasks[i].path);
+// An image that fails to decode leaves the default texture of its materials. The textures are only created by
+// walrus_model_upload once the whole model is decoded, not as each image finishes: the decode runs on the loader
+// thread while textures are created on the main thread, and the cooked model is written with every image.
+// Returns false if an image failed to decode
+static bool images_load_end(ImageLoad *load)
+{
+    walrus_job_wait(load->root);
+
+    bool loaded = true;
+    for (u32 i = 0; i < load->num_tasks; ++i) {
+        if (load->tasks[i].res != WR_MODEL_SUCCESS) {
+            cgltf_image const *image = load->tasks[i].source;
+            walrus_error("fail to load image %u from %s", i, image->uri ? image->uri : "buffer view");
+            loaded = false;
         }
-        walrus_str_free(tasks[i].path);
     }
-    walrus_free(tasks);
-    walrus_free(task_res);
+    walrus_free(load->tasks);
 
-    walrus_str_free(parent_path);
+    walrus_str_free(load->parent_path);
 
-    return res;
+    return loaded;
 }
 
 static void images_shutdown(Walrus_Image *images, u32 num_images)
@@ -841,105 +1452,193 @@ static void images_shutdown(Walrus_Image *images, u32 num_images)
     }
 }
 
-static void set_texture(Walrus_TextureHandle *textures, Walrus_Material *material, cgltf_data *gltf,
-                        cgltf_texture *texture, Walrus_Image *images, char const *name, bool srgb)
+static void material_set(ModelMaterial *material, Walrus_MeshMaterialProperty name, ModelPropertyType type,
+                         f32 const *value)
 {
-    Walrus_Image *image = &images[texture->image - &gltf->images[0]];
-    if (textures[texture - &gltf->textures[0]].id == 0) {
-        u64 flags = WR_RHI_SAMPLER_LINEAR;
-        if (texture->sampler) {
-            flags = convert_min_filter(texture->sampler->min_filter) |
-                    convert_mag_filter(texture->sampler->mag_filter) | convert_wrap_s(texture->sampler->wrap_s) |
-                    convert_wrap_t(texture->sampler->wrap_t);
-        }
-        if (srgb) flags |= WR_RHI_TEXTURE_SRGB;
+    static u32 const num_components[] = {1, 3, 4, 0};
+
+    ModelMaterialProperty *property = &material->properties[material->num_properties++];
+    property->name                  = name;
+    property->type                  = type;
+    property->texture               = 0;
+    property->srgb                  = false;
+    glm_vec4_zero(property->value);
+    memcpy(property->value, value, num_components[type] * sizeof(f32));
+}
 
-        textures[texture - &gltf->textures[0]] =
-            walrus_rhi_create_texture2d(image->width, image->height, WR_RHI_FORMAT_RGBA8, 0, flags, image->data);
-        walrus_rhi_frame();
+// The first material using a texture decides whether it is sRGB
+static void material_set_texture(Walrus_ModelData *data, ModelMaterial *material, cgltf_texture *texture,
+                                 Walrus_MeshMaterialProperty name, bool srgb)
+{
+    u32 const     index  = texture - &data->gltf->textures[0];
+    ModelTexture *target = &data->textures[index];
+    if (!target->used) {
+        target->used = true;
+        if (srgb) target->flags |= WR_RHI_TEXTURE_SRGB;
     }
 
-    walrus_material_set_texture(material, name, textures[texture - &gltf->textures[0]], srgb);
+    ModelMaterialProperty *property = &material->properties[material->num_properties++];
+    property->name                  = name;
+    property->type                  = MODEL_PROPERTY_TEXTURE;
+    property->texture               = index;
+    property->srgb                  = srgb;
+    glm_vec4_zero(property->value);
 }
 
-static void materials_init(Walrus_Model *model, Walrus_Image *images, cgltf_data *gltf)
+static void textures_decode(Walrus_ModelData *data)
+{
+    cgltf_data *gltf   = data->gltf;
+    data->num_textures = gltf->textures_count;
+    data->textures     = walrus_new(ModelTexture, walrus_max(data->num_textures, 1u));
+    for (u32 i = 0; i < data->num_textures; ++i) {
+        cgltf_texture *texture = &gltf->textures[i];
+        ModelTexture  *target  = &data->textures[i];
+        target->image          = texture->image ? texture->image - &gltf->images[0] : UINT32_MAX;
+        target->used           = false;
+        target->flags          = WR_RHI_SAMPLER_LINEAR;
+        if (texture->sampler) {
+            target->flags = convert_min_filter(texture->sampler->min_filter) |
+                            convert_mag_filter(texture->sampler->mag_filter) |
+                            convert_wrap_s(texture->sampler->wrap_s) | convert_wrap_t(texture->sampler->wrap_t);
+        }
+    }
+}
+
+static void materials_decode(Walrus_ModelData *data)
 {
     static Walrus_AlphaMode mode[cgltf_alpha_mode_max_enum] = {WR_ALPHA_MODE_OPAQUE, WR_ALPHA_MODE_MASK,
                                                                WR_ALPHA_MODE_BLEND};
 
-    for (u32 i = 0; i < model->num_materials; ++i) {
-        cgltf_material *material         = &gltf->materials[i];
-        model->materials[i].double_sided = material->double_sided;
-        model->materials[i].alpha_mode   = mode[material->alpha_mode];
+    cgltf_data *gltf    = data->gltf;
+    data->num_materials = gltf->materials_count;
+    data->materials     = walrus_new(ModelMaterial, walrus_max(data->num_materials, 1u));
+    for (u32 i = 0; i < data->num_materials; ++i) {
+        cgltf_material *material = &gltf->materials[i];
+        ModelMaterial  *target   = &data->materials[i];
+        target->double_sided     = material->double_sided;
+        target->alpha_mode       = mode[material->alpha_mode];
+        target->num_properties   = 0;
 
         if (material->alpha_mode == cgltf_alpha_mode_mask) {
-            walrus_material_set_float(&model->materials[i], s_property_names[WR_MESH_ALPHA_CUTOFF],
-                                      material->alpha_cutoff);
+            material_set(target, WR_MESH_ALPHA_CUTOFF, MODEL_PROPERTY_FLOAT, &material->alpha_cutoff);
         }
         if (material->normal_texture.texture) {
-            set_texture(model->textures, &model->materials[i], gltf, material->normal_texture.texture, images,
-                        s_property_names[WR_MESH_NORMAL], false);
-            walrus_material_set_float(&model->materials[i], s_property_names[WR_MESH_NORMAL_SCALE],
-                                      material->normal_texture.scale);
+            material_set_texture(data, target, material->normal_texture.texture, WR_MESH_NORMAL, false);
+            material_set(target, WR_MESH_NORMAL_SCALE, MODEL_PROPERTY_FLOAT, &material->normal_texture.scale);
         }
 
         if (material->emissive_texture.texture) {
-            set_texture(model->textures, &model->materials[i], gltf, material->emissive_texture.texture, images,
-                        s_property_names[WR_MESH_EMISSIVE], true);
+            material_set_texture(data, target, material->emissive_texture.texture, WR_MESH_EMISSIVE, true);
         }
-        walrus_material_set_vec3(&model->materials[i], s_property_names[WR_MESH_EMISSIVE_FACTOR],
-                                 material->emissive_factor);
+        material_set(target, WR_MESH_EMISSIVE_FACTOR, MODEL_PROPERTY_VEC3, material->emissive_factor);
 
         if (material->occlusion_texture.texture) {
-            set_texture(model->textures, &model->materials[i], gltf, material->occlusion_texture.texture, images,
-                        s_property_names[WR_MESH_OCCLUSION], false);
+            material_set_texture(data, target, material->occlusion_texture.texture, WR_MESH_OCCLUSION, false);
         }
 
         if (material->has_pbr_metallic_roughness) {
             cgltf_pbr_metallic_roughness *metallic_roughness = &material->pbr_metallic_roughness;
             if (metallic_roughness->base_color_texture.texture) {
-                set_texture(model->textures, &model->materials[i], gltf, metallic_roughness->base_color_texture.texture,
-                            images, s_property_names[WR_MESH_ALBEDO], true);
+                material_set_texture(data, target, metallic_roughness->base_color_texture.texture, WR_MESH_ALBEDO,
+                                     true);
             }
-            walrus_material_set_vec4(&model->materials[i], s_property_names[WR_MESH_ALBEDO_FACTOR],
-                                     metallic_roughness->base_color_factor);
-            walrus_material_set_float(&model->materials[i], s_property_names[WR_MESH_METALLIC_FACTOR],
-                                      metallic_roughness->metallic_factor);
-            walrus_material_set_float(&model->materials[i], s_property_names[WR_MESH_ROUGHNESS_FACTOR],
-                                      metallic_roughness->roughness_factor);
+            material_set(target, WR_MESH_ALBEDO_FACTOR, MODEL_PROPERTY_VEC4, metallic_roughness->base_color_factor);
+            material_set(target, WR_MESH_METALLIC_FACTOR, MODEL_PROPERTY_FLOAT, &metallic_roughness->metallic_factor);
+            material_set(target, WR_MESH_ROUGHNESS_FACTOR, MODEL_PROPERTY_FLOAT,
+                         &metallic_roughness->roughness_factor);
             if (metallic_roughness->metallic_roughness_texture.texture) {
-                set_texture(model->textures, &model->materials[i], gltf,
-                            metallic_roughness->metallic_roughness_texture.texture, images,
-                            s_property_names[WR_MESH_METALLIC_ROUGHNESS], false);
+                material_set_texture(data, target, metallic_roughness->metallic_roughness_texture.texture,
+                                     WR_MESH_METALLIC_ROUGHNESS, false);
             }
         }
         if (material->has_pbr_specular_glossiness) {
             cgltf_pbr_specular_glossiness *specular_glossiness = &material->pbr_specular_glossiness;
             if (specular_glossiness->specular_glossiness_texture.texture) {
-                set_texture(model->textures, &model->materials[i], gltf,
-                            specular_glossiness->specular_glossiness_texture.texture, images,
-                            s_property_names[WR_MESH_METALLIC_ROUGHNESS], true);
+                material_set_texture(data, target, specular_glossiness->specular_glossiness_texture.texture,
+                                     WR_MESH_METALLIC_ROUGHNESS, true);
             }
 
             if (specular_glossiness->diffuse_texture.texture) {
-                set_texture(model->textures, &model->materials[i], gltf, specular_glossiness->diffuse_texture.texture,
-                            images, s_property_names[WR_MESH_ALBEDO], true);
+                material_set_texture(data, target, specular_glossiness->diffuse_texture.texture, WR_MESH_ALBEDO,
+                                     true);
+            }
+            material_set(target, WR_MESH_ALBEDO_FACTOR, MODEL_PROPERTY_VEC4, specular_glossiness->diffuse_factor);
+            material_set(target, WR_MESH_SPECULAR_FACTOR, MODEL_PROPERTY_VEC3, specular_glossiness->specular_factor);
+            material_set(target, WR_MESH_GLOSSINESS_FACTOR, MODEL_PROPERTY_FLOAT,
+                         &specular_glossiness->glossiness_factor);
+        }
+    }
+}
+
+// A texture whose image failed to decode is not created, its materials keep the default texture
+static void textures_upload(Walrus_Model *model, Walrus_ModelData *data)
+{
+    for (u32 i = 0; i < data->num_textures; ++i) {
+        ModelTexture const *texture = &data->textures[i];
+        if (!texture->used || texture->image >= data->num_images || data->images[texture->image].data == NULL) {
+            continue;
+        }
+        Walrus_Image const *image = &data->images[texture->image];
+        model->textures[i] = walrus_rhi_create_texture2d(image->width, image->height, WR_RHI_FORMAT_RGBA8, 0,
+                                                         texture->flags, image->data);
+    }
+}
+
+static void materials_upload(Walrus_Model *model, Walrus_ModelData *data)
+{
+    for (u32 i = 0; i < model->num_materials; ++i) {
+        ModelMaterial const *source   = &data->materials[i];
+        Walrus_Material     *material = &model->materials[i];
+        walrus_model_material_init_default(material);
+
+        material->double_sided = source->double_sided;
+        material->alpha_mode   = source->alpha_mode;
+        for (u32 j = 0; j < source->num_properties; ++j) {
+            ModelMaterialProperty const *property = &source->properties[j];
+            char const                  *name     = s_property_names[property->name];
+            switch (property->type) {
+                case MODEL_PROPERTY_FLOAT:
+                    walrus_material_set_float(material, name, property->value[0]);
+                    break;
+                case MODEL_PROPERTY_VEC3:
+                    walrus_material_set_vec3(material, name, (f32 *)property->value);
+                    break;
+                case MODEL_PROPERTY_VEC4:
+                    walrus_material_set_vec4(material, name, (f32 *)property->value);
+                    break;
+                case MODEL_PROPERTY_TEXTURE:
+                    if (model->textures[property->texture].id != WR_INVALID_HANDLE) {
+                        walrus_material_set_texture(material, name, model->textures[property->texture],
+                                                    property->srgb);
+                    }
+                    break;
             }
-            walrus_material_set_vec4(&model->materials[i], s_property_names[WR_MESH_ALBEDO_FACTOR],
-                                     specular_glossiness->diffuse_factor);
-            walrus_material_set_vec3(&model->materials[i], s_property_names[WR_MESH_SPECULAR_FACTOR],
-                                     specular_glossiness->specular_factor);
-            walrus_material_set_float(&model->materials[i], s_property_names[WR_MESH_GLOSSINESS_FACTOR],
-                                      specular_glossiness->glossiness_factor);
         }
     }
 }
 
-static void buffers_init(Walrus_Model *model, cgltf_data *gltf)
+// A material set after the last flush is still linked for it
+static void materials_shutdown(Walrus_Model *model)
+{
+    for (u32 i = 0; i < model->num_materials; ++i) {
+        walrus_material_shutdown(&model->materials[i]);
+    }
+}
+
+static void buffers_decode(Walrus_ModelData *data)
+{
+    data->num_buffers = data->gltf->buffers_count;
+    data->buffers     = walrus_new(ModelBuffer, walrus_max(data->num_buffers, 1u));
+    for (u32 i = 0; i < data->num_buffers; ++i) {
+        data->buffers[i].data = data->gltf->buffers[i].data;
+        data->buffers[i].size = data->gltf->buffers[i].size;
+    }
+}
+
+static void buffers_upload(Walrus_Model *model, Walrus_ModelData *data)
 {
     for (u32 i = 0; i < model->num_buffers; ++i) {
-        model->buffers[i] = walrus_rhi_create_buffer(gltf->buffers[i].data, gltf->buffers[i].size, 0);
-        walrus_rhi_frame();
+        model->buffers[i] = walrus_rhi_create_buffer(data->buffers[i].data, data->buffers[i].size, 0);
     }
 }
 
@@ -948,7 +1647,7 @@ static void buffers_shutdown(Walrus_Model *model)
     for (u32 i = 0; i < model->num_buffers; ++i) {
         walrus_rhi_destroy_buffer(model->buffers[i]);
     }
-    walrus_rhi_destroy_buffer(model->tangent_buffer);
+    walrus_rhi_destroy_buffer(model->vertex_buffer);
 }
 
 static void calculate_skin_min_max(Walrus_Model *model, cgltf_data *gltf)
@@ -1034,27 +1733,57 @@ static void calculate_skin_min_max(Walrus_Model *model, cgltf_data *gltf)
     }
 }
 
-static void model_init(Walrus_Model *model, Walrus_Image *images, cgltf_data *gltf)
+static void model_decode(Walrus_Model *model, Walrus_ModelData *data)
 {
-    model_allocate(model, gltf);
+    model_allocate(model, data->gltf);
 
-    buffers_init(model, gltf);
+    buffers_decode(data);
 
-    materials_init(model, images, gltf);
+    textures_decode(data);
 
-    meshes_init(model, gltf);
+    materials_decode(data);
 
-    nodes_init(model, gltf);
+    meshes_decode(model, data);
 
-    animations_init(model, gltf);
+    nodes_init(model, data->gltf);
 
-    skins_init(model, gltf);
+    animations_init(model, data->gltf);
 
-    calculate_skin_min_max(model, gltf);
+    skins_init(model, data->gltf);
+
+    calculate_skin_min_max(model, data->gltf);
+}
+
+void walrus_model_data_free(Walrus_ModelData *data)
+{
+    if (data->cooked) {
+        walrus_free(data->cooked);
+    }
+    else {
+        u32 const num_morphs = walrus_array_len(data->morphs);
+        for (u32 i = 0; i < num_morphs; ++i) {
+            MorphData *morph = walrus_array_get(data->morphs, i);
+            walrus_free(morph->offsets);
+        }
+        images_shutdown(data->images, data->num_images);
+        walrus_free(data->vertices);
+        cgltf_free(data->gltf);
+    }
+    walrus_array_destroy(data->morphs);
+    walrus_array_destroy(data->layouts);
+
+    walrus_free(data->buffers);
+    walrus_free(data->images);
+    walrus_free(data->textures);
+    walrus_free(data->materials);
+    walrus_str_free(data->filename);
+    walrus_free(data);
 }
 
 void walrus_model_shutdown(Walrus_Model *model)
 {
+    materials_shutdown(model);
+
     textures_shutdown(model);
 
     animations_shutdown(model);
@@ -1063,12 +1792,21 @@ void walrus_model_shutdown(Walrus_Model *model)
 
     buffers_shutdown(model);
 
-    model_deallocate(model);
+    walrus_model_deallocate(model);
 }
 
-Walrus_ModelResult walrus_model_load_from_file(Walrus_Model *model, char const *filename)
+Walrus_ModelResult walrus_model_decode_from_file(Walrus_Model *model, Walrus_ModelData **data, char const *filename,
+                                                 u32 flags)
 {
     model_reset(model);
+    *data = NULL;
+
+    bool const cache = flags & WR_MODEL_LOAD_FLAG_CACHE;
+    if (cache && walrus_model_cache_read(model, data, filename, flags)) {
+        return WR_MODEL_SUCCESS;
+    }
+
+    u64 start = walrus_sysclock(WR_SYS_CLOCK_UNIT_MICROSEC);
 
     cgltf_options opt    = {0};
     cgltf_data   *gltf   = NULL;
@@ -1079,22 +1817,76 @@ Walrus_ModelResult walrus_model_load_from_file(Walrus_Model *model, char const *
 
     result = cgltf_load_buffers(&opt, gltf, filename);
     if (result != cgltf_result_success) {
+        cgltf_free(gltf);
         return WR_MODEL_BUFFER_ERROR;
     }
 
-    u32 const     num_images = gltf->images_count;
-    Walrus_Image *images     = walrus_alloca(sizeof(Walrus_Image) * num_images);
-    if (images_load_from_file(images, gltf, filename) != WR_MODEL_SUCCESS) {
-        return WR_MODEL_IMAGE_ERROR;
+    Walrus_ModelData *decoded = walrus_new0(Walrus_ModelData, 1);
+    decoded->gltf             = gltf;
+    decoded->num_images       = gltf->images_count;
+    decoded->images           = walrus_new0(Walrus_Image, walrus_max(decoded->num_images, 1u));
+    decoded->layouts          = walrus_array_create(sizeof(Walrus_VertexLayout), 0);
+    decoded->morphs           = walrus_array_create(sizeof(MorphData), 0);
+    decoded->filename         = walrus_str_dup(filename);
+    decoded->flags            = flags;
+    decoded->parse_time       = walrus_sysclock(WR_SYS_CLOCK_UNIT_MICROSEC) - start;
+
+    // Images are decoded while the meshes and their tangents are
+    start = walrus_sysclock(WR_SYS_CLOCK_UNIT_MICROSEC);
+    ImageLoad images;
+    images_load_begin(&images, decoded->images, gltf, filename);
+
+    model_decode(model, decoded);
+
+    bool const images_loaded = images_load_end(&images);
+    decoded->image_time      = walrus_sysclock(WR_SYS_CLOCK_UNIT_MICROSEC) - start;
+
+    // A missing image would be cooked as missing and never looked for again
+    if (cache && images_loaded) {
+        walrus_model_cache_write(model, decoded, filename);
     }
 
-    model_init(model, images, gltf);
+    *data = decoded;
 
-    walrus_rhi_frame();
+    return WR_MODEL_SUCCESS;
+}
 
-    images_shutdown(images, num_images);
+void walrus_model_upload(Walrus_Model *model, Walrus_ModelData *data)
+{
+    u64 const start = walrus_sysclock(WR_SYS_CLOCK_UNIT_MICROSEC);
 
-    cgltf_free(gltf);
+    buffers_upload(model, data);
+
+    textures_upload(model, data);
+
+    materials_upload(model, data);
+
+    meshes_upload(model, data);
+
+    u64 const upload_time = walrus_sysclock(WR_SYS_CLOCK_UNIT_MICROSEC) - start;
+    walrus_info("model %s: parse %.2fms, images %.2fms, tangents %.2fms, optimize %.2fms, upload %.2fms",
+                data->filename, data->parse_time * 1e-3, data->image_time * 1e-3, data->tangent_time * 1e-3,
+                data->optimize_time * 1e-3, upload_time * 1e-3);
+
+    walrus_model_data_free(data);
+}
+
+Walrus_ModelResult walrus_model_load_from_file(Walrus_Model *model, char const *filename)
+{
+    return walrus_model_load_from_file_full(model, filename, WR_MODEL_LOAD_FLAG_NONE);
+}
+
+Walrus_ModelResult walrus_model_load_from_file_full(Walrus_Model *model, char const *filename, u32 flags)
+{
+    Walrus_ModelData  *data = NULL;
+    Walrus_ModelResult res  = walrus_model_decode_from_file(model, &data, filename, flags);
+    if (res != WR_MODEL_SUCCESS) {
+        return res;
+    }
+
+    walrus_model_upload(model, data);
+
+    walrus_rhi_frame();
 
     return WR_MODEL_SUCCESS;
 }
@@ -0,0 +1,928 @@
+#include "model_private.h"
+#include <core/memory.h>
+#include <core/log.h>
+#include <core/macro.h>
+#include <core/math.h>
+#include <core/string.h>
+#include <core/sys.h>
+
+#include <cgltf.h>
+
+#include <stdio.h>
+#include <string.h>
+
+// Bump the version whenever the layout of the file or of a structure written as is changes
+#define COOKED_MAGIC   0x434d5257
+#define COOKED_VERSION 4
+#define COOKED_ALIGN   16
+
+#define COOKED_NONE UINT32_MAX
+
+#define cooked_index(ptr, base)        ((ptr) ? (u32)((ptr) - (base)) : COOKED_NONE)
+#define cooked_pointer(base, i, count) ((base) && (i) < (count) ? &(base)[i] : NULL)
+
+// NULL when there are none, as resource_new of the model does
+#define cooked_new(type, count)  ((count) > 0 ? walrus_new(type, count) : NULL)
+#define cooked_new0(type, count) ((count) > 0 ? walrus_new0(type, count) : NULL)
+
+typedef struct {
+    FILE *file;
+    u64   pos;
+} Writer;
+
+typedef struct {
+    u8  *data;
+    u64  size;
+    u64  pos;
+    bool error;
+} Reader;
+
+static void write_bytes(Writer *writer, void const *data, u64 size)
+{
+    if (size > 0) {
+        fwrite(data, 1, size, writer->file);
+        writer->pos += size;
+    }
+}
+
+static void write_u32(Writer *writer, u32 value)
+{
+    write_bytes(writer, &value, sizeof(value));
+}
+
+static void write_u64(Writer *writer, u64 value)
+{
+    write_bytes(writer, &value, sizeof(value));
+}
+
+// Blobs start on an aligned offset so that they are used in place once read
+static void write_blob(Writer *writer, void const *data, u64 size)
+{
+    static u8 const zeros[COOKED_ALIGN] = {0};
+
+    write_u64(writer, data ? size : 0);
+    write_bytes(writer, zeros, (COOKED_ALIGN - writer->pos % COOKED_ALIGN) % COOKED_ALIGN);
+    write_bytes(writer, data, data ? size : 0);
+}
+
+static void write_string(Writer *writer, char const *str)
+{
+    u32 const len = strlen(str);
+    write_u32(writer, len);
+    write_bytes(writer, str, len);
+}
+
+static void const *read_bytes(Reader *reader, u64 size)
+{
+    if (reader->error || size > reader->size - reader->pos) {
+        reader->error = true;
+        return NULL;
+    }
+    void const *data = reader->data + reader->pos;
+    reader->pos += size;
+    return data;
+}
+
+static void read_into(Reader *reader, void *dst, u64 size)
+{
+    void const *src = read_bytes(reader, size);
+    if (src) {
+        memcpy(dst, src, size);
+    }
+    else {
+        memset(dst, 0, size);
+    }
+}
+
+static u32 read_u32(Reader *reader)
+{
+    u32 value;
+    read_into(reader, &value, sizeof(value));
+    return value;
+}
+
+static u64 read_u64(Reader *reader)
+{
+    u64 value;
+    read_into(reader, &value, sizeof(value));
+    return value;
+}
+
+// Element counts are checked against what is left, every element taking at least `min_size` bytes
+static u32 read_count(Reader *reader, u64 min_size)
+{
+    u32 const count = read_u32(reader);
+    if (count * min_size > reader->size - reader->pos) {
+        reader->error = true;
+        return 0;
+    }
+    return count;
+}
+
+static void *read_blob(Reader *reader, u64 *size)
+{
+    u64 const len = read_u64(reader);
+    read_bytes(reader, (COOKED_ALIGN - reader->pos % COOKED_ALIGN) % COOKED_ALIGN);
+
+    void *data = len > 0 ? (void *)read_bytes(reader, len) : NULL;
+    if (size) {
+        *size = data ? len : 0;
+    }
+    return data;
+}
+
+// Copies `count` elements into their own allocation
+static void *read_array(Reader *reader, u64 element_size, u64 count)
+{
+    if (count == 0 || count > reader->size / element_size) {
+        reader->error |= count > 0;
+        return NULL;
+    }
+    void *data = walrus_malloc(element_size * count);
+    read_into(reader, data, element_size * count);
+    return data;
+}
+
+static char *read_string(Reader *reader)
+{
+    u32 const   len = read_u32(reader);
+    char const *str = read_bytes(reader, len);
+    return str ? walrus_str_substr(str, 0, len) : NULL;
+}
+
+static void *file_read(char const *path, u64 *size)
+{
+    FILE *file = fopen(path, "rb");
+    if (file == NULL) {
+        return NULL;
+    }
+
+    i64 len = -1;
+    if (fseek(file, 0, SEEK_END) == 0) {
+        len = ftell(file);
+    }
+    fseek(file, 0, SEEK_SET);
+
+    void *data = len >= 0 ? walrus_malloc(walrus_max(len, 1)) : NULL;
+    if (data && fread(data, 1, len, file) != (u64)len) {
+        walrus_free(data);
+        data = NULL;
+    }
+    fclose(file);
+
+    *size = len;
+    return data;
+}
+
+// FNV-1a over whole words, it only has to notice that a source changed
+static u64 content_hash(void const *data, u64 size)
+{
+    u8 const *bytes = data;
+    u64       hash  = 0xcbf29ce484222325ull;
+    u64       i     = 0;
+    for (; i + sizeof(u64) <= size; i += sizeof(u64)) {
+        u64 word;
+        memcpy(&word, bytes + i, sizeof(word));
+        hash = (hash ^ word) * 0x100000001b3ull;
+    }
+    for (; i < size; ++i) {
+        hash = (hash ^ bytes[i]) * 0x100000001b3ull;
+    }
+    return (hash ^ size) * 0x100000001b3ull;
+}
+
+static bool file_hash(char const *path, u64 *hash)
+{
+    u64   size = 0;
+    void *data = file_read(path, &size);
+    if (data == NULL) {
+        return false;
+    }
+    *hash = content_hash(data, size);
+    walrus_free(data);
+    return true;
+}
+
+// What a source looked like when it was cooked. Its size and time tell most of the time whether it changed, the
+// content is only hashed when they are not conclusive.
+typedef struct {
+    u64 size;
+    u64 mtime;
+    u64 hash;
+} SourceStamp;
+
+static bool stamp_take(char const *path, SourceStamp *stamp)
+{
+    return walrus_file_stat(path, &stamp->size, &stamp->mtime) && file_hash(path, &stamp->hash);
+}
+
+static void stamp_write(Writer *writer, SourceStamp const *stamp)
+{
+    write_u64(writer, stamp->size);
+    write_u64(writer, stamp->mtime);
+    write_u64(writer, stamp->hash);
+}
+
+static void stamp_read(Reader *reader, SourceStamp *stamp)
+{
+    stamp->size  = read_u64(reader);
+    stamp->mtime = read_u64(reader);
+    stamp->hash  = read_u64(reader);
+}
+
+// A file whose time is the second of the cook or later may have changed since within the same second, and a touched
+// file may have kept its content, both are hashed
+static bool stamp_fresh(char const *path, SourceStamp const *cooked, u64 cook_time)
+{
+    u64 size  = 0;
+    u64 mtime = 0;
+    if (!walrus_file_stat(path, &size, &mtime) || size != cooked->size) {
+        return false;
+    }
+    if (mtime == cooked->mtime && mtime < cook_time) {
+        return true;
+    }
+    u64 hash = 0;
+    return file_hash(path, &hash) && hash == cooked->hash;
+}
+
+static char *cooked_path(char const *filename)
+{
+    return walrus_str_njoin(filename, strlen(filename), ".cooked", strlen(".cooked"));
+}
+
+// Sources are named relative to the model, as the URIs of its buffers and images are
+static char *source_path(char const *filename, char const *uri)
+{
+    u64 const parent = walrus_min(walrus_str_last_of(filename, '/'), strlen(filename));
+    u64 const len    = strlen(uri);
+    char     *path   = walrus_str_alloc(parent + 1 + len);
+    walrus_str_nappend(&path, filename, parent);
+    walrus_str_nappend(&path, "/", 1);
+    walrus_str_nappend(&path, uri, len);
+    return path;
+}
+
+static void source_write(Writer *writer, char const *filename, char const *uri)
+{
+    char *decoded = walrus_str_dup(uri);
+    cgltf_decode_uri(decoded);
+
+    char       *path  = source_path(filename, decoded);
+    SourceStamp stamp = {0};
+    stamp_take(path, &stamp);
+    write_string(writer, decoded);
+    stamp_write(writer, &stamp);
+
+    walrus_str_free(path);
+    walrus_str_free(decoded);
+}
+
+static bool uri_external(char const *uri)
+{
+    return uri && strncmp(uri, "data:", strlen("data:")) != 0;
+}
+
+// The model file itself, then every buffer and image it references by file. Embedded data changes the model file.
+static void sources_write(Writer *writer, struct cgltf_data const *gltf, char const *filename, u64 cook_time,
+                          SourceStamp const *stamp)
+{
+    u32 num_sources = 0;
+    for (u32 i = 0; i < gltf->buffers_count; ++i) {
+        num_sources += uri_external(gltf->buffers[i].uri);
+    }
+    for (u32 i = 0; i < gltf->images_count; ++i) {
+        num_sources += gltf->images[i].buffer_view == NULL && uri_external(gltf->images[i].uri);
+    }
+
+    write_u64(writer, cook_time);
+    stamp_write(writer, stamp);
+    write_u32(writer, num_sources);
+    for (u32 i = 0; i < gltf->buffers_count; ++i) {
+        if (uri_external(gltf->buffers[i].uri)) {
+            source_write(writer, filename, gltf->buffers[i].uri);
+        }
+    }
+    for (u32 i = 0; i < gltf->images_count; ++i) {
+        if (gltf->images[i].buffer_view == NULL && uri_external(gltf->images[i].uri)) {
+            source_write(writer, filename, gltf->images[i].uri);
+        }
+    }
+}
+
+static bool sources_read(Reader *reader, char const *filename)
+{
+    u64 const   cook_time = read_u64(reader);
+    SourceStamp stamp;
+    stamp_read(reader, &stamp);
+    if (reader->error || !stamp_fresh(filename, &stamp, cook_time)) {
+        return false;
+    }
+
+    u32 const num_sources = read_u32(reader);
+    for (u32 i = 0; i < num_sources && !reader->error; ++i) {
+        char *uri = read_string(reader);
+        stamp_read(reader, &stamp);
+        if (uri == NULL) {
+            return false;
+        }
+        char *path  = source_path(filename, uri);
+        bool  fresh = stamp_fresh(path, &stamp, cook_time);
+        walrus_str_free(path);
+        walrus_str_free(uri);
+        if (!fresh) {
+            return false;
+        }
+    }
+    return !reader->error;
+}
+
+static void meshes_write(Writer *writer, Walrus_Model const *model)
+{
+    write_u32(writer, model->num_meshes);
+    for (u32 i = 0; i < model->num_meshes; ++i) {
+        Walrus_Mesh const *mesh = &model->meshes[i];
+        write_bytes(writer, mesh->name, sizeof(mesh->name));
+        write_u32(writer, mesh->num_weights);
+        write_bytes(writer, mesh->weights, mesh->num_weights * sizeof(f32));
+        write_u32(writer, mesh->num_primitives);
+        for (u32 j = 0; j < mesh->num_primitives; ++j) {
+            Walrus_MeshPrimitive const *primitive = &mesh->primitives[j];
+            write_u32(writer, primitive->num_streams);
+            for (u32 k = 0; k < primitive->num_streams; ++k) {
+                write_u32(writer, primitive->streams[k].buffer.id);
+                write_u32(writer, primitive->streams[k].offset);
+                write_u32(writer, primitive->streams[k].num_vertices);
+            }
+            write_u32(writer, primitive->indices.buffer.id);
+            write_u32(writer, primitive->indices.offset);
+            write_u32(writer, primitive->indices.num_indices);
+            write_u32(writer, primitive->indices.index32);
+            write_u32(writer, primitive->num_lods);
+            write_bytes(writer, primitive->lods, primitive->num_lods * sizeof(Walrus_MeshLod));
+            write_u32(writer, cooked_index(primitive->material, model->materials));
+            write_bytes(writer, primitive->min, sizeof(vec3));
+            write_bytes(writer, primitive->max, sizeof(vec3));
+        }
+    }
+}
+
+static void meshes_read(Reader *reader, Walrus_Model *model)
+{
+    model->num_meshes = read_count(reader, sizeof(((Walrus_Mesh *)0)->name));
+    model->meshes     = cooked_new0(Walrus_Mesh, model->num_meshes);
+    for (u32 i = 0; i < model->num_meshes; ++i) {
+        Walrus_Mesh *mesh = &model->meshes[i];
+        read_into(reader, mesh->name, sizeof(mesh->name));
+        mesh->name[sizeof(mesh->name) - 1] = 0;
+
+        mesh->num_weights    = read_count(reader, sizeof(f32));
+        mesh->weights        = read_array(reader, sizeof(f32), mesh->num_weights);
+        mesh->num_primitives = read_count(reader, sizeof(u32));
+        mesh->primitives     = cooked_new0(Walrus_MeshPrimitive, mesh->num_primitives);
+        for (u32 j = 0; j < mesh->num_primitives; ++j) {
+            Walrus_MeshPrimitive *primitive   = &mesh->primitives[j];
+            u32 const             num_streams = read_u32(reader);
+            primitive->num_streams            = walrus_min(num_streams, (u32)WR_RHI_MAX_VERTEX_STREAM);
+            for (u32 k = 0; k < primitive->num_streams; ++k) {
+                primitive->streams[k].buffer.id        = read_u32(reader);
+                primitive->streams[k].layout_handle.id = WR_INVALID_HANDLE;
+                primitive->streams[k].offset           = read_u32(reader);
+                primitive->streams[k].num_vertices     = read_u32(reader);
+            }
+            primitive->indices.buffer.id   = read_u32(reader);
+            primitive->indices.offset      = read_u32(reader);
+            primitive->indices.num_indices = read_u32(reader);
+            primitive->indices.index32     = read_u32(reader);
+
+            primitive->num_lods = read_u32(reader);
+            if (primitive->num_lods > WR_MESH_MAX_LODS) {
+                primitive->num_lods = 0;
+                reader->error       = true;
+            }
+            read_into(reader, primitive->lods, primitive->num_lods * sizeof(Walrus_MeshLod));
+
+            u32 const material         = read_u32(reader);
+            primitive->material        = cooked_pointer(model->materials, material, model->num_materials);
+            primitive->morph_target.id = WR_INVALID_HANDLE;
+            read_into(reader, primitive->min, sizeof(vec3));
+            read_into(reader, primitive->max, sizeof(vec3));
+        }
+    }
+}
+
+static void nodes_write(Writer *writer, Walrus_Model const *model)
+{
+    write_u32(writer, model->num_nodes);
+    for (u32 i = 0; i < model->num_nodes; ++i) {
+        Walrus_ModelNode const *node = &model->nodes[i];
+        write_u32(writer, cooked_index(node->mesh, model->meshes));
+        write_u32(writer, cooked_index(node->parent, model->nodes));
+        write_u32(writer, cooked_index(node->skin, model->skins));
+        write_u32(writer, node->num_children);
+        for (u32 j = 0; j < node->num_children; ++j) {
+            write_u32(writer, cooked_index(node->children[j], model->nodes));
+        }
+        write_bytes(writer, &node->local_transform, sizeof(Walrus_Transform));
+        write_bytes(writer, &node->world_transform, sizeof(Walrus_Transform));
+    }
+
+    write_u32(writer, model->num_roots);
+    for (u32 i = 0; i < model->num_roots; ++i) {
+        write_u32(writer, cooked_index(model->roots[i], model->nodes));
+    }
+    write_bytes(writer, model->hierarchy, model->num_nodes * sizeof(u32));
+    write_bytes(writer, model->parents, model->num_nodes * sizeof(u32));
+}
+
+static Walrus_ModelNode **read_node_pointers(Reader *reader, Walrus_Model const *model, u32 count)
+{
+    Walrus_ModelNode **nodes = cooked_new(Walrus_ModelNode *, count);
+    for (u32 i = 0; i < count; ++i) {
+        u32 const index = read_u32(reader);
+        nodes[i]        = cooked_pointer(model->nodes, index, model->num_nodes);
+    }
+    return nodes;
+}
+
+// Meshes and skins are allocated before the nodes point to them
+static void nodes_read(Reader *reader, Walrus_Model *model)
+{
+    model->num_nodes = read_count(reader, sizeof(u32));
+    model->nodes     = cooked_new0(Walrus_ModelNode, model->num_nodes);
+    for (u32 i = 0; i < model->num_nodes; ++i) {
+        Walrus_ModelNode *node = &model->nodes[i];
+
+        u32 const mesh   = read_u32(reader);
+        u32 const parent = read_u32(reader);
+        u32 const skin   = read_u32(reader);
+        node->mesh       = cooked_pointer(model->meshes, mesh, model->num_meshes);
+        node->parent     = cooked_pointer(model->nodes, parent, model->num_nodes);
+        node->skin       = cooked_pointer(model->skins, skin, model->num_skins);
+
+        node->num_children = read_count(reader, sizeof(u32));
+        node->children     = read_node_pointers(reader, model, node->num_children);
+        read_into(reader, &node->local_transform, sizeof(Walrus_Transform));
+        read_into(reader, &node->world_transform, sizeof(Walrus_Transform));
+    }
+
+    model->num_roots = read_count(reader, sizeof(u32));
+    model->roots     = read_node_pointers(reader, model, model->num_roots);
+    model->hierarchy = read_array(reader, sizeof(u32), model->num_nodes);
+    model->parents   = read_array(reader, sizeof(u32), model->num_nodes);
+}
+
+static void skins_write(Writer *writer, Walrus_Model const *model)
+{
+    for (u32 i = 0; i < model->num_skins; ++i) {
+        Walrus_ModelSkin const *skin = &model->skins[i];
+        write_u32(writer, cooked_index(skin->skeleton, model->nodes));
+        write_u32(writer, skin->num_joints);
+        for (u32 j = 0; j < skin->num_joints; ++j) {
+            Walrus_SkinJoint const *joint = &skin->joints[j];
+            write_u32(writer, cooked_index(joint->node, model->nodes));
+            write_bytes(writer, joint->inverse_bind_matrix, sizeof(mat4));
+            write_bytes(writer, joint->min, sizeof(vec3));
+            write_bytes(writer, joint->max, sizeof(vec3));
+        }
+    }
+}
+
+static void skins_read(Reader *reader, Walrus_Model *model)
+{
+    for (u32 i = 0; i < model->num_skins; ++i) {
+        Walrus_ModelSkin *skin = &model->skins[i];
+
+        u32 const skeleton = read_u32(reader);
+        skin->skeleton     = cooked_pointer(model->nodes, skeleton, model->num_nodes);
+        skin->num_joints   = read_count(reader, sizeof(mat4));
+        skin->joints       = cooked_new(Walrus_SkinJoint, skin->num_joints);
+        for (u32 j = 0; j < skin->num_joints; ++j) {
+            Walrus_SkinJoint *joint = &skin->joints[j];
+            u32 const         node  = read_u32(reader);
+            joint->node             = cooked_pointer(model->nodes, node, model->num_nodes);
+            read_into(reader, joint->inverse_bind_matrix, sizeof(mat4));
+            read_into(reader, joint->min, sizeof(vec3));
+            read_into(reader, joint->max, sizeof(vec3));
+        }
+    }
+}
+
+// Number of elements of every packed array of the stream that its tracks use, COOKED_NONE for a missing array
+static void stream_sizes(Walrus_AnimationStream const *stream, u32 *num_timestamps, u32 *num_values,
+                         u32 *num_quantized)
+{
+    *num_timestamps = stream->timestamps ? 0 : COOKED_NONE;
+    *num_values     = stream->values ? 0 : COOKED_NONE;
+    *num_quantized  = stream->quantized ? 0 : COOKED_NONE;
+    for (u32 i = 0; i < stream->num_tracks; ++i) {
+        Walrus_AnimationTrack const *track = &stream->tracks[i];
+        u32 const scale = track->interpolation == WR_ANIMATION_INTERPOLATION_CUBIC_SPLINE ? 3 : 1;
+        *num_timestamps = walrus_max(*num_timestamps, (track->timestamps - stream->timestamps) + track->num_keys);
+        if (track->values) {
+            u32 const end = (track->values - stream->values) + track->num_keys * track->num_components * scale;
+            *num_values   = walrus_max(*num_values, end);
+        }
+        if (track->quantized) {
+            *num_quantized = walrus_max(*num_quantized, (track->quantized - stream->quantized) + track->num_keys * 3);
+        }
+    }
+}
+
+static void *read_packed(Reader *reader, u64 element_size, u32 count)
+{
+    if (count == COOKED_NONE) {
+        return NULL;
+    }
+    if (count > reader->size / element_size) {
+        reader->error = true;
+        return NULL;
+    }
+    void *data = walrus_malloc(element_size * walrus_max(count, 1u));
+    read_into(reader, data, element_size * count);
+    return data;
+}
+
+static void stream_write(Writer *writer, Walrus_AnimationStream const *stream)
+{
+    u32 num_timestamps, num_values, num_quantized;
+    stream_sizes(stream, &num_timestamps, &num_values, &num_quantized);
+
+    write_u32(writer, stream->num_tracks);
+    write_u32(writer, num_timestamps);
+    write_u32(writer, num_values);
+    write_u32(writer, num_quantized);
+    write_bytes(writer, stream->timestamps, (num_timestamps != COOKED_NONE ? num_timestamps : 0) * sizeof(f32));
+    write_bytes(writer, stream->values, (num_values != COOKED_NONE ? num_values : 0) * sizeof(f32));
+    write_bytes(writer, stream->quantized, (num_quantized != COOKED_NONE ? num_quantized : 0) * sizeof(u16));
+    for (u32 i = 0; i < stream->num_tracks; ++i) {
+        Walrus_AnimationTrack const *track = &stream->tracks[i];
+        write_u32(writer, track->interpolation);
+        write_u32(writer, cooked_index(track->timestamps, stream->timestamps));
+        write_u32(writer, cooked_index(track->values, stream->values));
+        write_u32(writer, cooked_index(track->quantized, stream->quantized));
+        write_bytes(writer, track->range_min, sizeof(vec3));
+        write_bytes(writer, track->range_extent, sizeof(vec3));
+        write_u32(writer, track->node);
+        write_u32(writer, track->num_components);
+        write_u32(writer, track->num_keys);
+    }
+}
+
+static void stream_read(Reader *reader, Walrus_AnimationStream *stream)
+{
+    stream->num_tracks       = read_count(reader, sizeof(u32));
+    u32 const num_timestamps = read_u32(reader);
+    u32 const num_values     = read_u32(reader);
+    u32 const num_quantized  = read_u32(reader);
+    stream->tracks     = cooked_new(Walrus_AnimationTrack, stream->num_tracks);
+    stream->timestamps = read_packed(reader, sizeof(f32), num_timestamps);
+    stream->values     = read_packed(reader, sizeof(f32), num_values);
+    stream->quantized  = read_packed(reader, sizeof(u16), num_quantized);
+    for (u32 i = 0; i < stream->num_tracks; ++i) {
+        Walrus_AnimationTrack *track = &stream->tracks[i];
+        track->interpolation         = read_u32(reader);
+
+        u32 const timestamps = read_u32(reader);
+        u32 const values     = read_u32(reader);
+        u32 const quantized  = read_u32(reader);
+        track->timestamps    = cooked_pointer(stream->timestamps, timestamps, num_timestamps);
+        track->values        = cooked_pointer(stream->values, values, num_values);
+        track->quantized     = cooked_pointer(stream->quantized, quantized, num_quantized);
+        read_into(reader, track->range_min, sizeof(vec3));
+        read_into(reader, track->range_extent, sizeof(vec3));
+        track->node           = read_u32(reader);
+        track->num_components = read_u32(reader);
+        track->num_keys       = read_u32(reader);
+    }
+}
+
+static void animations_write(Writer *writer, Walrus_Model const *model)
+{
+    write_u32(writer, model->num_animations);
+    for (u32 i = 0; i < model->num_animations; ++i) {
+        Walrus_Animation const *animation = &model->animations[i];
+        write_bytes(writer, &animation->duration, sizeof(f32));
+        write_u32(writer, animation->num_tracks);
+
+        write_u32(writer, animation->num_samplers);
+        for (u32 j = 0; j < animation->num_samplers; ++j) {
+            Walrus_AnimationSampler const *sampler = &animation->samplers[j];
+            write_u32(writer, sampler->interpolation);
+            write_u32(writer, sampler->num_components);
+            write_u32(writer, sampler->num_frames);
+            write_bytes(writer, sampler->timestamps, sampler->num_frames * sizeof(f32));
+            write_bytes(writer, sampler->data, sampler->num_frames * sampler->num_components * sizeof(f32));
+        }
+
+        write_u32(writer, animation->num_channels);
+        for (u32 j = 0; j < animation->num_channels; ++j) {
+            Walrus_AnimationChannel const *channel = &animation->channels[j];
+            write_u32(writer, cooked_index(channel->sampler, animation->samplers));
+            write_u32(writer, cooked_index(channel->node, model->nodes));
+            write_u32(writer, channel->path);
+        }
+
+        for (u32 path = 0; path < WR_ANIMATION_PATH_COUNT; ++path) {
+            stream_write(writer, &animation->streams[path]);
+        }
+    }
+}
+
+static void animations_read(Reader *reader, Walrus_Model *model)
+{
+    model->num_animations = read_count(reader, sizeof(u32));
+    model->animations     = cooked_new0(Walrus_Animation, model->num_animations);
+    for (u32 i = 0; i < model->num_animations; ++i) {
+        Walrus_Animation *animation = &model->animations[i];
+        read_into(reader, &animation->duration, sizeof(f32));
+        animation->num_tracks = read_u32(reader);
+
+        animation->num_samplers = read_count(reader, sizeof(u32));
+        animation->samplers     = cooked_new0(Walrus_AnimationSampler, animation->num_samplers);
+        for (u32 j = 0; j < animation->num_samplers; ++j) {
+            Walrus_AnimationSampler *sampler = &animation->samplers[j];
+            sampler->interpolation           = read_u32(reader);
+            sampler->num_components          = read_u32(reader);
+            sampler->num_frames              = read_count(reader, sizeof(f32));
+            sampler->timestamps              = read_array(reader, sizeof(f32), sampler->num_frames);
+
+            u32 const num_values = sampler->num_frames * sampler->num_components;
+            sampler->data        = read_packed(reader, sizeof(f32), num_values);
+        }
+
+        animation->num_channels = read_count(reader, sizeof(u32));
+        animation->channels     = cooked_new(Walrus_AnimationChannel, animation->num_channels);
+        for (u32 j = 0; j < animation->num_channels; ++j) {
+            Walrus_AnimationChannel *channel = &animation->channels[j];
+
+            u32 const sampler = read_u32(reader);
+            u32 const node    = read_u32(reader);
+            channel->sampler  = cooked_pointer(animation->samplers, sampler, animation->num_samplers);
+            channel->node     = cooked_pointer(model->nodes, node, model->num_nodes);
+            channel->path     = read_u32(reader);
+        }
+
+        for (u32 path = 0; path < WR_ANIMATION_PATH_COUNT; ++path) {
+            stream_read(reader, &animation->streams[path]);
+        }
+    }
+}
+
+static void model_write(Writer *writer, Walrus_Model const *model)
+{
+    write_u32(writer, model->num_buffers);
+    write_u32(writer, model->num_textures);
+    write_u32(writer, model->num_materials);
+    write_u32(writer, model->num_skins);
+
+    meshes_write(writer, model);
+    nodes_write(writer, model);
+    skins_write(writer, model);
+    animations_write(writer, model);
+}
+
+// Allocates as model_allocate does, so that the model is freed the same way. Handles stay invalid until the upload
+// and materials uninitialized.
+static void model_read(Reader *reader, Walrus_Model *model)
+{
+    model->num_buffers = read_count(reader, sizeof(u64));
+    model->buffers     = cooked_new(Walrus_BufferHandle, model->num_buffers);
+    for (u32 i = 0; i < model->num_buffers; ++i) {
+        model->buffers[i].id = WR_INVALID_HANDLE;
+    }
+    model->vertex_buffer.id = WR_INVALID_HANDLE;
+
+    model->num_textures = read_count(reader, sizeof(ModelTexture));
+    model->textures     = cooked_new(Walrus_TextureHandle, model->num_textures);
+    for (u32 i = 0; i < model->num_textures; ++i) {
+        model->textures[i].id = WR_INVALID_HANDLE;
+    }
+
+    model->num_materials = read_count(reader, sizeof(ModelMaterial));
+    model->materials     = cooked_new(Walrus_Material, model->num_materials);
+
+    model->num_skins = read_count(reader, sizeof(u32));
+    model->skins     = cooked_new0(Walrus_ModelSkin, model->num_skins);
+
+    meshes_read(reader, model);
+    nodes_read(reader, model);
+    skins_read(reader, model);
+    animations_read(reader, model);
+}
+
+static void data_write(Writer *writer, Walrus_ModelData const *data)
+{
+    write_u32(writer, data->num_buffers);
+    for (u32 i = 0; i < data->num_buffers; ++i) {
+        write_blob(writer, data->buffers[i].data, data->buffers[i].size);
+    }
+
+    write_u32(writer, data->num_images);
+    for (u32 i = 0; i < data->num_images; ++i) {
+        Walrus_Image const *image = &data->images[i];
+        write_u32(writer, image->width);
+        write_u32(writer, image->height);
+        write_u32(writer, image->channel);
+        write_blob(writer, image->data, (u64)image->width * image->height * 4);
+    }
+
+    write_u32(writer, data->num_textures);
+    write_bytes(writer, data->textures, data->num_textures * sizeof(ModelTexture));
+    write_u32(writer, data->num_materials);
+    write_bytes(writer, data->materials, data->num_materials * sizeof(ModelMaterial));
+
+    u32 const num_layouts = walrus_array_len(data->layouts);
+    write_u32(writer, num_layouts);
+    for (u32 i = 0; i < num_layouts; ++i) {
+        write_bytes(writer, walrus_array_get(data->layouts, i), sizeof(Walrus_VertexLayout));
+    }
+
+    u32 const num_morphs = walrus_array_len(data->morphs);
+    write_u32(writer, num_morphs);
+    for (u32 i = 0; i < num_morphs; ++i) {
+        MorphData const *morph = walrus_array_get(data->morphs, i);
+        write_u32(writer, morph->num_vertices);
+        write_u32(writer, morph->num_targets);
+        write_blob(writer, morph->offsets, 4 * (u64)morph->num_vertices * morph->num_targets * sizeof(vec3));
+    }
+
+    write_blob(writer, data->vertices, data->vertices_size);
+}
+
+// Blobs are left in the cooked file, everything else is copied out of it
+static void data_read(Reader *reader, Walrus_ModelData *data)
+{
+    data->num_buffers = read_count(reader, sizeof(u64));
+    data->buffers     = walrus_new(ModelBuffer, walrus_max(data->num_buffers, 1u));
+    for (u32 i = 0; i < data->num_buffers; ++i) {
+        data->buffers[i].data = read_blob(reader, &data->buffers[i].size);
+    }
+
+    data->num_images = read_count(reader, 3 * sizeof(u32) + sizeof(u64));
+    data->images     = walrus_new0(Walrus_Image, walrus_max(data->num_images, 1u));
+    for (u32 i = 0; i < data->num_images; ++i) {
+        Walrus_Image *image = &data->images[i];
+        image->width        = read_u32(reader);
+        image->height       = read_u32(reader);
+        image->channel      = read_u32(reader);
+
+        u64 size    = 0;
+        image->data = read_blob(reader, &size);
+        if (size != (u64)image->width * image->height * 4) {
+            image->data = NULL;
+        }
+    }
+
+    data->num_textures = read_count(reader, sizeof(ModelTexture));
+    data->textures     = walrus_new(ModelTexture, walrus_max(data->num_textures, 1u));
+    read_into(reader, data->textures, data->num_textures * sizeof(ModelTexture));
+    data->num_materials = read_count(reader, sizeof(ModelMaterial));
+    data->materials     = walrus_new(ModelMaterial, walrus_max(data->num_materials, 1u));
+    read_into(reader, data->materials, data->num_materials * sizeof(ModelMaterial));
+
+    u32 const num_layouts = read_count(reader, sizeof(Walrus_VertexLayout));
+    data->layouts         = walrus_array_create(sizeof(Walrus_VertexLayout), 0);
+    for (u32 i = 0; i < num_layouts; ++i) {
+        Walrus_VertexLayout layout;
+        read_into(reader, &layout, sizeof(layout));
+        walrus_array_append(data->layouts, &layout);
+    }
+
+    u32 const num_morphs = read_count(reader, 2 * sizeof(u32) + sizeof(u64));
+    data->morphs         = walrus_array_create(sizeof(MorphData), 0);
+    for (u32 i = 0; i < num_morphs; ++i) {
+        MorphData morph;
+        morph.num_vertices = read_u32(reader);
+        morph.num_targets  = read_u32(reader);
+
+        u64 size      = 0;
+        morph.offsets = read_blob(reader, &size);
+        if (size != 4 * (u64)morph.num_vertices * morph.num_targets * sizeof(vec3)) {
+            morph.offsets = NULL;
+        }
+        walrus_array_append(data->morphs, &morph);
+    }
+
+    data->vertices = read_blob(reader, &data->vertices_size);
+}
+
+// Everything the upload reads must be in range, a file that does not match is stale rather than trusted
+static bool data_valid(Walrus_Model const *model, Walrus_ModelData const *data)
+{
+    if (data->num_buffers != model->num_buffers || data->num_textures != model->num_textures ||
+        data->num_materials != model->num_materials) {
+        return false;
+    }
+    for (u32 i = 0; i < data->num_materials; ++i) {
+        ModelMaterial const *material = &data->materials[i];
+        if (material->num_properties > WR_MATERIAL_MAX_PROPERTIES) {
+            return false;
+        }
+        for (u32 j = 0; j < material->num_properties; ++j) {
+            ModelMaterialProperty const *property = &material->properties[j];
+            if (property->name >= WR_MESH_PROPERTY_COUNT || property->type > MODEL_PROPERTY_TEXTURE ||
+                (property->type == MODEL_PROPERTY_TEXTURE && property->texture >= data->num_textures)) {
+                return false;
+            }
+        }
+    }
+
+    u32 num_streams    = 0;
+    u32 num_primitives = 0;
+    for (u32 i = 0; i < model->num_meshes; ++i) {
+        Walrus_Mesh const *mesh = &model->meshes[i];
+        for (u32 j = 0; j < mesh->num_primitives; ++j) {
+            Walrus_MeshPrimitive const *primitive = &mesh->primitives[j];
+            u32 const  id        = primitive->indices.buffer.id;
+            bool const generated = id == model->num_buffers && data->vertices_size > 0;
+            if (primitive->indices.num_indices > 0 && id >= model->num_buffers && !generated) {
+                return false;
+            }
+            num_streams += primitive->num_streams;
+        }
+        num_primitives += mesh->num_primitives;
+    }
+    return num_streams == walrus_array_len(data->layouts) && num_primitives == walrus_array_len(data->morphs);
+}
+
+bool walrus_model_cache_read(Walrus_Model *model, Walrus_ModelData **data, char const *filename, u32 flags)
+{
+    u64 const start = walrus_sysclock(WR_SYS_CLOCK_UNIT_MICROSEC);
+
+    char *path   = cooked_path(filename);
+    u64   size   = 0;
+    void *cooked = file_read(path, &size);
+    walrus_str_free(path);
+    if (cooked == NULL) {
+        return false;
+    }
+
+    Reader reader = {cooked, size, 0, false};
+    if (read_u32(&reader) != COOKED_MAGIC || read_u32(&reader) != COOKED_VERSION || read_u32(&reader) != flags ||
+        !sources_read(&reader, filename)) {
+        walrus_trace("cooked model %s is stale", filename);
+        walrus_free(cooked);
+        return false;
+    }
+
+    Walrus_ModelData *decoded = walrus_new0(Walrus_ModelData, 1);
+    decoded->cooked           = cooked;
+    decoded->filename         = walrus_str_dup(filename);
+    decoded->flags            = flags;
+
+    model_read(&reader, model);
+    data_read(&reader, decoded);
+    if (reader.error || !data_valid(model, decoded)) {
+        walrus_error("fail to read cooked model %s", filename);
+        walrus_model_deallocate(model);
+        walrus_model_data_free(decoded);
+        return false;
+    }
+
+    decoded->parse_time = walrus_sysclock(WR_SYS_CLOCK_UNIT_MICROSEC) - start;
+    *data               = decoded;
+
+    return true;
+}
+
+// Written next to the model then renamed over the previous file, a reader never sees a partial file
+void walrus_model_cache_write(Walrus_Model const *model, Walrus_ModelData const *data, char const *filename)
+{
+    // Taken before any source is looked at, a change after it always shows in their time
+    u64 const   cook_time = walrus_sysclock(WR_SYS_CLOCK_UNIT_SEC);
+    SourceStamp stamp;
+    if (!stamp_take(filename, &stamp)) {
+        return;
+    }
+
+    char *path = cooked_path(filename);
+    char *temp = walrus_str_njoin(path, walrus_str_len(path), ".tmp", strlen(".tmp"));
+
+    Writer writer = {fopen(temp, "wb"), 0};
+    if (writer.file == NULL) {
+        walrus_error("fail to fopen: %s", temp);
+        walrus_str_free(temp);
+        walrus_str_free(path);
+        return;
+    }
+
+    write_u32(&writer, COOKED_MAGIC);
+    write_u32(&writer, COOKED_VERSION);
+    write_u32(&writer, data->flags);
+    sources_write(&writer, data->gltf, filename, cook_time, &stamp);
+    model_write(&writer, model);
+    data_write(&writer, data);
+
+    bool const written = ferror(writer.file) == 0;
+    fclose(writer.file);
+
+    remove(path);
+    if (!written || rename(temp, path) != 0) {
+        walrus_error("fail to write cooked model %s", path);
+        remove(temp);
+    }
+
+    walrus_str_free(temp);
+    walrus_str_free(path);
+}
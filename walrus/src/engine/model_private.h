@@ -0,0 +1,100 @@
+#pragma once
+
+#include <engine/model.h>
+#include <core/array.h>
+#include <core/image.h>
+
+struct cgltf_data;
+
+typedef struct {
+    void const *data;
+    u64         size;
+} ModelBuffer;
+
+// Created at upload if a material uses it, `flags` holds the sampler and whether its first use is sRGB
+typedef struct {
+    u32  image;
+    u64  flags;
+    bool used;
+} ModelTexture;
+
+typedef enum {
+    MODEL_PROPERTY_FLOAT,
+    MODEL_PROPERTY_VEC3,
+    MODEL_PROPERTY_VEC4,
+    MODEL_PROPERTY_TEXTURE,
+} ModelPropertyType;
+
+// Properties are set in order at upload, over the defaults of walrus_model_material_init_default
+typedef struct {
+    Walrus_MeshMaterialProperty name;
+    ModelPropertyType           type;
+    u32                         texture;
+    bool                        srgb;
+    vec4                        value;
+} ModelMaterialProperty;
+
+typedef struct {
+    bool                  double_sided;
+    Walrus_AlphaMode      alpha_mode;
+    u32                   num_properties;
+    ModelMaterialProperty properties[WR_MATERIAL_MAX_PROPERTIES];
+} ModelMaterial;
+
+// Offsets of every target, one layer per attribute of the morph texture
+typedef struct {
+    f32 *offsets;
+    u32  num_vertices;
+    u32  num_targets;
+} MorphData;
+
+// Until the upload, the buffer handles of the primitive streams and indices hold the index of their buffer, the
+// streams and indices generated at load hold the index past the last buffer. The buffers, generated vertices, morph
+// offsets and image pixels either belong to the glTF document or point into the cooked file.
+struct Walrus_ModelData {
+    struct cgltf_data *gltf;
+    void              *cooked;
+
+    ModelBuffer *buffers;
+    u32          num_buffers;
+
+    Walrus_Image *images;
+    u32           num_images;
+
+    ModelTexture *textures;
+    u32           num_textures;
+
+    ModelMaterial *materials;
+    u32            num_materials;
+
+    // Vertex layouts of every stream and morph targets of every primitive, in mesh order
+    Walrus_Array *layouts;
+    Walrus_Array *morphs;
+
+    // Generated tangents, and the streams and indices of optimized primitives
+    void *vertices;
+    u64   vertices_size;
+
+    // Walrus_ModelLoadFlag the model was decoded with
+    u32 flags;
+
+    // Microseconds spent in every stage, reported once the model is uploaded
+    char *filename;
+    u64   parse_time;
+    u64   image_time;
+    u64   tangent_time;
+    u64   optimize_time;
+};
+
+// Frees the arrays of a model whose GPU resources were never created or are already destroyed
+void walrus_model_deallocate(Walrus_Model *model);
+
+// Data read from a cooked file points into it
+void walrus_model_data_free(Walrus_ModelData *data);
+
+// Loads the cooked file of the model, fails when it is missing, stale, written by another version or cooked with other
+// load flags
+bool walrus_model_cache_read(Walrus_Model *model, Walrus_ModelData **data, char const *filename, u32 flags);
+
+// Cooks a model decoded from its glTF file, before it is uploaded
+void walrus_model_cache_write(Walrus_Model const *model, Walrus_ModelData const *data, char const *filename);
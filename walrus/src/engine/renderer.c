@@ -42,14 +42,6 @@ void walrus_renderer_init(void)
     s_data->quad_vertices = walrus_rhi_create_buffer(quad_vertices, sizeof(quad_vertices), 0);
     s_data->quad_indices  = walrus_rhi_create_buffer(quad_indices, sizeof(quad_indices), WR_RHI_BUFFER_INDEX);
 
-    walrus_rhi_create_uniform("u_albedo", WR_RHI_UNIFORM_SAMPLER, 1);
-    walrus_rhi_create_uniform("u_albedo_factor", WR_RHI_UNIFORM_VEC4, 1);
-    walrus_rhi_create_uniform("u_emissive", WR_RHI_UNIFORM_SAMPLER, 1);
-    walrus_rhi_create_uniform("u_emissive_factor", WR_RHI_UNIFORM_VEC3, 1);
-    walrus_rhi_create_uniform("u_normal", WR_RHI_UNIFORM_SAMPLER, 1);
-    walrus_rhi_create_uniform("u_normal_scale", WR_RHI_UNIFORM_FLOAT, 1);
-    walrus_rhi_create_uniform("u_alpha_cutoff", WR_RHI_UNIFORM_FLOAT, 1);
-
     s_data->u_morph_texture = walrus_rhi_create_uniform("u_morph_texture", WR_RHI_UNIFORM_SAMPLER, 1);
     s_data->u_has_morph     = walrus_rhi_create_uniform("u_has_morph", WR_RHI_UNIFORM_BOOL, 1);
 }
@@ -59,7 +51,7 @@ void walrus_renderer_shutdown(void)
     walrus_free(s_data);
 }
 
-static void setup_primitive(Walrus_MeshPrimitive const *prim)
+static void setup_primitive(Walrus_MeshPrimitive const *prim, u32 lod)
 {
     bool has_morph = prim->morph_target.id != WR_INVALID_HANDLE;
     walrus_rhi_set_uniform(s_data->u_has_morph, 0, sizeof(bool), &has_morph);
@@ -69,11 +61,17 @@ static void setup_primitive(Walrus_MeshPrimitive const *prim)
         walrus_rhi_set_texture(unit, prim->morph_target);
     }
     if (prim->indices.buffer.id != WR_INVALID_HANDLE) {
+        u32 offset      = prim->indices.offset;
+        u32 num_indices = prim->indices.num_indices;
+        if (lod < prim->num_lods) {
+            offset      = prim->lods[lod].offset;
+            num_indices = prim->lods[lod].num_indices;
+        }
         if (prim->indices.index32) {
-            walrus_rhi_set_index32_buffer(prim->indices.buffer, prim->indices.offset, prim->indices.num_indices);
+            walrus_rhi_set_index32_buffer(prim->indices.buffer, offset, num_indices);
         }
         else {
-            walrus_rhi_set_index_buffer(prim->indices.buffer, prim->indices.offset, prim->indices.num_indices);
+            walrus_rhi_set_index_buffer(prim->indices.buffer, offset, num_indices);
         }
     }
     for (u32 j = 0; j < prim->num_streams; ++j) {
@@ -82,18 +80,70 @@ static void setup_primitive(Walrus_MeshPrimitive const *prim)
     }
 }
 
+static void encoder_setup_primitive(Walrus_RhiEncoder *encoder, Walrus_MeshPrimitive const *prim, u32 lod)
+{
+    bool has_morph = prim->morph_target.id != WR_INVALID_HANDLE;
+    walrus_rhi_encoder_set_uniform(encoder, s_data->u_has_morph, 0, sizeof(bool), &has_morph);
+    if (has_morph) {
+        u32 unit = walrus_rhi_get_caps()->max_texture_unit - 1;
+        walrus_rhi_encoder_set_uniform(encoder, s_data->u_morph_texture, 0, sizeof(u32), &unit);
+        walrus_rhi_encoder_set_texture(encoder, unit, prim->morph_target);
+    }
+    if (prim->indices.buffer.id != WR_INVALID_HANDLE) {
+        u32 offset      = prim->indices.offset;
+        u32 num_indices = prim->indices.num_indices;
+        if (lod < prim->num_lods) {
+            offset      = prim->lods[lod].offset;
+            num_indices = prim->lods[lod].num_indices;
+        }
+        if (prim->indices.index32) {
+            walrus_rhi_encoder_set_index32_buffer(encoder, prim->indices.buffer, offset, num_indices);
+        }
+        else {
+            walrus_rhi_encoder_set_index_buffer(encoder, prim->indices.buffer, offset, num_indices);
+        }
+    }
+    for (u32 j = 0; j < prim->num_streams; ++j) {
+        Walrus_PrimitiveStream const *stream = &prim->streams[j];
+        walrus_rhi_encoder_set_vertex_buffer(encoder, j, stream->buffer, stream->layout_handle, stream->offset,
+                                             stream->num_vertices);
+    }
+}
+
 void walrus_renderer_submit_mesh(u16 view_id, Walrus_ProgramHandle shader, mat4 const world,
                                  Walrus_MeshPrimitive const *mesh)
+{
+    walrus_renderer_submit_mesh_lod(view_id, shader, world, mesh, 0);
+}
+
+void walrus_renderer_submit_mesh_lod(u16 view_id, Walrus_ProgramHandle shader, mat4 const world,
+                                     Walrus_MeshPrimitive const *mesh, u32 lod)
 {
     walrus_rhi_set_transform(world);
 
-    setup_primitive(mesh);
+    setup_primitive(mesh, lod);
     walrus_rhi_submit(view_id, shader, 0, WR_RHI_DISCARD_ALL);
 }
 
+void walrus_renderer_encoder_submit_mesh_lod(Walrus_RhiEncoder *encoder, u16 view_id, Walrus_ProgramHandle shader,
+                                             mat4 const world, Walrus_MeshPrimitive const *mesh, u32 lod)
+{
+    walrus_rhi_encoder_set_transform(encoder, world);
+
+    encoder_setup_primitive(encoder, mesh, lod);
+    walrus_rhi_encoder_submit(encoder, view_id, shader, 0, WR_RHI_DISCARD_ALL);
+}
+
 void walrus_renderer_submit_quad(u16 view_id, Walrus_ProgramHandle shader)
 {
     walrus_rhi_set_vertex_buffer(0, s_data->quad_vertices, s_data->quad_layout, 0, 4);
     walrus_rhi_set_index_buffer(s_data->quad_indices, 0, 6);
     walrus_rhi_submit(view_id, shader, 0, WR_RHI_DISCARD_ALL);
 }
+
+void walrus_renderer_encoder_submit_quad(Walrus_RhiEncoder *encoder, u16 view_id, Walrus_ProgramHandle shader)
+{
+    walrus_rhi_encoder_set_vertex_buffer(encoder, 0, s_data->quad_vertices, s_data->quad_layout, 0, 4);
+    walrus_rhi_encoder_set_index_buffer(encoder, s_data->quad_indices, 0, 6);
+    walrus_rhi_encoder_submit(encoder, view_id, shader, 0, WR_RHI_DISCARD_ALL);
+}
@@ -1,18 +1,39 @@
 #include <engine/systems/animator_system.h>
 #include <engine/systems/model_system.h>
 #include <engine/animator.h>
+#include <engine/component.h>
 #include <core/macro.h>
+#include <core/job.h>
+
+// Animators sampled by one job
+#define ANIMATOR_GRAIN 4
 
 ECS_COMPONENT_DECLARE(Walrus_Animator);
+ECS_COMPONENT_DECLARE(Walrus_BakedAnimator);
+
+typedef struct {
+    Walrus_Animator       *animators;
+    Walrus_ModelRef const *refs;
+    f32                    dt;
+} AnimatorTickJob;
 
+static void animator_tick_range(u32 begin, u32 end, void *userdata)
+{
+    AnimatorTickJob const *job = userdata;
+    for (u32 i = begin; i < end; ++i) {
+        walrus_animator_tick(&job->animators[i], &job->refs[i].model, job->dt);
+    }
+}
+
+// Animators only write their own poses, so a table of them is sampled across the job system
 static void animator_tick(ecs_iter_t *it)
 {
-    Walrus_Animator *animators = ecs_field(it, Walrus_Animator, 1);
-    Walrus_ModelRef *refs      = ecs_field(it, Walrus_ModelRef, 2);
+    AnimatorTickJob job;
+    job.animators = ecs_field(it, Walrus_Animator, 1);
+    job.refs      = ecs_field(it, Walrus_ModelRef, 2);
+    job.dt        = it->delta_time;
 
-    for (i32 i = 0; i < it->count; ++i) {
-        walrus_animator_tick(&animators[i], &refs[i].model, it->delta_time);
-    }
+    walrus_parallel_for(0, it->count, ANIMATOR_GRAIN, animator_tick_range, &job);
 }
 
 static void on_animator_model_set(ecs_iter_t *it)
@@ -36,11 +57,13 @@ static void animator_system_init(Walrus_System *sys)
 {
     ecs_world_t *ecs = sys->ecs;
     ECS_COMPONENT_DEFINE(ecs, Walrus_Animator);
+    ECS_COMPONENT_DEFINE(ecs, Walrus_BakedAnimator);
 
-    ECS_SYSTEM(ecs, animator_tick, EcsOnUpdate, Walrus_Animator, Walrus_ModelRef);
+    ECS_SYSTEM(ecs, animator_tick, EcsOnUpdate, Walrus_Animator, Walrus_ModelRef, Walrus_ModelLoaded);
 
     ECS_OBSERVER(ecs, on_animator_unset, EcsUnSet, Walrus_Animator);
-    ECS_OBSERVER(ecs, on_animator_model_set, EcsOnSet, Walrus_Animator, Walrus_ModelRef);
+    // Animators are bound once the model is loaded, its entity is set again then
+    ECS_OBSERVER(ecs, on_animator_model_set, EcsOnSet, Walrus_Animator, Walrus_ModelRef, Walrus_ModelLoaded);
 }
 
 POLY_DEFINE_DERIVED(Walrus_System, void, animator_system_create, POLY_IMPL(on_system_init, animator_system_init))
@@ -6,8 +6,24 @@
 #include <core/macro.h>
 #include <core/memory.h>
 #include <core/assert.h>
+#include <core/atomic.h>
+#include <core/log.h>
 
 ECS_COMPONENT_DECLARE(Walrus_ModelRef);
+ECS_COMPONENT_DECLARE(Walrus_BakedAnimation);
+ECS_TAG_DECLARE(Walrus_ModelLoaded);
+
+typedef struct {
+    ecs_entity_t             entity;
+    char                    *path;
+    Walrus_Model             model;
+    Walrus_ModelData        *data;
+    Walrus_ModelResult       result;
+    Walrus_ModelLoadCallback callback;
+    void                    *userdata;
+    u32                      flags;
+    u32 volatile             done;
+} ModelLoad;
 
 static void on_model_set(ecs_iter_t *it)
 {
@@ -32,6 +48,98 @@ static void on_model_unset(ecs_iter_t *it)
     }
 }
 
+static void on_baked_animation_unset(ecs_iter_t *it)
+{
+    Walrus_BakedAnimation *baked = ecs_field(it, Walrus_BakedAnimation, 1);
+
+    for (i32 i = 0; i < it->count; ++i) {
+        walrus_baked_animation_shutdown(&baked[i]);
+    }
+}
+
+// Decodes the requested files one after another, the decoding itself spreads its images and tangents on the job
+// system. A NULL request stops the thread.
+static i32 model_loader_fn(Walrus_Thread *self, void *userdata)
+{
+    walrus_unused(self);
+    ModelSystem *model_sys = userdata;
+
+    while (true) {
+        walrus_semaphore_wait(model_sys->sem, -1);
+
+        walrus_mutex_lock(model_sys->mutex);
+        ModelLoad *load = walrus_queue_pop(model_sys->requests);
+        walrus_mutex_unlock(model_sys->mutex);
+
+        if (load == NULL) {
+            break;
+        }
+
+        load->result = walrus_model_decode_from_file(&load->model, &load->data, load->path, load->flags);
+        walrus_atomic_store_u32(&load->done, 1);
+    }
+
+    return 0;
+}
+
+static void model_set_loaded(ecs_world_t *ecs, ecs_entity_t e, Walrus_Model const *model)
+{
+    Walrus_ModelRef *ref = ecs_get_mut(ecs, e, Walrus_ModelRef);
+    ref->model           = *model;
+    ecs_add(ecs, e, Walrus_ModelLoaded);
+    ecs_modified(ecs, e, Walrus_ModelRef);
+}
+
+static void model_load_finish(ModelSystem *model_sys, ecs_world_t *ecs, ModelLoad *load)
+{
+    if (load->result == WR_MODEL_SUCCESS) {
+        walrus_model_upload(&load->model, load->data);
+    }
+
+    if (!ecs_is_alive(ecs, load->entity)) {
+        // Unloaded while it was decoded
+        if (load->result == WR_MODEL_SUCCESS) {
+            walrus_model_shutdown(&load->model);
+        }
+    }
+    else if (load->result == WR_MODEL_SUCCESS) {
+        model_set_loaded(ecs, load->entity, &load->model);
+        if (load->callback) {
+            load->callback(ecs, load->entity, load->result, load->userdata);
+        }
+    }
+    else {
+        walrus_error("fail to load model from %s", load->path);
+        if (load->callback) {
+            load->callback(ecs, load->entity, load->result, load->userdata);
+        }
+        walrus_hash_table_remove(model_sys->table, ecs_get(ecs, load->entity, Walrus_ModelRef)->name);
+        ecs_delete(ecs, load->entity);
+    }
+
+    walrus_str_free(load->path);
+    walrus_free(load);
+}
+
+// Runs every frame outside of the ECS progress, so finished models are set without deferring
+static void model_system_render(Walrus_System *sys)
+{
+    ModelSystem *model_sys = poly_cast(sys, ModelSystem);
+
+    // Callbacks can issue new loads, which are appended behind the ones already checked
+    u32 num_pending = 0;
+    for (u32 i = 0; i < walrus_array_len(model_sys->loads); ++i) {
+        ModelLoad *load = *(ModelLoad **)walrus_array_get(model_sys->loads, i);
+        if (walrus_atomic_load_u32(&load->done)) {
+            model_load_finish(model_sys, sys->ecs, load);
+        }
+        else {
+            *(ModelLoad **)walrus_array_get(model_sys->loads, num_pending++) = load;
+        }
+    }
+    walrus_array_resize(model_sys->loads, num_pending);
+}
+
 static void model_system_init(Walrus_System *sys)
 {
     ModelSystem *model_sys = poly_cast(sys, ModelSystem);
@@ -39,6 +147,8 @@ static void model_system_init(Walrus_System *sys)
     ecs_world_t *ecs = sys->ecs;
 
     ECS_COMPONENT_DEFINE(ecs, Walrus_ModelRef);
+    ECS_COMPONENT_DEFINE(ecs, Walrus_BakedAnimation);
+    ECS_TAG_DEFINE(ecs, Walrus_ModelLoaded);
 
     ecs_observer_init(ecs, &(ecs_observer_desc_t const){.events       = {EcsOnSet},
                                                         .entity       = ecs_entity(ecs, {0}),
@@ -48,16 +158,47 @@ static void model_system_init(Walrus_System *sys)
                                                         .entity       = ecs_entity(ecs, {0}),
                                                         .callback     = on_model_unset,
                                                         .filter.terms = {{.id = ecs_id(Walrus_ModelRef)}}});
+    // Instances inherit the atlas from their model, only the model owns it
+    ecs_observer_init(
+        ecs, &(ecs_observer_desc_t const){
+                 .events       = {EcsUnSet},
+                 .entity       = ecs_entity(ecs, {0}),
+                 .callback     = on_baked_animation_unset,
+                 .filter.terms = {{.id = ecs_id(Walrus_BakedAnimation), .src.flags = EcsSelf}}});
 
-    model_sys->table = walrus_hash_table_create(walrus_str_hash, walrus_str_equal);
+    model_sys->table      = walrus_hash_table_create(walrus_str_hash, walrus_str_equal);
+    model_sys->mutex      = walrus_mutex_create();
+    model_sys->sem        = walrus_semaphore_create();
+    model_sys->requests   = walrus_queue_alloc();
+    model_sys->loads      = walrus_array_create(sizeof(ModelLoad *), 0);
+    model_sys->load_flags = WR_MODEL_LOAD_FLAG_NONE;
+    model_sys->loader     = walrus_thread_create();
+    walrus_thread_init(model_sys->loader, model_loader_fn, model_sys, 0);
 }
 
 static void model_system_shutdown(Walrus_System *sys)
 {
     ModelSystem *model_sys = poly_cast(sys, ModelSystem);
+
+    // The loader decodes the requests left before it stops, so every load is done once it is joined
+    walrus_semaphore_post(model_sys->sem, 1);
+    walrus_thread_shutdown(model_sys->loader);
+    walrus_thread_destroy(model_sys->loader);
+    model_system_render(sys);
+
+    walrus_array_destroy(model_sys->loads);
+    walrus_queue_free(model_sys->requests);
+    walrus_semaphore_destroy(model_sys->sem);
+    walrus_mutex_destroy(model_sys->mutex);
     walrus_hash_table_destroy(model_sys->table);
 }
 
+void walrus_model_system_set_load_flags(Walrus_System *sys, u32 flags)
+{
+    ModelSystem *model_sys = poly_cast(sys, ModelSystem);
+    model_sys->load_flags  = flags;
+}
+
 void walrus_model_system_load_from_file(Walrus_System *sys, char const *name, char const *filename)
 {
     ModelSystem *model_sys = poly_cast(sys, ModelSystem);
@@ -67,10 +208,10 @@ void walrus_model_system_load_from_file(Walrus_System *sys, char const *name, ch
             ecs, 0, Walrus_ModelRef,
             {.name = walrus_str_dup(name), .path = walrus_str_dup(filename), .ref_count = walrus_malloc0(sizeof(i32))});
 
-        Walrus_ModelRef *ref = ecs_get_mut(ecs, e, Walrus_ModelRef);
-        if (walrus_model_load_from_file(&ref->model, ref->path) == WR_MODEL_SUCCESS) {
-            ecs_modified(ecs, e, Walrus_ModelRef);
-            walrus_hash_table_insert(model_sys->table, ref->name, walrus_val_to_ptr(e));
+        Walrus_Model model;
+        if (walrus_model_load_from_file_full(&model, filename, model_sys->load_flags) == WR_MODEL_SUCCESS) {
+            model_set_loaded(ecs, e, &model);
+            walrus_hash_table_insert(model_sys->table, ecs_get(ecs, e, Walrus_ModelRef)->name, walrus_val_to_ptr(e));
         }
         else {
             ecs_delete(ecs, e);
@@ -78,6 +219,36 @@ void walrus_model_system_load_from_file(Walrus_System *sys, char const *name, ch
     }
 }
 
+ecs_entity_t walrus_model_system_load_async(Walrus_System *sys, char const *name, char const *filename,
+                                            Walrus_ModelLoadCallback callback, void *userdata)
+{
+    ModelSystem *model_sys = poly_cast(sys, ModelSystem);
+    if (walrus_hash_table_contains(model_sys->table, name)) {
+        return walrus_ptr_to_val(walrus_hash_table_lookup(model_sys->table, name));
+    }
+
+    ecs_world_t *ecs = sys->ecs;
+    ecs_entity_t e   = ecs_set(
+        ecs, 0, Walrus_ModelRef,
+        {.name = walrus_str_dup(name), .path = walrus_str_dup(filename), .ref_count = walrus_malloc0(sizeof(i32))});
+    walrus_hash_table_insert(model_sys->table, ecs_get(ecs, e, Walrus_ModelRef)->name, walrus_val_to_ptr(e));
+
+    ModelLoad *load = walrus_new0(ModelLoad, 1);
+    load->entity    = e;
+    load->path      = walrus_str_dup(filename);
+    load->flags     = model_sys->load_flags;
+    load->callback  = callback;
+    load->userdata  = userdata;
+    walrus_array_append(model_sys->loads, &load);
+
+    walrus_mutex_lock(model_sys->mutex);
+    walrus_queue_push(model_sys->requests, load);
+    walrus_mutex_unlock(model_sys->mutex);
+    walrus_semaphore_post(model_sys->sem, 1);
+
+    return e;
+}
+
 bool walrus_model_system_unload(Walrus_System *sys, char const *name)
 {
     ModelSystem *model_sys = poly_cast(sys, ModelSystem);
@@ -94,6 +265,34 @@ bool walrus_model_system_unload(Walrus_System *sys, char const *name)
     return false;
 }
 
+bool walrus_model_system_bake(Walrus_System *sys, char const *name, f32 frame_rate)
+{
+    ModelSystem *model_sys = poly_cast(sys, ModelSystem);
+    if (walrus_hash_table_contains(model_sys->table, name)) {
+        ecs_entity_t           e   = walrus_ptr_to_val(walrus_hash_table_lookup(model_sys->table, name));
+        ecs_world_t           *ecs = sys->ecs;
+        Walrus_ModelRef const *ref = ecs_get(ecs, e, Walrus_ModelRef);
+        if (!ecs_has(ecs, e, Walrus_ModelLoaded)) {
+            return false;
+        }
+
+        // Rebaking releases the previous atlas first
+        ecs_remove(ecs, e, Walrus_BakedAnimation);
+
+        Walrus_BakedAnimation baked;
+        walrus_animation_bake(&baked, &ref->model, frame_rate);
+        if (!walrus_baked_animation_upload(&baked)) {
+            walrus_baked_animation_shutdown(&baked);
+            return false;
+        }
+        ecs_set_ptr(ecs, e, Walrus_BakedAnimation, &baked);
+
+        return true;
+    }
+
+    return false;
+}
+
 ecs_entity_t walrus_model_instantiate(Walrus_System *sys, char const *name, vec3 const trans, versor const rot,
                                       vec3 const scale)
 {
@@ -115,4 +314,5 @@ ecs_entity_t walrus_model_instantiate(Walrus_System *sys, char const *name, vec3
 }
 
 POLY_DEFINE_DERIVED(Walrus_System, ModelSystem, model_system_create, POLY_IMPL(on_system_init, model_system_init),
-                    POLY_IMPL(on_system_shutdown, model_system_shutdown))
+                    POLY_IMPL(on_system_shutdown, model_system_shutdown),
+                    POLY_IMPL(on_system_render, model_system_render))
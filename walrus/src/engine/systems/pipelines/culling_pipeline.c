@@ -3,79 +3,437 @@
 #include <engine/component.h>
 #include <engine/engine.h>
 #include <engine/camera.h>
+#include <engine/bvh.h>
+#include <engine/geometry.h>
+#include <core/array.h>
 #include <core/macro.h>
+#include <core/math.h>
+#include <core/memory.h>
+#include <core/mutex.h>
 
-ECS_SYSTEM_DECLARE(cull_test_static_mesh);
-ECS_SYSTEM_DECLARE(cull_test_skinned_mesh);
+#include <math.h>
+#include <stdlib.h>
+#include <string.h>
 
-static void cull_test_skinned_mesh(ecs_iter_t *it)
+// A visible mesh draws its coarsest level of detail whose error, projected at the distance of its box, stays within
+// this fraction of the view height
+#define LOD_SCREEN_ERROR 0.002f
+
+// Static meshes are kept in a bvh, the box is cached in the entity's proxy component
+typedef struct {
+    u32  proxy;
+    vec3 min;
+    vec3 max;
+} Walrus_CullProxy;
+
+ECS_COMPONENT_DECLARE(Walrus_CullProxy);
+ECS_SYSTEM_DECLARE(cull_gather);
+
+// A mesh as the executions of the frame test it, a skinned mesh has no proxy and is tested on its posed box
+typedef struct {
+    Walrus_MeshPrimitive const *mesh;
+    u32                         proxy;
+    u32                         skin_box;
+    vec3                        min;
+    vec3                        max;
+} CullItem;
+
+#define CULL_NO_SKIN_BOX UINT32_MAX
+
+// Visibility left by one execution, kept with its capacity from one frame to the next
+typedef struct {
+    Walrus_Visibility visibility;
+    u32               capacity;
+    u32              *proxies;
+    u32               num_proxy_words;
+    u32              *skin_boxes;
+    u32               num_skin_box_words;
+} CullResult;
+
+typedef struct {
+    Walrus_Bvh *bvh;
+    u32         num_changes;
+
+    // Entities whose transform or mesh was set since the last frame
+    Walrus_Array *dirty;
+
+    // Meshes of the frame by their index, and the results handed out to its executions
+    Walrus_Array *items;
+    Walrus_Array *results;
+    u32           num_results;
+    Walrus_Mutex *mutex;
+
+    // Posed boxes of the skinned meshes, culled in batches like the boxes of the bvh
+    Walrus_BoundingBoxSoA skin_boxes;
+
+    u32 camera;
+    u32 visibility;
+} CullingData;
+
+static CullingData *s_data = NULL;
+
+typedef struct {
+    Walrus_Camera *camera;
+    vec3           eye;
+    f32            view_height;
+} CullView;
+
+static void cull_view_init(CullView *view, Walrus_Camera *camera)
 {
-    Walrus_RenderMesh *meshes = ecs_field(it, Walrus_RenderMesh, 1);
-    Walrus_Camera     *camera = it->param;
+    mat4 inverse;
+    glm_mat4_inv(camera->view, inverse);
+    glm_vec3_copy(inverse[3], view->eye);
+    view->camera      = camera;
+    view->view_height = 2 * tanf(camera->fov * 0.5f);
+}
 
-    for (i32 i = 0; i < it->count; ++i) {
-        ecs_entity_t parent = ecs_get_target(it->world, it->entities[i], EcsChildOf, 0);
+static u32 lod_select(Walrus_MeshPrimitive const *mesh, vec3 const min, vec3 const max, CullView const *view)
+{
+    if (mesh->num_lods < 2) {
+        return 0;
+    }
 
-        Walrus_Transform const *p_trans = ecs_get(it->world, parent, Walrus_Transform);
+    vec3 extent, center;
+    glm_vec3_sub((f32 *)max, (f32 *)min, extent);
+    glm_vec3_center((f32 *)min, (f32 *)max, center);
+    f32 const size     = glm_vec3_max(extent);
+    f32 const distance = walrus_max(glm_vec3_distance(center, (f32 *)view->eye) - size * 0.5f, 0.f);
+    f32 const allowed  = LOD_SCREEN_ERROR * view->view_height * distance;
 
-        mat4 p_world;
-        walrus_transform_compose(p_trans, p_world);
+    u32 lod = 0;
+    while (lod + 1 < mesh->num_lods && mesh->lods[lod + 1].error * size <= allowed) {
+        ++lod;
+    }
+    return lod;
+}
 
-        meshes[i].culled = false;
+static void world_bounds(mat4 const world, vec3 const local_min, vec3 const local_max, vec3 min, vec3 max)
+{
+    Walrus_BoundingBox box;
+    walrus_bounding_box_from_min_max(&box, local_min, local_max);
+    walrus_bounding_box_transform(&box, world);
+    glm_vec3_sub(box.center, box.extends, min);
+    glm_vec3_add(box.center, box.extends, max);
+}
+
+static void static_mesh_bounds(Walrus_MeshPrimitive const *mesh, Walrus_Transform const *transform, vec3 min, vec3 max)
+{
+    mat4 world;
+    walrus_transform_compose(transform, world);
+    world_bounds(world, mesh->min, mesh->max, min, max);
+}
 
-        Walrus_SkinResource const *skin = ecs_get(it->world, it->entities[i], Walrus_SkinResource);
-        if (!walrus_camera_frustum_cull_test(camera, p_world, skin->min, skin->max)) {
-            meshes[i].culled = true;
+static void static_mesh_track(ecs_world_t *ecs, ecs_entity_t e)
+{
+    Walrus_RenderMesh const *mesh  = ecs_get(ecs, e, Walrus_RenderMesh);
+    Walrus_Transform const  *world = ecs_get(ecs, e, Walrus_Transform);
+    if (mesh == NULL || world == NULL || ecs_has(ecs, e, Walrus_SkinResource)) {
+        return;
+    }
+
+    vec3 min, max;
+    static_mesh_bounds(mesh->mesh, world, min, max);
+
+    Walrus_CullProxy const *cached = ecs_get(ecs, e, Walrus_CullProxy);
+    if (cached == NULL || cached->proxy == WR_BVH_INVALID_PROXY) {
+        Walrus_CullProxy proxy;
+        proxy.proxy = walrus_bvh_insert(s_data->bvh, min, max, e);
+        glm_vec3_copy(min, proxy.min);
+        glm_vec3_copy(max, proxy.max);
+        ecs_set_ptr(ecs, e, Walrus_CullProxy, &proxy);
+        ++s_data->num_changes;
+    }
+    else {
+        Walrus_CullProxy *proxy = ecs_get_mut(ecs, e, Walrus_CullProxy);
+        walrus_bvh_update(s_data->bvh, proxy->proxy, min, max);
+        glm_vec3_copy(min, proxy->min);
+        glm_vec3_copy(max, proxy->max);
+    }
+}
+
+static void on_static_mesh_set(ecs_iter_t *it)
+{
+    if (s_data != NULL) {
+        walrus_array_nappend(s_data->dirty, it->entities, it->count);
+    }
+}
+
+static int entity_compare(void const *a, void const *b)
+{
+    ecs_entity_t const x = *(ecs_entity_t const *)a;
+    ecs_entity_t const y = *(ecs_entity_t const *)b;
+    return x < y ? -1 : x > y;
+}
+
+// The transform system writes the world transforms of the children in place when the transform of their parent or
+// their own local transform is set, so the children of the recorded entities are refreshed with them
+static void cull_track_static_mesh(ecs_world_t *ecs)
+{
+    u32 const num_set = walrus_array_len(s_data->dirty);
+    if (num_set == 0) {
+        return;
+    }
+    for (u32 i = 0; i < num_set; ++i) {
+        ecs_entity_t const e = *(ecs_entity_t *)walrus_array_get(s_data->dirty, i);
+        if (!ecs_is_alive(ecs, e)) {
             continue;
         }
+        ecs_filter_t *f  = ecs_filter(ecs, {.terms = {{.id = ecs_id(Walrus_RenderMesh)},
+                                                      {.id = ecs_id(Walrus_Transform)},
+                                                      {.id = ecs_pair(EcsChildOf, e)}}});
+        ecs_iter_t    it = ecs_filter_iter(ecs, f);
+        while (ecs_filter_next(&it)) {
+            walrus_array_nappend(s_data->dirty, it.entities, it.count);
+        }
+        ecs_filter_fini(f);
+    }
+
+    // An entity set several times in the frame is inserted once
+    u32 const     num_dirty = walrus_array_len(s_data->dirty);
+    ecs_entity_t *dirty     = walrus_array_get(s_data->dirty, 0);
+    qsort(dirty, num_dirty, sizeof(ecs_entity_t), entity_compare);
+    for (u32 i = 0; i < num_dirty; ++i) {
+        if ((i == 0 || dirty[i] != dirty[i - 1]) && ecs_is_alive(ecs, dirty[i])) {
+            static_mesh_track(ecs, dirty[i]);
+        }
+    }
+    walrus_array_clear(s_data->dirty);
+}
+
+static void on_cull_proxy_remove(ecs_iter_t *it)
+{
+    Walrus_CullProxy *proxies = ecs_field(it, Walrus_CullProxy, 1);
+
+    for (i32 i = 0; i < it->count; ++i) {
+        // The bvh is gone once the pipeline is destroyed, and the observer fires for both of its terms
+        if (s_data != NULL && proxies[i].proxy != WR_BVH_INVALID_PROXY) {
+            walrus_bvh_remove(s_data->bvh, proxies[i].proxy);
+            ++s_data->num_changes;
+        }
+        proxies[i].proxy = WR_BVH_INVALID_PROXY;
     }
 }
 
-static void cull_test_static_mesh(ecs_iter_t *it)
+// Gives every mesh its index for the frame, the executions only read what is gathered here
+static void cull_gather(ecs_iter_t *it)
 {
     Walrus_RenderMesh *meshes = ecs_field(it, Walrus_RenderMesh, 1);
-    Walrus_Transform  *worlds = ecs_field(it, Walrus_Transform, 2);
-    Walrus_Camera     *camera = it->param;
 
     for (i32 i = 0; i < it->count; ++i) {
-        mat4 world;
-        walrus_transform_compose(&worlds[i], world);
+        CullItem item = {.mesh = meshes[i].mesh, .proxy = WR_BVH_INVALID_PROXY, .skin_box = CULL_NO_SKIN_BOX};
 
-        meshes[i].culled = false;
+        Walrus_SkinResource const *skin  = ecs_get(it->world, it->entities[i], Walrus_SkinResource);
+        Walrus_CullProxy const    *proxy = ecs_get(it->world, it->entities[i], Walrus_CullProxy);
+        if (skin) {
+            ecs_entity_t parent = ecs_get_target(it->world, it->entities[i], EcsChildOf, 0);
 
-        if (!walrus_camera_frustum_cull_test(camera, world, meshes[i].mesh->min, meshes[i].mesh->max)) {
-            meshes[i].culled = true;
-            continue;
+            mat4 p_world;
+            walrus_transform_compose(ecs_get(it->world, parent, Walrus_Transform), p_world);
+            world_bounds(p_world, skin->min, skin->max, item.min, item.max);
+
+            Walrus_BoundingBox box;
+            walrus_bounding_box_from_min_max(&box, item.min, item.max);
+            item.skin_box = s_data->skin_boxes.count;
+            walrus_bounding_box_soa_resize(&s_data->skin_boxes, item.skin_box + 1);
+            walrus_bounding_box_soa_set(&s_data->skin_boxes, item.skin_box, &box);
         }
+        else if (proxy) {
+            item.proxy = proxy->proxy;
+            glm_vec3_copy((f32 *)proxy->min, item.min);
+            glm_vec3_copy((f32 *)proxy->max, item.max);
+        }
+
+        meshes[i].index = walrus_array_len(s_data->items);
+        walrus_array_append(s_data->items, &item);
     }
 }
 
+static void culling_prepare(Walrus_FrameGraph *graph, void *userdata)
+{
+    walrus_unused(graph);
+    walrus_unused(userdata);
+
+    ecs_world_t *ecs = walrus_engine_vars()->ecs;
+
+    cull_track_static_mesh(ecs);
+
+    // Insertions and removals degrade the tree, rebuild it once they touched a quarter of the proxies
+    u32 const count = walrus_bvh_count(s_data->bvh);
+    if (s_data->num_changes * 4 > count) {
+        walrus_bvh_build(s_data->bvh);
+        s_data->num_changes = 0;
+    }
+    else {
+        walrus_bvh_refit(s_data->bvh);
+    }
+
+    walrus_array_clear(s_data->items);
+    walrus_bounding_box_soa_resize(&s_data->skin_boxes, 0);
+    ecs_run(ecs, ecs_id(cull_gather), 0, NULL);
+
+    s_data->num_results = 0;
+}
+
+// Executions of one frame run at once, each takes a result of its own
+static CullResult *result_acquire(u32 num_items, u32 num_proxy_words, u32 num_skin_box_words)
+{
+    walrus_mutex_lock(s_data->mutex);
+    if (s_data->num_results == walrus_array_len(s_data->results)) {
+        CullResult *result = walrus_new0(CullResult, 1);
+        walrus_array_append(s_data->results, &result);
+    }
+    CullResult *result = *(CullResult **)walrus_array_get(s_data->results, s_data->num_results++);
+    walrus_mutex_unlock(s_data->mutex);
+
+    if (num_items > result->capacity) {
+        result->visibility.visible = walrus_realloc(result->visibility.visible, sizeof(u32) * ((num_items + 31) / 32));
+        result->visibility.lods    = walrus_realloc(result->visibility.lods, sizeof(u8) * num_items);
+        result->capacity           = num_items;
+    }
+    if (num_proxy_words > result->num_proxy_words) {
+        result->proxies         = walrus_realloc(result->proxies, sizeof(u32) * num_proxy_words);
+        result->num_proxy_words = num_proxy_words;
+    }
+    if (num_skin_box_words > result->num_skin_box_words) {
+        result->skin_boxes         = walrus_realloc(result->skin_boxes, sizeof(u32) * num_skin_box_words);
+        result->num_skin_box_words = num_skin_box_words;
+    }
+    memset(result->visibility.visible, 0, sizeof(u32) * ((num_items + 31) / 32));
+    memset(result->proxies, 0, sizeof(u32) * num_proxy_words);
+    return result;
+}
+
+static void on_visible(u32 proxy, u64 userdata, void *ctx)
+{
+    walrus_unused(userdata);
+    u32 *proxies = ctx;
+    proxies[proxy >> 5] |= 1u << (proxy & 31);
+}
+
+static bool cull_item_visible(CullItem const *item, CullResult const *result)
+{
+    if (item->skin_box != CULL_NO_SKIN_BOX) {
+        return result->skin_boxes[item->skin_box >> 5] & (1u << (item->skin_box & 31));
+    }
+    return item->proxy == WR_BVH_INVALID_PROXY || (result->proxies[item->proxy >> 5] & (1u << (item->proxy & 31)));
+}
+
 static void culling_pass(Walrus_FrameGraph *graph, Walrus_FrameNode const *node)
 {
     walrus_unused(node);
 
-    ecs_world_t   *ecs    = walrus_engine_vars()->ecs;
-    Walrus_Camera *camera = walrus_fg_read_ptr(graph, "Camera");
+    Walrus_Camera *camera    = walrus_fg_read_ptr(graph, s_data->camera);
+    u32 const      num_items = walrus_array_len(s_data->items);
+    CullItem      *items     = walrus_array_get(s_data->items, 0);
+    CullResult    *result    = result_acquire(num_items, (walrus_bvh_proxy_bound(s_data->bvh) + 31) / 32,
+                                              (s_data->skin_boxes.count + 31) / 32);
+
+    Walrus_Frustum frustum;
+    walrus_frustum_from_camera(camera, &frustum);
+    walrus_bvh_query_frustum(s_data->bvh, &frustum, on_visible, result->proxies);
+    walrus_frustum_cull_boxes_parallel(&frustum, &s_data->skin_boxes, result->skin_boxes);
+
+    CullView view;
+    cull_view_init(&view, camera);
+
+    // A static mesh the bvh does not track is always drawn in full
+    for (u32 i = 0; i < num_items; ++i) {
+        result->visibility.lods[i] = 0;
+        if (cull_item_visible(&items[i], result)) {
+            result->visibility.visible[i >> 5] |= 1u << (i & 31);
+            if (items[i].skin_box != CULL_NO_SKIN_BOX || items[i].proxy != WR_BVH_INVALID_PROXY) {
+                result->visibility.lods[i] = lod_select(items[i].mesh, items[i].min, items[i].max, &view);
+            }
+        }
+    }
+
+    walrus_fg_write_ptr(graph, s_data->visibility, &result->visibility);
+}
+
+bool walrus_visibility_test(Walrus_Visibility const *visibility, u32 index, u32 *lod)
+{
+    if (visibility == NULL) {
+        *lod = 0;
+        return true;
+    }
+    *lod = visibility->lods[index];
+    return visibility->visible[index >> 5] & (1u << (index & 31));
+}
+
+bool walrus_culling_raycast(vec3 const origin, vec3 const dir, f32 max_t, ecs_entity_t *entity, f32 *t)
+{
+    Walrus_BvhHit hit;
+    if (s_data == NULL || !walrus_bvh_raycast(s_data->bvh, origin, dir, max_t, &hit)) {
+        return false;
+    }
+    *entity = hit.userdata;
+    *t      = hit.t;
+    return true;
+}
 
-    ecs_run(ecs, ecs_id(cull_test_static_mesh), 0, camera);
-    ecs_run(ecs, ecs_id(cull_test_skinned_mesh), 0, camera);
+static void culling_data_free(void *userdata)
+{
+    walrus_unused(userdata);
+    walrus_bvh_destroy(s_data->bvh);
+    walrus_array_destroy(s_data->dirty);
+    walrus_array_destroy(s_data->items);
+    for (u32 i = 0; i < walrus_array_len(s_data->results); ++i) {
+        CullResult *result = *(CullResult **)walrus_array_get(s_data->results, i);
+        walrus_free(result->visibility.visible);
+        walrus_free(result->visibility.lods);
+        walrus_free(result->proxies);
+        walrus_free(result->skin_boxes);
+        walrus_free(result);
+    }
+    walrus_array_destroy(s_data->results);
+    walrus_bounding_box_soa_free(&s_data->skin_boxes);
+    walrus_mutex_destroy(s_data->mutex);
+    walrus_free(s_data);
+    s_data = NULL;
 }
 
 Walrus_FramePipeline *walrus_culling_pipeline_add(Walrus_FrameGraph *graph, char const *name)
 {
     ecs_world_t *ecs = walrus_engine_vars()->ecs;
 
-    ecs_id(cull_test_static_mesh) =
-        ecs_system(ecs, {
-                            .entity             = ecs_entity(ecs, {0}),
-                            .query.filter.terms = {{.id = ecs_id(Walrus_RenderMesh)},
-                                                   {.id = ecs_id(Walrus_Transform)},
-                                                   {.id = ecs_id(Walrus_SkinResource), .oper = EcsNot}},
-                            .callback           = cull_test_static_mesh,
-                        });
-    ECS_SYSTEM_DEFINE(ecs, cull_test_skinned_mesh, 0, Walrus_RenderMesh, Walrus_SkinResource);
-
-    Walrus_FramePipeline *culling_pipeline = walrus_fg_add_pipeline(graph, name);
-    walrus_fg_add_node(culling_pipeline, culling_pass, "Culling");
+    ECS_COMPONENT_DEFINE(ecs, Walrus_CullProxy);
+
+    ECS_SYSTEM_DEFINE(ecs, cull_gather, 0, Walrus_RenderMesh);
+    ecs_observer(ecs, {.events       = {EcsOnRemove},
+                       .entity       = ecs_entity(ecs, {0}),
+                       .callback     = on_cull_proxy_remove,
+                       .filter.terms = {{.id = ecs_id(Walrus_CullProxy)}, {.id = ecs_id(Walrus_RenderMesh)}}});
+    ecs_entity_t const tracked[] = {ecs_id(Walrus_Transform), ecs_id(Walrus_LocalTransform), ecs_id(Walrus_RenderMesh)};
+    for (u32 i = 0; i < walrus_count_of(tracked); ++i) {
+        ecs_observer(ecs, {.events       = {EcsOnSet},
+                           .entity       = ecs_entity(ecs, {0}),
+                           .callback     = on_static_mesh_set,
+                           .filter.terms = {{.id = tracked[i]}}});
+    }
+
+    s_data             = walrus_new0(CullingData, 1);
+    s_data->bvh        = walrus_bvh_create();
+    s_data->dirty      = walrus_array_create(sizeof(ecs_entity_t), 0);
+    s_data->items      = walrus_array_create(sizeof(CullItem), 0);
+    s_data->results    = walrus_array_create(sizeof(CullResult *), 0);
+    s_data->mutex      = walrus_mutex_create();
+    s_data->camera     = walrus_fg_create_data(graph, "Camera");
+    s_data->visibility = walrus_fg_create_data(graph, "Visibility");
+
+    // Meshes created before the pipeline are tracked from the first frame
+    ecs_filter_t *f =
+        ecs_filter(ecs, {.terms = {{.id = ecs_id(Walrus_RenderMesh)}, {.id = ecs_id(Walrus_Transform)}}});
+    ecs_iter_t it = ecs_filter_iter(ecs, f);
+    while (ecs_filter_next(&it)) {
+        walrus_array_nappend(s_data->dirty, it.entities, it.count);
+    }
+    ecs_filter_fini(f);
+
+    Walrus_FramePipeline *culling_pipeline = walrus_fg_add_pipeline_full(graph, name, culling_data_free, NULL);
+    u32 const             culling          = walrus_fg_add_node(culling_pipeline, culling_pass, "Culling");
+    // What the passes drawing the meshes wait for
+    walrus_fg_node_write(culling_pipeline, culling, s_data->visibility);
+    walrus_fg_node_parallel(culling_pipeline, culling);
+    walrus_fg_set_prepare(culling_pipeline, culling_prepare);
     return culling_pipeline;
 }
@@ -1,5 +1,7 @@
 #include <engine/systems/pipelines/deferred_pipeline.h>
+#include <engine/systems/pipelines/culling_pipeline.h>
 #include <engine/systems/render_system.h>
+#include <engine/systems/model_system.h>
 #include <engine/shader_library.h>
 #include <engine/component.h>
 #include <engine/engine.h>
@@ -7,10 +9,8 @@
 #include <core/memory.h>
 #include <core/math.h>
 
-ECS_SYSTEM_DECLARE(deferred_submit_static_mesh);
-ECS_SYSTEM_DECLARE(deferred_submit_skinned_mesh);
-ECS_SYSTEM_DECLARE(forward_submit_static_mesh);
-ECS_SYSTEM_DECLARE(forward_submit_skinned_mesh);
+ECS_SYSTEM_DECLARE(deferred_gather_static_mesh);
+ECS_SYSTEM_DECLARE(deferred_gather_skinned_mesh);
 
 typedef enum {
     G_POS,
@@ -21,11 +21,36 @@ typedef enum {
     G_EMISSIVE
 } GBufferTexture;
 
+typedef enum {
+    DRAW_STATIC,
+    DRAW_SKINNED,
+    DRAW_BAKED,
+
+    DRAW_KIND_COUNT
+} DrawKind;
+
+// A mesh as the passes of every execution draw it, gathered once a frame so that they never touch the world
+typedef struct {
+    Walrus_MeshPrimitive const *mesh;
+    Walrus_Material const      *material;
+    u32                         index;
+    DrawKind                    kind;
+    mat4                        world;
+
+    bool                   has_weights;
+    Walrus_TransientBuffer weights;
+    Walrus_TransientBuffer joints;
+    Walrus_TextureHandle   baked_texture;
+    i32                    baked_offset;
+} DrawItem;
+
 typedef struct {
     Walrus_ProgramHandle gbuffer_shader;
     Walrus_ProgramHandle gbuffer_skin_shader;
     Walrus_ProgramHandle forward_shader;
     Walrus_ProgramHandle forward_skin_shader;
+    Walrus_ProgramHandle gbuffer_baked_skin_shader;
+    Walrus_ProgramHandle forward_baked_skin_shader;
 
     Walrus_ProgramHandle deferred_shader;
 
@@ -36,147 +61,184 @@ typedef struct {
     Walrus_UniformHandle u_galbedo;
     Walrus_UniformHandle u_gemissive;
 
-    Walrus_FramebufferHandle gbuffer;
+    Walrus_UniformHandle u_baked_animation;
+    Walrus_UniformHandle u_baked_joint_offset;
+
+    // Meshes of the frame, the opaque ones go to the gbuffer and the blended ones are lit forward
+    Walrus_Array *opaque;
+    Walrus_Array *blend;
+
+    // Frame graph resources
+    u32 gbuffer;
+    u32 gbuffer_textures[G_EMISSIVE + 1];
+    u32 visibility;
+    u32 backrt;
+    u32 camera;
 } DeferredRenderData;
 
 DeferredRenderData *s_data = NULL;
 
-static void gbuffer_pass(Walrus_FrameGraph *graph, Walrus_FrameNode const *node)
+static void draw_items(Walrus_RhiEncoder *encoder, u16 view_id, Walrus_Array *items,
+                       Walrus_Visibility const *visibility, Walrus_ProgramHandle const shaders[DRAW_KIND_COUNT])
 {
-    walrus_unused(node);
-    ecs_world_t *ecs = walrus_engine_vars()->ecs;
+    u32 const len = walrus_array_len(items);
+    for (u32 i = 0; i < len; ++i) {
+        DrawItem const *item = walrus_array_get(items, i);
 
-    u16           *view_id = walrus_fg_read_ptr(graph, "ViewSlot");
-    Walrus_Camera *camera  = walrus_fg_read_ptr(graph, "Camera");
-
-    walrus_rhi_set_view_rect_ratio(*view_id, WR_RHI_RATIO_EQUAL);
-    walrus_rhi_set_view_clear(*view_id, WR_RHI_CLEAR_DEPTH | WR_RHI_CLEAR_COLOR, 0, 1.0, 0);
-    walrus_rhi_set_view_transform(*view_id, camera->view, camera->projection);
-    walrus_rhi_set_framebuffer(*view_id, s_data->gbuffer);
+        u32 lod;
+        if (!walrus_visibility_test(visibility, item->index, &lod)) {
+            continue;
+        }
 
-    ecs_run(ecs, ecs_id(deferred_submit_static_mesh), 0, view_id);
-    ecs_run(ecs, ecs_id(deferred_submit_skinned_mesh), 0, view_id);
+        if (item->has_weights) {
+            walrus_rhi_encoder_set_transient_buffer(encoder, 0, &item->weights);
+        }
+        walrus_material_encoder_submit(encoder, item->material);
+        if (item->kind == DRAW_BAKED) {
+            u32 const unit = walrus_rhi_get_caps()->max_texture_unit - 2;
+            walrus_rhi_encoder_set_uniform(encoder, s_data->u_baked_animation, 0, sizeof(u32), &unit);
+            walrus_rhi_encoder_set_uniform(encoder, s_data->u_baked_joint_offset, 0, sizeof(i32), &item->baked_offset);
+            walrus_rhi_encoder_set_texture(encoder, unit, item->baked_texture);
+        }
+        else if (item->kind == DRAW_SKINNED) {
+            walrus_rhi_encoder_set_transient_buffer(encoder, 1, &item->joints);
+        }
+        walrus_renderer_encoder_submit_mesh_lod(encoder, view_id, shaders[item->kind], item->world, item->mesh, lod);
+    }
+}
 
-    ++(*view_id);
+static void gbuffer_pass(Walrus_FrameGraph *graph, Walrus_FrameNode const *node)
+{
+    u16                      view_id    = walrus_fg_view_id(graph, node);
+    Walrus_Camera           *camera     = walrus_fg_read_ptr(graph, s_data->camera);
+    Walrus_Visibility const *visibility = walrus_fg_read_ptr(graph, s_data->visibility);
+
+    walrus_rhi_set_view_rect_ratio(view_id, WR_RHI_RATIO_EQUAL);
+    walrus_rhi_set_view_clear(view_id, WR_RHI_CLEAR_DEPTH | WR_RHI_CLEAR_COLOR, 0, 1.0, 0);
+    walrus_rhi_set_view_transform(view_id, camera->view, camera->projection);
+    walrus_rhi_set_framebuffer(view_id, walrus_fg_framebuffer(graph, s_data->gbuffer));
+    // The gbuffer is opaque, repeated meshes are merged into instanced draws
+    walrus_rhi_set_view_mode(view_id, WR_RHI_VIEWMODE_INSTANCING);
+
+    Walrus_ProgramHandle const shaders[DRAW_KIND_COUNT] = {s_data->gbuffer_shader, s_data->gbuffer_skin_shader,
+                                                           s_data->gbuffer_baked_skin_shader};
+    draw_items(node->encoder, view_id, s_data->opaque, visibility, shaders);
 }
 
 static void lighting_pass(Walrus_FrameGraph *graph, Walrus_FrameNode const *node)
 {
-    walrus_unused(node);
-    ecs_world_t *ecs = walrus_engine_vars()->ecs;
-
-    u16                     *view_id = walrus_fg_read_ptr(graph, "ViewSlot");
-    Walrus_Camera           *camera  = walrus_fg_read_ptr(graph, "Camera");
-    Walrus_FramebufferHandle backrt  = {walrus_fg_read(graph, "BackRT")};
-
-    walrus_rhi_set_view_rect_ratio(*view_id, WR_RHI_RATIO_EQUAL);
-    walrus_rhi_set_view_clear(*view_id, WR_RHI_CLEAR_COLOR, 0, 1.0, 0);
-    walrus_rhi_set_view_transform(*view_id, camera->view, camera->projection);
-    walrus_rhi_set_framebuffer(*view_id, backrt);
-
-    walrus_rhi_set_uniform(s_data->u_gpos, 0, sizeof(u32), &(u32){G_POS});
-    walrus_rhi_set_uniform(s_data->u_gnormal, 0, sizeof(u32), &(u32){G_NORMAL});
-    walrus_rhi_set_uniform(s_data->u_galbedo, 0, sizeof(u32), &(u32){G_ALBEDO});
-    walrus_rhi_set_uniform(s_data->u_gemissive, 0, sizeof(u32), &(u32){G_EMISSIVE});
-
-    walrus_rhi_set_texture(G_POS, walrus_rhi_get_texture(s_data->gbuffer, G_POS));
-    walrus_rhi_set_texture(G_NORMAL, walrus_rhi_get_texture(s_data->gbuffer, G_NORMAL));
-    walrus_rhi_set_texture(G_ALBEDO, walrus_rhi_get_texture(s_data->gbuffer, G_ALBEDO));
-    walrus_rhi_set_texture(G_EMISSIVE, walrus_rhi_get_texture(s_data->gbuffer, G_EMISSIVE));
-
-    walrus_rhi_set_state(WR_RHI_STATE_WRITE_RGB, 0);
-    walrus_renderer_submit_quad(1, s_data->deferred_shader);
+    u16                      view_id    = walrus_fg_view_id(graph, node);
+    Walrus_Camera           *camera     = walrus_fg_read_ptr(graph, s_data->camera);
+    Walrus_Visibility const *visibility = walrus_fg_read_ptr(graph, s_data->visibility);
+
+    walrus_rhi_set_view_rect_ratio(view_id, WR_RHI_RATIO_EQUAL);
+    walrus_rhi_set_view_clear(view_id, WR_RHI_CLEAR_COLOR, 0, 1.0, 0);
+    walrus_rhi_set_view_transform(view_id, camera->view, camera->projection);
+    walrus_rhi_set_framebuffer(view_id, walrus_fg_framebuffer(graph, s_data->backrt));
+
+    Walrus_RhiEncoder *encoder = node->encoder;
+    walrus_rhi_encoder_set_uniform(encoder, s_data->u_gpos, 0, sizeof(u32), &(u32){G_POS});
+    walrus_rhi_encoder_set_uniform(encoder, s_data->u_gnormal, 0, sizeof(u32), &(u32){G_NORMAL});
+    walrus_rhi_encoder_set_uniform(encoder, s_data->u_galbedo, 0, sizeof(u32), &(u32){G_ALBEDO});
+    walrus_rhi_encoder_set_uniform(encoder, s_data->u_gemissive, 0, sizeof(u32), &(u32){G_EMISSIVE});
+
+    walrus_rhi_encoder_set_texture(encoder, G_POS, walrus_fg_texture(graph, s_data->gbuffer_textures[G_POS]));
+    walrus_rhi_encoder_set_texture(encoder, G_NORMAL, walrus_fg_texture(graph, s_data->gbuffer_textures[G_NORMAL]));
+    walrus_rhi_encoder_set_texture(encoder, G_ALBEDO, walrus_fg_texture(graph, s_data->gbuffer_textures[G_ALBEDO]));
+    walrus_rhi_encoder_set_texture(encoder, G_EMISSIVE,
+                                   walrus_fg_texture(graph, s_data->gbuffer_textures[G_EMISSIVE]));
+
+    walrus_rhi_encoder_set_state(encoder, WR_RHI_STATE_WRITE_RGB, 0);
+    walrus_renderer_encoder_submit_quad(encoder, view_id, s_data->deferred_shader);
+
+    Walrus_ProgramHandle const shaders[DRAW_KIND_COUNT] = {s_data->forward_shader, s_data->forward_skin_shader,
+                                                           s_data->forward_baked_skin_shader};
+    draw_items(encoder, view_id, s_data->blend, visibility, shaders);
+}
 
-    ecs_run(ecs, ecs_id(forward_submit_static_mesh), 0, view_id);
-    ecs_run(ecs, ecs_id(forward_submit_skinned_mesh), 0, view_id);
+static void draw_item_append(DrawItem *item)
+{
+    walrus_array_append(item->material->alpha_mode == WR_ALPHA_MODE_BLEND ? s_data->blend : s_data->opaque, item);
+}
 
-    ++(*view_id);
+static void weights_gather(ecs_world_t *world, ecs_entity_t entity, DrawItem *item)
+{
+    Walrus_WeightResource const *weights = ecs_get(world, entity, Walrus_WeightResource);
+    item->has_weights                    = weights != NULL;
+    if (weights) {
+        item->weights = weights->weight_buffer;
+    }
 }
 
-static void deferred_submit_static_mesh(ecs_iter_t *it)
+static void deferred_gather_static_mesh(ecs_iter_t *it)
 {
-    Walrus_RenderMesh *meshes     = ecs_field(it, Walrus_RenderMesh, 1);
-    Walrus_Material   *materials  = ecs_field(it, Walrus_Material, 2);
-    Walrus_Transform  *transforms = ecs_field(it, Walrus_Transform, 3);
-    u16                view_id    = *(u16 *)it->param;
+    Walrus_RenderMesh     *meshes     = ecs_field(it, Walrus_RenderMesh, 1);
+    Walrus_RenderMaterial *materials  = ecs_field(it, Walrus_RenderMaterial, 2);
+    Walrus_Transform      *transforms = ecs_field(it, Walrus_Transform, 3);
 
     for (i32 i = 0; i < it->count; ++i) {
-        if (meshes[i].culled) {
-            continue;
-        }
-        if (materials[i].alpha_mode == WR_ALPHA_MODE_BLEND) {
-            continue;
-        }
-
-        mat4 world;
-        walrus_transform_compose(&transforms[i], world);
+        DrawItem item = {
+            .mesh = meshes[i].mesh, .material = materials[i].material, .index = meshes[i].index, .kind = DRAW_STATIC};
+        walrus_transform_compose(&transforms[i], item.world);
+        weights_gather(it->world, it->entities[i], &item);
+        draw_item_append(&item);
+    }
+}
 
-        Walrus_TransientBuffer const *weights = NULL;
-        if (ecs_has(it->world, it->entities[i], Walrus_WeightResource)) {
-            weights = &ecs_get(it->world, it->entities[i], Walrus_WeightResource)->weight_buffer;
-            walrus_rhi_set_transient_buffer(0, weights);
-        }
-        walrus_material_submit(&materials[i]);
-        walrus_renderer_submit_mesh(view_id, s_data->gbuffer_shader, world, meshes[i].mesh);
+// The atlas row of a baked instance rides in the unused bottom row of its transform, so every instance of a mesh
+// submits the same uniforms and the instancing view merges them into one draw
+static bool baked_skin_gather(ecs_world_t *world, ecs_entity_t parent, Walrus_SkinResource const *skin, DrawItem *item)
+{
+    Walrus_BakedAnimator const  *animator = ecs_get(world, parent, Walrus_BakedAnimator);
+    Walrus_BakedAnimation const *baked    = ecs_get(world, parent, Walrus_BakedAnimation);
+    if (animator == NULL || baked == NULL || animator->clip >= baked->num_clips) {
+        return false;
     }
+
+    Walrus_Model const *model = &ecs_get(world, parent, Walrus_ModelRef)->model;
+    f32 const           time  = ecs_get_world_info(world)->world_time_total + animator->time_offset;
+    item->world[0][3]         = walrus_baked_animation_frame(baked, animator->clip, time);
+    item->baked_texture       = baked->texture;
+    item->baked_offset        = baked->skin_offsets[skin->skin - model->skins];
+
+    return true;
 }
 
-static void deferred_submit_skinned_mesh(ecs_iter_t *it)
+static void deferred_gather_skinned_mesh(ecs_iter_t *it)
 {
-    Walrus_RenderMesh   *meshes    = ecs_field(it, Walrus_RenderMesh, 1);
-    Walrus_Material     *materials = ecs_field(it, Walrus_Material, 2);
-    Walrus_SkinResource *skins     = ecs_field(it, Walrus_SkinResource, 3);
-    u16                  view_id   = *(u16 *)it->param;
+    Walrus_RenderMesh     *meshes    = ecs_field(it, Walrus_RenderMesh, 1);
+    Walrus_RenderMaterial *materials = ecs_field(it, Walrus_RenderMaterial, 2);
+    Walrus_SkinResource   *skins     = ecs_field(it, Walrus_SkinResource, 3);
 
     for (i32 i = 0; i < it->count; ++i) {
-        if (meshes[i].culled) {
-            continue;
-        }
-        if (materials[i].alpha_mode == WR_ALPHA_MODE_BLEND) {
-            continue;
-        }
+        DrawItem item = {.mesh = meshes[i].mesh, .material = materials[i].material, .index = meshes[i].index};
 
         ecs_entity_t parent = ecs_get_target(it->world, it->entities[i], EcsChildOf, 0);
+        walrus_transform_compose(ecs_get(it->world, parent, Walrus_Transform), item.world);
+        weights_gather(it->world, it->entities[i], &item);
 
-        Walrus_Transform const *p_trans = ecs_get(it->world, parent, Walrus_Transform);
-        mat4                    p_world;
-        walrus_transform_compose(p_trans, p_world);
-
-        if (ecs_has(it->world, it->entities[i], Walrus_WeightResource)) {
-            walrus_rhi_set_transient_buffer(0,
-                                            &ecs_get(it->world, it->entities[i], Walrus_WeightResource)->weight_buffer);
+        if (baked_skin_gather(it->world, parent, &skins[i], &item)) {
+            item.kind = DRAW_BAKED;
         }
-        walrus_rhi_set_transient_buffer(1, &skins[i].joint_buffer);
-        walrus_material_submit(&materials[i]);
-        walrus_renderer_submit_mesh(view_id, s_data->gbuffer_skin_shader, p_world, meshes[i].mesh);
+        else {
+            item.kind   = DRAW_SKINNED;
+            item.joints = skins[i].joint_buffer;
+        }
+        draw_item_append(&item);
     }
 }
 
-static void forward_submit_static_mesh(ecs_iter_t *it)
+static void deferred_prepare(Walrus_FrameGraph *graph, void *userdata)
 {
-    Walrus_RenderMesh *meshes     = ecs_field(it, Walrus_RenderMesh, 1);
-    Walrus_Material   *materials  = ecs_field(it, Walrus_Material, 2);
-    Walrus_Transform  *transforms = ecs_field(it, Walrus_Transform, 3);
-    u16                view_id    = *(u16 *)it->param;
-
-    for (i32 i = 0; i < it->count; ++i) {
-        if (meshes[i].culled) {
-            continue;
-        }
-        if (materials[i].alpha_mode != WR_ALPHA_MODE_BLEND) {
-            continue;
-        }
+    walrus_unused(graph);
+    walrus_unused(userdata);
 
-        mat4 world;
-        walrus_transform_compose(&transforms[i], world);
+    ecs_world_t *ecs = walrus_engine_vars()->ecs;
 
-        if (ecs_has(it->world, it->entities[i], Walrus_WeightResource)) {
-            walrus_rhi_set_transient_buffer(0,
-                                            &ecs_get(it->world, it->entities[i], Walrus_WeightResource)->weight_buffer);
-        }
-        walrus_material_submit(&materials[i]);
-        walrus_renderer_submit_mesh(view_id, s_data->forward_shader, world, meshes[i].mesh);
-    }
+    walrus_array_clear(s_data->opaque);
+    walrus_array_clear(s_data->blend);
+    ecs_run(ecs, ecs_id(deferred_gather_static_mesh), 0, NULL);
+    ecs_run(ecs, ecs_id(deferred_gather_skinned_mesh), 0, NULL);
 }
 
 static void render_data_free(void *userdata)
@@ -188,15 +250,19 @@ static void render_data_free(void *userdata)
     walrus_rhi_destroy_uniform(s_data->u_gbitangent);
     walrus_rhi_destroy_uniform(s_data->u_galbedo);
     walrus_rhi_destroy_uniform(s_data->u_gemissive);
+    walrus_rhi_destroy_uniform(s_data->u_baked_animation);
+    walrus_rhi_destroy_uniform(s_data->u_baked_joint_offset);
 
-    walrus_rhi_destroy_framebuffer(s_data->gbuffer);
-
+    walrus_array_destroy(s_data->opaque);
+    walrus_array_destroy(s_data->blend);
     walrus_free(s_data);
 }
 
 static void render_data_create(Walrus_FrameGraph *graph)
 {
-    s_data = walrus_new(DeferredRenderData, 1);
+    s_data         = walrus_new(DeferredRenderData, 1);
+    s_data->opaque = walrus_array_create(sizeof(DrawItem), 0);
+    s_data->blend  = walrus_array_create(sizeof(DrawItem), 0);
 
     s_data->u_gpos       = walrus_rhi_create_uniform("u_gpos", WR_RHI_UNIFORM_SAMPLER, 1);
     s_data->u_gnormal    = walrus_rhi_create_uniform("u_gnormal", WR_RHI_UNIFORM_SAMPLER, 1);
@@ -205,18 +271,25 @@ static void render_data_create(Walrus_FrameGraph *graph)
     s_data->u_galbedo    = walrus_rhi_create_uniform("u_galbedo", WR_RHI_UNIFORM_SAMPLER, 1);
     s_data->u_gemissive  = walrus_rhi_create_uniform("u_gemissive", WR_RHI_UNIFORM_SAMPLER, 1);
 
-    s_data->gbuffer_shader      = walrus_shader_library_load("gbuffer.shader");
-    s_data->gbuffer_skin_shader = walrus_shader_library_load("gbuffer_skin.shader");
-    s_data->forward_shader      = walrus_shader_library_load("forward_lighting.shader");
-    s_data->forward_skin_shader = walrus_shader_library_load("forward_lighting_skin.shader");
-    s_data->deferred_shader     = walrus_shader_library_load("deferred_lighting.shader");
+    s_data->u_baked_animation    = walrus_rhi_create_uniform("u_baked_animation", WR_RHI_UNIFORM_SAMPLER, 1);
+    s_data->u_baked_joint_offset = walrus_rhi_create_uniform("u_baked_joint_offset", WR_RHI_UNIFORM_INT, 1);
+
+    s_data->gbuffer_shader            = walrus_shader_library_load("gbuffer.shader");
+    s_data->gbuffer_skin_shader       = walrus_shader_library_load("gbuffer_skin.shader");
+    s_data->gbuffer_baked_skin_shader = walrus_shader_library_load("gbuffer_baked_skin.shader");
+    s_data->forward_shader            = walrus_shader_library_load("forward_lighting.shader");
+    s_data->forward_skin_shader       = walrus_shader_library_load("forward_lighting_skin.shader");
+    s_data->forward_baked_skin_shader = walrus_shader_library_load("forward_lighting_baked_skin.shader");
+    s_data->deferred_shader           = walrus_shader_library_load("deferred_lighting.shader");
 
     u64 flags =
         (u64)(walrus_u32cnttz(walrus_rhi_get_mssa()) + 1) << WR_RHI_TEXTURE_RT_MSAA_SHIFT | WR_RHI_SAMPLER_UVW_CLAMP;
 
     {
-        Walrus_Attachment  attachments[7] = {0};
-        Walrus_PixelFormat formats[6]     = {
+        u32                attachments[7];
+        char const        *names[6]   = {"GBufferPos",       "GBufferNormal", "GBufferTangent",
+                                         "GBufferBitangent", "GBufferAlbedo", "GBufferEmissive"};
+        Walrus_PixelFormat formats[6] = {
             WR_RHI_FORMAT_RGB32F,  // pos
             WR_RHI_FORMAT_RGB32F,  // normal
             WR_RHI_FORMAT_RGB32F,  // tangent
@@ -225,81 +298,56 @@ static void render_data_create(Walrus_FrameGraph *graph)
             WR_RHI_FORMAT_RGB8     // emissive
         };
 
-        attachments[walrus_count_of(attachments) - 1].handle =
-            (Walrus_TextureHandle){walrus_fg_read(graph, "DepthBuffer")};
-
         for (u32 i = 0; i < walrus_count_of(formats); ++i) {
-            attachments[i].handle = walrus_rhi_create_texture(
+            s_data->gbuffer_textures[i] = walrus_fg_create_texture(
+                graph, names[i],
                 &(Walrus_TextureCreateInfo){
-                    .ratio = WR_RHI_RATIO_EQUAL, .format = formats[i], .num_mipmaps = 1, .flags = flags},
-                NULL);
-            attachments[i].access = WR_RHI_ACCESS_WRITE;
-        }
-
-        s_data->gbuffer = walrus_rhi_create_framebuffer(attachments, walrus_count_of(attachments));
-    }
-}
-
-static void forward_submit_skinned_mesh(ecs_iter_t *it)
-{
-    Walrus_RenderMesh   *meshes    = ecs_field(it, Walrus_RenderMesh, 1);
-    Walrus_Material     *materials = ecs_field(it, Walrus_Material, 2);
-    Walrus_SkinResource *skins     = ecs_field(it, Walrus_SkinResource, 3);
-    u16                  view_id   = *(u16 *)it->param;
-
-    for (i32 i = 0; i < it->count; ++i) {
-        if (meshes[i].culled) {
-            continue;
-        }
-        if (materials[i].alpha_mode != WR_ALPHA_MODE_BLEND) {
-            continue;
+                    .ratio = WR_RHI_RATIO_EQUAL, .format = formats[i], .num_mipmaps = 1, .flags = flags});
+            attachments[i] = s_data->gbuffer_textures[i];
         }
+        attachments[walrus_count_of(attachments) - 1] = walrus_fg_lookup_resource(graph, "DepthBuffer");
 
-        ecs_entity_t parent = ecs_get_target(it->world, it->entities[i], EcsChildOf, 0);
-
-        Walrus_Transform const *p_trans = ecs_get(it->world, parent, Walrus_Transform);
-        mat4                    p_world;
-        walrus_transform_compose(p_trans, p_world);
-
-        if (ecs_has(it->world, it->entities[i], Walrus_WeightResource)) {
-            walrus_rhi_set_transient_buffer(0,
-                                            &ecs_get(it->world, it->entities[i], Walrus_WeightResource)->weight_buffer);
-        }
-        walrus_material_submit(&materials[i]);
-        walrus_rhi_set_transient_buffer(1, &skins[i].joint_buffer);
-        walrus_renderer_submit_mesh(view_id, s_data->forward_skin_shader, p_world, meshes[i].mesh);
+        s_data->gbuffer = walrus_fg_create_framebuffer(graph, "GBuffer", attachments, walrus_count_of(attachments));
     }
+    s_data->visibility = walrus_fg_create_data(graph, "Visibility");
+    s_data->backrt     = walrus_fg_lookup_resource(graph, "BackRT");
+    s_data->camera     = walrus_fg_create_data(graph, "Camera");
 }
 
 Walrus_FramePipeline *walrus_deferred_pipeline_add(Walrus_FrameGraph *graph, char const *name)
 {
     ecs_world_t *ecs = walrus_engine_vars()->ecs;
-    ecs_id(deferred_submit_static_mesh) =
-        ecs_system(ecs, {
-                            .entity             = ecs_entity(ecs, {0}),
-                            .query.filter.terms = {{.id = ecs_id(Walrus_RenderMesh)},
-                                                   {.id = ecs_id(Walrus_Material)},
-                                                   {.id = ecs_id(Walrus_Transform)},
-                                                   {.id = ecs_id(Walrus_SkinResource), .oper = EcsNot}},
-                            .callback           = deferred_submit_static_mesh,
-                        });
-    ECS_SYSTEM_DEFINE(ecs, deferred_submit_skinned_mesh, 0, Walrus_RenderMesh, Walrus_Material, Walrus_SkinResource);
-    ecs_id(forward_submit_static_mesh) =
+    ecs_id(deferred_gather_static_mesh) =
         ecs_system(ecs, {
                             .entity             = ecs_entity(ecs, {0}),
                             .query.filter.terms = {{.id = ecs_id(Walrus_RenderMesh)},
-                                                   {.id = ecs_id(Walrus_Material)},
+                                                   {.id = ecs_id(Walrus_RenderMaterial)},
                                                    {.id = ecs_id(Walrus_Transform)},
                                                    {.id = ecs_id(Walrus_SkinResource), .oper = EcsNot}},
-                            .callback           = forward_submit_static_mesh,
+                            .callback           = deferred_gather_static_mesh,
                         });
-    ECS_SYSTEM_DEFINE(ecs, forward_submit_skinned_mesh, 0, Walrus_RenderMesh, Walrus_Material, Walrus_SkinResource);
+    ECS_SYSTEM_DEFINE(ecs, deferred_gather_skinned_mesh, 0, Walrus_RenderMesh, Walrus_RenderMaterial,
+                      Walrus_SkinResource);
 
     render_data_create(graph);
 
     Walrus_FramePipeline *deferred_pipeline = walrus_fg_add_pipeline_full(graph, name, render_data_free, NULL);
-    walrus_fg_add_node(deferred_pipeline, gbuffer_pass, "GBuffer");
-    walrus_fg_add_node(deferred_pipeline, lighting_pass, "Lighting");
+    walrus_fg_set_prepare(deferred_pipeline, deferred_prepare);
+    u32 const gbuffer = walrus_fg_add_node(deferred_pipeline, gbuffer_pass, "GBuffer");
+    walrus_fg_node_read(deferred_pipeline, gbuffer, s_data->visibility);
+    walrus_fg_node_write(deferred_pipeline, gbuffer, s_data->gbuffer);
+    walrus_fg_node_views(deferred_pipeline, gbuffer, 1);
+    walrus_fg_node_parallel(deferred_pipeline, gbuffer);
+
+    u32 const lighting = walrus_fg_add_node(deferred_pipeline, lighting_pass, "Lighting");
+    walrus_fg_node_read(deferred_pipeline, lighting, s_data->visibility);
+    walrus_fg_node_read(deferred_pipeline, lighting, s_data->gbuffer_textures[G_POS]);
+    walrus_fg_node_read(deferred_pipeline, lighting, s_data->gbuffer_textures[G_NORMAL]);
+    walrus_fg_node_read(deferred_pipeline, lighting, s_data->gbuffer_textures[G_ALBEDO]);
+    walrus_fg_node_read(deferred_pipeline, lighting, s_data->gbuffer_textures[G_EMISSIVE]);
+    walrus_fg_node_write(deferred_pipeline, lighting, s_data->backrt);
+    walrus_fg_node_views(deferred_pipeline, lighting, 1);
+    walrus_fg_node_parallel(deferred_pipeline, lighting);
 
     return deferred_pipeline;
 }
@@ -13,61 +13,54 @@ typedef struct {
     Walrus_ProgramHandle copy_shader;
     Walrus_ProgramHandle hdr_shader;
 
-    Walrus_FramebufferHandle hdr_buffer;
+    // Frame graph resources
+    u32 color_buffer;
+    u32 depth_buffer;
+    u32 hdr_color;
+    u32 hdr_buffer;
+    u32 renderer;
 } HdrRenderData;
 
 static HdrRenderData *s_data;
 
+// Both passes are parallel nodes, they only touch their own views and record the draws into the node encoder
 static void hdr_pass(Walrus_FrameGraph *graph, Walrus_FrameNode const *node)
 {
-    walrus_unused(node);
+    Walrus_RhiEncoder *encoder = node->encoder;
+    u16 const          view_id = walrus_fg_view_id(graph, node);
 
-    u16 *view_id = walrus_fg_read_ptr(graph, "ViewSlot");
+    walrus_rhi_set_view_rect_ratio(view_id, WR_RHI_RATIO_EQUAL);
+    walrus_rhi_set_view_clear(view_id, WR_RHI_CLEAR_NONE, 0, 1.0, 0);
+    walrus_rhi_set_framebuffer(view_id, walrus_fg_framebuffer(graph, s_data->hdr_buffer));
 
-    Walrus_TextureHandle color_buffer = {walrus_fg_read(graph, "ColorBuffer")};
+    walrus_rhi_encoder_set_uniform(encoder, s_data->u_color_buffer, 0, sizeof(u32), &(u32){0});
+    walrus_rhi_encoder_set_texture(encoder, 0, walrus_fg_texture(graph, s_data->color_buffer));
 
-    walrus_rhi_set_view_rect_ratio(*view_id, WR_RHI_RATIO_EQUAL);
-    walrus_rhi_set_view_clear(*view_id, WR_RHI_CLEAR_NONE, 0, 1.0, 0);
-    walrus_rhi_set_framebuffer(*view_id, s_data->hdr_buffer);
-
-    walrus_rhi_set_uniform(s_data->u_color_buffer, 0, sizeof(u32), &(u32){0});
-    walrus_rhi_set_texture(0, color_buffer);
-
-    walrus_rhi_set_state(WR_RHI_STATE_WRITE_RGB | WR_RHI_STATE_WRITE_A, 0);
-    walrus_renderer_submit_quad(*view_id, s_data->hdr_shader);
-
-    walrus_fg_write(graph, "ColorBuffer", walrus_rhi_get_texture(s_data->hdr_buffer, 0).id);
-
-    ++(*view_id);
+    walrus_rhi_encoder_set_state(encoder, WR_RHI_STATE_WRITE_RGB | WR_RHI_STATE_WRITE_A, 0);
+    walrus_renderer_encoder_submit_quad(encoder, view_id, s_data->hdr_shader);
 }
 
 static void final_pass(Walrus_FrameGraph *graph, Walrus_FrameNode const *node)
 {
-    walrus_unused(node);
-
-    u16 *view_id = walrus_fg_read_ptr(graph, "ViewSlot");
+    Walrus_RhiEncoder *encoder  = node->encoder;
+    u16 const          view_id  = walrus_fg_view_id(graph, node);
+    Walrus_Renderer   *renderer = walrus_fg_read_ptr(graph, s_data->renderer);
 
-    Walrus_Renderer     *renderer     = walrus_fg_read_ptr(graph, "Renderer");
-    Walrus_TextureHandle color_buffer = {walrus_fg_read(graph, "ColorBuffer")};
-    Walrus_TextureHandle depth_buffer = {walrus_fg_read(graph, "DepthBuffer")};
+    walrus_rhi_set_view_rect(view_id, renderer->x, renderer->y, renderer->width, renderer->height);
+    walrus_rhi_set_view_clear(view_id, WR_RHI_CLEAR_NONE, 0, 1.0, 0);
+    walrus_rhi_set_framebuffer(view_id, renderer->framebuffer);
 
-    walrus_rhi_set_view_rect(*view_id, renderer->x, renderer->y, renderer->width, renderer->height);
-    walrus_rhi_set_view_clear(*view_id, WR_RHI_CLEAR_NONE, 0, 1.0, 0);
-    walrus_rhi_set_framebuffer(*view_id, renderer->framebuffer);
+    walrus_rhi_encoder_set_uniform(encoder, s_data->u_color_buffer, 0, sizeof(u32), &(u32){0});
+    walrus_rhi_encoder_set_texture(encoder, 0, walrus_fg_texture(graph, s_data->hdr_color));
 
-    walrus_rhi_set_uniform(s_data->u_color_buffer, 0, sizeof(u32), &(u32){0});
-    walrus_rhi_set_texture(0, color_buffer);
+    walrus_rhi_encoder_set_uniform(encoder, s_data->u_depth_buffer, 0, sizeof(u32), &(u32){1});
+    walrus_rhi_encoder_set_texture(encoder, 1, walrus_fg_texture(graph, s_data->depth_buffer));
 
-    walrus_rhi_set_uniform(s_data->u_depth_buffer, 0, sizeof(u32), &(u32){1});
-    walrus_rhi_set_texture(1, depth_buffer);
-
-    walrus_rhi_set_state(WR_RHI_STATE_WRITE_RGB | WR_RHI_STATE_WRITE_A | WR_RHI_STATE_WRITE_Z, 0);
-    walrus_renderer_submit_quad(*view_id, s_data->copy_shader);
-
-    ++(*view_id);
+    walrus_rhi_encoder_set_state(encoder, WR_RHI_STATE_WRITE_RGB | WR_RHI_STATE_WRITE_A | WR_RHI_STATE_WRITE_Z, 0);
+    walrus_renderer_encoder_submit_quad(encoder, view_id, s_data->copy_shader);
 }
 
-static void render_data_create(void)
+static void render_data_create(Walrus_FrameGraph *graph)
 {
     s_data                 = walrus_new(HdrRenderData, 1);
     s_data->u_color_buffer = walrus_rhi_create_uniform("u_color_buffer", WR_RHI_UNIFORM_SAMPLER, 1);
@@ -76,14 +69,16 @@ static void render_data_create(void)
     s_data->copy_shader = walrus_shader_library_load("copy.shader");
     s_data->hdr_shader  = walrus_shader_library_load("hdr.shader");
 
-    Walrus_Attachment attachment = {0};
-    attachment.handle            = walrus_rhi_create_texture(&(Walrus_TextureCreateInfo){.ratio       = WR_RHI_RATIO_EQUAL,
-                                                                                         .format      = WR_RHI_FORMAT_RGB8,
-                                                                                         .num_mipmaps = 1,
-                                                                                         .flags       = WR_RHI_SAMPLER_UVW_CLAMP},
-                                                             NULL);
-    attachment.access            = WR_RHI_ACCESS_WRITE;
-    s_data->hdr_buffer           = walrus_rhi_create_framebuffer(&attachment, 1);
+    s_data->color_buffer = walrus_fg_lookup_resource(graph, "ColorBuffer");
+    s_data->depth_buffer = walrus_fg_lookup_resource(graph, "DepthBuffer");
+    s_data->hdr_color    = walrus_fg_create_texture(
+        graph, "HdrColor",
+        &(Walrus_TextureCreateInfo){.ratio       = WR_RHI_RATIO_EQUAL,
+                                    .format      = WR_RHI_FORMAT_RGB8,
+                                    .num_mipmaps = 1,
+                                    .flags       = WR_RHI_SAMPLER_UVW_CLAMP});
+    s_data->hdr_buffer   = walrus_fg_create_framebuffer(graph, "HdrBuffer", &s_data->hdr_color, 1);
+    s_data->renderer     = walrus_fg_create_data(graph, "Renderer");
 }
 
 static void render_data_free(void *userdata)
@@ -92,18 +87,27 @@ static void render_data_free(void *userdata)
     walrus_rhi_destroy_uniform(s_data->u_color_buffer);
     walrus_rhi_destroy_uniform(s_data->u_depth_buffer);
 
-    walrus_rhi_destroy_framebuffer(s_data->hdr_buffer);
-
     walrus_free(s_data);
 }
 
 Walrus_FramePipeline *walrus_hdr_pipeline_add(Walrus_FrameGraph *graph, char const *name)
 {
+    render_data_create(graph);
+
     Walrus_FramePipeline *pipeline = walrus_fg_add_pipeline_full(graph, name, render_data_free, NULL);
-    walrus_fg_add_node(pipeline, hdr_pass, "HDR");
-    walrus_fg_add_node(pipeline, final_pass, "Final");
 
-    render_data_create();
+    u32 const hdr = walrus_fg_add_node(pipeline, hdr_pass, "HDR");
+    walrus_fg_node_read(pipeline, hdr, s_data->color_buffer);
+    walrus_fg_node_write(pipeline, hdr, s_data->hdr_buffer);
+    walrus_fg_node_views(pipeline, hdr, 1);
+    walrus_fg_node_parallel(pipeline, hdr);
+
+    // Presents to the target of the renderer, which is outside of the graph, so it declares no write and is kept
+    u32 const final = walrus_fg_add_node(pipeline, final_pass, "Final");
+    walrus_fg_node_read(pipeline, final, s_data->hdr_color);
+    walrus_fg_node_read(pipeline, final, s_data->depth_buffer);
+    walrus_fg_node_views(pipeline, final, 1);
+    walrus_fg_node_parallel(pipeline, final);
 
     return pipeline;
 }
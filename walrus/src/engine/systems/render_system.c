@@ -13,21 +13,47 @@
 #include <core/memory.h>
 #include <core/assert.h>
 #include <core/math.h>
+#include <core/log.h>
+#include <core/job.h>
 
 ECS_COMPONENT_DECLARE(Walrus_Renderer);
 ECS_COMPONENT_DECLARE(Walrus_RenderMesh);
-ECS_COMPONENT_DECLARE(Walrus_Material);
+ECS_COMPONENT_DECLARE(Walrus_RenderMaterial);
 ECS_COMPONENT_DECLARE(Walrus_WeightResource);
 ECS_COMPONENT_DECLARE(Walrus_SkinResource);
 
-ECS_SYSTEM_DECLARE(weight_update);
-ECS_SYSTEM_DECLARE(skin_update);
-ECS_SYSTEM_DECLARE(renderer_run);
+ECS_SYSTEM_DECLARE(weight_gather);
+ECS_SYSTEM_DECLARE(skin_gather);
+ECS_SYSTEM_DECLARE(camera_gather);
 
 #define DEFERRED_LIGHTING_PASS "DeferredRenderPass"
 #define CULLING_PASS           "CullingPass"
 #define HDR_PASS               "HDRPass"
 
+// Skins whose palettes are computed by one job
+#define SKIN_GRAIN 4
+
+// Morph targets whose weights are copied by one job
+#define WEIGHT_GRAIN 32
+
+typedef struct {
+    Walrus_WeightResource *resource;
+    Walrus_Model const    *model;
+    Walrus_Animator const *animator;
+} WeightJob;
+
+typedef struct {
+    Walrus_SkinResource   *resource;
+    Walrus_Model const    *model;
+    Walrus_Animator const *animator;
+} SkinJob;
+
+typedef struct {
+    Walrus_Renderer   *renderer;
+    Walrus_Camera     *camera;
+    Walrus_RhiEncoder *encoder;
+} CameraJob;
+
 static void on_model_add(ecs_iter_t *it)
 {
     Walrus_Transform *p_worlds = ecs_field(it, Walrus_Transform, 1);
@@ -71,8 +97,9 @@ static void on_model_add(ecs_iter_t *it)
                     ecs_add_pair(it->world, mesh, EcsIsA, weight);
                 }
 
-                ecs_set(it->world, mesh, Walrus_RenderMesh, {.mesh = &node->mesh->primitives[j], .culled = false});
-                ecs_set_ptr(it->world, mesh, Walrus_Material, material ? material : &render->default_material);
+                ecs_set(it->world, mesh, Walrus_RenderMesh, {.mesh = &node->mesh->primitives[j]});
+                ecs_set(it->world, mesh, Walrus_RenderMaterial,
+                        {.material = material ? material : &render->default_material});
 
                 walrus_transform_mul(&p_worlds[0], world, ecs_get_mut(it->world, mesh, Walrus_Transform));
                 ecs_modified(it->world, mesh, Walrus_Transform);
@@ -142,81 +169,175 @@ static void transform_bound(mat4 const m, vec3 const min, vec3 const max, vec3 r
     glm_vec3_add(new_center, new_extends, res_max);
 }
 
-static void renderer_run(ecs_iter_t *it)
+static void camera_gather(ecs_iter_t *it)
 {
-    RenderSystem    *render    = it->param;
     Walrus_Renderer *renderers = ecs_field(it, Walrus_Renderer, 1);
     Walrus_Camera   *cameras   = ecs_field(it, Walrus_Camera, 2);
-
+    Walrus_Array    *jobs      = it->param;
     for (i32 i = 0; i < it->count; ++i) {
-        if (!renderers[i].active) {
-            continue;
+        if (renderers[i].active) {
+            CameraJob job = {.renderer = &renderers[i], .camera = &cameras[i]};
+            walrus_array_append(jobs, &job);
+        }
+    }
+}
+
+// Every renderer draws to views of its own, so that one camera does not redefine the views of the previous one
+static void camera_execute_range(u32 begin, u32 end, void *userdata)
+{
+    RenderSystem *render    = userdata;
+    u16 const     num_views = render->output_pipeline->num_views;
+    for (u32 i = begin; i < end; ++i) {
+        CameraJob const   *job       = walrus_array_get(render->camera_jobs, i);
+        Walrus_FrameGraph *execution = walrus_array_get(render->executions, i);
+        walrus_fg_fork(&render->render_graph, execution);
+        walrus_fg_write_ptr(execution, render->renderer_slot, job->renderer);
+        walrus_fg_write_ptr(execution, render->camera_slot, job->camera);
+        walrus_fg_execute_pipeline_encoder(execution, render->output_pipeline, i * num_views, job->encoder);
+    }
+}
+
+// Cameras run as jobs on forks of the graph, the encoders are begun in camera order so that a camera records into
+// the same slot every frame
+static void renderer_run(RenderSystem *render)
+{
+    // A camera past the last view range is not drawn, its view ids would overlap the first ones
+    u32 const num_views   = walrus_max(render->output_pipeline->num_views, 1);
+    u32       num_cameras = walrus_array_len(render->camera_jobs);
+    if (num_cameras * num_views > WR_RHI_MAX_VIEWS) {
+        walrus_warn("%u cameras need more than %u views, only %u are drawn", num_cameras, WR_RHI_MAX_VIEWS,
+                    WR_RHI_MAX_VIEWS / num_views);
+        num_cameras = WR_RHI_MAX_VIEWS / num_views;
+    }
+    while (walrus_array_len(render->executions) < num_cameras) {
+        walrus_array_append(render->executions, &(Walrus_FrameGraph){0});
+    }
+
+    walrus_fg_prepare_pipeline(&render->render_graph, render->output_pipeline);
+
+    for (u32 begin = 0, end = 0; begin < num_cameras; begin = end) {
+        // Encoder 0 belongs to the immediate api
+        for (; end < num_cameras && end - begin < WR_RHI_MAX_ENCODERS - 1; ++end) {
+            CameraJob *job = walrus_array_get(render->camera_jobs, end);
+            job->encoder   = walrus_rhi_begin_encoder();
+            if (job->encoder == NULL) {
+                break;
+            }
+        }
+        if (end == begin) {
+            // No encoder is free, the cameras left record on the immediate one here
+            for (; end < num_cameras; ++end) {
+                ((CameraJob *)walrus_array_get(render->camera_jobs, end))->encoder = walrus_rhi_immediate_encoder();
+            }
+            camera_execute_range(begin, end, render);
+            break;
+        }
+        walrus_parallel_for(begin, end, 1, camera_execute_range, render);
+        for (u32 i = begin; i < end; ++i) {
+            walrus_rhi_end_encoder(((CameraJob *)walrus_array_get(render->camera_jobs, i))->encoder);
         }
-        u16 view_slot = 0;
-
-        walrus_fg_write(&render->render_graph, "ColorBuffer", walrus_rhi_get_texture(render->backrt, 0).id);
-        walrus_fg_write(&render->render_graph, "DepthBuffer", walrus_rhi_get_texture(render->backrt, 1).id);
-        walrus_fg_write(&render->render_graph, "BackRT", render->backrt.id);
-        walrus_fg_write_ptr(&render->render_graph, "Renderer", &renderers[i]);
-        walrus_fg_write_ptr(&render->render_graph, "Camera", &cameras[i]);
-        walrus_fg_write_ptr(&render->render_graph, "ViewSlot", &view_slot);
-        walrus_fg_execute(&render->render_graph, HDR_PASS);
-        /* walrus_rhi_set_debug(WR_RHI_DEBUG_STATS); */
     }
+    /* walrus_rhi_set_debug(WR_RHI_DEBUG_STATS); */
     walrus_rhi_touch(0);
 }
 
-static void weight_update(ecs_iter_t *it)
+// Allocates the weight buffer of every morphed mesh, the weights are then copied by jobs that never touch the world.
+// The model and its animator come from the parent, one table of weights has a single parent.
+static void weight_gather(ecs_iter_t *it)
 {
-    Walrus_WeightResource *weights = ecs_field(it, Walrus_WeightResource, 1);
+    Walrus_WeightResource *weights  = ecs_field(it, Walrus_WeightResource, 1);
+    Walrus_ModelRef const *ref      = ecs_field(it, Walrus_ModelRef, 2);
+    Walrus_Animator const *animator = ecs_field(it, Walrus_Animator, 3);
+    Walrus_Array          *jobs     = it->param;
     for (i32 i = 0; i < it->count; ++i) {
         walrus_rhi_alloc_transient_buffer(&weights[i].weight_buffer, weights[i].node->mesh->num_weights, sizeof(f32),
                                           walrus_rhi_get_caps()->ssbo_align);
 
-        ecs_entity_t        parent = ecs_get_target(it->world, it->entities[i], EcsChildOf, 0);
-        Walrus_Model const *model  = &ecs_get(it->world, parent, Walrus_ModelRef)->model;
-        if (ecs_has(it->world, parent, Walrus_Animator)) {
-            Walrus_Animator const *animator = ecs_get(it->world, parent, Walrus_Animator);
-            walrus_animator_weights(animator, model, weights[i].node, (f32 *)weights[i].weight_buffer.data);
+        WeightJob job = {.resource = &weights[i], .model = &ref->model, .animator = animator};
+        walrus_array_append(jobs, &job);
+    }
+}
+
+static void weight_update_range(u32 begin, u32 end, void *userdata)
+{
+    WeightJob const *jobs = userdata;
+    for (u32 i = begin; i < end; ++i) {
+        Walrus_WeightResource *resource = jobs[i].resource;
+        if (jobs[i].animator) {
+            walrus_animator_weights(jobs[i].animator, jobs[i].model, resource->node,
+                                    (f32 *)resource->weight_buffer.data);
         }
         else {
-            memcpy(weights[i].weight_buffer.data, weights[i].node->mesh->weights,
-                   sizeof(f32) * weights[i].node->mesh->num_weights);
+            memcpy(resource->weight_buffer.data, resource->node->mesh->weights,
+                   sizeof(f32) * resource->node->mesh->num_weights);
         }
     }
 }
 
-static void skin_update(ecs_iter_t *it)
+// Looks up the pose of every skin and allocates its palette, the palettes are then filled by jobs that never touch
+// the world
+static void skin_gather(ecs_iter_t *it)
 {
     Walrus_SkinResource *skins = ecs_field(it, Walrus_SkinResource, 1);
+    Walrus_Array        *jobs  = it->param;
     for (i32 i = 0; i < it->count; ++i) {
-        ecs_entity_t        parent = ecs_get_target(it->world, it->entities[i], EcsChildOf, 0);
-        Walrus_Model const *model  = &ecs_get(it->world, parent, Walrus_ModelRef)->model;
+        ecs_entity_t                 parent   = ecs_get_target(it->world, it->entities[i], EcsChildOf, 0);
+        Walrus_Model const          *model    = &ecs_get(it->world, parent, Walrus_ModelRef)->model;
+        Walrus_BakedAnimator const  *animator = ecs_get(it->world, parent, Walrus_BakedAnimator);
+        Walrus_BakedAnimation const *baked    = ecs_get(it->world, parent, Walrus_BakedAnimation);
+        if (animator && baked && animator->clip < baked->num_clips) {
+            // Baked skins are drawn straight from the atlas, the clip bounds stand in for the pose
+            u32 const bound = animator->clip * baked->num_skins + (skins[i].skin - model->skins);
+            glm_vec3_copy(baked->mins[bound], skins[i].min);
+            glm_vec3_copy(baked->maxs[bound], skins[i].max);
+            continue;
+        }
+
         walrus_rhi_alloc_transient_buffer(&skins[i].joint_buffer, skins[i].skin->num_joints, sizeof(mat4),
                                           walrus_max(walrus_rhi_get_caps()->ssbo_align, alignof(mat4)));
 
-        Walrus_ModelSkin *skin = skins[i].skin;
-
-        mat4 *skin_matrices = (mat4 *)skins[i].joint_buffer.data;
+        SkinJob job;
+        job.resource = &skins[i];
+        job.model    = model;
+        job.animator = ecs_get(it->world, parent, Walrus_Animator);
+        walrus_array_append(jobs, &job);
+    }
+}
 
-        glm_vec3_copy((vec3){FLT_MAX, FLT_MAX, FLT_MAX}, skins[i].min);
-        glm_vec3_copy((vec3){-FLT_MAX, -FLT_MAX, -FLT_MAX}, skins[i].max);
-        for (u32 j = 0; j < skin->num_joints; ++j) {
-            mat4 m;
-            if (ecs_has(it->world, parent, Walrus_Animator)) {
-                Walrus_Animator const *animator = ecs_get(it->world, parent, Walrus_Animator);
-                walrus_animator_transform(animator, model, skin->joints[j].node, m);
-                glm_mat4_mul(m, skin->joints[j].inverse_bind_matrix, skin_matrices[j]);
-            }
-            else {
-                walrus_transform_compose(&skin->joints[j].node->world_transform, m);
-                glm_mat4_mul(m, skin->joints[j].inverse_bind_matrix, skin_matrices[j]);
-            }
-            vec3 min, max;
-            transform_bound(m, skin->joints[j].min, skin->joints[j].max, min, max);
-            glm_vec3_minv(min, skins[i].min, skins[i].min);
-            glm_vec3_maxv(max, skins[i].max, skins[i].max);
+static void skin_palette(SkinJob const *job)
+{
+    Walrus_SkinResource    *resource      = job->resource;
+    Walrus_ModelSkin const *skin          = resource->skin;
+    mat4                   *skin_matrices = (mat4 *)resource->joint_buffer.data;
+
+    vec3 skin_min = {FLT_MAX, FLT_MAX, FLT_MAX};
+    vec3 skin_max = {-FLT_MAX, -FLT_MAX, -FLT_MAX};
+    for (u32 j = 0; j < skin->num_joints; ++j) {
+        Walrus_SkinJoint *joint = &skin->joints[j];
+
+        mat4 m;
+        if (job->animator) {
+            walrus_animator_transform(job->animator, job->model, joint->node, m);
+        }
+        else {
+            walrus_transform_compose(&joint->node->world_transform, m);
         }
+        glm_mat4_mul(m, joint->inverse_bind_matrix, skin_matrices[j]);
+
+        vec3 min, max;
+        transform_bound(m, joint->min, joint->max, min, max);
+        glm_vec3_minv(min, skin_min, skin_min);
+        glm_vec3_maxv(max, skin_max, skin_max);
+    }
+    glm_vec3_copy(skin_min, resource->min);
+    glm_vec3_copy(skin_max, resource->max);
+}
+
+static void skin_palette_range(u32 begin, u32 end, void *userdata)
+{
+    SkinJob const *jobs = userdata;
+    for (u32 i = begin; i < end; ++i) {
+        skin_palette(&jobs[i]);
     }
 }
 
@@ -226,7 +347,7 @@ static void render_system_init(Walrus_System *sys)
     ecs_world_t  *ecs    = sys->ecs;
     ECS_COMPONENT_DEFINE(ecs, Walrus_Renderer);
     ECS_COMPONENT_DEFINE(ecs, Walrus_RenderMesh);
-    ECS_COMPONENT_DEFINE(ecs, Walrus_Material);
+    ECS_COMPONENT_DEFINE(ecs, Walrus_RenderMaterial);
     ECS_COMPONENT_DEFINE(ecs, Walrus_WeightResource);
     ECS_COMPONENT_DEFINE(ecs, Walrus_SkinResource);
 
@@ -236,6 +357,7 @@ static void render_system_init(Walrus_System *sys)
                        .ctx          = render,
                        .filter.terms = {{.id = ecs_id(Walrus_Transform)},
                                         {.id = ecs_id(Walrus_ModelRef)},
+                                        {.id = Walrus_ModelLoaded},
                                         {.id = ecs_id(Walrus_ModelRef), .src.flags = EcsSelf, .oper = EcsNot}}});
     ecs_observer(ecs, {.events       = {EcsOnRemove},
                        .entity       = ecs_entity(ecs, {0}),
@@ -243,24 +365,30 @@ static void render_system_init(Walrus_System *sys)
                        .filter.terms = {{.id = ecs_id(Walrus_ModelRef)},
                                         {.id = ecs_id(Walrus_ModelRef), .src.flags = EcsSelf, .oper = EcsNot}}});
 
-    ecs_id(skin_update)   = ecs_system(ecs, {
+    ecs_id(skin_gather)   = ecs_system(ecs, {
                                                 .entity = ecs_entity(ecs, {0}),
                                                 .query.filter.terms =
                                                   {
                                                       {.id = ecs_id(Walrus_SkinResource), .src.flags = EcsSelf},
                                                   },
-                                                .callback = skin_update,
+                                                .callback = skin_gather,
                                           });
-    ecs_id(weight_update) = ecs_system(ecs, {
-                                                .entity = ecs_entity(ecs, {0}),
-                                                .query.filter.terms =
-                                                    {
-                                                        {.id = ecs_id(Walrus_WeightResource), .src.flags = EcsSelf},
-                                                    },
-                                                .callback = weight_update,
-                                            });
-
-    ECS_SYSTEM_DEFINE(ecs, renderer_run, 0, Walrus_Renderer, Walrus_Camera);
+    ecs_id(weight_gather) = ecs_system(
+        ecs, {
+                 .entity = ecs_entity(ecs, {0}),
+                 .query.filter.terms =
+                     {
+                         {.id = ecs_id(Walrus_WeightResource), .src.flags = EcsSelf},
+                         {.id = ecs_id(Walrus_ModelRef), .src.flags = EcsUp, .src.trav = EcsChildOf},
+                         {.id        = ecs_id(Walrus_Animator),
+                          .src.flags = EcsUp,
+                          .src.trav  = EcsChildOf,
+                          .oper      = EcsOptional},
+                     },
+                 .callback = weight_gather,
+             });
+
+    ECS_SYSTEM_DEFINE(ecs, camera_gather, 0, Walrus_Renderer, Walrus_Camera);
 
     walrus_renderer_init();
 
@@ -284,9 +412,14 @@ static void render_system_init(Walrus_System *sys)
 
     walrus_fg_init(&render->render_graph);
 
-    walrus_fg_write(&render->render_graph, "ColorBuffer", walrus_rhi_get_texture(render->backrt, 0).id);
-    walrus_fg_write(&render->render_graph, "DepthBuffer", walrus_rhi_get_texture(render->backrt, 1).id);
-    walrus_fg_write(&render->render_graph, "BackRT", render->backrt.id);
+    // The back buffer outlives the graph, the pipelines declare their transient targets themselves
+    u32 const backrt_textures[2] = {
+        walrus_fg_import_texture(&render->render_graph, "ColorBuffer", walrus_rhi_get_texture(render->backrt, 0)),
+        walrus_fg_import_texture(&render->render_graph, "DepthBuffer", walrus_rhi_get_texture(render->backrt, 1))};
+    walrus_fg_import_framebuffer(&render->render_graph, "BackRT", render->backrt, backrt_textures,
+                                 walrus_count_of(backrt_textures));
+    render->renderer_slot = walrus_fg_create_data(&render->render_graph, "Renderer");
+    render->camera_slot   = walrus_fg_create_data(&render->render_graph, "Camera");
 
     Walrus_FramePipeline *culling_pipeline = walrus_culling_pipeline_add(&render->render_graph, CULLING_PASS);
     Walrus_FramePipeline *deferred_pipeline =
@@ -297,15 +430,29 @@ static void render_system_init(Walrus_System *sys)
     walrus_fg_connect_pipeline(deferred_pipeline, hdr_pipeline);
 
     walrus_fg_compile(&render->render_graph);
+    render->output_pipeline = hdr_pipeline;
 
     walrus_model_material_init_default(&render->default_material);
+
+    render->skin_jobs   = walrus_array_create(sizeof(SkinJob), 0);
+    render->weight_jobs = walrus_array_create(sizeof(WeightJob), 0);
+    render->camera_jobs = walrus_array_create(sizeof(CameraJob), 0);
+    render->executions  = walrus_array_create(sizeof(Walrus_FrameGraph), 0);
 }
 
 static void render_system_shutdown(Walrus_System *sys)
 {
     RenderSystem *render = poly_cast(sys, RenderSystem);
+    for (u32 i = 0; i < walrus_array_len(render->executions); ++i) {
+        walrus_fg_fork_release(walrus_array_get(render->executions, i));
+    }
     walrus_fg_shutdown(&render->render_graph);
+    walrus_material_shutdown(&render->default_material);
     walrus_renderer_shutdown();
+    walrus_array_destroy(render->skin_jobs);
+    walrus_array_destroy(render->weight_jobs);
+    walrus_array_destroy(render->camera_jobs);
+    walrus_array_destroy(render->executions);
 }
 
 static void render_system_render(Walrus_System *sys)
@@ -313,9 +460,22 @@ static void render_system_render(Walrus_System *sys)
     ecs_world_t  *ecs    = sys->ecs;
     RenderSystem *render = poly_cast(sys, RenderSystem);
 
-    ecs_run(ecs, ecs_id(weight_update), 0, NULL);
-    ecs_run(ecs, ecs_id(skin_update), 0, NULL);
-    ecs_run(ecs, ecs_id(renderer_run), 0, render);
+    // Values set since the last frame reach the buffers before any encoder binds them
+    walrus_material_flush();
+
+    walrus_array_clear(render->weight_jobs);
+    ecs_run(ecs, ecs_id(weight_gather), 0, render->weight_jobs);
+    walrus_parallel_for(0, walrus_array_len(render->weight_jobs), WEIGHT_GRAIN, weight_update_range,
+                        walrus_array_get(render->weight_jobs, 0));
+
+    walrus_array_clear(render->skin_jobs);
+    ecs_run(ecs, ecs_id(skin_gather), 0, render->skin_jobs);
+    walrus_parallel_for(0, walrus_array_len(render->skin_jobs), SKIN_GRAIN, skin_palette_range,
+                        walrus_array_get(render->skin_jobs, 0));
+
+    walrus_array_clear(render->camera_jobs);
+    ecs_run(ecs, ecs_id(camera_gather), 0, render->camera_jobs);
+    renderer_run(render);
 }
 
 POLY_DEFINE_DERIVED(Walrus_System, RenderSystem, render_system_create, POLY_IMPL(on_system_init, render_system_init),
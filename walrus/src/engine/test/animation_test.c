@@ -0,0 +1,656 @@
+#include <engine/animation_baker.h>
+#include <engine/animator.h>
+#include <core/memory.h>
+#include <core/job.h>
+
+#include <math.h>
+#include <stdio.h>
+#include <string.h>
+
+#define NUM_NODES     16
+#define NUM_KEYS      600
+#define FPS           60
+#define TOLERANCE     1e-3f
+#define BAKE_RATE     30
+#define LONG_KEYS     200000
+#define NUM_ANIMATORS 64
+
+#define EXPECT(e)                                                          \
+    if (!(e)) {                                                            \
+        printf("%s:%d: expectation failed: %s\n", __FILE__, __LINE__, #e); \
+        return 1;                                                          \
+    }
+
+static void model_init(Walrus_Model *model, Walrus_Animation *animation)
+{
+    memset(model, 0, sizeof(Walrus_Model));
+    model->num_nodes = NUM_NODES;
+    model->nodes     = walrus_new0(Walrus_ModelNode, NUM_NODES);
+    model->hierarchy = walrus_new(u32, NUM_NODES);
+    model->parents   = walrus_new(u32, NUM_NODES);
+    for (u32 i = 0; i < NUM_NODES; ++i) {
+        model->hierarchy[i] = i;
+        model->parents[i]   = i > 0 ? (i - 1) / 2 : WR_MODEL_INVALID_NODE;
+        walrus_transform_indenity(&model->nodes[i].local_transform);
+    }
+    model->animations     = animation;
+    model->num_animations = 1;
+}
+
+static void model_shutdown(Walrus_Model *model)
+{
+    walrus_free(model->nodes);
+    walrus_free(model->hierarchy);
+    walrus_free(model->parents);
+}
+
+static void animation_shutdown(Walrus_Animation *animation)
+{
+    for (u32 i = 0; i < WR_ANIMATION_PATH_COUNT; ++i) {
+        walrus_free(animation->streams[i].tracks);
+        walrus_free(animation->streams[i].timestamps);
+        walrus_free(animation->streams[i].values);
+        walrus_free(animation->streams[i].quantized);
+    }
+}
+
+// One track per node and path with `num_values` floats per key, packed as the model cooks them
+static void stream_init(Walrus_AnimationStream *stream, Walrus_AnimationInterpolation interpolation,
+                        u32 num_components, u32 num_keys, u32 num_values)
+{
+    stream->num_tracks = NUM_NODES;
+    stream->tracks     = walrus_new0(Walrus_AnimationTrack, NUM_NODES);
+    stream->timestamps = walrus_new(f32, NUM_NODES * num_keys);
+    stream->values     = walrus_new(f32, NUM_NODES * num_keys * num_values);
+    stream->quantized  = NULL;
+    for (u32 i = 0; i < NUM_NODES; ++i) {
+        Walrus_AnimationTrack *track = &stream->tracks[i];
+        track->interpolation         = interpolation;
+        track->timestamps            = stream->timestamps + i * num_keys;
+        track->values                = stream->values + i * num_keys * num_values;
+        track->node                  = i;
+        track->num_components        = num_components;
+        track->num_keys              = num_keys;
+    }
+}
+
+// Smooth motion captured at a fixed rate, with a scale that never changes
+static void mocap_init(Walrus_Animation *animation)
+{
+    memset(animation, 0, sizeof(Walrus_Animation));
+    stream_init(&animation->streams[WR_ANIMATION_PATH_TRANSLATION], WR_ANIMATION_INTERPOLATION_LINEAR, 3, NUM_KEYS, 3);
+    stream_init(&animation->streams[WR_ANIMATION_PATH_ROTATION], WR_ANIMATION_INTERPOLATION_LINEAR, 4, NUM_KEYS, 4);
+    stream_init(&animation->streams[WR_ANIMATION_PATH_SCALE], WR_ANIMATION_INTERPOLATION_STEP, 3, NUM_KEYS, 3);
+
+    Walrus_AnimationStream *translation = &animation->streams[WR_ANIMATION_PATH_TRANSLATION];
+    Walrus_AnimationStream *rotation    = &animation->streams[WR_ANIMATION_PATH_ROTATION];
+    Walrus_AnimationStream *scale       = &animation->streams[WR_ANIMATION_PATH_SCALE];
+    for (u32 i = 0; i < NUM_NODES; ++i) {
+        for (u32 k = 0; k < NUM_KEYS; ++k) {
+            u32 const key   = i * NUM_KEYS + k;
+            f32 const t     = (f32)k / FPS;
+            f32 const phase = i * 0.37f;
+            f32 const angle = 2.0f * sinf(t * 0.9f + phase);
+
+            translation->timestamps[key] = t;
+            rotation->timestamps[key]    = t;
+            scale->timestamps[key]       = t;
+
+            glm_vec3_copy((vec3){sinf(t * 1.3f + phase), 0.5f * cosf(t * 0.7f + phase), 0.1f * i},
+                          &translation->values[key * 3]);
+            glm_vec4_copy((vec4){0, sinf(angle / 2), 0, cosf(angle / 2)}, &rotation->values[key * 4]);
+            glm_vec3_fill(&scale->values[key * 3], 1 + 0.1f * i);
+        }
+    }
+    animation->num_tracks = NUM_NODES * 3;
+    animation->duration   = (f32)(NUM_KEYS - 1) / FPS;
+}
+
+static u32 animation_size(Walrus_Animation const *animation)
+{
+    u32 size = 0;
+    for (u32 path = 0; path < WR_ANIMATION_PATH_COUNT; ++path) {
+        Walrus_AnimationStream const *stream = &animation->streams[path];
+        for (u32 i = 0; i < stream->num_tracks; ++i) {
+            Walrus_AnimationTrack const *track = &stream->tracks[i];
+            size += track->num_keys * sizeof(f32);
+            size += track->quantized ? track->num_keys * 3 * sizeof(u16)
+                                     : track->num_keys * track->num_components * sizeof(f32);
+        }
+    }
+    return size;
+}
+
+static f32 max_error(f32 const *a, f32 const *b, u32 n)
+{
+    f32 error = 0;
+    for (u32 c = 0; c < n; ++c) {
+        error = fmaxf(error, fabsf(a[c] - b[c]));
+    }
+    return error;
+}
+
+static i32 compression_test(void)
+{
+    Walrus_Animation raw;
+    Walrus_Animation compressed;
+    mocap_init(&raw);
+    mocap_init(&compressed);
+    walrus_animation_compress(&compressed, TOLERANCE);
+
+    u32 const raw_size        = animation_size(&raw);
+    u32 const compressed_size = animation_size(&compressed);
+    printf("compressed %u bytes to %u bytes\n", raw_size, compressed_size);
+    EXPECT(compressed_size * 4 < raw_size);
+
+    Walrus_Model raw_model;
+    Walrus_Model compressed_model;
+    model_init(&raw_model, &raw);
+    model_init(&compressed_model, &compressed);
+
+    Walrus_Animator expected;
+    Walrus_Animator animator;
+    walrus_animator_init(&expected);
+    walrus_animator_init(&animator);
+    walrus_animator_bind(&expected, &raw_model);
+    walrus_animator_bind(&animator, &compressed_model);
+    walrus_animator_play(&expected, 0);
+    walrus_animator_play(&animator, 0);
+
+    // Quantization adds a little on top of the key reduction tolerance
+    f32 const bound = TOLERANCE * 2;
+    for (u32 frame = 0; frame < 1000; ++frame) {
+        f32 const dt = 0.0071f;
+        walrus_animator_tick(&expected, &raw_model, dt);
+        walrus_animator_tick(&animator, &compressed_model, dt);
+        for (u32 i = 0; i < NUM_NODES; ++i) {
+            Walrus_Transform const *a = &expected.locals[i];
+            Walrus_Transform const *b = &animator.locals[i];
+
+            // q and -q are the same rotation
+            f32 dot = 0;
+            for (u32 c = 0; c < 4; ++c) {
+                dot += a->rot[c] * b->rot[c];
+            }
+            f32 rot[4];
+            for (u32 c = 0; c < 4; ++c) {
+                rot[c] = dot < 0 ? -b->rot[c] : b->rot[c];
+            }
+
+            EXPECT(max_error(a->trans, b->trans, 3) < bound);
+            EXPECT(max_error(a->rot, rot, 4) < bound);
+            EXPECT(max_error(a->scale, b->scale, 3) < bound);
+        }
+    }
+
+    walrus_animator_shutdown(&expected);
+    walrus_animator_shutdown(&animator);
+    model_shutdown(&raw_model);
+    model_shutdown(&compressed_model);
+    animation_shutdown(&raw);
+    animation_shutdown(&compressed);
+    return 0;
+}
+
+// Keys of (t^3, t^2, t) with their derivatives as tangents, the spline reproduces the curve exactly
+static i32 cubic_spline_test(void)
+{
+    Walrus_Animation animation;
+    memset(&animation, 0, sizeof(Walrus_Animation));
+    stream_init(&animation.streams[WR_ANIMATION_PATH_TRANSLATION], WR_ANIMATION_INTERPOLATION_CUBIC_SPLINE, 3, 3, 9);
+    Walrus_AnimationStream *stream = &animation.streams[WR_ANIMATION_PATH_TRANSLATION];
+    for (u32 i = 0; i < NUM_NODES; ++i) {
+        for (u32 k = 0; k < 3; ++k) {
+            f32 const t   = k;
+            f32      *key = &stream->values[(i * 3 + k) * 9];
+
+            stream->timestamps[i * 3 + k] = t;
+            glm_vec3_copy((vec3){3 * t * t, 2 * t, 1}, key);
+            glm_vec3_copy((vec3){t * t * t, t * t, t}, key + 3);
+            glm_vec3_copy((vec3){3 * t * t, 2 * t, 1}, key + 6);
+        }
+    }
+    animation.num_tracks = NUM_NODES;
+    animation.duration   = 2;
+
+    // Cubic spline tracks are left as they are
+    walrus_animation_compress(&animation, TOLERANCE);
+
+    Walrus_Model model;
+    model_init(&model, &animation);
+
+    Walrus_Animator animator;
+    walrus_animator_init(&animator);
+    walrus_animator_bind(&animator, &model);
+    walrus_animator_play(&animator, 0);
+    animator.layers[0].clips[0].repeat = false;
+
+    f32 t = 0;
+    for (u32 frame = 0; frame < 100; ++frame) {
+        walrus_animator_tick(&animator, &model, 0.025f);
+        t                 = fminf(t + 0.025f, 2);
+        f32 const curve[] = {t * t * t, t * t, t};
+        for (u32 i = 0; i < NUM_NODES; ++i) {
+            EXPECT(max_error(animator.locals[i].trans, curve, 3) < 1e-4f);
+        }
+    }
+
+    walrus_animator_shutdown(&animator);
+    model_shutdown(&model);
+    animation_shutdown(&animation);
+    return 0;
+}
+
+// Every baked frame is the skin palette the animator produces at that time, and frames in between stay close to it
+static i32 baking_test(void)
+{
+    Walrus_Animation animations[2];
+    mocap_init(&animations[0]);
+    mocap_init(&animations[1]);
+    walrus_animation_compress(&animations[1], TOLERANCE);
+
+    Walrus_Model model;
+    model_init(&model, animations);
+    model.num_animations = 2;
+
+    Walrus_SkinJoint joints[NUM_NODES];
+    Walrus_ModelSkin skin = {.joints = joints, .skeleton = &model.nodes[0], .num_joints = NUM_NODES};
+    for (u32 i = 0; i < NUM_NODES; ++i) {
+        joints[i].node = &model.nodes[i];
+        glm_translate_make(joints[i].inverse_bind_matrix, (vec3){0, -0.1f * i, 0});
+        glm_vec3_fill(joints[i].min, -0.1f);
+        glm_vec3_fill(joints[i].max, 0.1f);
+    }
+    model.skins     = &skin;
+    model.num_skins = 1;
+
+    Walrus_BakedAnimation baked;
+    walrus_animation_bake(&baked, &model, BAKE_RATE);
+    EXPECT(baked.num_clips == 2 && baked.num_joints == NUM_NODES);
+    EXPECT(baked.clips[1].first_frame == baked.clips[0].num_frames);
+    EXPECT(baked.num_frames == baked.clips[0].num_frames * 2);
+
+    Walrus_Animator animator;
+    walrus_animator_init(&animator);
+    walrus_animator_bind(&animator, &model);
+    for (u32 clip = 0; clip < 2; ++clip) {
+        walrus_animator_play(&animator, clip);
+        animator.layers[0].clips[0].repeat = false;
+
+        f32 const duration = baked.clips[clip].duration;
+        for (u32 sample = 0; sample < 1000; ++sample) {
+            // Half of the samples land on baked frames, the others anywhere in the clip where blending two frames
+            // cuts the corner of the rotation between them
+            u32 const  last  = baked.clips[clip].num_frames - 1;
+            bool const exact = sample % 2 == 0;
+            f32 const  time =
+                exact ? duration * (sample / 2 % last) / last : fminf(sample * 0.173f / BAKE_RATE, duration);
+
+            animator.layers[0].clips[0].timestamp = time;
+            walrus_animator_tick(&animator, &model, 0);
+
+            f32 const row = walrus_baked_animation_frame(&baked, clip, time);
+            for (u32 j = 0; j < NUM_NODES; ++j) {
+                mat4 world, expected, matrix;
+                walrus_animator_transform(&animator, &model, joints[j].node, world);
+                glm_mat4_mul(world, joints[j].inverse_bind_matrix, expected);
+                walrus_baked_animation_joint(&baked, row, 0, j, matrix);
+                for (u32 c = 0; c < 4; ++c) {
+                    EXPECT(max_error(expected[c], matrix[c], 4) < (exact ? 1e-4f : 2.5e-2f));
+                }
+
+                // The clip bounds cover the joint wherever it goes
+                vec3 center;
+                glm_mat4_mulv3(world, (vec3){0, 0, 0}, 1, center);
+                for (u32 c = 0; c < 3; ++c) {
+                    EXPECT(baked.mins[clip][c] <= center[c] && center[c] <= baked.maxs[clip][c]);
+                }
+            }
+        }
+    }
+
+    // Clips loop, and their last frame is their end
+    EXPECT(walrus_baked_animation_frame(&baked, 1, 0) == baked.clips[1].first_frame);
+    EXPECT(fabsf(walrus_baked_animation_frame(&baked, 0, baked.clips[0].duration * 3 + 0.5f) -
+                 walrus_baked_animation_frame(&baked, 0, 0.5f)) < 1e-2f);
+
+    walrus_animator_shutdown(&animator);
+    walrus_baked_animation_shutdown(&baked);
+    model_shutdown(&model);
+    animation_shutdown(&animations[0]);
+    animation_shutdown(&animations[1]);
+    return 0;
+}
+
+// A straight line sampled for a long time reduces to evenly spaced keys, in time linear in the number of keys
+static i32 long_track_test(void)
+{
+    Walrus_Animation animation;
+    memset(&animation, 0, sizeof(Walrus_Animation));
+    stream_init(&animation.streams[WR_ANIMATION_PATH_TRANSLATION], WR_ANIMATION_INTERPOLATION_LINEAR, 3, LONG_KEYS, 3);
+    Walrus_AnimationStream *stream = &animation.streams[WR_ANIMATION_PATH_TRANSLATION];
+    for (u32 i = 0; i < NUM_NODES; ++i) {
+        for (u32 k = 0; k < LONG_KEYS; ++k) {
+            f32 const t                           = (f32)k / FPS;
+            stream->timestamps[i * LONG_KEYS + k] = t;
+            glm_vec3_copy((vec3){t * 0.01f, 1, i}, &stream->values[(i * LONG_KEYS + k) * 3]);
+        }
+    }
+    animation.num_tracks = NUM_NODES;
+    animation.duration   = (f32)(LONG_KEYS - 1) / FPS;
+
+    walrus_animation_compress(&animation, TOLERANCE);
+    for (u32 i = 0; i < NUM_NODES; ++i) {
+        Walrus_AnimationTrack const *track = &stream->tracks[i];
+        EXPECT(track->quantized != NULL);
+        EXPECT(track->num_keys > 2 && track->num_keys * 16 < LONG_KEYS);
+        EXPECT(track->timestamps[0] == 0 && track->timestamps[track->num_keys - 1] == animation.duration);
+        for (u32 k = 1; k < track->num_keys; ++k) {
+            EXPECT(track->timestamps[k] > track->timestamps[k - 1]);
+        }
+    }
+
+    animation_shutdown(&animation);
+    return 0;
+}
+
+// Holds every node at `trans` and a uniform `scale` for a second
+static void pose_init(Walrus_Animation *animation, f32 const *trans, f32 scale)
+{
+    memset(animation, 0, sizeof(Walrus_Animation));
+    stream_init(&animation->streams[WR_ANIMATION_PATH_TRANSLATION], WR_ANIMATION_INTERPOLATION_LINEAR, 3, 2, 3);
+    stream_init(&animation->streams[WR_ANIMATION_PATH_SCALE], WR_ANIMATION_INTERPOLATION_LINEAR, 3, 2, 3);
+
+    Walrus_AnimationStream *translation = &animation->streams[WR_ANIMATION_PATH_TRANSLATION];
+    Walrus_AnimationStream *scales      = &animation->streams[WR_ANIMATION_PATH_SCALE];
+    for (u32 key = 0; key < NUM_NODES * 2; ++key) {
+        translation->timestamps[key] = key % 2;
+        scales->timestamps[key]      = key % 2;
+        glm_vec3_copy((f32 *)trans, &translation->values[key * 3]);
+        glm_vec3_fill(&scales->values[key * 3], scale);
+    }
+    animation->num_tracks = NUM_NODES * 2;
+    animation->duration   = 1;
+}
+
+static bool node_at(Walrus_Animator const *animator, u32 node, f32 x, f32 y, f32 z, f32 scale)
+{
+    f32 const trans[]  = {x, y, z};
+    f32 const scales[] = {scale, scale, scale};
+    return max_error(animator->locals[node].trans, trans, 3) < 1e-5f &&
+           max_error(animator->locals[node].scale, scales, 3) < 1e-5f;
+}
+
+static bool in_subtree(Walrus_Model const *model, u32 node, u32 root)
+{
+    for (u32 ancestor = node; ancestor != WR_MODEL_INVALID_NODE; ancestor = model->parents[ancestor]) {
+        if (ancestor == root) {
+            return true;
+        }
+    }
+    return false;
+}
+
+// Clips on a layer average by weight, cross-fades move the weight over, and upper layers override or add on top
+static i32 blending_test(void)
+{
+    Walrus_Animation animations[3];
+    pose_init(&animations[0], (vec3){1, 0, 0}, 1);
+    pose_init(&animations[1], (vec3){0, 2, 0}, 1);
+    pose_init(&animations[2], (vec3){0, 0, 4}, 3);
+
+    Walrus_Model model;
+    model_init(&model, animations);
+    model.num_animations = 3;
+
+    Walrus_Animator animator;
+    walrus_animator_init(&animator);
+    walrus_animator_bind(&animator, &model);
+
+    // Weighted clips
+    walrus_animator_blend(&animator, 0, 0, 1);
+    walrus_animator_blend(&animator, 0, 1, 3);
+    walrus_animator_tick(&animator, &model, 0);
+    for (u32 i = 0; i < NUM_NODES; ++i) {
+        EXPECT(node_at(&animator, i, 0.25f, 1.5f, 0, 1));
+    }
+
+    // A cross-fade moves the weight from the playing clip to the new one, and drops the old clip once faded out
+    walrus_animator_play(&animator, 0);
+    walrus_animator_crossfade(&animator, 0, 1, 1);
+    walrus_animator_tick(&animator, &model, 0.25f);
+    EXPECT(animator.layers[0].num_clips == 2);
+    for (u32 i = 0; i < NUM_NODES; ++i) {
+        EXPECT(node_at(&animator, i, 0.75f, 0.5f, 0, 1));
+    }
+    walrus_animator_tick(&animator, &model, 1);
+    EXPECT(animator.layers[0].num_clips == 1 && animator.layers[0].clips[0].index == 1);
+    for (u32 i = 0; i < NUM_NODES; ++i) {
+        EXPECT(node_at(&animator, i, 0, 2, 0, 1));
+    }
+
+    // An additive layer adds its difference from the bind pose by its weight, scales multiply
+    walrus_animator_play(&animator, 0);
+    walrus_animator_set_layer(&animator, 1, WR_ANIMATOR_BLEND_ADDITIVE, 0.5f);
+    walrus_animator_blend(&animator, 1, 2, 1);
+    walrus_animator_tick(&animator, &model, 0);
+    for (u32 i = 0; i < NUM_NODES; ++i) {
+        EXPECT(node_at(&animator, i, 1, 0, 2, 2));
+    }
+
+    // A masked override layer only affects the subtree it is masked to
+    walrus_animator_set_layer(&animator, 1, WR_ANIMATOR_BLEND_OVERRIDE, 1);
+    walrus_animator_crossfade(&animator, 1, 1, 0);
+    walrus_animator_mask_subtree(&animator, &model, 1, &model.nodes[1], 1);
+    walrus_animator_tick(&animator, &model, 0);
+    EXPECT(animator.layers[1].num_clips == 1);
+    for (u32 i = 0; i < NUM_NODES; ++i) {
+        EXPECT(in_subtree(&model, i, 1) ? node_at(&animator, i, 0, 2, 0, 1) : node_at(&animator, i, 1, 0, 0, 1));
+    }
+
+    // Masks scale the layer weight per node
+    f32 mask[NUM_NODES];
+    for (u32 i = 0; i < NUM_NODES; ++i) {
+        mask[i] = i % 2 ? 0.5f : 0;
+    }
+    walrus_animator_set_mask(&animator, 1, mask);
+    walrus_animator_tick(&animator, &model, 0);
+    for (u32 i = 0; i < NUM_NODES; ++i) {
+        EXPECT(i % 2 ? node_at(&animator, i, 0.5f, 1, 0, 1) : node_at(&animator, i, 1, 0, 0, 1));
+    }
+
+    walrus_animator_shutdown(&animator);
+    model_shutdown(&model);
+    for (u32 i = 0; i < 3; ++i) {
+        animation_shutdown(&animations[i]);
+    }
+    return 0;
+}
+
+// Interpolates a raw track one key at a time, as the batched sampling should
+static void track_reference(Walrus_AnimationTrack const *track, f32 time, f32 *value)
+{
+    u32 const n   = track->num_components;
+    u32       key = 0;
+    while (key + 1 < track->num_keys && track->timestamps[key + 1] <= time) {
+        ++key;
+    }
+    f32 factor = 0;
+    if (key + 1 < track->num_keys && time > track->timestamps[key]) {
+        factor = (time - track->timestamps[key]) / (track->timestamps[key + 1] - track->timestamps[key]);
+    }
+
+    f32 const *from = &track->values[key * n];
+    f32 const *to   = key + 1 < track->num_keys ? &track->values[(key + 1) * n] : from;
+    f32        dot  = 0;
+    for (u32 c = 0; c < n; ++c) {
+        dot += from[c] * to[c];
+    }
+    f32 const sign = n == 4 && dot < 0 ? -1.0f : 1.0f;
+    f32       len  = 0;
+    for (u32 c = 0; c < n; ++c) {
+        value[c] = from[c] + (to[c] * sign - from[c]) * factor;
+        len += value[c] * value[c];
+    }
+    if (n == 4) {
+        for (u32 c = 0; c < n; ++c) {
+            value[c] /= sqrtf(len);
+        }
+    }
+}
+
+// Tracks sampled in batches match the scalar interpolation at any time, whether playback moves forward, jumps back
+// or only part of a batch is used
+static i32 sampling_test(void)
+{
+    Walrus_Animation animation;
+    mocap_init(&animation);
+    // Fewer tracks than a batch leaves lanes unused, the nodes without a track keep the bind pose
+    u32 const num_rotations                                  = NUM_NODES - 3;
+    animation.streams[WR_ANIMATION_PATH_ROTATION].num_tracks = num_rotations;
+
+    Walrus_Model model;
+    model_init(&model, &animation);
+
+    Walrus_Animator animator;
+    walrus_animator_init(&animator);
+    walrus_animator_bind(&animator, &model);
+    walrus_animator_play(&animator, 0);
+
+    for (u32 sample = 0; sample < 2000; ++sample) {
+        f32 const time =
+            sample < 1000 ? animation.duration * sample / 1000 : fmodf(sample * 0.731f, animation.duration);
+
+        animator.layers[0].clips[0].timestamp = time;
+        walrus_animator_tick(&animator, &model, 0);
+
+        for (u32 i = 0; i < NUM_NODES; ++i) {
+            f32 expected[4];
+            track_reference(&animation.streams[WR_ANIMATION_PATH_TRANSLATION].tracks[i], time, expected);
+            EXPECT(max_error(animator.locals[i].trans, expected, 3) < 1e-5f);
+            track_reference(&animation.streams[WR_ANIMATION_PATH_SCALE].tracks[i], time, expected);
+            EXPECT(max_error(animator.locals[i].scale, expected, 3) < 1e-5f);
+
+            if (i < num_rotations) {
+                track_reference(&animation.streams[WR_ANIMATION_PATH_ROTATION].tracks[i], time, expected);
+            }
+            else {
+                glm_vec4_copy((vec4){0, 0, 0, 1}, expected);
+            }
+            EXPECT(max_error(animator.locals[i].rot, expected, 4) < 1e-5f);
+        }
+    }
+
+    walrus_animator_shutdown(&animator);
+    model_shutdown(&model);
+    animation_shutdown(&animation);
+    return 0;
+}
+
+typedef struct {
+    Walrus_Animator    *animators;
+    Walrus_Model const *model;
+    Walrus_SkinJoint   *joints;
+    mat4               *palettes;
+    f32                 dt;
+} AnimatorUpdate;
+
+// Ticks the animators and builds their skin palettes, as the animator and render systems do for a range of entities
+static void animator_update_range(u32 begin, u32 end, void *userdata)
+{
+    AnimatorUpdate const *update = userdata;
+    for (u32 i = begin; i < end; ++i) {
+        walrus_animator_tick(&update->animators[i], update->model, update->dt);
+        for (u32 j = 0; j < NUM_NODES; ++j) {
+            mat4 world;
+            walrus_animator_transform(&update->animators[i], update->model, update->joints[j].node, world);
+            glm_mat4_mul(world, update->joints[j].inverse_bind_matrix, update->palettes[i * NUM_NODES + j]);
+        }
+    }
+}
+
+// Animators ticked and skinned across the job system end up exactly where ticking them one after the other does
+static i32 parallel_update_test(void)
+{
+    Walrus_Animation animations[2];
+    mocap_init(&animations[0]);
+    mocap_init(&animations[1]);
+    walrus_animation_compress(&animations[1], TOLERANCE);
+
+    Walrus_Model model;
+    model_init(&model, animations);
+    model.num_animations = 2;
+
+    Walrus_SkinJoint joints[NUM_NODES];
+    for (u32 j = 0; j < NUM_NODES; ++j) {
+        joints[j].node = &model.nodes[j];
+        glm_translate_make(joints[j].inverse_bind_matrix, (vec3){0, -0.1f * j, 0});
+    }
+
+    AnimatorUpdate updates[2];
+    for (u32 u = 0; u < 2; ++u) {
+        updates[u].animators = walrus_new(Walrus_Animator, NUM_ANIMATORS);
+        updates[u].model     = &model;
+        updates[u].joints    = joints;
+        updates[u].palettes  = walrus_new(mat4, NUM_ANIMATORS * NUM_NODES);
+        updates[u].dt        = 1.0f / FPS;
+        for (u32 i = 0; i < NUM_ANIMATORS; ++i) {
+            Walrus_Animator *animator = &updates[u].animators[i];
+            walrus_animator_init(animator);
+            walrus_animator_bind(animator, &model);
+            walrus_animator_play(animator, i % 2);
+            animator->layers[0].clips[0].timestamp = i * 0.13f;
+            if (i % 3 == 0) {
+                walrus_animator_crossfade(animator, 0, (i + 1) % 2, 0.5f);
+            }
+        }
+    }
+
+    for (u32 frame = 0; frame < 120; ++frame) {
+        animator_update_range(0, NUM_ANIMATORS, &updates[0]);
+        walrus_parallel_for(0, NUM_ANIMATORS, 4, animator_update_range, &updates[1]);
+        for (u32 i = 0; i < NUM_ANIMATORS; ++i) {
+            EXPECT(memcmp(updates[0].animators[i].worlds, updates[1].animators[i].worlds,
+                          NUM_NODES * sizeof(Walrus_Transform)) == 0);
+        }
+        EXPECT(memcmp(updates[0].palettes, updates[1].palettes, NUM_ANIMATORS * NUM_NODES * sizeof(mat4)) == 0);
+    }
+
+    for (u32 u = 0; u < 2; ++u) {
+        for (u32 i = 0; i < NUM_ANIMATORS; ++i) {
+            walrus_animator_shutdown(&updates[u].animators[i]);
+        }
+        walrus_free(updates[u].animators);
+        walrus_free(updates[u].palettes);
+    }
+    model_shutdown(&model);
+    animation_shutdown(&animations[0]);
+    animation_shutdown(&animations[1]);
+    return 0;
+}
+
+i32 main(void)
+{
+    walrus_job_init(3);
+    i32 const r = parallel_update_test();
+    walrus_job_shutdown();
+    if (r != 0) {
+        return 1;
+    }
+    if (sampling_test() != 0) {
+        return 1;
+    }
+    if (blending_test() != 0) {
+        return 1;
+    }
+    if (long_track_test() != 0) {
+        return 1;
+    }
+    if (cubic_spline_test() != 0) {
+        return 1;
+    }
+    if (baking_test() != 0) {
+        return 1;
+    }
+    return compression_test();
+}
@@ -0,0 +1,250 @@
+#include <engine/bvh.h>
+#include <engine/camera.h>
+#include <core/job.h>
+#include <core/memory.h>
+
+#include <float.h>
+#include <stdio.h>
+
+#define NUM_BOXES 10000
+#define NUM_RAYS  1000
+
+#define EXPECT(e)                                                          \
+    if (!(e)) {                                                            \
+        printf("%s:%d: expectation failed: %s\n", __FILE__, __LINE__, #e); \
+        return 1;                                                          \
+    }
+
+static u64 s_rng = 0x9e3779b97f4a7c15ull;
+
+static f32 randf(f32 min, f32 max)
+{
+    s_rng ^= s_rng << 13;
+    s_rng ^= s_rng >> 7;
+    s_rng ^= s_rng << 17;
+    return min + (max - min) * (f32)(s_rng >> 40) / (f32)(1 << 24);
+}
+
+typedef struct {
+    vec3 min;
+    vec3 max;
+    u32  proxy;
+    bool alive;
+    bool visible;
+} TestBox;
+
+static TestBox s_boxes[NUM_BOXES];
+
+static void random_box(TestBox *box)
+{
+    for (u32 j = 0; j < 3; ++j) {
+        f32 const c = randf(-500, 500);
+        f32 const e = randf(0.5, 5);
+        box->min[j] = c - e;
+        box->max[j] = c + e;
+    }
+}
+
+typedef struct {
+    Walrus_Bvh *bvh;
+    u32         num_visible;
+    u32         num_nested;
+} QueryState;
+
+// Casts a ray at the visible box from inside the query, the query and the raycast must not share traversal state
+static void on_visible(u32 proxy, u64 userdata, void *ctx)
+{
+    QueryState *state = ctx;
+    if (s_boxes[userdata].proxy == proxy) {
+        s_boxes[userdata].visible = true;
+        ++state->num_visible;
+    }
+
+    vec3 center;
+    glm_vec3_center(s_boxes[userdata].min, s_boxes[userdata].max, center);
+    vec3 const    origin = {center[0], center[1], center[2] + 20};
+    Walrus_BvhHit hit;
+    if (walrus_bvh_raycast(state->bvh, origin, (vec3){0, 0, -1}, FLT_MAX, &hit)) {
+        ++state->num_nested;
+    }
+}
+
+static i32 check_frustum(Walrus_Bvh *bvh, Walrus_Frustum const *frustum)
+{
+    for (u32 i = 0; i < NUM_BOXES; ++i) {
+        s_boxes[i].visible = false;
+    }
+    QueryState state = {bvh, 0, 0};
+    walrus_bvh_query_frustum(bvh, frustum, on_visible, &state);
+
+    u32 expected = 0;
+    for (u32 i = 0; i < NUM_BOXES; ++i) {
+        Walrus_BoundingBox box;
+        walrus_bounding_box_from_min_max(&box, s_boxes[i].min, s_boxes[i].max);
+        bool const visible = s_boxes[i].alive && walrus_bounding_box_intersects_frustum(&box, frustum);
+        EXPECT(visible == s_boxes[i].visible);
+        expected += visible;
+    }
+    EXPECT(state.num_visible == expected);
+    EXPECT(state.num_nested == expected);
+    return 0;
+}
+
+static f32 ray_box(TestBox const *box, vec3 const origin, vec3 const dir)
+{
+    f32 t_min = 0;
+    f32 t_max = FLT_MAX;
+    for (u32 i = 0; i < 3; ++i) {
+        f32 t0 = (box->min[i] - origin[i]) * (1.0f / dir[i]);
+        f32 t1 = (box->max[i] - origin[i]) * (1.0f / dir[i]);
+        if (t0 > t1) {
+            f32 const tmp = t0;
+            t0            = t1;
+            t1            = tmp;
+        }
+        t_min = t0 > t_min ? t0 : t_min;
+        t_max = t1 < t_max ? t1 : t_max;
+    }
+    return t_min <= t_max ? t_min : FLT_MAX;
+}
+
+typedef struct {
+    vec3          origin;
+    vec3          dir;
+    Walrus_BvhHit hit;
+    bool          found;
+} TestRay;
+
+typedef struct {
+    Walrus_Bvh *bvh;
+    TestRay    *rays;
+} RayJob;
+
+static void cast_rays(u32 begin, u32 end, void *userdata)
+{
+    RayJob const *job = userdata;
+    for (u32 r = begin; r < end; ++r) {
+        TestRay *ray = &job->rays[r];
+        ray->found   = walrus_bvh_raycast(job->bvh, ray->origin, ray->dir, FLT_MAX, &ray->hit);
+    }
+}
+
+// Rays are cast from all the workers at once
+static i32 check_raycast(Walrus_Bvh *bvh)
+{
+    static TestRay rays[NUM_RAYS];
+    for (u32 r = 0; r < NUM_RAYS; ++r) {
+        for (u32 j = 0; j < 3; ++j) {
+            rays[r].origin[j] = randf(-600, 600);
+            rays[r].dir[j]    = randf(-1, 1);
+        }
+    }
+    RayJob job = {bvh, rays};
+    walrus_parallel_for(0, NUM_RAYS, 16, cast_rays, &job);
+
+    for (u32 r = 0; r < NUM_RAYS; ++r) {
+        f32 const *origin = rays[r].origin;
+        f32 const *dir    = rays[r].dir;
+
+        f32 closest = FLT_MAX;
+        for (u32 i = 0; i < NUM_BOXES; ++i) {
+            if (s_boxes[i].alive) {
+                f32 const t = ray_box(&s_boxes[i], origin, dir);
+                closest     = t < closest ? t : closest;
+            }
+        }
+
+        Walrus_BvhHit const hit   = rays[r].hit;
+        bool const          found = rays[r].found;
+        EXPECT(found == (closest != FLT_MAX));
+        if (found) {
+            EXPECT(s_boxes[hit.userdata].alive && s_boxes[hit.userdata].proxy == hit.proxy);
+            EXPECT(hit.t == ray_box(&s_boxes[hit.userdata], origin, dir));
+            EXPECT(hit.t == closest);
+        }
+    }
+    return 0;
+}
+
+static i32 check(Walrus_Bvh *bvh, Walrus_Frustum const *frustum)
+{
+    if (check_frustum(bvh, frustum) != 0) {
+        return 1;
+    }
+    return check_raycast(bvh);
+}
+
+static i32 bvh_test(Walrus_Bvh *bvh, Walrus_Frustum const *frustum)
+{
+    // Incremental insertion
+    for (u32 i = 0; i < NUM_BOXES; ++i) {
+        random_box(&s_boxes[i]);
+        s_boxes[i].proxy = walrus_bvh_insert(bvh, s_boxes[i].min, s_boxes[i].max, i);
+        s_boxes[i].alive = true;
+    }
+    EXPECT(walrus_bvh_count(bvh) == NUM_BOXES);
+    if (check(bvh, frustum) != 0) {
+        return 1;
+    }
+
+    // Surface area heuristic build over the same proxies
+    walrus_bvh_build(bvh);
+    if (check(bvh, frustum) != 0) {
+        return 1;
+    }
+
+    // Moved boxes are only visible to queries after the refit
+    for (u32 i = 0; i < NUM_BOXES; i += 3) {
+        random_box(&s_boxes[i]);
+        walrus_bvh_update(bvh, s_boxes[i].proxy, s_boxes[i].min, s_boxes[i].max);
+    }
+    walrus_bvh_refit(bvh);
+    if (check(bvh, frustum) != 0) {
+        return 1;
+    }
+
+    // Removed proxies are reused by new boxes
+    for (u32 i = 0; i < NUM_BOXES; i += 2) {
+        walrus_bvh_remove(bvh, s_boxes[i].proxy);
+        s_boxes[i].alive = false;
+    }
+    EXPECT(walrus_bvh_count(bvh) == NUM_BOXES / 2);
+    if (check(bvh, frustum) != 0) {
+        return 1;
+    }
+    for (u32 i = 0; i < NUM_BOXES; i += 4) {
+        random_box(&s_boxes[i]);
+        s_boxes[i].proxy = walrus_bvh_insert(bvh, s_boxes[i].min, s_boxes[i].max, i);
+        s_boxes[i].alive = true;
+        EXPECT(walrus_bvh_userdata(bvh, s_boxes[i].proxy) == i);
+    }
+    if (check(bvh, frustum) != 0) {
+        return 1;
+    }
+
+    walrus_bvh_build(bvh);
+    return check(bvh, frustum);
+}
+
+i32 main(void)
+{
+    // A camera at the origin looking down -z, its local frustum is also the world frustum
+    Walrus_Camera camera;
+    camera.fov    = glm_rad(45);
+    camera.aspect = 16.0 / 9.0;
+    camera.near_z = 0.1;
+    camera.far_z  = 1000;
+
+    Walrus_Frustum frustum;
+    walrus_frustum_from_camera_local(&camera, &frustum);
+
+    walrus_job_init(3);
+    Walrus_Bvh *bvh = walrus_bvh_create();
+
+    i32 r = bvh_test(bvh, &frustum);
+
+    walrus_bvh_destroy(bvh);
+    walrus_job_shutdown();
+
+    return r;
+}
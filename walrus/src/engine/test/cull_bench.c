@@ -0,0 +1,131 @@
+#include <engine/camera.h>
+#include <engine/geometry.h>
+#include <core/job.h>
+#include <core/sys.h>
+#include <core/memory.h>
+
+#include <stdio.h>
+
+#define NUM_ITERATIONS 100
+
+static u64 s_rng = 0x9e3779b97f4a7c15ull;
+
+static f32 randf(f32 min, f32 max)
+{
+    s_rng ^= s_rng << 13;
+    s_rng ^= s_rng >> 7;
+    s_rng ^= s_rng << 17;
+    return min + (max - min) * (f32)(s_rng >> 40) / (f32)(1 << 24);
+}
+
+typedef struct {
+    Walrus_BoundingBox   *boxes;
+    Walrus_BoundingBoxSoA soa;
+    u32                  *reference;
+    u32                  *visibility;
+} CullBuffer;
+
+static void fill_boxes(CullBuffer *buffer, u32 size)
+{
+    walrus_bounding_box_soa_resize(&buffer->soa, size);
+    for (u32 i = 0; i < size; ++i) {
+        Walrus_BoundingBox *box = &buffer->boxes[i];
+        for (u32 j = 0; j < 3; ++j) {
+            box->center[j]  = randf(-500, 500);
+            box->extends[j] = randf(0.5, 5);
+        }
+        walrus_bounding_box_soa_set(&buffer->soa, i, box);
+    }
+}
+
+static bool verify(CullBuffer const *buffer, u32 size)
+{
+    for (u32 i = 0; i < (size + 31) / 32; ++i) {
+        if (buffer->visibility[i] != buffer->reference[i]) {
+            return false;
+        }
+    }
+    return true;
+}
+
+static bool bench(CullBuffer *buffer, Walrus_Frustum const *frustum, u32 size)
+{
+    fill_boxes(buffer, size);
+
+    u64 scalar   = 0;
+    u64 batch    = 0;
+    u64 parallel = 0;
+    u32 visible  = 0;
+    for (u32 i = 0; i < NUM_ITERATIONS; ++i) {
+        u64 start = walrus_sysclock(WR_SYS_CLOCK_UNIT_MICROSEC);
+        for (u32 j = 0; j < size; j += 32) {
+            u32 bits = 0;
+            for (u32 k = j; k < size && k < j + 32; ++k) {
+                bits |= (u32)walrus_bounding_box_intersects_frustum(&buffer->boxes[k], frustum) << (k - j);
+            }
+            buffer->reference[j >> 5] = bits;
+        }
+        scalar += walrus_sysclock(WR_SYS_CLOCK_UNIT_MICROSEC) - start;
+
+        start = walrus_sysclock(WR_SYS_CLOCK_UNIT_MICROSEC);
+        walrus_frustum_cull_boxes(frustum, &buffer->soa, 0, size, buffer->visibility);
+        batch += walrus_sysclock(WR_SYS_CLOCK_UNIT_MICROSEC) - start;
+        if (!verify(buffer, size)) {
+            printf("walrus_frustum_cull_boxes failed on %u boxes\n", size);
+            return false;
+        }
+
+        start = walrus_sysclock(WR_SYS_CLOCK_UNIT_MICROSEC);
+        walrus_frustum_cull_boxes_parallel(frustum, &buffer->soa, buffer->visibility);
+        parallel += walrus_sysclock(WR_SYS_CLOCK_UNIT_MICROSEC) - start;
+        if (!verify(buffer, size)) {
+            printf("walrus_frustum_cull_boxes_parallel failed on %u boxes\n", size);
+            return false;
+        }
+    }
+    for (u32 i = 0; i < size; ++i) {
+        visible += (buffer->reference[i >> 5] >> (i & 31)) & 1;
+    }
+
+    printf("%6u boxes (%u visible): scalar %8.2fus batch %8.2fus parallel %8.2fus\n", size, visible,
+           (f64)scalar / NUM_ITERATIONS, (f64)batch / NUM_ITERATIONS, (f64)parallel / NUM_ITERATIONS);
+    return true;
+}
+
+i32 main(void)
+{
+    u32 const sizes[]  = {10000, 100000};
+    u32 const max_size = 100000;
+
+    // A camera at the origin looking down -z, its local frustum is also the world frustum
+    Walrus_Camera camera;
+    camera.fov    = glm_rad(45);
+    camera.aspect = 16.0 / 9.0;
+    camera.near_z = 0.1;
+    camera.far_z  = 1000;
+
+    Walrus_Frustum frustum;
+    walrus_frustum_from_camera_local(&camera, &frustum);
+
+    CullBuffer buffer;
+    buffer.boxes      = walrus_new(Walrus_BoundingBox, max_size);
+    buffer.reference  = walrus_new(u32, (max_size + 31) / 32);
+    buffer.visibility = walrus_new(u32, (max_size + 31) / 32);
+    walrus_bounding_box_soa_init(&buffer.soa);
+
+    walrus_job_init(7);
+
+    bool success = true;
+    for (u32 i = 0; i < 2 && success; ++i) {
+        success &= bench(&buffer, &frustum, sizes[i]);
+    }
+
+    walrus_job_shutdown();
+
+    walrus_free(buffer.boxes);
+    walrus_free(buffer.reference);
+    walrus_free(buffer.visibility);
+    walrus_bounding_box_soa_free(&buffer.soa);
+
+    return success ? 0 : 1;
+}
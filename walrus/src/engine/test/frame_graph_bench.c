@@ -0,0 +1,137 @@
+#include <engine/frame_graph.h>
+#include <core/string.h>
+#include <core/macro.h>
+#include <core/sys.h>
+
+#include <stdio.h>
+
+#define NUM_ITERATIONS 100000
+#define NUM_PIPELINES  3
+#define NUM_NODES      4
+
+typedef enum {
+    SLOT_RENDERER,
+    SLOT_CAMERA,
+    SLOT_VIEW,
+
+    SLOT_COUNT
+} Slot;
+
+static char const *s_names[SLOT_COUNT] = {"Renderer", "Camera", "ViewSlot"};
+
+static u32 s_slots[SLOT_COUNT];
+
+// Blackboard the frame graph used to keep, names are duplicated on every write and hashed on every read
+static Walrus_HashTable *s_named;
+
+static u64 s_renderer;
+static u64 s_camera;
+static u64 s_checksum;
+
+// Passes read what the real ones do, the renderer, the camera and the view slot they bump
+static void slot_pass(Walrus_FrameGraph *graph, Walrus_FrameNode const *node)
+{
+    u64 const renderer = walrus_fg_read(graph, s_slots[SLOT_RENDERER]);
+    u64 const camera   = walrus_fg_read(graph, s_slots[SLOT_CAMERA]);
+    u16      *view_id  = walrus_fg_read_ptr(graph, s_slots[SLOT_VIEW]);
+    s_checksum += renderer + camera + node->index + (*view_id)++;
+}
+
+static void named_pass(Walrus_FrameGraph *graph, Walrus_FrameNode const *node)
+{
+    walrus_unused(graph);
+    u64 const renderer = walrus_ptr_to_val(walrus_hash_table_lookup(s_named, s_names[SLOT_RENDERER]));
+    u64 const camera   = walrus_ptr_to_val(walrus_hash_table_lookup(s_named, s_names[SLOT_CAMERA]));
+    u16      *view_id  = walrus_hash_table_lookup(s_named, s_names[SLOT_VIEW]);
+    s_checksum += renderer + camera + node->index + (*view_id)++;
+}
+
+static Walrus_FramePipeline *build(Walrus_FrameGraph *graph, Walrus_FrameNodeCallback func)
+{
+    walrus_fg_init(graph);
+    for (u32 i = 0; i < SLOT_COUNT; ++i) {
+        s_slots[i] = walrus_fg_create_data(graph, s_names[i]);
+    }
+
+    Walrus_FramePipeline *prev = NULL;
+    for (u32 i = 0; i < NUM_PIPELINES; ++i) {
+        char name[16];
+        snprintf(name, sizeof(name), "Pipeline%u", i);
+        Walrus_FramePipeline *pipeline = walrus_fg_add_pipeline(graph, name);
+        for (u32 j = 0; j < NUM_NODES; ++j) {
+            walrus_fg_add_node(pipeline, func, name);
+        }
+        if (prev) {
+            walrus_fg_connect_pipeline(prev, pipeline);
+        }
+        prev = pipeline;
+    }
+    walrus_fg_compile(graph);
+
+    return prev;
+}
+
+static u64 run_slots(void)
+{
+    Walrus_FrameGraph     graph;
+    Walrus_FramePipeline *output = build(&graph, slot_pass);
+
+    s_checksum = 0;
+    u64 start  = walrus_sysclock(WR_SYS_CLOCK_UNIT_MICROSEC);
+    for (u32 i = 0; i < NUM_ITERATIONS; ++i) {
+        u16 view_slot = 0;
+        walrus_fg_write(&graph, s_slots[SLOT_RENDERER], s_renderer);
+        walrus_fg_write(&graph, s_slots[SLOT_CAMERA], s_camera);
+        walrus_fg_write_ptr(&graph, s_slots[SLOT_VIEW], &view_slot);
+        walrus_fg_execute_pipeline(&graph, output, 0);
+    }
+    u64 const time = walrus_sysclock(WR_SYS_CLOCK_UNIT_MICROSEC) - start;
+
+    walrus_fg_shutdown(&graph);
+    return time;
+}
+
+static u64 run_named(void)
+{
+    Walrus_FrameGraph graph;
+    build(&graph, named_pass);
+    s_named = walrus_hash_table_create_full(walrus_str_hash, walrus_str_equal, (Walrus_KeyDestroyFunc)walrus_str_free,
+                                            NULL);
+
+    s_checksum = 0;
+    u64 start  = walrus_sysclock(WR_SYS_CLOCK_UNIT_MICROSEC);
+    for (u32 i = 0; i < NUM_ITERATIONS; ++i) {
+        u16 view_slot = 0;
+        walrus_hash_table_insert(s_named, walrus_str_dup(s_names[SLOT_RENDERER]), walrus_val_to_ptr(s_renderer));
+        walrus_hash_table_insert(s_named, walrus_str_dup(s_names[SLOT_CAMERA]), walrus_val_to_ptr(s_camera));
+        walrus_hash_table_insert(s_named, walrus_str_dup(s_names[SLOT_VIEW]), &view_slot);
+        walrus_fg_execute(&graph, "Pipeline2");
+    }
+    u64 const time = walrus_sysclock(WR_SYS_CLOCK_UNIT_MICROSEC) - start;
+
+    walrus_hash_table_destroy(s_named);
+    walrus_fg_shutdown(&graph);
+    return time;
+}
+
+i32 main(void)
+{
+    s_renderer = 0x1000;
+    s_camera   = 0x2000;
+
+    u64 const  named        = run_named();
+    u64 const  named_sum    = s_checksum;
+    u64 const  slots        = run_slots();
+    u64 const  num_nodes    = NUM_PIPELINES * NUM_NODES;
+    f64 const  named_frame  = (f64)named * 1e3 / NUM_ITERATIONS;
+    f64 const  slots_frame  = (f64)slots * 1e3 / NUM_ITERATIONS;
+    bool const same_results = named_sum == s_checksum;
+
+    printf("%llu nodes: named %8.2fns (%6.2fns/node) slots %8.2fns (%6.2fns/node)\n", (unsigned long long)num_nodes,
+           named_frame, named_frame / num_nodes, slots_frame, slots_frame / num_nodes);
+    if (!same_results) {
+        printf("passes read different values through the slots\n");
+    }
+
+    return same_results ? 0 : 1;
+}
@@ -0,0 +1,428 @@
+#include <engine/frame_graph.h>
+#include <rhi/rhi.h>
+#include <core/job.h>
+#include <core/macro.h>
+
+#include <stdio.h>
+#include <string.h>
+
+#define EXPECT(e)                                                          \
+    if (!(e)) {                                                            \
+        printf("%s:%d: expectation failed: %s\n", __FILE__, __LINE__, #e); \
+        return 1;                                                          \
+    }
+
+typedef enum {
+    RES_VISIBILITY,
+    RES_FIRST,
+    RES_SECOND,
+    RES_THIRD,
+    RES_THIRD_TARGET,
+    RES_UNUSED,
+    RES_OUTPUT,
+
+    RES_COUNT
+} Resource;
+
+static u32 s_ids[RES_COUNT];
+
+static char const *s_executed[16];
+static u32         s_num_executed;
+
+static Walrus_TextureHandle     s_textures[RES_COUNT];
+static Walrus_FramebufferHandle s_third_target;
+
+static char const *s_prepared[4];
+static u32         s_num_prepared;
+
+static void prepare(Walrus_FrameGraph *graph, void *userdata)
+{
+    walrus_unused(graph);
+    s_prepared[s_num_prepared++] = userdata;
+}
+
+static void record(Walrus_FrameGraph *graph, Walrus_FrameNode const *node)
+{
+    s_executed[s_num_executed++] = node->name;
+    for (u32 i = 0; i < RES_COUNT; ++i) {
+        Walrus_FrameResource *declared = walrus_array_get(graph->declarations, s_ids[i]);
+        if (declared->type == WR_FG_RESOURCE_TEXTURE && s_textures[i].id == WR_INVALID_HANDLE) {
+            s_textures[i] = walrus_fg_texture(graph, s_ids[i]);
+        }
+    }
+    if (s_third_target.id == WR_INVALID_HANDLE) {
+        s_third_target = walrus_fg_framebuffer(graph, s_ids[RES_THIRD_TARGET]);
+    }
+}
+
+static i32 frame_graph_test(void)
+{
+    Walrus_FrameGraph graph;
+    walrus_fg_init(&graph);
+
+    Walrus_TextureCreateInfo const color = {.ratio = WR_RHI_RATIO_EQUAL, .format = WR_RHI_FORMAT_RGBA8};
+    Walrus_TextureCreateInfo const hdr   = {.ratio = WR_RHI_RATIO_EQUAL, .format = WR_RHI_FORMAT_RGB32F};
+
+    s_ids[RES_VISIBILITY]   = walrus_fg_create_data(&graph, "Visibility");
+    s_ids[RES_FIRST]        = walrus_fg_create_texture(&graph, "First", &color);
+    s_ids[RES_SECOND]       = walrus_fg_create_texture(&graph, "Second", &color);
+    s_ids[RES_THIRD]        = walrus_fg_create_texture(&graph, "Third", &color);
+    s_ids[RES_THIRD_TARGET] = walrus_fg_create_framebuffer(&graph, "ThirdTarget", &s_ids[RES_THIRD], 1);
+    s_ids[RES_UNUSED]       = walrus_fg_create_texture(&graph, "Unused", &hdr);
+    s_ids[RES_OUTPUT]       = walrus_fg_import_framebuffer(&graph, "Output", (Walrus_FramebufferHandle){0}, NULL, 0);
+
+    EXPECT(walrus_fg_create_texture(&graph, "First", &color) == s_ids[RES_FIRST]);
+    EXPECT(walrus_fg_lookup_resource(&graph, "Second") == s_ids[RES_SECOND]);
+    EXPECT(walrus_fg_lookup_resource(&graph, "Missing") == WR_FG_INVALID_RESOURCE);
+
+    Walrus_FramePipeline *pre   = walrus_fg_add_pipeline_full(&graph, "Pre", NULL, "Pre");
+    Walrus_FramePipeline *scene = walrus_fg_add_pipeline_full(&graph, "Main", NULL, "Main");
+    walrus_fg_connect_pipeline(pre, scene);
+    walrus_fg_set_prepare(pre, prepare);
+    walrus_fg_set_prepare(scene, prepare);
+
+    u32 const cull = walrus_fg_add_node(pre, record, "Cull");
+    walrus_fg_node_write(pre, cull, s_ids[RES_VISIBILITY]);
+
+    // First lives over levels 1-2, Third starts at 3 and can take its texture, Second overlaps both
+    u32 const a = walrus_fg_add_node(scene, record, "A");
+    walrus_fg_node_read(scene, a, s_ids[RES_VISIBILITY]);
+    walrus_fg_node_write(scene, a, s_ids[RES_FIRST]);
+    u32 const b = walrus_fg_add_node(scene, record, "B");
+    walrus_fg_node_read(scene, b, s_ids[RES_FIRST]);
+    walrus_fg_node_write(scene, b, s_ids[RES_SECOND]);
+    u32 const c = walrus_fg_add_node(scene, record, "C");
+    walrus_fg_node_read(scene, c, s_ids[RES_SECOND]);
+    walrus_fg_node_write(scene, c, s_ids[RES_THIRD_TARGET]);
+    u32 const unused = walrus_fg_add_node(scene, record, "Unused");
+    walrus_fg_node_read(scene, unused, s_ids[RES_FIRST]);
+    walrus_fg_node_write(scene, unused, s_ids[RES_UNUSED]);
+    u32 const d = walrus_fg_add_node(scene, record, "D");
+    walrus_fg_node_read(scene, d, s_ids[RES_SECOND]);
+    walrus_fg_node_read(scene, d, s_ids[RES_THIRD_TARGET]);
+    walrus_fg_node_write(scene, d, s_ids[RES_OUTPUT]);
+    walrus_fg_add_node(scene, record, "Side");
+
+    walrus_fg_compile(&graph);
+
+    // Nothing reads the visibility within Pre alone
+    EXPECT(walrus_array_len(pre->schedule) == 0);
+    EXPECT(walrus_array_len(scene->schedule) == 6);
+    EXPECT(scene->num_levels == 5);
+
+    Walrus_FrameResourceUse *uses = walrus_array_get(scene->uses, 0);
+    EXPECT(uses[s_ids[RES_VISIBILITY]].first == 0 && uses[s_ids[RES_VISIBILITY]].last == 1);
+    EXPECT(uses[s_ids[RES_FIRST]].first == 1 && uses[s_ids[RES_FIRST]].last == 2);
+    EXPECT(uses[s_ids[RES_SECOND]].first == 2 && uses[s_ids[RES_SECOND]].last == 4);
+    EXPECT(uses[s_ids[RES_THIRD]].first == 3 && uses[s_ids[RES_THIRD]].last == 4);
+    EXPECT(uses[s_ids[RES_UNUSED]].first == UINT32_MAX);
+    EXPECT(uses[s_ids[RES_THIRD]].physical == uses[s_ids[RES_FIRST]].physical);
+    EXPECT(uses[s_ids[RES_SECOND]].physical != uses[s_ids[RES_FIRST]].physical);
+    EXPECT(walrus_array_len(graph.pool) == 2);
+
+    // The pipelines a target depends on are prepared before it
+    walrus_fg_prepare_pipeline(&graph, scene);
+    EXPECT(s_num_prepared == 2);
+    EXPECT(strcmp(s_prepared[0], "Pre") == 0 && strcmp(s_prepared[1], "Main") == 0);
+    walrus_fg_prepare_pipeline(&graph, pre);
+    EXPECT(s_num_prepared == 3 && strcmp(s_prepared[2], "Pre") == 0);
+
+    walrus_fg_execute(&graph, "Main");
+
+    // Side depends on nothing and joins the first level
+    char const *expected[] = {"Cull", "Side", "A", "B", "C", "D"};
+    EXPECT(s_num_executed == 6);
+    for (u32 i = 0; i < s_num_executed; ++i) {
+        EXPECT(strcmp(s_executed[i], expected[i]) == 0);
+    }
+
+    EXPECT(s_textures[RES_FIRST].id != WR_INVALID_HANDLE);
+    EXPECT(s_textures[RES_THIRD].id == s_textures[RES_FIRST].id);
+    EXPECT(s_textures[RES_SECOND].id != s_textures[RES_FIRST].id);
+    EXPECT(s_textures[RES_UNUSED].id == WR_INVALID_HANDLE);
+    EXPECT(s_third_target.id != WR_INVALID_HANDLE);
+    EXPECT(walrus_rhi_get_texture(s_third_target, 0).id == s_textures[RES_THIRD].id);
+
+    // Outside of an execution the transient resources have no handle
+    EXPECT(walrus_fg_texture(&graph, s_ids[RES_FIRST]).id == WR_INVALID_HANDLE);
+
+    // Compiling again releases the previous textures instead of piling them up
+    walrus_fg_compile(&graph);
+    EXPECT(walrus_array_len(graph.pool) == 2);
+
+    walrus_fg_shutdown(&graph);
+
+    return 0;
+}
+
+static i32 view_order_test(void)
+{
+    Walrus_FrameGraph graph;
+    walrus_fg_init(&graph);
+
+    Walrus_TextureCreateInfo const color = {.ratio = WR_RHI_RATIO_EQUAL, .format = WR_RHI_FORMAT_RGBA8};
+
+    u32 const data   = walrus_fg_create_data(&graph, "Data");
+    u32 const first  = walrus_fg_create_texture(&graph, "First", &color);
+    u32 const second = walrus_fg_create_texture(&graph, "Second", &color);
+    u32 const out0   = walrus_fg_import_texture(&graph, "Out0", (Walrus_TextureHandle){0});
+    u32 const out1   = walrus_fg_import_texture(&graph, "Out1", (Walrus_TextureHandle){0});
+
+    Walrus_FramePipeline *pipeline = walrus_fg_add_pipeline(&graph, "Views");
+
+    // A is declared after B but has nothing to wait for, the second texture takes the pooled first one
+    u32 const p = walrus_fg_add_node(pipeline, record, "P");
+    walrus_fg_node_write(pipeline, p, data);
+    u32 const b = walrus_fg_add_node(pipeline, record, "B");
+    walrus_fg_node_read(pipeline, b, data);
+    walrus_fg_node_write(pipeline, b, second);
+    u32 const a = walrus_fg_add_node(pipeline, record, "A");
+    walrus_fg_node_write(pipeline, a, first);
+    walrus_fg_node_write(pipeline, a, out0);
+    u32 const c = walrus_fg_add_node(pipeline, record, "C");
+    walrus_fg_node_read(pipeline, c, second);
+    walrus_fg_node_write(pipeline, c, out1);
+    for (u32 i = 0; i < 4; ++i) {
+        walrus_fg_node_views(pipeline, i, 1);
+    }
+
+    walrus_fg_compile(&graph);
+
+    Walrus_FrameResourceUse *uses = walrus_array_get(pipeline->uses, 0);
+    EXPECT(uses[first].physical == uses[second].physical);
+
+    // Every view writing the shared texture comes before or after all the views using the other one
+    u16 views[4];
+    for (u32 i = 0; i < walrus_array_len(pipeline->schedule); ++i) {
+        Walrus_FrameNode const *node = walrus_array_get(pipeline->schedule, i);
+        views[node->index]           = node->view_offset;
+    }
+    EXPECT(views[p] < views[b] && views[a] < views[b] && views[b] < views[c]);
+
+    walrus_fg_shutdown(&graph);
+
+    return 0;
+}
+
+#define NUM_PRODUCERS 10
+
+static u16                s_views[NUM_PRODUCERS + 1];
+static Walrus_RhiEncoder *s_encoders[NUM_PRODUCERS + 1];
+
+static void record_views(Walrus_FrameGraph *graph, Walrus_FrameNode const *node)
+{
+    s_views[node->index]    = walrus_fg_view_id(graph, node);
+    s_encoders[node->index] = node->encoder;
+}
+
+static i32 parallel_test(void)
+{
+    Walrus_FrameGraph graph;
+    walrus_fg_init(&graph);
+
+    Walrus_FramePipeline *pipeline = walrus_fg_add_pipeline(&graph, "Parallel");
+
+    // More producers than encoders, the level runs in several batches
+    u32 outputs[NUM_PRODUCERS];
+    for (u32 i = 0; i < NUM_PRODUCERS; ++i) {
+        char name[16];
+        snprintf(name, sizeof(name), "Output%u", i);
+        outputs[i]      = walrus_fg_create_data(&graph, name);
+        u32 const index = walrus_fg_add_node(pipeline, record_views, "Producer");
+        walrus_fg_node_write(pipeline, index, outputs[i]);
+        walrus_fg_node_views(pipeline, index, 2);
+        walrus_fg_node_parallel(pipeline, index);
+    }
+    u32 const consumer = walrus_fg_add_node(pipeline, record_views, "Consumer");
+    for (u32 i = 0; i < NUM_PRODUCERS; ++i) {
+        walrus_fg_node_read(pipeline, consumer, outputs[i]);
+    }
+    walrus_fg_node_views(pipeline, consumer, 1);
+
+    walrus_fg_compile(&graph);
+
+    EXPECT(pipeline->num_levels == 2);
+    EXPECT(pipeline->num_views == NUM_PRODUCERS * 2 + 1);
+
+    walrus_fg_execute_pipeline(&graph, pipeline, 4);
+
+    // Views follow the declaration order whatever thread ran the node
+    for (u32 i = 0; i < NUM_PRODUCERS; ++i) {
+        EXPECT(s_views[i] == 4 + i * 2);
+        EXPECT(s_encoders[i] != NULL);
+    }
+    EXPECT(s_views[consumer] == 4 + NUM_PRODUCERS * 2);
+    EXPECT(s_encoders[consumer] == NULL);
+
+    // Encoders are handed out in schedule order, a node records into the same slot every frame
+    Walrus_RhiEncoder *encoders[NUM_PRODUCERS];
+    for (u32 i = 0; i < NUM_PRODUCERS; ++i) {
+        u32 const batch_index = i % (WR_RHI_MAX_ENCODERS - 1);
+        EXPECT(batch_index == 0 || s_encoders[i] > s_encoders[i - 1]);
+        EXPECT(s_encoders[i] == s_encoders[batch_index]);
+        encoders[i] = s_encoders[i];
+    }
+    walrus_fg_execute_pipeline(&graph, pipeline, 4);
+    EXPECT(memcmp(encoders, s_encoders, sizeof(encoders)) == 0);
+
+    // Without a free encoder the nodes still run, on the immediate one
+    Walrus_RhiEncoder *taken[WR_RHI_MAX_ENCODERS];
+    u32                num_taken = 0;
+    while ((taken[num_taken] = walrus_rhi_begin_encoder()) != NULL) {
+        ++num_taken;
+    }
+    memset(s_encoders, 0, sizeof(s_encoders));
+    walrus_fg_execute_pipeline(&graph, pipeline, 4);
+    for (u32 i = 0; i < num_taken; ++i) {
+        walrus_rhi_end_encoder(taken[i]);
+    }
+    for (u32 i = 0; i < NUM_PRODUCERS; ++i) {
+        EXPECT(s_views[i] == 4 + i * 2);
+        EXPECT(s_encoders[i] == walrus_rhi_immediate_encoder());
+    }
+
+    Walrus_FrameNode const *node = walrus_array_get(pipeline->schedule, NUM_PRODUCERS);
+    EXPECT(node->index == consumer && node->level == 1);
+
+    walrus_fg_shutdown(&graph);
+
+    return 0;
+}
+
+#define NUM_CAMERAS 12
+
+typedef struct {
+    Walrus_FrameGraph  *graph;
+    Walrus_FrameGraph  *executions;
+    Walrus_RhiEncoder **encoders;
+    u32                 camera;
+    u32                 result;
+    u32                 scene;
+} CameraTest;
+
+static CameraTest s_camera_test;
+static u64        s_results[NUM_CAMERAS];
+static u16        s_camera_views[NUM_CAMERAS];
+static bool       s_camera_encoders[NUM_CAMERAS];
+
+static void camera_scale(Walrus_FrameGraph *graph, Walrus_FrameNode const *node)
+{
+    walrus_unused(node);
+    u64 const camera = walrus_fg_read(graph, s_camera_test.camera);
+    walrus_fg_write(graph, s_camera_test.result, camera * walrus_fg_read(graph, s_camera_test.scene));
+}
+
+static void camera_output(Walrus_FrameGraph *graph, Walrus_FrameNode const *node)
+{
+    u64 const camera          = walrus_fg_read(graph, s_camera_test.camera);
+    s_results[camera]         = walrus_fg_read(graph, s_camera_test.result);
+    s_camera_views[camera]    = walrus_fg_view_id(graph, node);
+    s_camera_encoders[camera] = node->encoder == s_camera_test.encoders[camera];
+}
+
+static void camera_execute(u32 begin, u32 end, void *userdata)
+{
+    Walrus_FramePipeline *pipeline = userdata;
+    for (u32 i = begin; i < end; ++i) {
+        Walrus_FrameGraph *execution = &s_camera_test.executions[i];
+        walrus_fg_fork(s_camera_test.graph, execution);
+        walrus_fg_write(execution, s_camera_test.camera, i);
+        walrus_fg_execute_pipeline_encoder(execution, pipeline, i * pipeline->num_views, s_camera_test.encoders[i]);
+    }
+}
+
+static i32 execution_test(void)
+{
+    Walrus_FrameGraph graph;
+    walrus_fg_init(&graph);
+
+    s_camera_test.graph  = &graph;
+    s_camera_test.camera = walrus_fg_create_data(&graph, "Camera");
+    s_camera_test.result = walrus_fg_create_data(&graph, "Result");
+    s_camera_test.scene  = walrus_fg_create_data(&graph, "Scene");
+
+    Walrus_FramePipeline *pipeline = walrus_fg_add_pipeline(&graph, "Camera");
+    u32 const             scale    = walrus_fg_add_node(pipeline, camera_scale, "Scale");
+    walrus_fg_node_write(pipeline, scale, s_camera_test.result);
+    walrus_fg_node_parallel(pipeline, scale);
+    u32 const output = walrus_fg_add_node(pipeline, camera_output, "Output");
+    walrus_fg_node_read(pipeline, output, s_camera_test.result);
+    walrus_fg_node_views(pipeline, output, 2);
+    walrus_fg_node_parallel(pipeline, output);
+
+    walrus_fg_compile(&graph);
+    EXPECT(pipeline->num_levels == 2 && pipeline->num_views == 2);
+
+    // Values written to the graph before the forks are seen by every execution
+    walrus_fg_write(&graph, s_camera_test.scene, 3);
+    walrus_fg_write(&graph, s_camera_test.camera, UINT32_MAX);
+
+    // Each camera runs as a job on an encoder of its own, batched by the encoders left
+    Walrus_FrameGraph  executions[NUM_CAMERAS] = {0};
+    Walrus_RhiEncoder *encoders[NUM_CAMERAS];
+    s_camera_test.executions = executions;
+    s_camera_test.encoders   = encoders;
+    for (u32 begin = 0, end = 0; begin < NUM_CAMERAS; begin = end) {
+        for (; end < NUM_CAMERAS && end - begin < WR_RHI_MAX_ENCODERS - 1; ++end) {
+            encoders[end] = walrus_rhi_begin_encoder();
+            EXPECT(encoders[end] != NULL);
+        }
+        walrus_parallel_for(begin, end, 1, camera_execute, pipeline);
+        for (u32 i = begin; i < end; ++i) {
+            walrus_rhi_end_encoder(encoders[i]);
+        }
+    }
+
+    for (u32 i = 0; i < NUM_CAMERAS; ++i) {
+        EXPECT(s_results[i] == i * 3);
+        EXPECT(s_camera_views[i] == i * 2);
+        EXPECT(s_camera_encoders[i]);
+        EXPECT(walrus_fg_read(&executions[i], s_camera_test.camera) == i);
+    }
+
+    // The executions leave the blackboard of the graph and the schedule as they were
+    EXPECT(walrus_fg_read(&graph, s_camera_test.camera) == UINT32_MAX);
+    EXPECT(walrus_fg_read(&graph, s_camera_test.result) == 0);
+    for (u32 i = 0; i < walrus_array_len(pipeline->schedule); ++i) {
+        Walrus_FrameNode const *node = walrus_array_get(pipeline->schedule, i);
+        EXPECT(node->encoder == NULL);
+    }
+
+    for (u32 i = 0; i < NUM_CAMERAS; ++i) {
+        walrus_fg_fork_release(&executions[i]);
+    }
+    walrus_fg_shutdown(&graph);
+
+    return 0;
+}
+
+i32 main(void)
+{
+    Walrus_RhiCreateInfo info;
+    info.resolution    = (Walrus_Resolution){1280, 720, 0};
+    info.flags         = WR_RHI_FLAG_NULL;
+    info.single_thread = true;
+    info.num_frames    = 1;
+
+    if (walrus_rhi_init(&info) != WR_RHI_SUCCESS) {
+        return 1;
+    }
+
+    walrus_job_init(3);
+
+    i32 r = frame_graph_test();
+    if (r == 0) {
+        r = view_order_test();
+    }
+    if (r == 0) {
+        r = parallel_test();
+    }
+    if (r == 0) {
+        r = execution_test();
+    }
+
+    walrus_job_shutdown();
+    walrus_rhi_shutdown();
+
+    return r;
+}
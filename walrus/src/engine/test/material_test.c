@@ -0,0 +1,154 @@
+#include <engine/material.h>
+#include <rhi/rhi.h>
+#include <core/string.h>
+
+#include <stdio.h>
+#include <string.h>
+
+#define EXPECT(e)                                                          \
+    if (!(e)) {                                                            \
+        printf("%s:%d: expectation failed: %s\n", __FILE__, __LINE__, #e); \
+        return 1;                                                          \
+    }
+
+static Walrus_ProgramHandle s_program;
+
+static void draw(Walrus_Material *material, u32 num)
+{
+    for (u32 i = 0; i < num; ++i) {
+        walrus_material_submit(material);
+        walrus_rhi_set_vertex_count(3);
+        walrus_rhi_submit(0, s_program, 0, WR_RHI_DISCARD_ALL);
+    }
+    walrus_rhi_frame();
+}
+
+static void draw_encoder(Walrus_Material *material, u32 num)
+{
+    Walrus_RhiEncoder *encoder = walrus_rhi_begin_encoder();
+    for (u32 i = 0; i < num; ++i) {
+        walrus_material_encoder_submit(encoder, material);
+        walrus_rhi_encoder_set_vertex_count(encoder, 3);
+        walrus_rhi_encoder_submit(encoder, 0, s_program, 0, WR_RHI_DISCARD_ALL);
+    }
+    walrus_rhi_end_encoder(encoder);
+    walrus_rhi_frame();
+}
+
+static i32 material_test(void)
+{
+    Walrus_Material material;
+    walrus_material_init(&material);
+    material.double_sided = false;
+    material.alpha_mode   = WR_ALPHA_MODE_OPAQUE;
+
+    // Same layout as the Material block of the mesh shaders
+    walrus_material_set_float(&material, "u_alpha_cutoff", 0.5f);
+    walrus_material_set_texture_color(&material, "u_albedo", WR_COLOR_TEXTURE_BLACK);
+    walrus_material_set_vec4(&material, "u_albedo_factor", (vec4){1, 2, 3, 4});
+    walrus_material_set_texture_color(&material, "u_emissive", WR_COLOR_TEXTURE_WHITE);
+    walrus_material_set_vec3(&material, "u_emissive_factor", (vec3){5, 6, 7});
+    walrus_material_set_float(&material, "u_normal_scale", 8);
+    walrus_material_set_bool(&material, "u_flag", true);
+
+    f32 const expected[] = {0.5f, 0, 0, 0, 1, 2, 3, 4, 5, 6, 7, 8};
+    EXPECT(memcmp(material.block, expected, sizeof(expected)) == 0);
+    EXPECT(material.block_size == sizeof(expected) + sizeof(u32));
+    EXPECT(*(u32 *)&material.block[sizeof(expected)] == 1);
+    EXPECT(material.num_textures == 2);
+    EXPECT(material.buffer.id != WR_INVALID_HANDLE);
+
+    // The setters only mark the bytes they changed, a flush uploads them in one update
+    EXPECT(material.dirty_begin == 0 && material.dirty_end == material.block_size);
+    walrus_material_flush();
+    EXPECT(material.dirty_begin == material.dirty_end);
+
+    // Many draws of one material stream no uniform and bind its block once
+    draw(&material, 16);
+    Walrus_RhiStats const *stats = walrus_rhi_get_stats();
+    EXPECT(stats->uniform_updates == 0);
+    EXPECT(stats->block_binds == 1);
+
+    // Recorded from an encoder it binds the same
+    draw_encoder(&material, 16);
+    stats = walrus_rhi_get_stats();
+    EXPECT(stats->draw_calls == 16);
+    EXPECT(stats->uniform_updates == 0);
+    EXPECT(stats->block_binds == 1);
+
+    walrus_material_set_float(&material, "u_normal_scale", 9);
+    EXPECT(*(f32 *)&material.block[44] == 9);
+    EXPECT(material.dirty_begin == 44 && material.dirty_end == 48);
+
+    // Removing a value leaves the others where the shader expects them
+    EXPECT(walrus_material_remove(&material, "u_alpha_cutoff"));
+    EXPECT(*(f32 *)material.block == 0);
+    EXPECT(*(f32 *)&material.block[16] == 1);
+    EXPECT(*(f32 *)&material.block[44] == 9);
+    EXPECT(*(u32 *)&material.block[48] == 1);
+    EXPECT(material.num_textures == 2);
+
+    walrus_material_shutdown(&material);
+
+    // Reserved slots do not depend on the order the values are set in
+    walrus_material_init(&material);
+    walrus_material_reserve(&material, "u_alpha_cutoff", WR_MATERIAL_PROPERTY_FLOAT, 0);
+    walrus_material_reserve(&material, "u_albedo_factor", WR_MATERIAL_PROPERTY_VEC4, 16);
+    walrus_material_reserve(&material, "u_emissive_factor", WR_MATERIAL_PROPERTY_VEC3, 32);
+    walrus_material_reserve(&material, "u_normal_scale", WR_MATERIAL_PROPERTY_FLOAT, 44);
+    walrus_material_reserve(&material, "u_normal", WR_MATERIAL_PROPERTY_TEXTURE2D, 2);
+
+    walrus_material_set_float(&material, "u_metallic_factor", 10);
+    walrus_material_set_texture_color(&material, "u_albedo", WR_COLOR_TEXTURE_BLACK);
+    walrus_material_set_float(&material, "u_normal_scale", 8);
+    walrus_material_set_vec3(&material, "u_emissive_factor", (vec3){5, 6, 7});
+    walrus_material_set_vec4(&material, "u_albedo_factor", (vec4){1, 2, 3, 4});
+    walrus_material_set_float(&material, "u_alpha_cutoff", 0.5f);
+
+    EXPECT(memcmp(material.block, expected, sizeof(expected)) == 0);
+    EXPECT(*(f32 *)&material.block[48] == 10);
+    EXPECT(material.block_size == 52);
+    EXPECT(material.properties[6].offset == 3);
+    EXPECT(material.num_textures == 4);
+
+    // A material shut down before the flush is left out of it
+    Walrus_Material other;
+    walrus_material_init(&other);
+    walrus_material_set_float(&other, "u_alpha_cutoff", 1);
+    walrus_material_shutdown(&material);
+    walrus_material_flush();
+    EXPECT(other.dirty_begin == other.dirty_end);
+    walrus_material_shutdown(&other);
+
+    return 0;
+}
+
+i32 main(void)
+{
+    Walrus_RhiCreateInfo info;
+    info.resolution    = (Walrus_Resolution){1280, 720, 0};
+    info.flags         = WR_RHI_FLAG_NULL;
+    info.single_thread = true;
+    info.num_frames    = 1;
+
+    if (walrus_rhi_init(&info) != WR_RHI_SUCCESS) {
+        return 1;
+    }
+
+    // The null backend never compiles shaders, the sources only need to be distinct
+    char *vs = walrus_str_dup("vs");
+    char *fs = walrus_str_dup("fs");
+
+    Walrus_ShaderHandle shaders[2] = {walrus_rhi_create_shader(WR_RHI_SHADER_VERTEX, vs),
+                                      walrus_rhi_create_shader(WR_RHI_SHADER_FRAGMENT, fs)};
+    s_program                      = walrus_rhi_create_program(shaders, 2, true);
+    walrus_str_free(vs);
+    walrus_str_free(fs);
+
+    i32 r = material_test();
+
+    walrus_rhi_destroy_program(s_program);
+    walrus_rhi_shutdown();
+
+    return r;
+}
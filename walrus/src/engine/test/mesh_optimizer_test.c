@@ -0,0 +1,247 @@
+#include <engine/mesh_optimizer.h>
+#include <core/memory.h>
+#include <core/sort.h>
+
+#include <stdio.h>
+#include <string.h>
+
+#define GRID_SIZE     64
+#define NUM_TRIANGLES (GRID_SIZE * GRID_SIZE * 2)
+#define NUM_INDICES   (NUM_TRIANGLES * 3)
+#define NUM_UNIQUE    ((GRID_SIZE + 1) * (GRID_SIZE + 1))
+#define THRESHOLD     1.05f
+
+#define EXPECT(e)                                                          \
+    if (!(e)) {                                                            \
+        printf("%s:%d: expectation failed: %s\n", __FILE__, __LINE__, #e); \
+        return 1;                                                          \
+    }
+
+typedef struct {
+    f32 position[3];
+    f32 uv[2];
+} Vertex;
+
+static u64 s_rng = 0x9e3779b97f4a7c15ull;
+
+static u32 randu(u32 max)
+{
+    s_rng ^= s_rng << 13;
+    s_rng ^= s_rng >> 7;
+    s_rng ^= s_rng << 17;
+    return (s_rng >> 32) % max;
+}
+
+static void grid_vertex(Vertex *vertex, u32 x, u32 y)
+{
+    vertex->position[0] = x;
+    vertex->position[1] = (x * 7 + y * 13) % 5 * 0.5f;
+    vertex->position[2] = y;
+    vertex->uv[0]       = (f32)x / GRID_SIZE;
+    vertex->uv[1]       = (f32)y / GRID_SIZE;
+}
+
+// Corners of the two triangles of a quad
+static u32 const s_corners[2][3][2] = {
+    {{0, 0}, {0, 1}, {1, 1}},
+    {{0, 0}, {1, 1}, {1, 0}},
+};
+
+// A triangle soup of a bumpy grid in random order, every corner of every triangle being its own vertex
+static void grid_init(Vertex *vertices, u32 *indices)
+{
+    u32 *order = walrus_new(u32, NUM_TRIANGLES);
+    for (u32 i = 0; i < NUM_TRIANGLES; ++i) {
+        order[i] = i;
+    }
+    for (u32 i = NUM_TRIANGLES - 1; i > 0; --i) {
+        u32 const j = randu(i + 1);
+        u32 const t = order[i];
+        order[i]    = order[j];
+        order[j]    = t;
+    }
+
+    for (u32 i = 0; i < NUM_TRIANGLES; ++i) {
+        u32 const quad = order[i] / 2;
+        u32 const x    = quad % GRID_SIZE;
+        u32 const y    = quad / GRID_SIZE;
+        for (u32 j = 0; j < 3; ++j) {
+            u32 const *corner = s_corners[order[i] % 2][j];
+            grid_vertex(&vertices[i * 3 + j], x + corner[0], y + corner[1]);
+            indices[i * 3 + j] = i * 3 + j;
+        }
+    }
+    walrus_free(order);
+}
+
+static i32 u64_compare(void const *lhs, void const *rhs)
+{
+    u64 const a = *(u64 const *)lhs;
+    u64 const b = *(u64 const *)rhs;
+    return (i32)(a > b) - (i32)(a < b);
+}
+
+// Triangles keyed by the grid position of their corners in order, sorted so that two meshes can be compared
+static void triangle_keys(u64 *keys, Vertex const *vertices, u32 const *indices)
+{
+    for (u32 i = 0; i < NUM_TRIANGLES; ++i) {
+        keys[i] = 0;
+        for (u32 j = 0; j < 3; ++j) {
+            Vertex const *v = &vertices[indices[i * 3 + j]];
+            keys[i]         = keys[i] * NUM_UNIQUE + (u32)v->position[0] * (GRID_SIZE + 1) + (u32)v->position[2];
+        }
+    }
+    walrus_quick_sort(keys, NUM_TRIANGLES, sizeof(u64), u64_compare);
+}
+
+// Deduplicates, orders for the cache then for overdraw, then lays the vertices out in fetch order
+static u32 optimize(Vertex *dst, u32 *dst_indices, Vertex const *vertices, u32 const *indices, f32 *acmr)
+{
+    Walrus_MeshStream stream = {vertices, sizeof(Vertex), sizeof(Vertex)};
+
+    u32      *remap      = walrus_new(u32, NUM_INDICES);
+    u32      *temp       = walrus_new(u32, NUM_INDICES);
+    Vertex   *unique     = walrus_new(Vertex, NUM_INDICES);
+    u32 const num_unique = walrus_mesh_generate_remap(remap, indices, NUM_INDICES, NUM_INDICES, &stream, 1);
+    walrus_mesh_remap_indices(temp, indices, NUM_INDICES, remap);
+    walrus_mesh_remap_vertices(unique, sizeof(Vertex), &stream, NUM_INDICES, remap);
+
+    walrus_mesh_optimize_vertex_cache(dst_indices, temp, NUM_INDICES, num_unique, WR_MESH_CACHE_SIZE);
+    acmr[0] = walrus_mesh_acmr(dst_indices, NUM_INDICES, num_unique, WR_MESH_CACHE_SIZE);
+
+    walrus_mesh_optimize_overdraw(temp, dst_indices, NUM_INDICES, unique->position, sizeof(Vertex), num_unique,
+                                  WR_MESH_CACHE_SIZE, THRESHOLD);
+    acmr[1] = walrus_mesh_acmr(temp, NUM_INDICES, num_unique, WR_MESH_CACHE_SIZE);
+
+    walrus_mesh_optimize_vertex_fetch_remap(remap, temp, NUM_INDICES, num_unique);
+    walrus_mesh_remap_indices(dst_indices, temp, NUM_INDICES, remap);
+    stream.data = unique;
+    walrus_mesh_remap_vertices(dst, sizeof(Vertex), &stream, num_unique, remap);
+
+    walrus_free(remap);
+    walrus_free(temp);
+    walrus_free(unique);
+
+    return num_unique;
+}
+
+// Twice the area of the triangles seen from above, positive for the winding of the grid
+static f32 grid_area(Vertex const *vertices, u32 const *indices, u32 num_indices)
+{
+    f32 area = 0;
+    for (u32 i = 0; i < num_indices; i += 3) {
+        f32 const *a = vertices[indices[i]].position;
+        f32 const *b = vertices[indices[i + 1]].position;
+        f32 const *c = vertices[indices[i + 2]].position;
+        area += (b[2] - a[2]) * (c[0] - a[0]) - (b[0] - a[0]) * (c[2] - a[2]);
+    }
+    return area;
+}
+
+// A flat grid simplifies down to its locked border without a hole or a flipped triangle, a bumpy one stops at the
+// error asked for
+static i32 simplify_test(void)
+{
+    Vertex *vertices = walrus_new(Vertex, NUM_UNIQUE);
+    u32    *indices  = walrus_new(u32, NUM_INDICES);
+    u32    *result   = walrus_new(u32, NUM_INDICES);
+    for (u32 y = 0; y <= GRID_SIZE; ++y) {
+        for (u32 x = 0; x <= GRID_SIZE; ++x) {
+            grid_vertex(&vertices[y * (GRID_SIZE + 1) + x], x, y);
+            vertices[y * (GRID_SIZE + 1) + x].position[1] = 0;
+        }
+    }
+    for (u32 i = 0; i < NUM_TRIANGLES; ++i) {
+        u32 const quad = i / 2;
+        for (u32 j = 0; j < 3; ++j) {
+            u32 const *corner  = s_corners[i % 2][j];
+            u32 const  x       = quad % GRID_SIZE + corner[0];
+            u32 const  y       = quad / GRID_SIZE + corner[1];
+            indices[i * 3 + j] = y * (GRID_SIZE + 1) + x;
+        }
+    }
+    f32 const area = grid_area(vertices, indices, NUM_INDICES);
+    EXPECT(area > 0);
+
+    f32       error  = 1;
+    u32 const target = NUM_INDICES / 8;
+    u32 const count  = walrus_mesh_simplify(result, indices, NUM_INDICES, vertices->position, sizeof(Vertex),
+                                            NUM_UNIQUE, target, 0.01f, &error);
+    printf("flat grid %u -> %u indices, error %f\n", NUM_INDICES, count, error);
+    EXPECT(count <= target && count % 3 == 0);
+    EXPECT(error < 1e-3f);
+    EXPECT(grid_area(vertices, result, count) == area);
+    for (u32 i = 0; i < count; i += 3) {
+        EXPECT(grid_area(vertices, &result[i], 3) > 0);
+    }
+
+    for (u32 i = 0; i < NUM_UNIQUE; ++i) {
+        vertices[i].position[1] = (i * 2654435761u >> 16) % 13 * 0.25f;
+    }
+    u32 const bumpy = walrus_mesh_simplify(result, indices, NUM_INDICES, vertices->position, sizeof(Vertex),
+                                           NUM_UNIQUE, 0, 0.005f, &error);
+    printf("bumpy grid %u -> %u indices, error %f\n", NUM_INDICES, bumpy, error);
+    EXPECT(bumpy > count && error <= 0.005f);
+
+    walrus_free(vertices);
+    walrus_free(indices);
+    walrus_free(result);
+
+    return 0;
+}
+
+i32 main(void)
+{
+    Vertex *vertices  = walrus_new(Vertex, NUM_INDICES);
+    u32    *indices   = walrus_new(u32, NUM_INDICES);
+    Vertex *optimized = walrus_new(Vertex, NUM_INDICES);
+    u32    *result    = walrus_new(u32, NUM_INDICES);
+    Vertex *again     = walrus_new(Vertex, NUM_INDICES);
+    u32    *again_ids = walrus_new(u32, NUM_INDICES);
+    u64    *keys      = walrus_new(u64, NUM_TRIANGLES);
+    u64    *expected  = walrus_new(u64, NUM_TRIANGLES);
+    grid_init(vertices, indices);
+
+    f32 const before = walrus_mesh_acmr(indices, NUM_INDICES, NUM_INDICES, WR_MESH_CACHE_SIZE);
+    EXPECT(before == 3);
+
+    f32       acmr[2];
+    u32 const num_unique = optimize(optimized, result, vertices, indices, acmr);
+    f32 const after      = walrus_mesh_acmr(result, NUM_INDICES, num_unique, WR_MESH_CACHE_SIZE);
+    printf("ACMR %.3f -> cache %.3f -> overdraw %.3f, %u -> %u vertices\n", before, acmr[0], acmr[1], NUM_INDICES,
+           num_unique);
+
+    EXPECT(num_unique == NUM_UNIQUE);
+    EXPECT(acmr[0] < 0.8f);
+    EXPECT(acmr[1] <= acmr[0] * THRESHOLD + 0.05f);
+    EXPECT(after == acmr[1]);
+
+    // Every triangle is kept with its winding
+    triangle_keys(expected, vertices, indices);
+    triangle_keys(keys, optimized, result);
+    EXPECT(memcmp(keys, expected, NUM_TRIANGLES * sizeof(u64)) == 0);
+
+    // Vertices are laid out in the order they are first fetched
+    u32 next = 0;
+    for (u32 i = 0; i < NUM_INDICES; ++i) {
+        EXPECT(result[i] <= next);
+        next += result[i] == next;
+    }
+    EXPECT(next == num_unique);
+
+    // Same input, same output
+    EXPECT(optimize(again, again_ids, vertices, indices, acmr) == num_unique);
+    EXPECT(memcmp(again_ids, result, NUM_INDICES * sizeof(u32)) == 0);
+    EXPECT(memcmp(again, optimized, num_unique * sizeof(Vertex)) == 0);
+
+    walrus_free(vertices);
+    walrus_free(indices);
+    walrus_free(optimized);
+    walrus_free(result);
+    walrus_free(again);
+    walrus_free(again_ids);
+    walrus_free(keys);
+    walrus_free(expected);
+
+    return simplify_test();
+}
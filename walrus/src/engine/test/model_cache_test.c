@@ -0,0 +1,170 @@
+#include "model_private.h"
+
+#include <core/job.h>
+#include <core/sys.h>
+#include <core/platform.h>
+
+#include <stdio.h>
+#include <string.h>
+
+#if WR_PLATFORM == WR_PLATFORM_WINDOWS
+#include <sys/utime.h>
+#else
+#include <utime.h>
+#endif
+
+#define EXPECT(e)                                                          \
+    if (!(e)) {                                                            \
+        printf("%s:%d: expectation failed: %s\n", __FILE__, __LINE__, #e); \
+        return 1;                                                          \
+    }
+
+// Sources are named relative to the model, the model is named with its directory
+#define MODEL_PATH  "./model_cache_test.gltf"
+#define BUFFER_PATH "./model_cache_test.bin"
+#define COOKED_PATH MODEL_PATH ".cooked"
+
+// A triangle in an external buffer, `%s` takes more top level properties
+static char const s_gltf[] =
+    "{\"asset\":{\"version\":\"2.0\"},"
+    "\"buffers\":[{\"uri\":\"model_cache_test.bin\",\"byteLength\":36}],"
+    "\"bufferViews\":[{\"buffer\":0,\"byteLength\":36}],"
+    "\"accessors\":[{\"bufferView\":0,\"componentType\":5126,\"count\":3,\"type\":\"VEC3\","
+    "\"min\":[0,0,0],\"max\":[%d,1,0]}],"
+    "\"meshes\":[{\"primitives\":[{\"attributes\":{\"POSITION\":0}}]}],"
+    "\"nodes\":[{\"mesh\":0,\"translation\":[1,2,3]}],"
+    "\"scenes\":[{\"nodes\":[0]}],\"scene\":0%s}";
+
+static bool file_write(char const *path, void const *data, u64 size)
+{
+    FILE *file = fopen(path, "wb");
+    if (file == NULL) {
+        return false;
+    }
+    bool const written = fwrite(data, 1, size, file) == size;
+    fclose(file);
+    return written;
+}
+
+static bool file_exists(char const *path)
+{
+    FILE *file = fopen(path, "rb");
+    if (file) {
+        fclose(file);
+    }
+    return file != NULL;
+}
+
+// Times set well apart, a rewrite within the same second would otherwise look untouched
+static void file_set_mtime(char const *path, u64 mtime)
+{
+#if WR_PLATFORM == WR_PLATFORM_WINDOWS
+    struct _utimbuf times = {(time_t)mtime, (time_t)mtime};
+    _utime(path, &times);
+#else
+    struct utimbuf times = {(time_t)mtime, (time_t)mtime};
+    utime(path, &times);
+#endif
+}
+
+static bool sources_write(f32 width, char const *extra)
+{
+    f32 const positions[9] = {0, 0, 0, width, 0, 0, 0, 1, 0};
+    char      gltf[1024];
+    snprintf(gltf, sizeof(gltf), s_gltf, (i32)width, extra);
+    return file_write(MODEL_PATH, gltf, strlen(gltf)) && file_write(BUFFER_PATH, positions, sizeof(positions));
+}
+
+// Decodes the model and tells whether it came from the cooked file, with the width of its triangle
+static Walrus_ModelResult decode(u32 flags, bool *cooked, f32 *width)
+{
+    Walrus_Model       model;
+    Walrus_ModelData  *data = NULL;
+    Walrus_ModelResult res  = walrus_model_decode_from_file(&model, &data, MODEL_PATH, flags);
+    if (res != WR_MODEL_SUCCESS) {
+        return res;
+    }
+
+    *cooked = data->cooked != NULL;
+    *width  = -1;
+    if (model.num_meshes == 1 && model.meshes[0].num_primitives == 1 && model.num_nodes == 1 &&
+        model.nodes[0].local_transform.trans[2] == 3) {
+        *width = model.meshes[0].primitives[0].max[0];
+    }
+
+    walrus_model_data_free(data);
+    walrus_model_deallocate(&model);
+    return res;
+}
+
+static i32 model_cache_test(void)
+{
+    bool cooked = false;
+    f32  width  = 0;
+
+    remove(COOKED_PATH);
+    EXPECT(sources_write(1, ""));
+
+    // Nothing is cooked unless asked to
+    EXPECT(decode(WR_MODEL_LOAD_FLAG_NONE, &cooked, &width) == WR_MODEL_SUCCESS);
+    EXPECT(!cooked && width == 1);
+    EXPECT(!file_exists(COOKED_PATH));
+
+    EXPECT(decode(WR_MODEL_LOAD_FLAG_CACHE, &cooked, &width) == WR_MODEL_SUCCESS);
+    EXPECT(!cooked && width == 1);
+    EXPECT(file_exists(COOKED_PATH));
+
+    // The cooked model reads back the same
+    EXPECT(decode(WR_MODEL_LOAD_FLAG_CACHE, &cooked, &width) == WR_MODEL_SUCCESS);
+    EXPECT(cooked && width == 1);
+
+    // Other load flags cook another model
+    EXPECT(decode(WR_MODEL_LOAD_FLAG_CACHE | WR_MODEL_LOAD_FLAG_OPTIMIZE, &cooked, &width) == WR_MODEL_SUCCESS);
+    EXPECT(!cooked && width == 1);
+    EXPECT(decode(WR_MODEL_LOAD_FLAG_CACHE, &cooked, &width) == WR_MODEL_SUCCESS);
+    EXPECT(!cooked);
+
+    // A source touched without any change keeps the cooked model
+    u64 size  = 0;
+    u64 mtime = 0;
+    EXPECT(walrus_file_stat(BUFFER_PATH, &size, &mtime));
+    EXPECT(sources_write(1, ""));
+    file_set_mtime(MODEL_PATH, mtime - 100);
+    file_set_mtime(BUFFER_PATH, mtime - 100);
+    EXPECT(decode(WR_MODEL_LOAD_FLAG_CACHE, &cooked, &width) == WR_MODEL_SUCCESS);
+    EXPECT(cooked && width == 1);
+
+    // A buffer changed in place, with the same size, is decoded again
+    EXPECT(sources_write(2, ""));
+    file_set_mtime(MODEL_PATH, mtime - 100);
+    file_set_mtime(BUFFER_PATH, mtime - 50);
+    EXPECT(decode(WR_MODEL_LOAD_FLAG_CACHE, &cooked, &width) == WR_MODEL_SUCCESS);
+    EXPECT(!cooked && width == 2);
+    EXPECT(decode(WR_MODEL_LOAD_FLAG_CACHE, &cooked, &width) == WR_MODEL_SUCCESS);
+    EXPECT(cooked && width == 2);
+
+    // An image that fails to load is not cooked as missing
+    remove(COOKED_PATH);
+    EXPECT(sources_write(1, ",\"images\":[{\"uri\":\"model_cache_test_missing.png\"}]"));
+    EXPECT(decode(WR_MODEL_LOAD_FLAG_CACHE, &cooked, &width) == WR_MODEL_SUCCESS);
+    EXPECT(!cooked && width == 1);
+    EXPECT(!file_exists(COOKED_PATH));
+
+    return 0;
+}
+
+i32 main(void)
+{
+    // Images are decoded on the job system, here by the caller alone
+    walrus_job_init(0);
+
+    i32 r = model_cache_test();
+
+    walrus_job_shutdown();
+
+    remove(COOKED_PATH);
+    remove(MODEL_PATH);
+    remove(BUFFER_PATH);
+
+    return r;
+}
@@ -2,18 +2,22 @@
 #include "rhi_p.h"
 
 #include <core/assert.h>
+#include <core/atomic.h>
+#include <core/log.h>
 #include <core/math.h>
+#include <core/memory.h>
 #include <core/sort.h>
 
 #include <cglm/mat4.h>
 #include <string.h>
 
-#define SortKeyViewNumBits     (31 - walrus_u32cntlz(WR_RHI_MAX_VIEWS))
+#define SortKeyViewNumBits     (8)
 #define SortKeySortTypeNumBits (2)
 #define SortKeyProgramNumBits  (32)
 #define SortKeyBlendNumBits    (2)
 #define SortKeyDepthNumBits    (16)
-#define SortKeySeqNumBits      (16)
+#define SortKeyEncoderNumBits  (3)
+#define SortKeySeqNumBits      (16 + SortKeyEncoderNumBits)
 
 #define SortKeyViewBitShift (64 - SortKeyViewNumBits)
 #define SortKeyViewMask     ((u64)((1 << SortKeyViewNumBits) - 1) << SortKeyViewBitShift)
@@ -68,6 +72,21 @@
 #define SortKeyComputeProgramBitShift (SortKeyComputeSeqBitShift - SortKeyProgramNumBits)
 #define SortKeyComputeProgramBitMask  ((((u64)1 << SortKeyProgramNumBits) - 1) << SortKeyComputeProgramBitShift)
 
+// Every field is packed in the 64 bits, raising a limit needs bits taken from another field
+_Static_assert(WR_RHI_MAX_VIEWS <= (1 << SortKeyViewNumBits), "SortKey view bits do not hold WR_RHI_MAX_VIEWS");
+_Static_assert(WR_RHI_MAX_ENCODERS <= (1 << SortKeyEncoderNumBits),
+               "SortKey encoder bits do not hold WR_RHI_MAX_ENCODERS");
+_Static_assert(SortKeyProgram0BitShift >= SortKeyDepthNumBits && SortKeyProgram1BitShift >= 0,
+               "SortKey program and depth keys overflow 64 bits");
+_Static_assert(SortKeyProgram2BitShift >= 0 && SortKeyComputeProgramBitShift >= 0,
+               "SortKey sequence keys overflow 64 bits");
+
+// The slot of the encoder above its own sequence
+static u64 sortkey_sequence(Sortkey const *key)
+{
+    return ((u64)key->encoder << 16) | key->sequence;
+}
+
 u64 sortkey_encode_draw(Sortkey *key, SortKeyType type)
 {
     switch (type) {
@@ -88,7 +107,7 @@ u64 sortkey_encode_draw(Sortkey *key, SortKeyType type)
         } break;
         case SORT_SEQUENCE: {
             u64 const view    = ((u64)(key->view_id) << SortKeyViewBitShift) & SortKeyViewMask;
-            u64 const seq     = ((u64)(key->sequence) << SortKeySeq2BitShift) & SortKeySeq2Mask;
+            u64 const seq     = (sortkey_sequence(key) << SortKeySeq2BitShift) & SortKeySeq2Mask;
             u64 const blend   = ((u64)(key->blend) << SortKeyBlend2BitShift) & SortKeyBlend2Mask;
             u64 const program = ((u64)(key->program.id) << SortKeyProgram2BitShift) & SortKeyProgram2Mask;
             return view | SortKeyDrawBit | SortKeySortTypeSequence | seq | blend | program;
@@ -100,11 +119,11 @@ u64 sortkey_encode_draw(Sortkey *key, SortKeyType type)
 u64 sortkey_encode_compute(Sortkey *key)
 {
     u64 const program = ((u64)(key->program.id) << SortKeyComputeProgramBitShift) & SortKeyComputeProgramBitMask;
-    u64 const seq     = ((u64)(key->sequence) << SortKeyComputeSeqBitShift) & SortKeyComputeSeqBitMask;
+    u64 const seq     = (sortkey_sequence(key) << SortKeyComputeSeqBitShift) & SortKeyComputeSeqBitMask;
     u64 const view    = ((u64)(key->view_id) << SortKeyViewBitShift) & SortKeyViewMask;
     u64 const key_val = program | seq | view;
 
-    walrus_assert_msg(seq == ((u64)(key->sequence) << SortKeyComputeSeqBitShift),
+    walrus_assert_msg(seq == (sortkey_sequence(key) << SortKeyComputeSeqBitShift),
                       "SortKey error, sequence is truncated (Sequence: %d).", key->sequence);
     return key_val;
 }
@@ -116,6 +135,7 @@ void sortkey_reset(Sortkey *key)
     key->view_id    = 0;
     key->program.id = 0;
     key->sequence   = 0;
+    key->encoder    = 0;
 }
 
 bool sortkey_decode(Sortkey *key, u64 key_val, u16 *view_map)
@@ -159,20 +179,42 @@ u64 sortkey_remapview(u64 key_val, u16 *view_map)
 
 void frame_init(RenderFrame *frame, u32 min_resource_cb, u32 max_transient_vb, u32 max_transient_ib)
 {
-    Sortkey term;
-    sortkey_reset(&term);
-    term.program.id                          = WR_INVALID_HANDLE;
-    frame->sortkeys[WR_RHI_MAX_DRAW_CALLS]   = sortkey_encode_draw(&term, SORT_PROGRAM);
-    frame->sortvalues[WR_RHI_MAX_DRAW_CALLS] = WR_RHI_MAX_DRAW_CALLS;
+    frame->sortkeys         = NULL;
+    frame->sortvalues       = NULL;
+    frame->sort_temp_keys   = NULL;
+    frame->sort_temp_values = NULL;
+    frame->sort_capacity    = 0;
 
     frame->num_render_items = 0;
-    frame->uniforms         = uniform_buffer_create(1 << 20);
     frame->num_matrices     = 1;
     frame->vbo_offset       = 0;
     frame->max_transient_vb = max_transient_vb;
     frame->max_transient_ib = max_transient_ib;
+    frame->transient_vb     = NULL;
+    frame->transient_ib     = NULL;
+    frame->instance_layout  = (Walrus_LayoutHandle){WR_INVALID_HANDLE};
+    memset(&frame->stats, 0, sizeof(frame->stats));
+
+    // Extra encoders use small chunks and only grow once they record uniforms
+    frame->uniforms[0] = uniform_buffer_create(1 << 20);
+    for (u32 i = 1; i < WR_RHI_MAX_ENCODERS; ++i) {
+        frame->uniforms[i] = uniform_buffer_create(64 << 10);
+    }
 
-    glm_mat4_copy((mat4)GLM_MAT4_IDENTITY_INIT, frame->matrix_cache[0]);
+    frame->page_mutex = walrus_mutex_create();
+    memset(frame->item_pages, 0, sizeof(frame->item_pages));
+    memset(frame->stream_pages, 0, sizeof(frame->stream_pages));
+    memset(frame->bind_pages, 0, sizeof(frame->bind_pages));
+    memset(frame->matrix_pages, 0, sizeof(frame->matrix_pages));
+    for (u32 i = 0; i < FRAME_NUM_BIND_SHARDS; ++i) {
+        frame->bind_shards[i].mutex = walrus_mutex_create();
+        frame->bind_shards[i].table = NULL;
+        frame->bind_shards[i].size  = 0;
+        frame->bind_shards[i].count = 0;
+    }
+
+    frame->matrix_pages[0] = walrus_new(mat4, FRAME_PAGE_SIZE);
+    glm_mat4_copy((mat4)GLM_MAT4_IDENTITY_INIT, frame->matrix_pages[0][0]);
 
     command_buffer_init(&frame->cmd_pre, min_resource_cb);
     command_buffer_init(&frame->cmd_post, min_resource_cb);
@@ -183,7 +225,28 @@ void frame_init(RenderFrame *frame, u32 min_resource_cb, u32 max_transient_vb, u
 
 void frame_shutdown(RenderFrame *frame)
 {
-    uniform_buffer_destroy(frame->uniforms);
+    for (u32 i = 0; i < WR_RHI_MAX_ENCODERS; ++i) {
+        uniform_buffer_destroy(frame->uniforms[i]);
+    }
+    for (u32 i = 0; i < FRAME_NUM_ITEM_PAGES; ++i) {
+        walrus_free(frame->item_pages[i]);
+        walrus_free(frame->bind_pages[i]);
+    }
+    for (u32 i = 0; i < FRAME_NUM_STREAM_PAGES; ++i) {
+        walrus_free(frame->stream_pages[i]);
+    }
+    for (u32 i = 0; i < FRAME_NUM_BIND_SHARDS; ++i) {
+        walrus_free(frame->bind_shards[i].table);
+        walrus_mutex_destroy(frame->bind_shards[i].mutex);
+    }
+    for (u32 i = 0; i < FRAME_NUM_MATRIX_PAGES; ++i) {
+        walrus_free(frame->matrix_pages[i]);
+    }
+    walrus_free(frame->sortkeys);
+    walrus_free(frame->sortvalues);
+    walrus_free(frame->sort_temp_keys);
+    walrus_free(frame->sort_temp_values);
+    walrus_mutex_destroy(frame->page_mutex);
 }
 
 void frame_reset(RenderFrame *frame)
@@ -222,20 +285,138 @@ void frame_reset_all_free_handles(RenderFrame *frame)
 void frame_start(RenderFrame *frame)
 {
     frame->num_render_items = 0;
+    frame->num_streams      = 0;
+    frame->num_bind_sets    = 0;
     frame->num_matrices     = 1;
     frame->vbo_offset       = 0;
     frame->ibo_offset       = 0;
     frame->debug_flags      = WR_RHI_DEBUG_NONE;
+    for (u32 i = 0; i < FRAME_NUM_BIND_SHARDS; ++i) {
+        BindSetShard *shard = &frame->bind_shards[i];
+        if (shard->table) {
+            memset(shard->table, 0xff, sizeof(BindSetSlot) * shard->size);
+        }
+        shard->count = 0;
+    }
     command_buffer_start(&frame->cmd_pre);
     command_buffer_start(&frame->cmd_post);
-    uniform_buffer_start(frame->uniforms, 0);
+    for (u32 i = 0; i < WR_RHI_MAX_ENCODERS; ++i) {
+        uniform_buffer_reset(frame->uniforms[i]);
+    }
 }
 
 void frame_finish(RenderFrame *frame)
 {
     command_buffer_finish(&frame->cmd_pre);
     command_buffer_finish(&frame->cmd_post);
-    uniform_buffer_finish(frame->uniforms);
+    for (u32 i = 0; i < WR_RHI_MAX_ENCODERS; ++i) {
+        uniform_buffer_finish(frame->uniforms[i]);
+    }
+}
+
+static bool draw_can_instance(RenderDraw const *draw)
+{
+    return draw->num_instances == 1 && draw->num_matrices == 1 && draw->instance_buffer.id == WR_INVALID_HANDLE;
+}
+
+static bool draw_instance_equal(RenderFrame const *frame, RenderDraw const *lhs, RenderDraw const *rhs)
+{
+    if (lhs->stream_mask != rhs->stream_mask || lhs->num_vertices != rhs->num_vertices ||
+        lhs->num_indices != rhs->num_indices || lhs->index_buffer.id != rhs->index_buffer.id ||
+        lhs->index_size != rhs->index_size || lhs->index_offset != rhs->index_offset ||
+        lhs->state_flags != rhs->state_flags || lhs->stencil != rhs->stencil ||
+        lhs->blend_factor != rhs->blend_factor || !viewrect_equal(&lhs->scissor, &rhs->scissor)) {
+        return false;
+    }
+
+    u32 const mask = lhs->stream_mask != UINT16_MAX ? lhs->stream_mask : 0;
+    for (u32 id = 0, stream_mask = mask; 0 != stream_mask; stream_mask >>= 1, ++id) {
+        u32 const ntz = walrus_u32cnttz(stream_mask);
+        stream_mask >>= ntz;
+        id += ntz;
+
+        VertexStream const *a = frame_get_stream(frame, lhs, id);
+        VertexStream const *b = frame_get_stream(frame, rhs, id);
+        if (a->handle.id != b->handle.id || a->layout_handle.id != b->layout_handle.id || a->offset != b->offset) {
+            return false;
+        }
+    }
+
+    // Uniforms are recorded per draw, the merged draw only applies the first draw's range
+    u32 const size = lhs->uniform_end - lhs->uniform_begin;
+    return size == rhs->uniform_end - rhs->uniform_begin &&
+           uniform_buffer_equal(frame->uniforms[lhs->uniform_idx], lhs->uniform_begin,
+                                frame->uniforms[rhs->uniform_idx], rhs->uniform_begin, size);
+}
+
+// Number of sorted items from `item` that can be drawn as instances of the first one
+static u32 frame_instance_run(RenderFrame const *frame, u32 item)
+{
+    u64 const key_val = frame->sortkeys[item];
+    u32 const first   = frame->sortvalues[item];
+    if (!(key_val & SortKeyDrawBit) ||
+        frame->views[frame->view_map[sortkey_decode_view(key_val)]].mode != WR_RHI_VIEWMODE_INSTANCING) {
+        return 1;
+    }
+
+    RenderDraw const *leader = &frame_get_render_item(frame, first)->draw;
+    RenderBind const *bind   = frame_get_render_bind(frame, first);
+    if (!draw_can_instance(leader)) {
+        return 1;
+    }
+
+    u32 last = item + 1;
+    for (; last < frame->num_render_items && frame->sortkeys[last] == key_val; ++last) {
+        u32 const         id   = frame->sortvalues[last];
+        RenderDraw const *draw = &frame_get_render_item(frame, id)->draw;
+        if (!draw_can_instance(draw) || frame_get_render_bind(frame, id) != bind ||
+            !draw_instance_equal(frame, leader, draw)) {
+            break;
+        }
+    }
+    return last - item;
+}
+
+// Identical draws share a sort key in instancing views, so a run of them is adjacent after sorting. The run's
+// transforms are copied to the transient vertex buffer and the first draw is turned into an instanced draw of them.
+static void frame_merge_instances(RenderFrame *frame)
+{
+    if (frame->transient_vb == NULL || frame->instance_layout.id == WR_INVALID_HANDLE) {
+        return;
+    }
+
+    u32 num_items = 0;
+    for (u32 item = 0; item < frame->num_render_items;) {
+        u32 num    = frame_instance_run(frame, item);
+        u32 offset = 0;
+        if (num > 1) {
+            offset = frame_alloc_transient_vb(frame, &num, sizeof(mat4), 16);
+        }
+        if (num > 1) {
+            for (u32 i = 0; i < num; ++i) {
+                RenderDraw const *draw = &frame_get_render_item(frame, frame->sortvalues[item + i])->draw;
+                u8               *dst  = &frame->transient_vb->data[offset + i * sizeof(mat4)];
+                memcpy(dst, frame_get_matrix(frame, draw->start_matrix), sizeof(mat4));
+            }
+
+            RenderDraw *leader      = &frame_get_render_item(frame, frame->sortvalues[item])->draw;
+            leader->instance_buffer = frame->transient_vb->handle;
+            leader->instance_layout = frame->instance_layout;
+            leader->instance_offset = offset;
+            leader->num_instances   = num;
+            leader->start_matrix    = 0;
+            frame->stats.merged_draws += num - 1;
+        }
+        else {
+            // A single draw, or the transient buffer is full and the run is drawn one by one
+            num = 1;
+        }
+        frame->sortkeys[num_items]   = frame->sortkeys[item];
+        frame->sortvalues[num_items] = frame->sortvalues[item];
+        ++num_items;
+        item += num;
+    }
+    frame->num_render_items = num_items;
 }
 
 void frame_sort(RenderFrame *frame)
@@ -251,25 +432,88 @@ void frame_sort(RenderFrame *frame)
             viewrect_intersect(&frame->views[i].scissor, &rect);
         }
     }
+
+    if (frame->num_render_items > frame->sort_capacity) {
+        frame->sort_capacity    = walrus_max(frame->num_render_items, frame->sort_capacity * 2);
+        frame->sortkeys         = walrus_realloc(frame->sortkeys, sizeof(u64) * frame->sort_capacity);
+        frame->sortvalues       = walrus_realloc(frame->sortvalues, sizeof(u32) * frame->sort_capacity);
+        frame->sort_temp_keys   = walrus_realloc(frame->sort_temp_keys, sizeof(u64) * frame->sort_capacity);
+        frame->sort_temp_values = walrus_realloc(frame->sort_temp_values, sizeof(u32) * frame->sort_capacity);
+    }
+    // Submits failing after they took their item leave it without a bind set, it is not drawn
+    u32 num_items = 0;
     for (u32 i = 0; i < frame->num_render_items; ++i) {
-        frame->sortkeys[i] = sortkey_remapview(frame->sortkeys[i], view_remap);
+        RenderItemPage const *page = frame->item_pages[i >> FRAME_PAGE_SHIFT];
+        if (page->binds[i & FRAME_PAGE_MASK] != UINT32_MAX) {
+            frame->sortkeys[num_items]   = sortkey_remapview(page->keys[i & FRAME_PAGE_MASK], view_remap);
+            frame->sortvalues[num_items] = i;
+            ++num_items;
+        }
     }
-    static u64 tmp_keys[WR_RHI_MAX_DRAW_CALLS];
-    static u32 tmp_values[WR_RHI_MAX_DRAW_CALLS];
-    walrus_radix_sort64(frame->sortkeys, tmp_keys, frame->sortvalues, tmp_values, frame->num_render_items,
-                        sizeof(tmp_values[0]));
+    walrus_radix_sort64_u32(frame->sortkeys, frame->sort_temp_keys, frame->sortvalues, frame->sort_temp_values,
+                            num_items);
+    frame->num_render_items = num_items;
+
+    frame_merge_instances(frame);
+}
+
+// Pages stay allocated until shutdown, only the first use of a page takes the lock
+static void frame_page_get(RenderFrame *frame, void *volatile *page, u64 size)
+{
+    if (walrus_likely(walrus_atomic_load_ptr(page) != NULL)) {
+        return;
+    }
+    walrus_mutex_lock(frame->page_mutex);
+    if (*page == NULL) {
+        walrus_atomic_store_ptr(page, walrus_malloc(size));
+    }
+    walrus_mutex_unlock(frame->page_mutex);
+}
+
+u32 frame_alloc_render_item(RenderFrame *frame)
+{
+    u32 id = walrus_atomic_fetch_add_sat_u32(&frame->num_render_items, 1, WR_RHI_MAX_DRAW_CALLS);
+    if (id < WR_RHI_MAX_DRAW_CALLS) {
+        frame_page_get(frame, (void *volatile *)&frame->item_pages[id >> FRAME_PAGE_SHIFT], sizeof(RenderItemPage));
+    }
+    return id;
+}
+
+// Reserves up to `*pnum` contiguous entries that never cross a page
+static u32 frame_reserve_range(RenderFrame *frame, u32 volatile *counter, u32 max, u32 *pnum, void *volatile *pages,
+                               u64 page_size)
+{
+    u32 num  = walrus_min(*pnum, FRAME_PAGE_SIZE);
+    u32 prev = walrus_atomic_load_u32(counter);
+    u32 first;
+    u32 last;
+    do {
+        // Start on the next page instead of splitting the range
+        first = prev;
+        if ((first & FRAME_PAGE_MASK) + num > FRAME_PAGE_SIZE) {
+            first = (first + FRAME_PAGE_MASK) & ~FRAME_PAGE_MASK;
+        }
+        first = walrus_min(first, max);
+        last  = walrus_min(first + num, max);
+    } while (!walrus_atomic_cas_u32(counter, &prev, last));
+
+    *pnum = last - first;
+    if (*pnum > 0) {
+        frame_page_get(frame, &pages[first >> FRAME_PAGE_SHIFT], page_size);
+    }
+    return first;
 }
 
 static u32 frame_reserve_matrices(RenderFrame *frame, u32 *pnum)
 {
-    u32 num             = *pnum;
-    u32 first           = frame->num_matrices;
-    frame->num_matrices = walrus_min(WR_RHI_MAX_MATRIX_CACHE - 1, walrus_u32satadd(num, frame->num_matrices));
+    walrus_assert_msg(*pnum <= FRAME_PAGE_SIZE, "Too many matrices in one draw. {} (max:{})", *pnum, FRAME_PAGE_SIZE);
+
+    u32 const num   = *pnum;
+    u32 const first = frame_reserve_range(frame, &frame->num_matrices, WR_RHI_MAX_MATRIX_CACHE - 1, pnum,
+                                          (void *volatile *)frame->matrix_pages, sizeof(mat4) * FRAME_PAGE_SIZE);
 
     walrus_assert_msg(first + num < WR_RHI_MAX_MATRIX_CACHE, "Matrix cache overflow. {} (max:{})", first + num,
                       WR_RHI_MAX_MATRIX_CACHE);
-    num   = walrus_min(num, WR_RHI_MAX_MATRIX_CACHE - 1 - first);
-    *pnum = num;
     return first;
 }
 
@@ -277,12 +521,230 @@ u32 frame_add_matrices(RenderFrame *frame, mat4 const mat, u32 *num)
 {
     if (mat) {
         u32 first = frame_reserve_matrices(frame, num);
-        memcpy(&frame->matrix_cache[first], mat, sizeof(mat4) * *num);
+        memcpy(frame_get_matrix(frame, first), mat, sizeof(mat4) * *num);
         return first;
     }
     return 0;
 }
 
+bool frame_add_streams(RenderFrame *frame, RenderDraw *draw, VertexStream const *streams)
+{
+    if (draw->stream_mask == 0 || draw->stream_mask == UINT16_MAX) {
+        draw->first_stream = 0;
+        return true;
+    }
+
+    u32 const num   = walrus_u32cntbits(draw->stream_mask);
+    u32       avail = num;
+    u32 const first = frame_reserve_range(frame, &frame->num_streams, FRAME_MAX_STREAMS, &avail,
+                                          (void *volatile *)frame->stream_pages,
+                                          sizeof(VertexStream) * FRAME_PAGE_SIZE);
+    if (avail != num) {
+        return false;
+    }
+
+    VertexStream *dst = &frame->stream_pages[first >> FRAME_PAGE_SHIFT][first & FRAME_PAGE_MASK];
+    for (u32 id = 0, stream_mask = draw->stream_mask; 0 != stream_mask; stream_mask >>= 1, ++id) {
+        u32 const ntz = walrus_u32cnttz(stream_mask);
+        stream_mask >>= ntz;
+        id += ntz;
+
+        *dst++ = streams[id];
+    }
+    draw->first_stream = first;
+    return true;
+}
+
+WR_INLINE u32 hash_combine(u32 hash, u32 value)
+{
+    return (hash ^ value) * 16777619u;
+}
+
+u32 bind_hash(RenderBind const *bind)
+{
+    u32 hash = hash_combine(2166136261u, bind->binding_mask);
+    hash     = hash_combine(hash, bind->block_mask);
+    for (u32 unit = 0, mask = bind->binding_mask; 0 != mask; mask >>= 1, ++unit) {
+        u32 const ntz = walrus_u32cnttz(mask);
+        mask >>= ntz;
+        unit += ntz;
+
+        Binding const *binding = &bind->bindings[unit];
+        u32 const      packed  = binding->type | binding->format << 8 | binding->access << 16 | binding->mip << 24;
+
+        hash = hash_combine(hash, binding->id);
+        hash = hash_combine(hash, packed);
+        hash = hash_combine(hash, binding->sampler_flags);
+    }
+    for (u32 slot = 0, mask = bind->block_mask; 0 != mask; mask >>= 1, ++slot) {
+        u32 const ntz = walrus_u32cnttz(mask);
+        mask >>= ntz;
+        slot += ntz;
+
+        BlockBinding const *binding = &bind->block_bindings[slot];
+
+        hash = hash_combine(hash, binding->handle.id);
+        hash = hash_combine(hash, binding->offset);
+        hash = hash_combine(hash, binding->size);
+    }
+    return hash;
+}
+
+bool bind_equal(RenderBind const *lhs, RenderBind const *rhs)
+{
+    if (lhs->binding_mask != rhs->binding_mask || lhs->block_mask != rhs->block_mask) {
+        return false;
+    }
+    for (u32 unit = 0; unit < WR_RHI_MAX_TEXTURE_SAMPLERS; ++unit) {
+        if (!(lhs->binding_mask & (1u << unit))) {
+            continue;
+        }
+        Binding const *a = &lhs->bindings[unit];
+        Binding const *b = &rhs->bindings[unit];
+        if (a->id != b->id || a->type != b->type || a->sampler_flags != b->sampler_flags || a->format != b->format ||
+            a->access != b->access || a->mip != b->mip) {
+            return false;
+        }
+    }
+    for (u32 slot = 0; slot < WR_RHI_MAX_UNIFORM_BINDINGS; ++slot) {
+        if (!(lhs->block_mask & (1u << slot))) {
+            continue;
+        }
+        BlockBinding const *a = &lhs->block_bindings[slot];
+        BlockBinding const *b = &rhs->block_bindings[slot];
+        if (a->handle.id != b->handle.id || a->offset != b->offset || a->size != b->size) {
+            return false;
+        }
+    }
+    return true;
+}
+
+static void bind_table_insert(BindSetSlot *table, u32 size, u32 hash, u32 index)
+{
+    u32 slot = hash & (size - 1);
+    while (table[slot].index != UINT32_MAX) {
+        slot = (slot + 1) & (size - 1);
+    }
+    table[slot].hash  = hash;
+    table[slot].index = index;
+}
+
+static void bind_table_grow(BindSetShard *shard)
+{
+    u32 const    size  = walrus_max(shard->size * 2, 64);
+    BindSetSlot *table = walrus_new(BindSetSlot, size);
+    memset(table, 0xff, sizeof(BindSetSlot) * size);
+    for (u32 i = 0; i < shard->size; ++i) {
+        if (shard->table[i].index != UINT32_MAX) {
+            bind_table_insert(table, size, shard->table[i].hash, shard->table[i].index);
+        }
+    }
+    walrus_free(shard->table);
+    shard->table = table;
+    shard->size  = size;
+}
+
+// The top bits of the hash pick the shard, the low bits the slot in its table. A bind set is written to its page
+// before it is published in the shard, and read back only by lookups holding the same shard lock.
+u32 frame_add_bind_set(RenderFrame *frame, RenderBind const *bind, u32 hash)
+{
+    BindSetShard *shard = &frame->bind_shards[hash >> (32 - FRAME_BIND_SHARD_SHIFT)];
+    walrus_mutex_lock(shard->mutex);
+
+    if (shard->count * 2 >= shard->size) {
+        bind_table_grow(shard);
+    }
+
+    u32 const mask  = shard->size - 1;
+    u32       slot  = hash & mask;
+    u32       index = UINT32_MAX;
+    for (; shard->table[slot].index != UINT32_MAX; slot = (slot + 1) & mask) {
+        if (shard->table[slot].hash == hash && bind_equal(frame_get_bind_set(frame, shard->table[slot].index), bind)) {
+            index = shard->table[slot].index;
+            break;
+        }
+    }
+
+    if (index == UINT32_MAX) {
+        index = walrus_atomic_fetch_add_u32(&frame->num_bind_sets, 1);
+        if (index >= FRAME_MAX_BIND_SETS) {
+            walrus_mutex_unlock(shard->mutex);
+            if (index == FRAME_MAX_BIND_SETS) {
+                walrus_warn("Bind set overflow, draws with new bind sets are dropped this frame (max: %u)",
+                            FRAME_MAX_BIND_SETS);
+            }
+            return UINT32_MAX;
+        }
+        frame_page_get(frame, (void *volatile *)&frame->bind_pages[index >> FRAME_PAGE_SHIFT],
+                       sizeof(RenderBind) * FRAME_PAGE_SIZE);
+        *frame_get_bind_set(frame, index) = *bind;
+        shard->table[slot].hash           = hash;
+        shard->table[slot].index          = index;
+        ++shard->count;
+    }
+
+    walrus_mutex_unlock(shard->mutex);
+    return index;
+}
+
+void frame_set_render_bind(RenderFrame *frame, u32 id, u32 bind_set)
+{
+    frame->item_pages[id >> FRAME_PAGE_SHIFT]->binds[id & FRAME_PAGE_MASK] = bind_set;
+}
+
+u32 draw_instance_hash(RenderFrame const *frame, RenderDraw const *draw, u32 bind_set)
+{
+    u32 hash = hash_combine(2166136261u, bind_set);
+    hash     = hash_combine(hash, draw->num_vertices);
+    hash     = hash_combine(hash, draw->num_indices);
+    hash     = hash_combine(hash, draw->index_buffer.id);
+    hash     = hash_combine(hash, (u32)draw->index_offset);
+    hash     = hash_combine(hash, (u32)draw->state_flags);
+    hash     = hash_combine(hash, (u32)(draw->state_flags >> 32));
+    hash     = hash_combine(hash, (u32)draw->stencil);
+    hash     = hash_combine(hash, draw->stream_mask);
+
+    u32 const mask = draw->stream_mask != UINT16_MAX ? draw->stream_mask : 0;
+    for (u32 id = 0, stream_mask = mask; 0 != stream_mask; stream_mask >>= 1, ++id) {
+        u32 const ntz = walrus_u32cnttz(stream_mask);
+        stream_mask >>= ntz;
+        id += ntz;
+
+        VertexStream const *stream = frame_get_stream(frame, draw, id);
+
+        hash = hash_combine(hash, stream->handle.id);
+        hash = hash_combine(hash, (u32)stream->offset);
+    }
+    return hash;
+}
+
+void frame_memory_stats(RenderFrame const *frame, Walrus_RhiStats *stats)
+{
+    u64 memory = sizeof(RenderFrame);
+    for (u32 i = 0; i < FRAME_NUM_ITEM_PAGES; ++i) {
+        memory += frame->item_pages[i] ? sizeof(RenderItemPage) : 0;
+        memory += frame->bind_pages[i] ? sizeof(RenderBind) * FRAME_PAGE_SIZE : 0;
+    }
+    for (u32 i = 0; i < FRAME_NUM_STREAM_PAGES; ++i) {
+        memory += frame->stream_pages[i] ? sizeof(VertexStream) * FRAME_PAGE_SIZE : 0;
+    }
+    for (u32 i = 0; i < FRAME_NUM_MATRIX_PAGES; ++i) {
+        memory += frame->matrix_pages[i] ? sizeof(mat4) * FRAME_PAGE_SIZE : 0;
+    }
+    for (u32 i = 0; i < WR_RHI_MAX_ENCODERS; ++i) {
+        memory += frame->uniforms[i]->size;
+    }
+    for (u32 i = 0; i < FRAME_NUM_BIND_SHARDS; ++i) {
+        memory += sizeof(BindSetSlot) * frame->bind_shards[i].size;
+    }
+    memory += frame->cmd_pre.capacity + frame->cmd_post.capacity;
+    memory += (sizeof(u64) + sizeof(u32)) * 2 * frame->sort_capacity;
+
+    stats->num_bind_sets = walrus_min(frame->num_bind_sets, FRAME_MAX_BIND_SETS);
+    stats->num_streams   = frame->num_streams;
+    stats->frame_memory  = memory;
+}
+
 u32 frame_avail_transient_vb_size(RenderFrame *frame, u32 num, u16 stride, u16 align)
 {
     u32 const offset     = walrus_stride_align(frame->vbo_offset, align);
@@ -320,6 +782,7 @@ u32 frame_alloc_transient_ib(RenderFrame *frame, u32 *num, u16 stride, u16 align
 void draw_clear(RenderDraw *draw, u8 flags)
 {
     if (flags & WR_RHI_DISCARD_STATE) {
+        draw->uniform_idx   = 0;
         draw->uniform_begin = 0;
         draw->uniform_end   = 0;
 
@@ -333,11 +796,9 @@ void draw_clear(RenderDraw *draw, u8 flags)
         draw->num_matrices = 1;
     }
     if (flags & WR_RHI_DISCARD_VERTEX_STREAMS) {
-        draw->num_vertices                = UINT32_MAX;
-        draw->stream_mask                 = 0;
-        draw->streams[0].offset           = 0;
-        draw->streams[0].handle.id        = WR_INVALID_HANDLE;
-        draw->streams[0].layout_handle.id = WR_INVALID_HANDLE;
+        draw->num_vertices = UINT32_MAX;
+        draw->stream_mask  = 0;
+        draw->first_stream = 0;
     }
     if (flags & WR_RHI_DISCARD_INDEX_BUFFER) {
         draw->num_indices     = UINT32_MAX;
@@ -356,6 +817,7 @@ void draw_clear(RenderDraw *draw, u8 flags)
 void compute_clear(RenderCompute *compute, u8 flags)
 {
     if (flags & WR_RHI_DISCARD_STATE) {
+        compute->uniform_idx   = 0;
         compute->uniform_begin = 0;
         compute->uniform_end   = 0;
     }
@@ -368,11 +830,16 @@ void compute_clear(RenderCompute *compute, u8 flags)
 void bind_clear(RenderBind *bind, u8 flags)
 {
     if (flags & WR_RHI_DISCARD_BINDINGS) {
+        bind->binding_mask = 0;
+        bind->block_mask   = 0;
         for (u32 i = 0; i < WR_RHI_MAX_TEXTURE_SAMPLERS; ++i) {
             Binding *binding       = &bind->bindings[i];
             binding->id            = WR_INVALID_HANDLE;
             binding->type          = WR_RHI_BIND_IMAGE;
             binding->sampler_flags = 0;
+            binding->format        = 0;
+            binding->access        = 0;
+            binding->mip           = 0;
         }
         for (u32 i = 0; i < WR_RHI_MAX_UNIFORM_BINDINGS; ++i) {
             BlockBinding *binding = &bind->block_bindings[i];
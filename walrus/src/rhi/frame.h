@@ -2,6 +2,9 @@
 
 #include <rhi/rhi_defines.h>
 #include <rhi/type.h>
+#include <core/macro.h>
+#include <core/math.h>
+#include <core/mutex.h>
 
 #include "uniform_buffer.h"
 #include "view.h"
@@ -18,7 +21,9 @@ typedef struct {
     u8                   blend;
     u16                  view_id;
     Walrus_ProgramHandle program;
-    u32                  sequence;
+    // A sequence only orders the submits of one encoder, sequential views merge the encoders in slot order
+    u16                  sequence;
+    u8                   encoder;
 } Sortkey;
 
 typedef enum {
@@ -41,12 +46,14 @@ typedef struct {
 } VertexStream;
 
 typedef struct {
-    VertexStream streams[WR_RHI_MAX_VERTEX_STREAM];
-    u16          stream_mask;
+    // Only the streams in `stream_mask` are stored, packed from `first_stream` in the frame
+    u32 first_stream;
+    u16 stream_mask;
 
     u32 num_vertices;
     u32 num_indices;
 
+    u8  uniform_idx;
     u32 uniform_begin;
     u32 uniform_end;
 
@@ -74,6 +81,7 @@ typedef struct {
     u32 num_y;
     u32 num_z;
 
+    u8  uniform_idx;
     u32 uniform_begin;
     u32 uniform_end;
 
@@ -102,15 +110,51 @@ typedef struct {
 } BlockBinding;
 
 typedef struct {
+    u32          binding_mask;
+    u16          block_mask;
     Binding      bindings[WR_RHI_MAX_TEXTURE_SAMPLERS];
     BlockBinding block_bindings[WR_RHI_MAX_UNIFORM_BINDINGS];
 } RenderBind;
 
-typedef struct {
+typedef union {
     RenderDraw    draw;
     RenderCompute compute;
 } RenderItem;
 
+// Render items, streams, bind sets and matrices are stored in pages allocated on first use, so a frame only holds
+// memory for the peak number of draw calls it has actually seen
+#define FRAME_PAGE_SHIFT       (10)
+#define FRAME_PAGE_SIZE        (1 << FRAME_PAGE_SHIFT)
+#define FRAME_PAGE_MASK        (FRAME_PAGE_SIZE - 1)
+#define FRAME_MAX_STREAMS      (WR_RHI_MAX_DRAW_CALLS * 2)
+#define FRAME_MAX_BIND_SETS    (WR_RHI_MAX_DRAW_CALLS)
+#define FRAME_NUM_ITEM_PAGES   ((WR_RHI_MAX_DRAW_CALLS + FRAME_PAGE_MASK) >> FRAME_PAGE_SHIFT)
+#define FRAME_NUM_STREAM_PAGES ((FRAME_MAX_STREAMS + FRAME_PAGE_MASK) >> FRAME_PAGE_SHIFT)
+#define FRAME_NUM_MATRIX_PAGES ((WR_RHI_MAX_MATRIX_CACHE + FRAME_PAGE_MASK) >> FRAME_PAGE_SHIFT)
+
+typedef struct {
+    RenderItem items[FRAME_PAGE_SIZE];
+    u32        binds[FRAME_PAGE_SIZE];
+    u64        keys[FRAME_PAGE_SIZE];
+} RenderItemPage;
+
+typedef struct {
+    u32 hash;
+    u32 index;
+} BindSetSlot;
+
+// Bind sets are looked up in one of several tables picked by their hash, each behind its own lock, so encoders
+// missing their cached bind set at the same time rarely wait on each other
+#define FRAME_BIND_SHARD_SHIFT (4)
+#define FRAME_NUM_BIND_SHARDS  (1 << FRAME_BIND_SHARD_SHIFT)
+
+typedef struct {
+    Walrus_Mutex *mutex;
+    BindSetSlot  *table;
+    u32           size;
+    u32           count;
+} BindSetShard;
+
 typedef struct {
     CommandBuffer cmd_pre;
     CommandBuffer cmd_post;
@@ -118,19 +162,32 @@ typedef struct {
     RenderView views[WR_RHI_MAX_VIEWS];
     u16        view_map[WR_RHI_MAX_VIEWS];
 
-    u32        num_render_items;
-    RenderItem render_items[WR_RHI_MAX_DRAW_CALLS + 1];
-    RenderBind render_binds[WR_RHI_MAX_DRAW_CALLS + 1];
+    u32             num_render_items;
+    RenderItemPage *item_pages[FRAME_NUM_ITEM_PAGES];
+
+    VertexStream *stream_pages[FRAME_NUM_STREAM_PAGES];
+    u32           num_streams;
 
-    u64 sortkeys[WR_RHI_MAX_DRAW_CALLS + 1];
-    u32 sortvalues[WR_RHI_MAX_DRAW_CALLS + 1];
+    // Bind sets are deduplicated per frame, render items refer to them by index
+    RenderBind  *bind_pages[FRAME_NUM_ITEM_PAGES];
+    u32          num_bind_sets;
+    BindSetShard bind_shards[FRAME_NUM_BIND_SHARDS];
+
+    // Gathered from the item pages by frame_sort, grown to the peak number of render items
+    u64 *sortkeys;
+    u32 *sortvalues;
+    u64 *sort_temp_keys;
+    u32 *sort_temp_values;
+    u32  sort_capacity;
 
     Walrus_Resolution resolution;
 
-    UniformBuffer *uniforms;
+    UniformBuffer *uniforms[WR_RHI_MAX_ENCODERS];
+
+    mat4 *matrix_pages[FRAME_NUM_MATRIX_PAGES];
+    u32   num_matrices;
 
-    mat4 matrix_cache[WR_RHI_MAX_MATRIX_CACHE];
-    u32  num_matrices;
+    Walrus_Mutex *page_mutex;
 
     u32 vbo_offset;
     u32 ibo_offset;
@@ -140,8 +197,13 @@ typedef struct {
     Walrus_TransientBuffer *transient_vb;
     Walrus_TransientBuffer *transient_ib;
 
+    // Per instance model matrix layout of draws merged in instancing views
+    Walrus_LayoutHandle instance_layout;
+
     u16 debug_flags;
 
+    Walrus_RhiStats stats;
+
     FREE_HANDLE(WR_RHI_MAX_BUFFERS, buffer);
     FREE_HANDLE(WR_RHI_MAX_VERTEX_LAYOUTS, layout);
     FREE_HANDLE(WR_RHI_MAX_TEXTURES, texture);
@@ -167,10 +229,63 @@ void frame_start(RenderFrame *frame);
 
 void frame_finish(RenderFrame *frame);
 
+// Sorts the render items and merges identical draws of instancing views, which allocates from the transient vertex
+// buffer, so it must be uploaded after sorting
 void frame_sort(RenderFrame *frame);
 
+u32 frame_alloc_render_item(RenderFrame *frame);
+
+WR_INLINE RenderItem *frame_get_render_item(RenderFrame const *frame, u32 id)
+{
+    return &frame->item_pages[id >> FRAME_PAGE_SHIFT]->items[id & FRAME_PAGE_MASK];
+}
+
+WR_INLINE void frame_set_sortkey(RenderFrame *frame, u32 id, u64 key_val)
+{
+    frame->item_pages[id >> FRAME_PAGE_SHIFT]->keys[id & FRAME_PAGE_MASK] = key_val;
+}
+
+WR_INLINE RenderBind *frame_get_bind_set(RenderFrame const *frame, u32 index)
+{
+    return &frame->bind_pages[index >> FRAME_PAGE_SHIFT][index & FRAME_PAGE_MASK];
+}
+
+WR_INLINE RenderBind *frame_get_render_bind(RenderFrame const *frame, u32 id)
+{
+    return frame_get_bind_set(frame, frame->item_pages[id >> FRAME_PAGE_SHIFT]->binds[id & FRAME_PAGE_MASK]);
+}
+
+WR_INLINE VertexStream const *frame_get_stream(RenderFrame const *frame, RenderDraw const *draw, u8 stream_id)
+{
+    u32 const index = draw->first_stream + walrus_u32cntbits(draw->stream_mask & ((1u << stream_id) - 1));
+    return &frame->stream_pages[index >> FRAME_PAGE_SHIFT][index & FRAME_PAGE_MASK];
+}
+
+// Matrices added in one call never cross a page, so `num` matrices from `id` are contiguous
+WR_INLINE mat4 *frame_get_matrix(RenderFrame const *frame, u32 id)
+{
+    return &frame->matrix_pages[id >> FRAME_PAGE_SHIFT][id & FRAME_PAGE_MASK];
+}
+
 u32 frame_add_matrices(RenderFrame *frame, mat4 const mat, u32 *num);
 
+// Copies the set streams of `streams` packed into the frame, returns false if the frame is out of streams
+bool frame_add_streams(RenderFrame *frame, RenderDraw *draw, VertexStream const *streams);
+
+u32 bind_hash(RenderBind const *bind);
+
+bool bind_equal(RenderBind const *lhs, RenderBind const *rhs);
+
+// Returns UINT32_MAX if the frame is out of bind sets
+u32 frame_add_bind_set(RenderFrame *frame, RenderBind const *bind, u32 hash);
+
+void frame_set_render_bind(RenderFrame *frame, u32 id, u32 bind_set);
+
+// Hash of everything but the transform that decides whether two draws can be merged into one instanced draw
+u32 draw_instance_hash(RenderFrame const *frame, RenderDraw const *draw, u32 bind_set);
+
+void frame_memory_stats(RenderFrame const *frame, Walrus_RhiStats *stats);
+
 u32 frame_avail_transient_vb_size(RenderFrame *frame, u32 num, u16 stride, u16 align);
 
 u32 frame_alloc_transient_vb(RenderFrame *frame, u32 *num, u16 stride, u16 align);
@@ -3,6 +3,7 @@
 #include "gl_texture.h"
 #include "gl_framebuffer.h"
 #include "frame.h"
+#include "state_diff.h"
 
 #include <core/macro.h>
 #include <core/log.h>
@@ -21,27 +22,21 @@ void wajs_setup_gl_context(void);
 
 GlRenderer *gl_renderer = NULL;
 
-typedef struct {
-    u32 draw_calls;
-    u32 compute_calls;
-    u32 num_vertices;
-    u32 num_indices;
-    u32 num_instance;
-} RenderStats;
-
-static void clean_stats(RenderStats *stats)
+static void clean_stats(Walrus_RhiStats *stats)
 {
-    stats->draw_calls    = 0;
-    stats->compute_calls = 0;
-    stats->num_vertices  = 0;
-    stats->num_indices   = 0;
-    stats->num_instance  = 0;
+    memset(stats, 0, sizeof(Walrus_RhiStats));
 }
 
-static void output_stats(RenderStats *stats)
+static void output_stats(Walrus_RhiStats const *stats)
 {
-    walrus_trace("compute calls: %d draw calls: %d num vertices: %d num indices: %d num instance: %d",
-                 stats->compute_calls, stats->draw_calls, stats->num_vertices, stats->num_indices, stats->num_instance);
+    walrus_trace("compute calls: %d draw calls: %d num vertices: %d num indices: %d num instance: %d merged: %d",
+                 stats->compute_calls, stats->draw_calls, stats->num_vertices, stats->num_indices,
+                 stats->num_instances, stats->merged_draws);
+    walrus_trace("programs: %d states: %d textures: %d blocks: %d attributes: %d index buffers: %d",
+                 stats->program_changes, stats->state_changes, stats->texture_binds, stats->block_binds,
+                 stats->attribute_binds, stats->index_binds);
+    walrus_trace("bind sets: %d streams: %d frame memory: %.2f MB", stats->num_bind_sets, stats->num_streams,
+                 stats->frame_memory / (1024.0 * 1024.0));
 }
 
 static GLenum const s_attribute_type[WR_RHI_COMPONENT_COUNT] = {
@@ -192,6 +187,24 @@ void apply_lazy_enabled_vertex_attribute(void)
     }
 }
 
+static bool s_instance_model_reset = false;
+
+// Shaders always read the instance model matrix, draws that are not merged see the identity through the generic
+// attribute values. Drawing with the attribute arrays enabled leaves those values undefined, so they are set again.
+static void reset_instance_model(void)
+{
+    if (s_vao_current_enabled & (UINT64_C(1) << WR_RHI_INSTANCE_MODEL_ATTRIBUTE)) {
+        s_instance_model_reset = false;
+        return;
+    }
+    if (!s_instance_model_reset) {
+        for (u32 i = 0; i < 4; ++i) {
+            glVertexAttrib4f(WR_RHI_INSTANCE_MODEL_ATTRIBUTE + i, i == 0, i == 1, i == 2, i == 3);
+        }
+        s_instance_model_reset = true;
+    }
+}
+
 static void commit(GlProgram const *program)
 {
     UniformBuffer *buffer = program->buffer;
@@ -201,20 +214,12 @@ static void commit(GlProgram const *program)
 
     uniform_buffer_start(buffer, 0);
 
-    while (true) {
-        u64 op = uniform_buffer_read_value(buffer);
-        if (op == UNIFORM_BUFFER_END) {
-            break;
-        }
-
-        Walrus_UniformHandle handle;
-        memcpy(&handle, uniform_buffer_read(buffer, sizeof(Walrus_UniformHandle)), sizeof(Walrus_UniformHandle));
+    Walrus_UniformType   type;
+    u32                  loc;
+    Walrus_UniformHandle handle;
+    u8                   num;
+    while (uniform_buffer_read_uniform_handle(buffer, &type, &loc, &handle, &num)) {
         void *data = gl_renderer->uniforms[handle.id];
-
-        Walrus_UniformType type;
-        u32                loc;
-        u8                 num;
-        uniform_decode_op(&type, &loc, &num, op);
         switch (type) {
             case WR_RHI_UNIFORM_BOOL:
             case WR_RHI_UNIFORM_UINT: {
@@ -283,7 +288,7 @@ static void set_predefineds(GlProgram const *prog, RenderFrame const *frame, Ren
                 glUniformMatrix4fv(u->loc, 1, GL_FALSE, &view->projection[0][0]);
                 break;
             case PREDEFINED_MODEL:
-                glUniformMatrix4fv(u->loc, num_matrices, GL_FALSE, &frame->matrix_cache[start_matrix][0][0]);
+                glUniformMatrix4fv(u->loc, num_matrices, GL_FALSE, &frame_get_matrix(frame, start_matrix)[0][0][0]);
                 break;
             case PREDEFINED_COUNT:
                 break;
@@ -386,6 +391,9 @@ static void gl_init(Renderer *renderer, Walrus_RhiCreateInfo const *info, Walrus
     glGetIntegerv(GL_MAX_TEXTURE_IMAGE_UNITS, &var);
     caps->max_texture_unit = var;
 
+    glGetIntegerv(GL_MAX_TEXTURE_SIZE, &var);
+    caps->max_texture_size = var;
+
     glDepthRangef(0, 1);
 
     gl_renderer->msaa_fbo = 0;
@@ -540,6 +548,13 @@ static void submit(RenderFrame *frame)
 {
     update_resolution(&frame->resolution);
 
+    Walrus_RhiStats *stats = &frame->stats;
+
+    clean_stats(stats);
+
+    Sortkey sortkey;
+    frame_sort(frame);
+
     if (frame->vbo_offset > 0) {
         Walrus_TransientBuffer *vb = frame->transient_vb;
         gl_buffer_update(vb->handle, 0, frame->vbo_offset, vb->data);
@@ -551,9 +566,6 @@ static void submit(RenderFrame *frame)
 
     u32 resolution_height = frame->resolution.height;
 
-    Sortkey sortkey;
-    frame_sort(frame);
-
     glBindVertexArray(gl_renderer->vao);
 
     u16             view_id      = UINT16_MAX;
@@ -562,38 +574,22 @@ static void submit(RenderFrame *frame)
     Walrus_FramebufferHandle fbh      = (Walrus_FramebufferHandle){WR_RHI_MAX_FRAMEBUFFERS};
     u16                      discards = WR_RHI_CLEAR_NONE;
 
-    Walrus_ProgramHandle current_prog = {WR_INVALID_HANDLE};
-
-    bool was_compute = false;
-
-    glDisable(GL_STENCIL_TEST);
-    glDisable(GL_DEPTH_TEST);
-    glDepthFunc(GL_LESS);
-    glDisable(GL_CULL_FACE);
-    glDisable(GL_BLEND);
+    StateCache cache;
+    state_cache_reset(&cache);
 
-    RenderDraw current_state;
-    draw_clear(&current_state, WR_RHI_DISCARD_ALL);
-    current_state.state_flags = WR_RHI_STATE_NONE;
-    current_state.stencil     = pack_stencil(WR_RHI_STENCIL_NONE, WR_RHI_STENCIL_NONE);
-    u32 blend_factor          = 0;
-
-    RenderBind current_bind;
-    bind_clear(&current_bind, WR_RHI_DISCARD_ALL);
+    StateDelta delta;
 
     GLenum primitive = GL_TRIANGLES;
 
-    RenderStats stats;
-
-    clean_stats(&stats);
+    frame_memory_stats(frame, stats);
 
     for (u32 item = 0; item < frame->num_render_items; ++item) {
         u64 const  key_val    = frame->sortkeys[item];
         bool const is_compute = sortkey_decode(&sortkey, key_val, frame->view_map);
 
         u32 const         item_id     = frame->sortvalues[item];
-        RenderItem const *render_item = &frame->render_items[item_id];
-        RenderBind const *render_bind = &frame->render_binds[item_id];
+        RenderItem const *render_item = frame_get_render_item(frame, item_id);
+        RenderBind const *render_bind = frame_get_render_bind(frame, item_id);
         RenderDraw const *draw        = &render_item->draw;
 
         bool const        view_changed = sortkey.view_id != view_id;
@@ -601,6 +597,7 @@ static void submit(RenderFrame *frame)
 
         if (view_changed) {
             view_id = sortkey.view_id;
+            ++stats->view_changes;
 
             if (frame->views[view_id].fb.id != fbh.id) {
                 fbh               = frame->views[view_id].fb;
@@ -642,24 +639,20 @@ static void submit(RenderFrame *frame)
                 glDisable(GL_SCISSOR_TEST);
             }
 
-            glDisable(GL_STENCIL_TEST);
-            glDisable(GL_DEPTH_TEST);
-            glDepthFunc(GL_LESS);
-            glDisable(GL_CULL_FACE);
-            glDisable(GL_BLEND);
+            state_cache_begin_view(&cache, view);
         }
 
         if (is_compute) {
-            if (!was_compute) {
-                was_compute = true;
-            }
             RenderCompute const *compute = &render_item->compute;
             GlProgram           *program = &gl_renderer->programs[sortkey.program.id];
             glUseProgram(program->id);
 
-            u32 const  max_compute_bindings = WR_RHI_MAX_TEXTURE_SAMPLERS;
-            GLbitfield barrier              = 0;
-            for (u32 unit = 0; unit < max_compute_bindings; ++unit) {
+            GLbitfield barrier = 0;
+            for (u32 unit = 0, mask = render_bind->binding_mask; 0 != mask; mask >>= 1, ++unit) {
+                u32 const ntz = walrus_u32cnttz(mask);
+                mask >>= ntz;
+                unit += ntz;
+
                 Binding const *bind = &render_bind->bindings[unit];
                 if (bind->id != WR_INVALID_HANDLE) {
                     GlTexture *texture = &gl_renderer->textures[bind->id];
@@ -677,7 +670,11 @@ static void submit(RenderFrame *frame)
                     }
                 }
             }
-            for (u32 binding = 0; binding < WR_RHI_MAX_UNIFORM_BINDINGS; ++binding) {
+            for (u32 binding = 0, mask = render_bind->block_mask; 0 != mask; mask >>= 1, ++binding) {
+                u32 const ntz = walrus_u32cnttz(mask);
+                mask >>= ntz;
+                binding += ntz;
+
                 BlockBinding const *bind = &render_bind->block_bindings[binding];
                 if (bind->handle.id != WR_INVALID_HANDLE) {
                     GlBuffer *buffer = &gl_renderer->buffers[bind->handle.id];
@@ -691,7 +688,8 @@ static void submit(RenderFrame *frame)
                 }
             }
             if (barrier != 0) {
-                renderer_uniform_updates(frame->uniforms, draw->uniform_begin, draw->uniform_end);
+                renderer_uniform_updates(frame->uniforms[compute->uniform_idx], compute->uniform_begin,
+                                         compute->uniform_end);
                 const bool constantsChanged = compute->uniform_begin < compute->uniform_end;
                 if (constantsChanged) {
                     commit(program);
@@ -700,35 +698,26 @@ static void submit(RenderFrame *frame)
                 glDispatchCompute(compute->num_x, compute->num_y, compute->num_z);
                 glMemoryBarrier(barrier);
 
-                ++stats.compute_calls;
+                ++stats->compute_calls;
             }
+            state_cache_invalidate(&cache, STATE_DIRTY_PROGRAM | STATE_DIRTY_TEXTURES | STATE_DIRTY_BLOCKS);
             continue;
         }
 
-        bool const reset_state = view_changed || was_compute;
-        if (was_compute) {
-            was_compute = false;
+        renderer_uniform_updates(frame->uniforms[draw->uniform_idx], draw->uniform_begin, draw->uniform_end);
+        if (sortkey.program.id == WR_INVALID_HANDLE) {
+            continue;
         }
 
-        u64 const new_flags       = draw->state_flags;
-        u64       changed_flags   = current_state.state_flags ^ draw->state_flags;
-        current_state.state_flags = new_flags;
+        state_cache_diff_draw(&cache, frame, sortkey.program, draw, render_bind, &delta);
+        state_delta_count(&delta, stats);
 
+        u64 const new_flags       = draw->state_flags;
         u64 const new_stencil     = draw->stencil;
-        u64       changed_stencil = current_state.stencil ^ draw->stencil;
-        current_state.stencil     = new_stencil;
-
-        if (reset_state) {
-            draw_clear(&current_state, WR_RHI_DISCARD_ALL);
-            changed_flags             = WR_RHI_STATE_MASK;
-            changed_stencil           = pack_stencil(WR_RHI_STENCIL_MASK, WR_RHI_STENCIL_MASK);
-            current_state.state_flags = new_flags;
-            current_state.stencil     = new_stencil;
-            bind_clear(&current_bind, WR_RHI_DISCARD_ALL);
-        }
-        if (!viewrect_equal(&current_state.scissor, &draw->scissor)) {
-            current_state.scissor = draw->scissor;
-            if (viewrect_zero_area(&current_state.scissor)) {
+        u64 const changed_stencil = delta.changed_stencil;
+
+        if (delta.dirty & STATE_DIRTY_SCISSOR) {
+            if (viewrect_zero_area(&draw->scissor)) {
                 if (view_scissor) {
                     glScissor(view_scissor->x, resolution_height - view_scissor->height - view_scissor->y,
                               view_scissor->width, view_scissor->height);
@@ -739,7 +728,7 @@ static void submit(RenderFrame *frame)
                 }
             }
             else {
-                ViewRect scissor_rect = current_state.scissor;
+                ViewRect scissor_rect = draw->scissor;
                 if (view_scissor) {
                     viewrect_intersect(&scissor_rect, view_scissor);
                 }
@@ -749,7 +738,7 @@ static void submit(RenderFrame *frame)
             }
         }
 
-        if (WR_RHI_STATE_BLEND_MASK & changed_flags || draw->blend_factor != blend_factor) {
+        if (delta.dirty & STATE_DIRTY_BLEND) {
             u32 const blend   = (u32)((new_flags & WR_RHI_STATE_BLEND_MASK) >> WR_RHI_STATE_BLEND_SHIFT);
             u32 const src_rgb = (blend)&0xf;
             u32 const dst_rgb = (blend >> 4) & 0xf;
@@ -757,24 +746,23 @@ static void submit(RenderFrame *frame)
             u32 const dst_a   = (blend >> 12) & 0xf;
             if (src_rgb != 0 && dst_rgb != 0 && src_a != 0 && dst_a != 0) {
                 glBlendFuncSeparate(s_blend[src_rgb].src, s_blend[dst_rgb].dst, s_blend[src_a].src, s_blend[dst_a].dst);
-                if ((s_blend[src_rgb].is_factor || s_blend[dst_rgb].is_factor) && blend_factor != draw->blend_factor) {
-                    u32 const rgba = draw->blend_factor;
-
-                    GLclampf rr = ((rgba >> 24)) / 255.0f;
-                    GLclampf gg = ((rgba >> 16) & 0xff) / 255.0f;
-                    GLclampf bb = ((rgba >> 8) & 0xff) / 255.0f;
-                    GLclampf aa = (rgba & 0xff) / 255.0f;
-
-                    glBlendColor(rr, gg, bb, aa);
-                    blend_factor = draw->blend_factor;
-                }
                 glEnable(GL_BLEND);
             }
             else {
                 glDisable(GL_BLEND);
             }
         }
-        if (WR_RHI_STATE_DEPTH_TEST_MASK & changed_flags) {
+        if (delta.dirty & STATE_DIRTY_BLEND_FACTOR) {
+            u32 const rgba = draw->blend_factor;
+
+            GLclampf rr = ((rgba >> 24)) / 255.0f;
+            GLclampf gg = ((rgba >> 16) & 0xff) / 255.0f;
+            GLclampf bb = ((rgba >> 8) & 0xff) / 255.0f;
+            GLclampf aa = (rgba & 0xff) / 255.0f;
+
+            glBlendColor(rr, gg, bb, aa);
+        }
+        if (delta.dirty & STATE_DIRTY_DEPTH) {
             u32 const func = (new_flags & WR_RHI_STATE_DEPTH_TEST_MASK) >> WR_RHI_STATE_DEPTH_TEST_SHIFT;
             if (func != 0) {
                 glEnable(GL_DEPTH_TEST);
@@ -790,13 +778,13 @@ static void submit(RenderFrame *frame)
                 }
             }
         }
-        if (WR_RHI_STATE_WRITE_MASK & changed_flags) {
+        if (delta.dirty & STATE_DIRTY_WRITE) {
             glColorMask(!!(new_flags & WR_RHI_STATE_WRITE_R), !!(new_flags & WR_RHI_STATE_WRITE_G),
                         !!(new_flags & WR_RHI_STATE_WRITE_B), !!(new_flags & WR_RHI_STATE_WRITE_A));
             glDepthMask(!!(new_flags & WR_RHI_STATE_WRITE_Z));
         }
 
-        if (WR_RHI_STATE_CULL_MASK & changed_flags) {
+        if (delta.dirty & STATE_DIRTY_CULL) {
             if (WR_RHI_STATE_CULL_CCW & new_flags) {
                 glEnable(GL_CULL_FACE);
                 glCullFace(GL_FRONT);
@@ -810,7 +798,7 @@ static void submit(RenderFrame *frame)
             }
         }
 
-        if (changed_stencil != 0) {
+        if (delta.dirty & STATE_DIRTY_STENCIL) {
             if (new_stencil != 0) {
                 glEnable(GL_STENCIL_TEST);
 
@@ -844,205 +832,159 @@ static void submit(RenderFrame *frame)
             }
         }
 
-        if (WR_RHI_STATE_DRAW_MASK & changed_flags) {
+        if (delta.dirty & STATE_DIRTY_PRIMITIVE) {
             primitive = s_primitives[((new_flags & WR_RHI_STATE_DRAW_MASK) >> WR_RHI_STATE_DRAW_SHIFT)];
         }
 
-        renderer_uniform_updates(frame->uniforms, draw->uniform_begin, draw->uniform_end);
-        bool const program_changed = current_prog.id != sortkey.program.id;
+        GlProgram const *program         = &gl_renderer->programs[sortkey.program.id];
+        bool const       program_changed = delta.dirty & STATE_DIRTY_PROGRAM;
         if (program_changed) {
-            current_prog = sortkey.program;
-            if (current_prog.id != WR_INVALID_HANDLE) {
-                glUseProgram(gl_renderer->programs[current_prog.id].id);
-            }
-            else {
-                glUseProgram(0);
-            }
+            glUseProgram(program->id);
         }
 
-        if (current_prog.id != WR_INVALID_HANDLE) {
-            GlProgram const *program = &gl_renderer->programs[current_prog.id];
-
-            bool const constants_changed = draw->uniform_begin < draw->uniform_end;
-            if (program_changed || constants_changed) {
-                commit(program);
-            }
-            set_predefineds(program, frame, view, draw->start_matrix, draw->num_matrices);
-            GLbitfield barrier = 0;
-            for (u32 unit = 0; unit < WR_RHI_MAX_TEXTURE_SAMPLERS; ++unit) {
-                Binding const *bind    = &render_bind->bindings[unit];
-                Binding       *current = &current_bind.bindings[unit];
-                if (program_changed || bind->id != current->id || bind->type != current->type ||
-                    bind->sampler_flags != current->sampler_flags) {
-                    if (bind->id != WR_INVALID_HANDLE) {
-                        GlTexture const *texture = &gl_renderer->textures[bind->id];
-                        switch (bind->type) {
-                            case WR_RHI_BIND_TEXTURE: {
-                                glActiveTexture(GL_TEXTURE0 + unit);
-                                glBindTexture(texture->target, texture->id);
-                            } break;
-                            case WR_RHI_BIND_IMAGE: {
-                                glBindImageTexture(unit, texture->id, bind->mip, GL_FALSE, 0, s_access[bind->access],
-                                                   s_image_format[bind->format]);
-                                barrier |= GL_SHADER_IMAGE_ACCESS_BARRIER_BIT;
-                            } break;
-                            default:
-                                break;
-                        }
-                    }
-                    *current = *bind;
-                }
+        bool const constants_changed = draw->uniform_begin < draw->uniform_end;
+        if (program_changed || constants_changed) {
+            commit(program);
+        }
+        set_predefineds(program, frame, view, draw->start_matrix, draw->num_matrices);
+
+        for (u32 unit = 0, mask = delta.texture_mask; 0 != mask; mask >>= 1, ++unit) {
+            u32 const ntz = walrus_u32cnttz(mask);
+            mask >>= ntz;
+            unit += ntz;
+
+            Binding const   *bind    = &render_bind->bindings[unit];
+            GlTexture const *texture = &gl_renderer->textures[bind->id];
+            switch (bind->type) {
+                case WR_RHI_BIND_TEXTURE: {
+                    glActiveTexture(GL_TEXTURE0 + unit);
+                    glBindTexture(texture->target, texture->id);
+                } break;
+                case WR_RHI_BIND_IMAGE: {
+                    glBindImageTexture(unit, texture->id, bind->mip, GL_FALSE, 0, s_access[bind->access],
+                                       s_image_format[bind->format]);
+                } break;
+                default:
+                    break;
             }
-            for (u32 binding = 0; binding < WR_RHI_MAX_UNIFORM_BINDINGS; ++binding) {
-                BlockBinding const *bind = &render_bind->block_bindings[binding];
-                if (bind->handle.id != WR_INVALID_HANDLE) {
-                    GlBuffer *buffer = &gl_renderer->buffers[bind->handle.id];
-                    if (buffer->flags & WR_RHI_BUFFER_UNIFORM_BLOCK) {
-                        glBindBufferRange(GL_UNIFORM_BUFFER, binding, buffer->id, bind->offset, bind->size);
-                    }
-                    else {
-                        glBindBufferRange(GL_SHADER_STORAGE_BUFFER, binding, buffer->id, bind->offset, bind->size);
-                        barrier |= GL_SHADER_STORAGE_BARRIER_BIT;
-                    }
-                }
+        }
+        for (u32 binding = 0, mask = delta.block_mask; 0 != mask; mask >>= 1, ++binding) {
+            u32 const ntz = walrus_u32cnttz(mask);
+            mask >>= ntz;
+            binding += ntz;
+
+            BlockBinding const *bind   = &render_bind->block_bindings[binding];
+            GlBuffer const     *buffer = &gl_renderer->buffers[bind->handle.id];
+            if (buffer->flags & WR_RHI_BUFFER_UNIFORM_BLOCK) {
+                glBindBufferRange(GL_UNIFORM_BUFFER, binding, buffer->id, bind->offset, bind->size);
             }
-            walrus_unused(barrier);
-
-            bool bind_attributes = false;
-            if (draw->stream_mask != UINT16_MAX) {
-                for (u32 id = 0, stream_mask = draw->stream_mask; 0 != stream_mask; stream_mask >>= 1, ++id) {
-                    u32 const ntz = walrus_u32cnttz(stream_mask);
-                    stream_mask >>= ntz;
-                    id += ntz;
-
-                    VertexStream const *stream = &draw->streams[id];
-                    if (current_state.streams[id].handle.id != stream->handle.id) {
-                        bind_attributes = true;
-                    }
-                    if (current_state.streams[id].layout_handle.id != stream->layout_handle.id) {
-                        bind_attributes = true;
-                    }
-                    if (current_state.streams[id].offset != stream->offset) {
-                        bind_attributes = true;
-                    }
-                }
+            else {
+                glBindBufferRange(GL_SHADER_STORAGE_BUFFER, binding, buffer->id, bind->offset, bind->size);
             }
+        }
 
-            if (program_changed || current_state.stream_mask != draw->stream_mask ||
-                current_state.instance_buffer.id != draw->instance_buffer.id ||
-                current_state.instance_layout.id != draw->instance_layout.id ||
-                current_state.num_instances != draw->num_instances ||
-                current_state.instance_offset != draw->instance_offset) {
-                current_state.stream_mask     = draw->stream_mask;
-                current_state.instance_buffer = draw->instance_buffer;
-                current_state.instance_layout = draw->instance_layout;
-                current_state.instance_offset = draw->instance_offset;
-
-                bind_attributes = true;
+        if (delta.dirty & STATE_DIRTY_INDEX_BUFFER) {
+            if (draw->index_buffer.id != WR_INVALID_HANDLE) {
+                GlBuffer const *ib = &gl_renderer->buffers[draw->index_buffer.id];
+                glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, ib->id);
             }
-
-            if (current_state.index_buffer.id != draw->index_buffer.id) {
-                current_state.index_buffer = draw->index_buffer;
-
-                if (draw->index_buffer.id != WR_INVALID_HANDLE) {
-                    GlBuffer const *ib = &gl_renderer->buffers[draw->index_buffer.id];
-                    glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, ib->id);
-                }
-                else {
-                    glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, 0);
-                }
+            else {
+                glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, 0);
             }
+        }
 
-            u32 num_vertices  = draw->num_vertices;
-            u32 num_instances = draw->num_instances;
-            if (num_vertices == UINT32_MAX) {
-                for (u32 id = 0, stream_mask = draw->stream_mask; 0 != stream_mask; stream_mask >>= 1, ++id) {
-                    u32 const ntz = walrus_u32cnttz(stream_mask);
-                    stream_mask >>= ntz;
-                    id += ntz;
+        u32 num_vertices  = draw->num_vertices;
+        u32 num_instances = draw->num_instances;
+        if (num_vertices == UINT32_MAX) {
+            for (u32 id = 0, stream_mask = draw->stream_mask; 0 != stream_mask; stream_mask >>= 1, ++id) {
+                u32 const ntz = walrus_u32cnttz(stream_mask);
+                stream_mask >>= ntz;
+                id += ntz;
 
-                    VertexStream const *stream = &draw->streams[id];
+                VertexStream const *stream = frame_get_stream(frame, draw, id);
 
-                    if (stream->handle.id != WR_INVALID_HANDLE) {
-                        GlBuffer const *vb = &gl_renderer->buffers[stream->handle.id];
+                if (stream->handle.id != WR_INVALID_HANDLE) {
+                    GlBuffer const *vb = &gl_renderer->buffers[stream->handle.id];
 
-                        Walrus_LayoutHandle const layout_handle = stream->layout_handle;
-                        if (layout_handle.id != WR_INVALID_HANDLE) {
-                            Walrus_VertexLayout const *layout = &gl_renderer->vertex_layouts[layout_handle.id];
+                    Walrus_LayoutHandle const layout_handle = stream->layout_handle;
+                    if (layout_handle.id != WR_INVALID_HANDLE) {
+                        Walrus_VertexLayout const *layout = &gl_renderer->vertex_layouts[layout_handle.id];
 
-                            num_vertices = walrus_min(num_vertices, vb->size / layout->stride);
-                        }
+                        num_vertices = walrus_min(num_vertices, vb->size / layout->stride);
                     }
                 }
             }
-            bool const instance_valid =
-                draw->instance_buffer.id != WR_INVALID_HANDLE && draw->instance_layout.id != WR_INVALID_HANDLE;
-            if (instance_valid && num_instances == UINT32_MAX) {
-                Walrus_VertexLayout const *layout          = &gl_renderer->vertex_layouts[draw->instance_layout.id];
-                GlBuffer const            *instance_buffer = &gl_renderer->buffers[draw->instance_buffer.id];
-                num_instances = walrus_min(num_instances, instance_buffer->size / layout->stride);
-            }
-            if (bind_attributes && draw->stream_mask != UINT16_MAX) {
-                for (u8 i = 0; i < WR_RHI_MAX_VERTEX_ATTRIBUTES; ++i) {
-                    lazy_disable_vertex_attribute(i);
-                    glVertexAttribDivisor(i, 0);
-                }
-                for (u32 id = 0, stream_mask = draw->stream_mask; 0 != stream_mask; stream_mask >>= 1, ++id) {
-                    u32 const ntz = walrus_u32cnttz(stream_mask);
-                    stream_mask >>= ntz;
-                    id += ntz;
-                    VertexStream const *stream = &draw->streams[id];
-                    if (stream->handle.id != WR_INVALID_HANDLE) {
-                        GlBuffer const *vb = &gl_renderer->buffers[stream->handle.id];
-
-                        Walrus_LayoutHandle const layout_handle = stream->layout_handle;
-                        if (layout_handle.id != WR_INVALID_HANDLE) {
-                            glBindBuffer(GL_ARRAY_BUFFER, vb->id);
-                            Walrus_VertexLayout const *layout = &gl_renderer->vertex_layouts[layout_handle.id];
-                            bind_vertex_attributes(layout, stream->offset);
-                            glBindBuffer(GL_ARRAY_BUFFER, 0);
-                        }
+        }
+        bool const instance_valid =
+            draw->instance_buffer.id != WR_INVALID_HANDLE && draw->instance_layout.id != WR_INVALID_HANDLE;
+        if (instance_valid && num_instances == UINT32_MAX) {
+            Walrus_VertexLayout const *layout          = &gl_renderer->vertex_layouts[draw->instance_layout.id];
+            GlBuffer const            *instance_buffer = &gl_renderer->buffers[draw->instance_buffer.id];
+            num_instances = walrus_min(num_instances, instance_buffer->size / layout->stride);
+        }
+        if (delta.dirty & STATE_DIRTY_ATTRIBUTES && draw->stream_mask != UINT16_MAX) {
+            for (u8 i = 0; i < WR_RHI_MAX_VERTEX_ATTRIBUTES; ++i) {
+                lazy_disable_vertex_attribute(i);
+                glVertexAttribDivisor(i, 0);
+            }
+            for (u32 id = 0, stream_mask = draw->stream_mask; 0 != stream_mask; stream_mask >>= 1, ++id) {
+                u32 const ntz = walrus_u32cnttz(stream_mask);
+                stream_mask >>= ntz;
+                id += ntz;
+                VertexStream const *stream = frame_get_stream(frame, draw, id);
+                if (stream->handle.id != WR_INVALID_HANDLE) {
+                    GlBuffer const *vb = &gl_renderer->buffers[stream->handle.id];
+
+                    Walrus_LayoutHandle const layout_handle = stream->layout_handle;
+                    if (layout_handle.id != WR_INVALID_HANDLE) {
+                        glBindBuffer(GL_ARRAY_BUFFER, vb->id);
+                        Walrus_VertexLayout const *layout = &gl_renderer->vertex_layouts[layout_handle.id];
+                        bind_vertex_attributes(layout, stream->offset);
+                        glBindBuffer(GL_ARRAY_BUFFER, 0);
                     }
                 }
-                if (instance_valid) {
-                    GlBuffer const *instance_buffer = &gl_renderer->buffers[draw->instance_buffer.id];
-                    glBindBuffer(GL_ARRAY_BUFFER, instance_buffer->id);
+            }
+            if (instance_valid) {
+                GlBuffer const *instance_buffer = &gl_renderer->buffers[draw->instance_buffer.id];
+                glBindBuffer(GL_ARRAY_BUFFER, instance_buffer->id);
 
-                    Walrus_VertexLayout const *layout = &gl_renderer->vertex_layouts[draw->instance_layout.id];
-                    bind_vertex_attributes(layout, draw->instance_offset);
-                    glBindBuffer(GL_ARRAY_BUFFER, 0);
-                }
-                apply_lazy_enabled_vertex_attribute();
+                Walrus_VertexLayout const *layout = &gl_renderer->vertex_layouts[draw->instance_layout.id];
+                bind_vertex_attributes(layout, draw->instance_offset);
+                glBindBuffer(GL_ARRAY_BUFFER, 0);
             }
+            apply_lazy_enabled_vertex_attribute();
+            reset_instance_model();
+        }
 
-            if (draw->index_buffer.id != WR_INVALID_HANDLE) {
-                static GLenum const index_type[5] = {GL_ZERO, GL_UNSIGNED_BYTE, GL_UNSIGNED_SHORT, GL_ZERO,
-                                                     GL_UNSIGNED_INT};
+        if (draw->index_buffer.id != WR_INVALID_HANDLE) {
+            static GLenum const index_type[5] = {GL_ZERO, GL_UNSIGNED_BYTE, GL_UNSIGNED_SHORT, GL_ZERO,
+                                                 GL_UNSIGNED_INT};
 
-                GlBuffer const *ib = &gl_renderer->buffers[draw->index_buffer.id];
+            GlBuffer const *ib = &gl_renderer->buffers[draw->index_buffer.id];
 
-                u32 num_indices = draw->num_indices;
-                if (num_indices == UINT32_MAX) {
-                    num_indices = ib->size / draw->index_size;
-                }
-                glDrawElementsInstanced(primitive, num_indices, index_type[draw->index_size],
-                                        (void *)draw->index_offset, num_instances);
-
-                ++stats.draw_calls;
-                stats.num_vertices += num_vertices;
-                stats.num_indices += num_indices;
+            u32 num_indices = draw->num_indices;
+            if (num_indices == UINT32_MAX) {
+                num_indices = ib->size / draw->index_size;
             }
-            else if (num_vertices != UINT32_MAX) {
-                glDrawArraysInstanced(primitive, 0, num_vertices, num_instances);
+            glDrawElementsInstanced(primitive, num_indices, index_type[draw->index_size], (void *)draw->index_offset,
+                                    num_instances);
 
-                ++stats.draw_calls;
-                stats.num_vertices += num_vertices;
-            }
+            ++stats->draw_calls;
+            stats->num_vertices += num_vertices;
+            stats->num_indices += num_indices;
+            stats->num_instances += num_instances;
+        }
+        else if (num_vertices != UINT32_MAX) {
+            glDrawArraysInstanced(primitive, 0, num_vertices, num_instances);
+
+            ++stats->draw_calls;
+            stats->num_vertices += num_vertices;
+            stats->num_instances += num_instances;
         }
     }
 
     if (frame->debug_flags & WR_RHI_DEBUG_STATS) {
-        output_stats(&stats);
+        output_stats(stats);
     }
 
     glBindVertexArray(0);
@@ -0,0 +1,304 @@
+#include "null_renderer.h"
+#include "frame.h"
+
+#include <core/macro.h>
+#include <core/log.h>
+#include <core/memory.h>
+#include <core/math.h>
+
+#include <string.h>
+
+NullRenderer *null_renderer = NULL;
+
+static void output_stats(Walrus_RhiStats const *stats)
+{
+    walrus_trace(
+        "[null] compute calls: %d draw calls: %d num vertices: %d num indices: %d num instance: %d views: %d programs: "
+        "%d uniforms: %d textures: %d blocks: %d",
+        stats->compute_calls, stats->draw_calls, stats->num_vertices, stats->num_indices, stats->num_instances,
+        stats->view_changes, stats->program_changes, stats->uniform_updates, stats->texture_binds, stats->block_binds);
+    walrus_trace("[null] states: %d attributes: %d index buffers: %d", stats->state_changes, stats->attribute_binds,
+                 stats->index_binds);
+    walrus_trace("[null] bind sets: %d streams: %d frame memory: %.2f MB", stats->num_bind_sets, stats->num_streams,
+                 stats->frame_memory / (1024.0 * 1024.0));
+}
+
+static void null_init(Renderer *renderer, Walrus_RhiCreateInfo const *info, Walrus_RhiCapabilities *caps)
+{
+    null_renderer = poly_cast(renderer, NullRenderer);
+
+    memset(null_renderer, 0, sizeof(NullRenderer));
+    null_renderer->resolution = info->resolution;
+
+    caps->ssbo_align       = 16;
+    caps->ubo_align        = 256;
+    caps->max_msaa         = 1;
+    caps->max_texture_unit = WR_RHI_MAX_TEXTURE_SAMPLERS;
+    caps->max_texture_size = 16384;
+}
+
+static void null_shutdown(void)
+{
+    walrus_free(null_renderer->deltas);
+    null_renderer->deltas     = NULL;
+    null_renderer->max_deltas = 0;
+
+    for (u32 i = 0; i < walrus_count_of(null_renderer->uniforms); ++i) {
+        walrus_free(null_renderer->uniforms[i]);
+        null_renderer->uniforms[i] = NULL;
+    }
+}
+
+static void null_shader_create(Walrus_ShaderType type, Walrus_ShaderHandle handle, char const *source)
+{
+    walrus_unused(type);
+    walrus_unused(handle);
+    walrus_unused(source);
+}
+
+static void null_shader_destroy(Walrus_ShaderHandle handle)
+{
+    walrus_unused(handle);
+}
+
+static void null_program_create(Walrus_ProgramHandle handle, Walrus_ShaderHandle *shaders, u32 num)
+{
+    walrus_unused(handle);
+    walrus_unused(shaders);
+    walrus_unused(num);
+}
+
+static void null_program_destroy(Walrus_ProgramHandle handle)
+{
+    walrus_unused(handle);
+}
+
+static void null_uniform_create(Walrus_UniformHandle handle, const char *name, u32 size)
+{
+    walrus_unused(name);
+    null_renderer->uniforms[handle.id]      = walrus_malloc0(size);
+    null_renderer->uniform_sizes[handle.id] = size;
+}
+
+static void null_uniform_destroy(Walrus_UniformHandle handle)
+{
+    walrus_free(null_renderer->uniforms[handle.id]);
+    null_renderer->uniforms[handle.id]      = NULL;
+    null_renderer->uniform_sizes[handle.id] = 0;
+}
+
+static void null_uniform_resize(Walrus_UniformHandle handle, u32 size)
+{
+    null_renderer->uniforms[handle.id]      = walrus_realloc(null_renderer->uniforms[handle.id], size);
+    null_renderer->uniform_sizes[handle.id] = size;
+}
+
+static void null_uniform_update(Walrus_UniformHandle handle, u32 offset, u32 size, void const *data)
+{
+    if (offset + size <= null_renderer->uniform_sizes[handle.id]) {
+        memcpy((u8 *)null_renderer->uniforms[handle.id] + offset, data, size);
+    }
+    ++null_renderer->num_uniform_updates;
+}
+
+static void null_vertex_layout_create(Walrus_LayoutHandle handle, Walrus_VertexLayout const *layout)
+{
+    memcpy(&null_renderer->vertex_layouts[handle.id], layout, sizeof(Walrus_VertexLayout));
+}
+
+static void null_vertex_layout_destroy(Walrus_LayoutHandle handle)
+{
+    walrus_unused(handle);
+}
+
+static void null_buffer_create(Walrus_BufferHandle handle, void const *data, u64 size, u16 flags)
+{
+    walrus_unused(data);
+    null_renderer->buffers[handle.id].size  = size;
+    null_renderer->buffers[handle.id].flags = flags;
+}
+
+static void null_buffer_destroy(Walrus_BufferHandle handle)
+{
+    null_renderer->buffers[handle.id].size  = 0;
+    null_renderer->buffers[handle.id].flags = 0;
+}
+
+static void null_buffer_update(Walrus_BufferHandle handle, u64 offset, u64 size, void const *data)
+{
+    walrus_unused(handle);
+    walrus_unused(offset);
+    walrus_unused(size);
+    walrus_unused(data);
+}
+
+static void null_texture_create(Walrus_TextureHandle handle, Walrus_TextureCreateInfo const *info, void const *data)
+{
+    walrus_unused(handle);
+    walrus_unused(info);
+    walrus_unused(data);
+}
+
+static void null_texture_destroy(Walrus_TextureHandle handle)
+{
+    walrus_unused(handle);
+}
+
+static void null_texture_resize(Walrus_TextureHandle handle, u32 width, u32 height, u32 depth, u8 num_mipmaps,
+                                u8 num_layers)
+{
+    walrus_unused(handle);
+    walrus_unused(width);
+    walrus_unused(height);
+    walrus_unused(depth);
+    walrus_unused(num_mipmaps);
+    walrus_unused(num_layers);
+}
+
+static void null_framebuffer_create(Walrus_FramebufferHandle handle, Walrus_Attachment *attachments, u8 num)
+{
+    walrus_unused(handle);
+    walrus_unused(attachments);
+    walrus_unused(num);
+}
+
+static void null_framebuffer_destroy(Walrus_FramebufferHandle handle)
+{
+    walrus_unused(handle);
+}
+
+static void record_delta(StateDelta const *delta)
+{
+    if (null_renderer->num_deltas == null_renderer->max_deltas) {
+        u32 const max_deltas      = walrus_max(null_renderer->max_deltas * 2, 64);
+        null_renderer->deltas     = walrus_realloc(null_renderer->deltas, max_deltas * sizeof(StateDelta));
+        null_renderer->max_deltas = max_deltas;
+    }
+    null_renderer->deltas[null_renderer->num_deltas++] = *delta;
+}
+
+static void submit(RenderFrame *frame)
+{
+    null_renderer->resolution          = frame->resolution;
+    null_renderer->num_uniform_updates = 0;
+    null_renderer->num_deltas          = 0;
+
+    Walrus_RhiStats *stats = &frame->stats;
+    memset(stats, 0, sizeof(Walrus_RhiStats));
+
+    Sortkey sortkey;
+    frame_sort(frame);
+
+    u16 view_id = UINT16_MAX;
+
+    StateCache cache;
+    state_cache_reset(&cache);
+
+    StateDelta delta;
+
+    frame_memory_stats(frame, stats);
+
+    for (u32 item = 0; item < frame->num_render_items; ++item) {
+        u64 const  key_val    = frame->sortkeys[item];
+        bool const is_compute = sortkey_decode(&sortkey, key_val, frame->view_map);
+
+        u32 const         item_id     = frame->sortvalues[item];
+        RenderItem const *render_item = frame_get_render_item(frame, item_id);
+        RenderBind const *render_bind = frame_get_render_bind(frame, item_id);
+        RenderDraw const *draw        = &render_item->draw;
+
+        bool const view_changed = sortkey.view_id != view_id;
+        if (view_changed) {
+            view_id = sortkey.view_id;
+            ++stats->view_changes;
+            state_cache_begin_view(&cache, &frame->views[view_id]);
+        }
+
+        if (is_compute) {
+            RenderCompute const *compute = &render_item->compute;
+
+            renderer_uniform_updates(frame->uniforms[compute->uniform_idx], compute->uniform_begin,
+                                     compute->uniform_end);
+            stats->texture_binds += walrus_u32cntbits(render_bind->binding_mask);
+            stats->block_binds += walrus_u32cntbits(render_bind->block_mask);
+            ++stats->compute_calls;
+
+            state_cache_invalidate(&cache, STATE_DIRTY_PROGRAM | STATE_DIRTY_TEXTURES | STATE_DIRTY_BLOCKS);
+            continue;
+        }
+
+        renderer_uniform_updates(frame->uniforms[draw->uniform_idx], draw->uniform_begin, draw->uniform_end);
+        if (sortkey.program.id == WR_INVALID_HANDLE) {
+            continue;
+        }
+
+        state_cache_diff_draw(&cache, frame, sortkey.program, draw, render_bind, &delta);
+        state_delta_count(&delta, stats);
+        record_delta(&delta);
+
+        u32 num_vertices  = draw->num_vertices;
+        u32 num_instances = draw->num_instances;
+        if (num_vertices == UINT32_MAX) {
+            for (u32 id = 0, stream_mask = draw->stream_mask; 0 != stream_mask; stream_mask >>= 1, ++id) {
+                u32 const ntz = walrus_u32cnttz(stream_mask);
+                stream_mask >>= ntz;
+                id += ntz;
+
+                VertexStream const *stream = frame_get_stream(frame, draw, id);
+                if (stream->handle.id != WR_INVALID_HANDLE && stream->layout_handle.id != WR_INVALID_HANDLE) {
+                    NullBuffer const          *vb     = &null_renderer->buffers[stream->handle.id];
+                    Walrus_VertexLayout const *layout = &null_renderer->vertex_layouts[stream->layout_handle.id];
+                    if (layout->stride > 0) {
+                        num_vertices = walrus_min(num_vertices, vb->size / layout->stride);
+                    }
+                }
+            }
+        }
+        bool const instance_valid =
+            draw->instance_buffer.id != WR_INVALID_HANDLE && draw->instance_layout.id != WR_INVALID_HANDLE;
+        if (instance_valid && num_instances == UINT32_MAX) {
+            Walrus_VertexLayout const *layout          = &null_renderer->vertex_layouts[draw->instance_layout.id];
+            NullBuffer const          *instance_buffer = &null_renderer->buffers[draw->instance_buffer.id];
+            if (layout->stride > 0) {
+                num_instances = walrus_min(num_instances, instance_buffer->size / layout->stride);
+            }
+        }
+
+        if (draw->index_buffer.id != WR_INVALID_HANDLE) {
+            u32 num_indices = draw->num_indices;
+            if (num_indices == UINT32_MAX && draw->index_size > 0) {
+                num_indices = null_renderer->buffers[draw->index_buffer.id].size / draw->index_size;
+            }
+
+            ++stats->draw_calls;
+            stats->num_vertices += num_vertices;
+            stats->num_indices += num_indices;
+            stats->num_instances += num_instances;
+        }
+        else if (num_vertices != UINT32_MAX) {
+            ++stats->draw_calls;
+            stats->num_vertices += num_vertices;
+            stats->num_instances += num_instances;
+        }
+    }
+
+    stats->uniform_updates = null_renderer->num_uniform_updates;
+
+    if (frame->debug_flags & WR_RHI_DEBUG_STATS) {
+        output_stats(stats);
+    }
+}
+
+POLY_DEFINE_DERIVED(Renderer, NullRenderer, null_create, POLY_IMPL(init, null_init), POLY_IMPL(shutdown, null_shutdown),
+                    POLY_IMPL(submit, submit), POLY_IMPL(create_shader, null_shader_create),
+                    POLY_IMPL(destroy_shader, null_shader_destroy), POLY_IMPL(create_program, null_program_create),
+                    POLY_IMPL(destroy_program, null_program_destroy), POLY_IMPL(create_uniform, null_uniform_create),
+                    POLY_IMPL(destroy_uniform, null_uniform_destroy), POLY_IMPL(resize_uniform, null_uniform_resize),
+                    POLY_IMPL(update_uniform, null_uniform_update),
+                    POLY_IMPL(create_vertex_layout, null_vertex_layout_create),
+                    POLY_IMPL(destroy_vertex_layout, null_vertex_layout_destroy),
+                    POLY_IMPL(create_buffer, null_buffer_create), POLY_IMPL(destroy_buffer, null_buffer_destroy),
+                    POLY_IMPL(update_buffer, null_buffer_update), POLY_IMPL(create_texture, null_texture_create),
+                    POLY_IMPL(destroy_texture, null_texture_destroy), POLY_IMPL(resize_texture, null_texture_resize),
+                    POLY_IMPL(create_framebuffer, null_framebuffer_create),
+                    POLY_IMPL(destroy_framebuffer, null_framebuffer_destroy))
@@ -0,0 +1,30 @@
+#pragma once
+
+#include "rhi_p.h"
+#include "state_diff.h"
+
+typedef struct {
+    u64 size;
+    u16 flags;
+} NullBuffer;
+
+typedef struct {
+    Walrus_Resolution resolution;
+
+    NullBuffer buffers[WR_RHI_MAX_BUFFERS];
+
+    void *uniforms[WR_RHI_MAX_UNIFORMS];
+    u32   uniform_sizes[WR_RHI_MAX_UNIFORMS];
+    u32   num_uniform_updates;
+
+    Walrus_VertexLayout vertex_layouts[WR_RHI_MAX_VERTEX_LAYOUTS];
+
+    // State deltas of the last submitted frame in submission order, so headless tests can inspect them
+    StateDelta *deltas;
+    u32         num_deltas;
+    u32         max_deltas;
+} NullRenderer;
+
+extern NullRenderer *null_renderer;
+
+POLY_DECLARE_DERIVED(Renderer, NullRenderer, null_create)
@@ -1,10 +1,13 @@
 #include <rhi/rhi.h>
 #include "rhi_p.h"
 #include "gl_renderer.h"
+#include "null_renderer.h"
 #include <core/assert.h>
 #include <core/math.h>
 #include <core/memory.h>
 #include <core/string.h>
+#include <core/atomic.h>
+#include <core/mutex.h>
 
 #include <math.h>
 #include <string.h>
@@ -48,10 +51,35 @@ static void handles_shutdown(RhiContext* ctx)
     walrus_handle_destroy(ctx->shaders);
 }
 
-static void discard(u8 flags)
+static void encoder_discard(Walrus_RhiEncoder* encoder, u8 flags)
 {
-    draw_clear(&s_ctx->draw, flags);
-    bind_clear(&s_ctx->bind, flags);
+    draw_clear(&encoder->draw, flags);
+    bind_clear(&encoder->bind, flags);
+}
+
+static void encoder_reset(Walrus_RhiEncoder* encoder)
+{
+    u32 const pos          = s_ctx->submit_frame->uniforms[encoder->uniform_idx]->pos;
+    encoder->uniform_begin = pos;
+    encoder->uniform_end   = pos;
+    encoder->bind_set      = UINT32_MAX;
+    encoder->bind_hash     = 0;
+    sortkey_reset(&encoder->key);
+    encoder->key.encoder = encoder->uniform_idx;
+    compute_clear(&encoder->compute, WR_RHI_DISCARD_ALL);
+    encoder_discard(encoder, WR_RHI_DISCARD_ALL);
+}
+
+static u32 encoder_add_bind_set(Walrus_RhiEncoder* encoder, RenderFrame* frame)
+{
+    u32 const hash = bind_hash(&encoder->bind);
+    if (encoder->bind_set != UINT32_MAX && encoder->bind_hash == hash &&
+        bind_equal(frame_get_bind_set(frame, encoder->bind_set), &encoder->bind)) {
+        return encoder->bind_set;
+    }
+    encoder->bind_set  = frame_add_bind_set(frame, &encoder->bind, hash);
+    encoder->bind_hash = hash;
+    return encoder->bind_set;
 }
 
 static void view_reset(RenderView* view)
@@ -77,19 +105,13 @@ static void view_reset(RenderView* view)
 void renderer_uniform_updates(UniformBuffer* uniform, u32 begin, u32 end)
 {
     uniform_buffer_start(uniform, begin);
-    while (uniform->pos < end) {
-        u64 op = uniform_buffer_read_value(uniform);
-        if (op == UNIFORM_BUFFER_END) {
-            break;
-        }
-
-        Walrus_UniformType   type;
-        Walrus_UniformHandle handle;
 
-        uniform_decode_op(&type, &handle.id, NULL, op);
-        u32         offset = uniform_buffer_read_value(uniform);
-        u32         size   = uniform_buffer_read_value(uniform);
-        void const* data   = uniform_buffer_read(uniform, size);
+    Walrus_UniformType   type;
+    Walrus_UniformHandle handle;
+    u32                  offset;
+    u32                  size;
+    void const*          data;
+    while (uniform->pos < end && uniform_buffer_read_uniform(uniform, &type, &handle, &offset, &size, &data)) {
         if (type < WR_RHI_UNIFORM_COUNT) {
             POLY_FUNC(s_renderer, update_uniform)(handle, offset, size, data);
         }
@@ -227,6 +249,10 @@ void renderer_create(Walrus_RhiCreateInfo const* info)
         static GlRenderer gl_renderer = {0};
         *s_renderer = gl_create(&gl_renderer, NULL);
     }
+    else if (info->flags & WR_RHI_FLAG_NULL) {
+        static NullRenderer null_renderer = {0};
+        *s_renderer = null_create(&null_renderer, NULL);
+    }
     else {
         walrus_assert_msg(false, "No render backend specifed");
     }
@@ -291,10 +317,32 @@ static void free_all_handles(RenderFrame* frame)
     queue_free(s_ctx->framebuffers, frame->queue_frame_buffer);
 }
 
+static RenderFrame* frame_next(RenderFrame* frame)
+{
+    return &s_ctx->frames[(frame - s_ctx->frames + 1) % s_ctx->num_frames];
+}
+
+// Frames beyond the second one may only be in flight between init and shutdown, both run in lock step
+static void frame_pipeline_begin(void)
+{
+    for (u8 i = 2; i < s_ctx->num_frames; ++i) {
+        render_sem_post();
+    }
+}
+
+static void frame_pipeline_end(void)
+{
+    for (u8 i = 2; i < s_ctx->num_frames; ++i) {
+        render_sem_wait(-1);
+    }
+}
+
 static void frame_swap(void)
 {
     RenderFrame* frame = s_ctx->submit_frame;
 
+    walrus_assert_msg(s_ctx->num_encoders == 0, "All encoders must be ended before the frame is swapped");
+
     frame->resolution = s_ctx->resolution;
     memcpy(frame->view_map, s_ctx->view_map, sizeof(s_ctx->view_map));
     memcpy(frame->views, s_ctx->views, sizeof(s_ctx->views));
@@ -304,20 +352,24 @@ static void frame_swap(void)
     frame_finish(frame);
 
     if (!s_ctx->info.single_thread) {
-        s_ctx->submit_frame = s_ctx->render_frame;
-        s_ctx->render_frame = frame;
+        // The next frame in the ring has been rendered, render_sem_wait guarantees it
+        s_ctx->submit_frame = frame_next(s_ctx->submit_frame);
+        s_ctx->stats        = s_ctx->submit_frame->stats;
     }
 
-    s_ctx->uniform_begin = 0;
-    s_ctx->uniform_end   = 0;
+    for (u32 i = 0; i < WR_RHI_MAX_ENCODERS; ++i) {
+        s_ctx->encoders[i].uniform_begin = 0;
+        s_ctx->encoders[i].uniform_end   = 0;
+        s_ctx->encoders[i].bind_set      = UINT32_MAX;
+        memset(s_ctx->encoders[i].seqs, 0, sizeof(s_ctx->encoders[i].seqs));
+    }
 
     if (s_ctx->info.single_thread) {
         walrus_rhi_render_frame(-1);
+        s_ctx->stats = frame->stats;
     }
 
     frame_start(s_ctx->submit_frame);
-
-    memset(s_ctx->seqs, 0, sizeof(s_ctx->seqs));
 }
 
 static void frame_no_render_wait(void)
@@ -597,10 +649,8 @@ static void destroy_transient_buffer(Walrus_TransientBuffer* buffer)
 
 static void init_resources(RhiContext* ctx)
 {
-    frame_init(ctx->submit_frame, WR_RHI_MIN_RESOURCE_COMMAND_BUFFER_SIZE, WR_RHI_MIN_TRANSIENT_BUFFER_SIZE,
-               WR_RHI_MIN_TRANSIENT_INDEX_BUFFER_SIZE);
-    if (!ctx->info.single_thread) {
-        frame_init(ctx->render_frame, WR_RHI_MIN_RESOURCE_COMMAND_BUFFER_SIZE, WR_RHI_MIN_TRANSIENT_BUFFER_SIZE,
+    for (u8 i = 0; i < ctx->num_frames; ++i) {
+        frame_init(&ctx->frames[i], WR_RHI_MIN_RESOURCE_COMMAND_BUFFER_SIZE, WR_RHI_MIN_TRANSIENT_BUFFER_SIZE,
                    WR_RHI_MIN_TRANSIENT_INDEX_BUFFER_SIZE);
     }
     if (!ctx->info.single_thread) {
@@ -627,9 +677,8 @@ static void shutdown_resources(RhiContext* ctx)
     walrus_hash_table_destroy(ctx->vertex_layout_table);
 
     handles_shutdown(ctx);
-    frame_shutdown(ctx->submit_frame);
-    if (!ctx->info.single_thread) {
-        frame_shutdown(ctx->render_frame);
+    for (u8 i = 0; i < ctx->num_frames; ++i) {
+        frame_shutdown(&ctx->frames[i]);
     }
 }
 
@@ -644,16 +693,23 @@ Walrus_RhiError walrus_rhi_init(Walrus_RhiCreateInfo* info)
     ctx->initialized  = false;
     ctx->api_sem      = NULL;
     ctx->render_sem   = NULL;
+    ctx->num_frames   = info->single_thread ? 1 : walrus_clamp(info->num_frames, 2, WR_RHI_MAX_FRAMES);
     ctx->submit_frame = &ctx->frames[0];
-    ctx->render_frame = info->single_thread ? &ctx->frames[0] : &ctx->frames[1];
-
-    ctx->uniform_begin = 0;
-    ctx->uniform_end   = 0;
+    ctx->render_frame = &ctx->frames[0];
 
     ctx->caps.instance_align = 16;
 
+    memset(&ctx->stats, 0, sizeof(ctx->stats));
+
     init_resources(ctx);
 
+    ctx->num_encoders  = 0;
+    ctx->encoder_mutex = walrus_mutex_create();
+    for (u32 i = 0; i < WR_RHI_MAX_ENCODERS; ++i) {
+        ctx->encoders[i].uniform_idx = i;
+        ctx->encoder_used[i]         = false;
+    }
+
     for (u32 i = 0; i < WR_RHI_MAX_UNIFORMS; ++i) {
         ctx->uniform_refs[i].ref_count = 0;
     }
@@ -673,7 +729,9 @@ Walrus_RhiError walrus_rhi_init(Walrus_RhiCreateInfo* info)
     }
 
     s_ctx = ctx;
-    discard(WR_RHI_DISCARD_ALL);
+    for (u32 i = 0; i < WR_RHI_MAX_ENCODERS; ++i) {
+        encoder_reset(&ctx->encoders[i]);
+    }
 
     CommandBuffer* buf = get_command_buffer(COMMAND_RENDERER_INIT);
     command_buffer_write(buf, Walrus_RhiCreateInfo, info);
@@ -688,17 +746,21 @@ Walrus_RhiError walrus_rhi_init(Walrus_RhiCreateInfo* info)
         walrus_rhi_frame();
 
         shutdown_resources(s_ctx);
+        walrus_mutex_destroy(s_ctx->encoder_mutex);
 
         return WR_RHI_INIT_ERROR;
     }
 
-    s_ctx->submit_frame->transient_vb =
-        create_transient_buffer(s_ctx->submit_frame->max_transient_vb, WR_RHI_BUFFER_NONE);
-    s_ctx->submit_frame->transient_ib =
-        create_transient_buffer(s_ctx->submit_frame->max_transient_ib, WR_RHI_BUFFER_INDEX);
-    walrus_rhi_frame();
+    Walrus_VertexLayout instance_layout;
+    walrus_vertex_layout_begin_instance(&instance_layout, 1);
+    walrus_vertex_layout_add_mat4(&instance_layout, WR_RHI_INSTANCE_MODEL_ATTRIBUTE);
+    walrus_vertex_layout_end(&instance_layout);
+    Walrus_LayoutHandle const instance_layout_handle = walrus_rhi_create_vertex_layout(&instance_layout);
+    for (u8 i = 0; i < s_ctx->num_frames; ++i) {
+        s_ctx->frames[i].instance_layout = instance_layout_handle;
+    }
 
-    if (!info->single_thread) {
+    for (u8 i = 0; i < s_ctx->num_frames; ++i) {
         s_ctx->submit_frame->transient_vb =
             create_transient_buffer(s_ctx->submit_frame->max_transient_vb, WR_RHI_BUFFER_NONE);
         s_ctx->submit_frame->transient_ib =
@@ -706,19 +768,21 @@ Walrus_RhiError walrus_rhi_init(Walrus_RhiCreateInfo* info)
         walrus_rhi_frame();
     }
 
+    frame_pipeline_begin();
+
     return s_ctx->err;
 }
 
 void walrus_rhi_shutdown(void)
 {
+    frame_pipeline_end();
+
     get_command_buffer(COMMAND_RENDERER_SHUTDOWN_BEGIN);
     walrus_rhi_frame();
 
-    destroy_transient_buffer(s_ctx->submit_frame->transient_vb);
-    destroy_transient_buffer(s_ctx->submit_frame->transient_ib);
-    walrus_rhi_frame();
+    walrus_rhi_destroy_vertex_layout(s_ctx->frames[0].instance_layout);
 
-    if (!s_ctx->info.single_thread) {
+    for (u8 i = 0; i < s_ctx->num_frames; ++i) {
         destroy_transient_buffer(s_ctx->submit_frame->transient_vb);
         destroy_transient_buffer(s_ctx->submit_frame->transient_ib);
         walrus_rhi_frame();
@@ -732,6 +796,7 @@ void walrus_rhi_shutdown(void)
     render_sem_wait(-1);  // Waiting for RenderShutdown to finish
 
     shutdown_resources(s_ctx);
+    walrus_mutex_destroy(s_ctx->encoder_mutex);
 
     walrus_free(s_ctx);
     s_ctx = NULL;
@@ -799,6 +864,7 @@ Walrus_RenderResult walrus_rhi_render_frame(i32 ms)
             }
         }
         render_exec_command(&s_ctx->render_frame->cmd_post);
+        s_ctx->render_frame = frame_next(s_ctx->render_frame);
         render_sem_post();
     }
     else {
@@ -808,59 +874,40 @@ Walrus_RenderResult walrus_rhi_render_frame(i32 ms)
     return res;
 }
 
-void walrus_rhi_touch(u16 view_id)
+void walrus_rhi_encoder_touch(Walrus_RhiEncoder* encoder, u16 view_id)
 {
-    discard(WR_RHI_DISCARD_ALL);
-    walrus_rhi_submit(view_id, (Walrus_ProgramHandle){WR_INVALID_HANDLE}, 0, WR_RHI_DISCARD_ALL);
+    encoder_discard(encoder, WR_RHI_DISCARD_ALL);
+    walrus_rhi_encoder_submit(encoder, view_id, (Walrus_ProgramHandle){WR_INVALID_HANDLE}, 0, WR_RHI_DISCARD_ALL);
 }
 
-void walrus_rhi_submit(u16 view_id, Walrus_ProgramHandle program, u32 depth, u8 flags)
+void walrus_rhi_encoder_submit(Walrus_RhiEncoder* encoder, u16 view_id, Walrus_ProgramHandle program, u32 depth,
+                               u8 flags)
 {
-    if (s_ctx->draw.num_indices == 0 || s_ctx->draw.num_vertices == 0) {
-        discard(flags);
+    if (encoder->draw.num_indices == 0 || encoder->draw.num_vertices == 0) {
+        encoder_discard(encoder, flags);
         return;
     }
     RenderFrame* frame = s_ctx->submit_frame;
 
-    u32 const render_item_id = frame->num_render_items;
-    frame->num_render_items  = walrus_min(WR_RHI_MAX_DRAW_CALLS, walrus_u32satadd(frame->num_render_items, 1));
-    if (frame->num_render_items >= WR_RHI_MAX_DRAW_CALLS) {
-        discard(flags);
+    u32 const render_item_id = frame_alloc_render_item(frame);
+    if (render_item_id >= WR_RHI_MAX_DRAW_CALLS) {
+        encoder_discard(encoder, flags);
         return;
     }
 
-    s_ctx->uniform_end        = frame->uniforms->pos;
-    s_ctx->draw.uniform_begin = s_ctx->uniform_begin;
-    s_ctx->draw.uniform_end   = s_ctx->uniform_end;
-
-    s_ctx->key.view_id = view_id;
-    s_ctx->key.program = program;
-
-    SortKeyType type;
-    switch (s_ctx->views[view_id].mode) {
-        case WR_RHI_VIEWMODE_SEQUENTIAL:
-            s_ctx->key.sequence = s_ctx->seqs[view_id]++;
-            type                = SORT_SEQUENCE;
-            break;
-        case WR_RHI_VIEWMODE_DEPTH_ASCENDING:
-            s_ctx->key.depth = depth;
-            type             = SORT_DEPTH;
-            break;
-        case WR_RHI_VIEWMODE_DEPTH_DESCENDING:
-            s_ctx->key.depth = UINT32_MAX - depth;
-            type             = SORT_DEPTH;
-            break;
-        default:
-            s_ctx->key.depth = depth;
-            type             = SORT_PROGRAM;
-            break;
+    // The item is taken first so that a full frame does not reserve streams, an item that gets none is not drawn
+    if (!frame_add_streams(frame, &encoder->draw, encoder->streams)) {
+        frame_set_render_bind(frame, render_item_id, UINT32_MAX);
+        encoder_discard(encoder, flags);
+        return;
     }
-    u64 key_val = sortkey_encode_draw(&s_ctx->key, type);
 
-    frame->sortkeys[render_item_id]   = key_val;
-    frame->sortvalues[render_item_id] = render_item_id;
+    encoder->uniform_end        = frame->uniforms[encoder->uniform_idx]->pos;
+    encoder->draw.uniform_idx   = encoder->uniform_idx;
+    encoder->draw.uniform_begin = encoder->uniform_begin;
+    encoder->draw.uniform_end   = encoder->uniform_end;
 
-    u16 stream_mask = s_ctx->draw.stream_mask;
+    u16 stream_mask = encoder->draw.stream_mask;
     if (stream_mask != UINT16_MAX) {
         u32 num_vertices = UINT32_MAX;
 
@@ -869,63 +916,102 @@ void walrus_rhi_submit(u16 view_id, Walrus_ProgramHandle program, u32 depth, u8
             stream_mask >>= ntz;
             id += ntz;
 
-            num_vertices = walrus_min(num_vertices, s_ctx->num_vertices[id]);
+            num_vertices = walrus_min(num_vertices, encoder->num_vertices[id]);
         }
-        s_ctx->draw.num_vertices = num_vertices;
+        encoder->draw.num_vertices = num_vertices;
     }
     else {
         // set_vertex_count
-        s_ctx->draw.num_vertices = s_ctx->num_vertices[0];
+        encoder->draw.num_vertices = encoder->num_vertices[0];
+    }
+
+    u32 const bind_set = encoder_add_bind_set(encoder, frame);
+    if (bind_set == UINT32_MAX) {
+        frame_set_render_bind(frame, render_item_id, UINT32_MAX);
+        encoder_discard(encoder, flags);
+        return;
+    }
+
+    encoder->key.view_id = view_id;
+    encoder->key.program = program;
+
+    SortKeyType type;
+    switch (s_ctx->views[view_id].mode) {
+        case WR_RHI_VIEWMODE_SEQUENTIAL:
+            encoder->key.sequence = encoder->seqs[view_id]++;
+            type                  = SORT_SEQUENCE;
+            break;
+        case WR_RHI_VIEWMODE_DEPTH_ASCENDING:
+            encoder->key.depth = depth;
+            type               = SORT_DEPTH;
+            break;
+        case WR_RHI_VIEWMODE_DEPTH_DESCENDING:
+            encoder->key.depth = UINT32_MAX - depth;
+            type               = SORT_DEPTH;
+            break;
+        case WR_RHI_VIEWMODE_INSTANCING: {
+            // Draws that can be merged get the same key so they end up adjacent, the depth is ignored
+            u32 const hash     = draw_instance_hash(frame, &encoder->draw, bind_set);
+            encoder->key.depth = (hash ^ (hash >> 16)) & UINT16_MAX;
+            type               = SORT_PROGRAM;
+        } break;
+        default:
+            encoder->key.depth = depth;
+            type               = SORT_PROGRAM;
+            break;
     }
+    u64 key_val = sortkey_encode_draw(&encoder->key, type);
+
+    frame_set_sortkey(frame, render_item_id, key_val);
 
-    frame->render_items[render_item_id].draw = s_ctx->draw;
-    frame->render_binds[render_item_id]      = s_ctx->bind;
+    frame_get_render_item(frame, render_item_id)->draw = encoder->draw;
+    frame_set_render_bind(frame, render_item_id, bind_set);
 
-    draw_clear(&s_ctx->draw, flags);
-    bind_clear(&s_ctx->bind, flags);
+    draw_clear(&encoder->draw, flags);
+    bind_clear(&encoder->bind, flags);
 
     if (flags & WR_RHI_DISCARD_STATE) {
-        s_ctx->uniform_begin = s_ctx->uniform_end;
+        encoder->uniform_begin = encoder->uniform_end;
     }
 }
 
-void walrus_rhi_dispatch(u16 view_id, Walrus_ProgramHandle program, u32 num_x, u32 num_y, u32 num_z, u8 flags)
+void walrus_rhi_encoder_dispatch(Walrus_RhiEncoder* encoder, u16 view_id, Walrus_ProgramHandle program, u32 num_x,
+                                 u32 num_y, u32 num_z, u8 flags)
 {
-    RenderFrame*   frame          = s_ctx->submit_frame;
-    const uint32_t render_item_id = frame->num_render_items;
-    frame->num_render_items       = walrus_min(walrus_u32satadd(frame->num_render_items, 1), WR_RHI_MAX_DRAW_CALLS);
+    RenderFrame* frame          = s_ctx->submit_frame;
+    u32 const    render_item_id = frame_alloc_render_item(frame);
     if (WR_RHI_MAX_DRAW_CALLS <= render_item_id) {
-        discard(flags);
+        encoder_discard(encoder, flags);
         return;
     }
 
-    s_ctx->uniform_end           = frame->uniforms->pos;
-    s_ctx->compute.uniform_begin = s_ctx->uniform_begin;
-    s_ctx->compute.uniform_end   = s_ctx->uniform_end;
-    s_ctx->compute.start_matrix  = s_ctx->draw.start_matrix;
-    s_ctx->compute.num_matrices  = s_ctx->draw.num_matrices;
-    s_ctx->compute.num_x         = walrus_max(num_x, 1);
-    s_ctx->compute.num_y         = walrus_max(num_y, 1);
-    s_ctx->compute.num_z         = walrus_max(num_z, 1);
+    encoder->uniform_end           = frame->uniforms[encoder->uniform_idx]->pos;
+    encoder->compute.uniform_idx   = encoder->uniform_idx;
+    encoder->compute.uniform_begin = encoder->uniform_begin;
+    encoder->compute.uniform_end   = encoder->uniform_end;
+    encoder->compute.start_matrix  = encoder->draw.start_matrix;
+    encoder->compute.num_matrices  = encoder->draw.num_matrices;
+    encoder->compute.num_x         = walrus_max(num_x, 1);
+    encoder->compute.num_y         = walrus_max(num_y, 1);
+    encoder->compute.num_z         = walrus_max(num_z, 1);
 
-    s_ctx->key.view_id  = view_id;
-    s_ctx->key.program  = program;
-    s_ctx->key.depth    = 0;
-    s_ctx->key.sequence = s_ctx->seqs[view_id]++;
+    encoder->key.view_id  = view_id;
+    encoder->key.program  = program;
+    encoder->key.depth    = 0;
+    encoder->key.sequence = encoder->seqs[view_id]++;
 
-    u64 key_val                       = sortkey_encode_compute(&s_ctx->key);
-    frame->sortkeys[render_item_id]   = key_val;
-    frame->sortvalues[render_item_id] = render_item_id;
+    u64 key_val = sortkey_encode_compute(&encoder->key);
+    frame_set_sortkey(frame, render_item_id, key_val);
 
-    frame->render_items[render_item_id].compute = s_ctx->compute;
-    frame->render_binds[render_item_id]         = s_ctx->bind;
+    frame_get_render_item(frame, render_item_id)->compute = encoder->compute;
+    frame_set_render_bind(frame, render_item_id, encoder_add_bind_set(encoder, frame));
 
-    compute_clear(&s_ctx->compute, flags);
-    bind_clear(&s_ctx->bind, flags);
-    s_ctx->uniform_begin = s_ctx->uniform_end;
+    compute_clear(&encoder->compute, flags);
+    bind_clear(&encoder->bind, flags);
+    encoder->uniform_begin = encoder->uniform_end;
 }
 
-void walrus_rhi_set_state(u64 state, u32 rgba)
+void walrus_rhi_encoder_set_state(Walrus_RhiEncoder* encoder, u64 state, u32 rgba)
 {
     u8 const blend = ((state & WR_RHI_STATE_BLEND_MASK) >> WR_RHI_STATE_BLEND_SHIFT) & 0xff;
 
@@ -946,19 +1032,19 @@ void walrus_rhi_set_state(u64 state, u32 rgba)
     //                            |  |  |  |  |  |  |  |  |  |  |  |  +----- WR_RHI_STATE_BLEND_INV_FACTOR
     //                            |  |  |  |  |  |  |  |  |  |  |  |  |
     //                            x  |  |  |  |  |  |  |  |  |  |  |  |  |  x  x  x  x  x
-    s_ctx->key.blend         = "\x0\x2\x2\x3\x3\x2\x3\x2\x3\x2\x2\x2\x2\x2\x2\x2\x2\x2\x2"[((blend)&0xf) + (!!blend)];
-    s_ctx->draw.state_flags  = state;
-    s_ctx->draw.blend_factor = rgba;
+    encoder->key.blend = "\x0\x2\x2\x3\x3\x2\x3\x2\x3\x2\x2\x2\x2\x2\x2\x2\x2\x2\x2"[((blend)&0xf) + (!!blend)];
+    encoder->draw.state_flags  = state;
+    encoder->draw.blend_factor = rgba;
 }
 
-void walrus_rhi_set_stencil(u32 fstencil, u32 bstencil)
+void walrus_rhi_encoder_set_stencil(Walrus_RhiEncoder* encoder, u32 fstencil, u32 bstencil)
 {
-    s_ctx->draw.stencil = pack_stencil(fstencil, bstencil);
+    encoder->draw.stencil = pack_stencil(fstencil, bstencil);
 }
 
-void walrus_rhi_set_scissor(i32 x, i32 y, u32 width, u32 height)
+void walrus_rhi_encoder_set_scissor(Walrus_RhiEncoder* encoder, i32 x, i32 y, u32 width, u32 height)
 {
-    s_ctx->draw.scissor = (ViewRect){x, y, width, height};
+    encoder->draw.scissor = (ViewRect){x, y, width, height};
 }
 
 void walrus_rhi_set_view_rect(u16 view_id, i32 x, i32 y, u32 width, u32 height)
@@ -1061,11 +1147,11 @@ void walrus_rhi_screen_to_world_dir(u16 view_id, vec2 const screen, vec3 world_d
     glm_vec3_normalize(world_dir);
 }
 
-void walrus_rhi_set_transform(mat4 const transform)
+void walrus_rhi_encoder_set_transform(Walrus_RhiEncoder* encoder, mat4 const transform)
 {
-    u32 num                  = 1;
-    s_ctx->draw.start_matrix = frame_add_matrices(s_ctx->submit_frame, transform, &num);
-    s_ctx->draw.num_matrices = num;
+    u32 num                    = 1;
+    encoder->draw.start_matrix = frame_add_matrices(s_ctx->submit_frame, transform, &num);
+    encoder->draw.num_matrices = num;
 }
 
 static void shader_inc_ref(Walrus_ShaderHandle handle)
@@ -1264,12 +1350,13 @@ void walrus_rhi_destroy_uniform(Walrus_UniformHandle handle)
     }
 }
 
-void walrus_rhi_set_uniform(Walrus_UniformHandle handle, u32 offset, u32 size, void const* data)
+void walrus_rhi_encoder_set_uniform(Walrus_RhiEncoder* encoder, Walrus_UniformHandle handle, u32 offset, u32 size,
+                                    void const* data)
 {
     UniformRef* ref = &s_ctx->uniform_refs[handle.id];
     if (ref->ref_count > 0) {
-        uniform_buffer_update(&s_ctx->submit_frame->uniforms, 64 << 10, 1 << 20);
-        uniform_buffer_write_uniform(s_ctx->submit_frame->uniforms, ref->type, handle, offset, size, data);
+        UniformBuffer* uniforms = s_ctx->submit_frame->uniforms[encoder->uniform_idx];
+        uniform_buffer_write_uniform(uniforms, encoder->uniform_begin, ref->type, handle, offset, size, data);
     }
     else {
         walrus_error("Cannot find valid uniform!");
@@ -1389,101 +1476,115 @@ static bool set_stream_bit(RenderDraw* draw, u8 stream, Walrus_BufferHandle hand
     return tmp != 0;
 }
 
-void walrus_rhi_set_vertex_count(u32 num_vertices)
+void walrus_rhi_encoder_set_vertex_count(Walrus_RhiEncoder* encoder, u32 num_vertices)
 {
-    walrus_assert_msg(0 == s_ctx->draw.stream_mask, "set_vertex_buffer was already called for this draw call.");
-    s_ctx->draw.stream_mask  = UINT16_MAX;
-    VertexStream* stream     = &s_ctx->draw.streams[0];
-    stream->offset           = 0;
-    stream->handle.id        = WR_INVALID_HANDLE;
-    stream->layout_handle.id = WR_INVALID_HANDLE;
-    s_ctx->num_vertices[0]   = num_vertices;
+    walrus_assert_msg(0 == encoder->draw.stream_mask, "set_vertex_buffer was already called for this draw call.");
+    encoder->draw.stream_mask = UINT16_MAX;
+    encoder->num_vertices[0]  = num_vertices;
 }
 
-void walrus_rhi_set_vertex_buffer(u8 stream_id, Walrus_BufferHandle handle, Walrus_LayoutHandle layout_handle,
-                                  u32 offset, u32 num_vertices)
+void walrus_rhi_encoder_set_vertex_buffer(Walrus_RhiEncoder* encoder, u8 stream_id, Walrus_BufferHandle handle,
+                                          Walrus_LayoutHandle layout_handle, u32 offset, u32 num_vertices)
 {
     walrus_assert(handle.id != WR_INVALID_HANDLE);
-    if (set_stream_bit(&s_ctx->draw, stream_id, handle)) {
-        VertexStream* stream           = &s_ctx->draw.streams[stream_id];
-        stream->offset                 = offset;
-        stream->handle                 = handle;
-        stream->layout_handle          = layout_handle;
-        s_ctx->num_vertices[stream_id] = num_vertices;
+    if (set_stream_bit(&encoder->draw, stream_id, handle)) {
+        VertexStream* stream             = &encoder->streams[stream_id];
+        stream->offset                   = offset;
+        stream->handle                   = handle;
+        stream->layout_handle            = layout_handle;
+        encoder->num_vertices[stream_id] = num_vertices;
     }
 }
 
-void walrus_rhi_set_transient_vertex_buffer(u8 stream_id, Walrus_TransientBuffer* buffer,
-                                            Walrus_LayoutHandle layout_handle, u32 offset, u32 num_vertices)
+void walrus_rhi_encoder_set_transient_vertex_buffer(Walrus_RhiEncoder* encoder, u8 stream_id,
+                                                    Walrus_TransientBuffer* buffer, Walrus_LayoutHandle layout_handle,
+                                                    u32 offset, u32 num_vertices)
 {
     walrus_assert(buffer->handle.id != WR_INVALID_HANDLE);
-    if (set_stream_bit(&s_ctx->draw, stream_id, buffer->handle)) {
-        VertexStream* stream           = &s_ctx->draw.streams[stream_id];
-        stream->offset                 = offset + buffer->offset;
-        stream->handle                 = buffer->handle;
-        stream->layout_handle          = layout_handle;
-        s_ctx->num_vertices[stream_id] = walrus_clamp(0, (buffer->size - offset) / buffer->stride, num_vertices);
+    if (set_stream_bit(&encoder->draw, stream_id, buffer->handle)) {
+        VertexStream* stream             = &encoder->streams[stream_id];
+        stream->offset                   = offset + buffer->offset;
+        stream->handle                   = buffer->handle;
+        stream->layout_handle            = layout_handle;
+        encoder->num_vertices[stream_id] = walrus_clamp(0, (buffer->size - offset) / buffer->stride, num_vertices);
     }
 }
-void walrus_rhi_set_instance_buffer(Walrus_BufferHandle handle, Walrus_LayoutHandle layout_handle, u32 offset,
-                                    u32 num_instance)
+void walrus_rhi_encoder_set_instance_buffer(Walrus_RhiEncoder* encoder, Walrus_BufferHandle handle,
+                                            Walrus_LayoutHandle layout_handle, u32 offset, u32 num_instance)
 {
     walrus_assert(handle.id != WR_INVALID_HANDLE);
 
-    s_ctx->draw.instance_buffer = handle;
-    s_ctx->draw.instance_layout = layout_handle;
-    s_ctx->draw.instance_offset = offset;
-    s_ctx->draw.num_instances   = num_instance;
+    encoder->draw.instance_buffer = handle;
+    encoder->draw.instance_layout = layout_handle;
+    encoder->draw.instance_offset = offset;
+    encoder->draw.num_instances   = num_instance;
 }
 
-void walrus_rhi_set_transient_instance_buffer(Walrus_TransientBuffer* buffer, Walrus_LayoutHandle layout_handle,
-                                              u32 offset, u32 num_instance)
+void walrus_rhi_encoder_set_transient_instance_buffer(Walrus_RhiEncoder* encoder, Walrus_TransientBuffer* buffer,
+                                                      Walrus_LayoutHandle layout_handle, u32 offset, u32 num_instance)
 {
     walrus_assert(buffer->handle.id != WR_INVALID_HANDLE);
 
-    s_ctx->draw.instance_buffer = buffer->handle;
-    s_ctx->draw.instance_layout = layout_handle;
-    s_ctx->draw.instance_offset = offset + buffer->offset;
-    s_ctx->draw.num_instances   = walrus_clamp(0, (buffer->size - offset) / buffer->stride, num_instance);
+    encoder->draw.instance_buffer = buffer->handle;
+    encoder->draw.instance_layout = layout_handle;
+    encoder->draw.instance_offset = offset + buffer->offset;
+    encoder->draw.num_instances   = walrus_clamp(0, (buffer->size - offset) / buffer->stride, num_instance);
 }
 
-void walrus_rhi_set_index_buffer(Walrus_BufferHandle handle, u32 offset, u32 num_indices)
+void walrus_rhi_encoder_set_index_buffer(Walrus_RhiEncoder* encoder, Walrus_BufferHandle handle, u32 offset,
+                                         u32 num_indices)
 {
     walrus_assert(handle.id != WR_INVALID_HANDLE);
 
-    s_ctx->draw.index_buffer = handle;
-    s_ctx->draw.index_size   = sizeof(u16);
-    s_ctx->draw.index_offset = offset;
-    s_ctx->draw.num_indices  = num_indices;
+    encoder->draw.index_buffer = handle;
+    encoder->draw.index_size   = sizeof(u16);
+    encoder->draw.index_offset = offset;
+    encoder->draw.num_indices  = num_indices;
 }
 
-void walrus_rhi_set_index32_buffer(Walrus_BufferHandle handle, u32 offset, u32 num_indices)
+void walrus_rhi_encoder_set_index32_buffer(Walrus_RhiEncoder* encoder, Walrus_BufferHandle handle, u32 offset,
+                                           u32 num_indices)
 {
     walrus_assert(handle.id != WR_INVALID_HANDLE);
 
-    s_ctx->draw.index_buffer = handle;
-    s_ctx->draw.index_size   = sizeof(u32);
-    s_ctx->draw.index_offset = offset;
-    s_ctx->draw.num_indices  = num_indices;
+    encoder->draw.index_buffer = handle;
+    encoder->draw.index_size   = sizeof(u32);
+    encoder->draw.index_offset = offset;
+    encoder->draw.num_indices  = num_indices;
 }
 
-void walrus_rhi_set_transient_index_buffer(Walrus_TransientBuffer* buffer, u32 offset, u32 num_indices)
+void walrus_rhi_encoder_set_transient_index_buffer(Walrus_RhiEncoder* encoder, Walrus_TransientBuffer* buffer,
+                                                   u32 offset, u32 num_indices)
 {
     walrus_assert(buffer);
     walrus_assert(buffer->handle.id != WR_INVALID_HANDLE);
 
-    s_ctx->draw.index_buffer = buffer->handle;
-    s_ctx->draw.index_size   = buffer->stride;
-    s_ctx->draw.index_offset = offset + buffer->offset;
-    s_ctx->draw.num_indices  = walrus_clamp(0, (buffer->size - offset) / buffer->stride, num_indices);
+    encoder->draw.index_buffer = buffer->handle;
+    encoder->draw.index_size   = buffer->stride;
+    encoder->draw.index_offset = offset + buffer->offset;
+    encoder->draw.num_indices  = walrus_clamp(0, (buffer->size - offset) / buffer->stride, num_indices);
 }
 
-void walrus_rhi_set_transient_buffer(u8 binding, Walrus_TransientBuffer const* buffer)
+void walrus_rhi_encoder_set_transient_buffer(Walrus_RhiEncoder* encoder, u8 binding,
+                                             Walrus_TransientBuffer const* buffer)
 {
-    BlockBinding* block = &s_ctx->bind.block_bindings[binding];
+    BlockBinding* block = &encoder->bind.block_bindings[binding];
     block->handle       = buffer->handle;
     block->offset       = buffer->offset;
     block->size         = buffer->size;
+    encoder->bind.block_mask |= 1 << binding;
+}
+
+void walrus_rhi_encoder_set_block_buffer(Walrus_RhiEncoder* encoder, u8 binding, Walrus_BufferHandle handle,
+                                         u32 offset, u32 size)
+{
+    walrus_assert(handle.id != WR_INVALID_HANDLE);
+
+    BlockBinding* block = &encoder->bind.block_bindings[binding];
+    block->handle       = handle;
+    block->offset       = offset;
+    block->size         = size;
+    encoder->bind.block_mask |= 1 << binding;
 }
 
 Walrus_TextureHandle walrus_rhi_create_texture(Walrus_TextureCreateInfo const* info, void const* data)
@@ -1592,27 +1693,29 @@ void walrus_rhi_destroy_texture(Walrus_TextureHandle handle)
     texture_dec_ref(handle);
 }
 
-void walrus_rhi_set_texture(u8 unit, Walrus_TextureHandle texture)
+void walrus_rhi_encoder_set_texture(Walrus_RhiEncoder* encoder, u8 unit, Walrus_TextureHandle texture)
 {
     if (unit >= s_ctx->caps.max_texture_unit) {
         s_ctx->err = WR_RHI_TEXTURE_UNIT_ERROR;
         return;
     }
 
-    Binding* bind = &s_ctx->bind.bindings[unit];
+    Binding* bind = &encoder->bind.bindings[unit];
     bind->type    = WR_RHI_BIND_TEXTURE;
     bind->id      = texture.id;
+    encoder->bind.binding_mask |= 1u << unit;
 }
 
-void walrus_rhi_set_image(uint8_t unit, Walrus_TextureHandle handle, u8 mip, Walrus_DataAccess access,
-                          Walrus_PixelFormat format)
+void walrus_rhi_encoder_set_image(Walrus_RhiEncoder* encoder, uint8_t unit, Walrus_TextureHandle handle, u8 mip,
+                                  Walrus_DataAccess access, Walrus_PixelFormat format)
 {
-    Binding* bind = &s_ctx->bind.bindings[unit];
+    Binding* bind = &encoder->bind.bindings[unit];
     bind->type    = WR_RHI_BIND_IMAGE;
     bind->id      = handle.id;
     bind->mip     = (uint8_t)(mip);
     bind->format  = format;
     bind->access  = (uint8_t)(access);
+    encoder->bind.binding_mask |= 1u << unit;
 }
 
 u32 walrus_rhi_avail_transient_buffer(u32 num, u32 stride, u32 align)
@@ -1622,6 +1725,8 @@ u32 walrus_rhi_avail_transient_buffer(u32 num, u32 stride, u32 align)
 
 bool walrus_rhi_alloc_transient_buffer(Walrus_TransientBuffer* buffer, u32 num, u32 stride, u32 align)
 {
+    bool succ = false;
+    walrus_mutex_lock(s_ctx->encoder_mutex);
     if (num == walrus_rhi_avail_transient_buffer(num, stride, align)) {
         walrus_assert_msg(buffer != NULL, "buffer can't be NULL!");
         walrus_assert_msg(num > 0, "num must be greater than 0!");
@@ -1634,9 +1739,11 @@ bool walrus_rhi_alloc_transient_buffer(Walrus_TransientBuffer* buffer, u32 num,
         buffer->offset                    = offset;
         buffer->stride                    = stride;
         buffer->handle                    = tvb->handle;
-        return true;
+        succ                              = true;
     }
-    return false;
+    walrus_mutex_unlock(s_ctx->encoder_mutex);
+
+    return succ;
 }
 
 u32 walrus_rhi_avail_transient_index_buffer(u32 num, u32 stride)
@@ -1646,6 +1753,8 @@ u32 walrus_rhi_avail_transient_index_buffer(u32 num, u32 stride)
 
 bool walrus_rhi_alloc_transient_index_buffer(Walrus_TransientBuffer* buffer, u32 num, u32 stride)
 {
+    bool succ = false;
+    walrus_mutex_lock(s_ctx->encoder_mutex);
     if (num == walrus_rhi_avail_transient_index_buffer(num, stride)) {
         walrus_assert_msg(buffer != NULL, "buffer can't be NULL!");
         walrus_assert_msg(num > 0, "num must be greater than 0!");
@@ -1658,9 +1767,11 @@ bool walrus_rhi_alloc_transient_index_buffer(Walrus_TransientBuffer* buffer, u32
         buffer->offset                    = offset;
         buffer->stride                    = stride;
         buffer->handle                    = tib->handle;
-        return true;
+        succ                              = true;
     }
-    return false;
+    walrus_mutex_unlock(s_ctx->encoder_mutex);
+
+    return succ;
 }
 
 Walrus_FramebufferHandle walrus_rhi_create_framebuffer(Walrus_Attachment* attachments, u8 num)
@@ -1719,7 +1830,158 @@ Walrus_RhiCapabilities const* walrus_rhi_get_caps(void)
     return &s_ctx->caps;
 }
 
+Walrus_RhiStats const* walrus_rhi_get_stats(void)
+{
+    return &s_ctx->stats;
+}
+
 void walrus_rhi_set_debug(u16 debug)
 {
     s_ctx->submit_frame->debug_flags = debug;
 }
+
+Walrus_RhiEncoder* walrus_rhi_begin_encoder(void)
+{
+    Walrus_RhiEncoder* encoder = NULL;
+
+    walrus_mutex_lock(s_ctx->encoder_mutex);
+    for (u32 i = 1; i < WR_RHI_MAX_ENCODERS; ++i) {
+        if (!s_ctx->encoder_used[i]) {
+            s_ctx->encoder_used[i] = true;
+            ++s_ctx->num_encoders;
+            encoder = &s_ctx->encoders[i];
+            break;
+        }
+    }
+    walrus_mutex_unlock(s_ctx->encoder_mutex);
+
+    if (encoder == NULL) {
+        s_ctx->err = WR_RHI_ALLOC_ERROR;
+        return NULL;
+    }
+
+    encoder_reset(encoder);
+
+    return encoder;
+}
+
+Walrus_RhiEncoder* walrus_rhi_immediate_encoder(void)
+{
+    return &s_ctx->encoders[0];
+}
+
+void walrus_rhi_end_encoder(Walrus_RhiEncoder* encoder)
+{
+    walrus_assert(encoder != &s_ctx->encoders[0]);
+
+    walrus_mutex_lock(s_ctx->encoder_mutex);
+    s_ctx->encoder_used[encoder->uniform_idx] = false;
+    --s_ctx->num_encoders;
+    walrus_mutex_unlock(s_ctx->encoder_mutex);
+}
+
+void walrus_rhi_touch(u16 view_id)
+{
+    walrus_rhi_encoder_touch(&s_ctx->encoders[0], view_id);
+}
+
+void walrus_rhi_submit(u16 view_id, Walrus_ProgramHandle program, u32 depth, u8 flags)
+{
+    walrus_rhi_encoder_submit(&s_ctx->encoders[0], view_id, program, depth, flags);
+}
+
+void walrus_rhi_dispatch(u16 view_id, Walrus_ProgramHandle program, u32 num_x, u32 num_y, u32 num_z, u8 flags)
+{
+    walrus_rhi_encoder_dispatch(&s_ctx->encoders[0], view_id, program, num_x, num_y, num_z, flags);
+}
+
+void walrus_rhi_set_state(u64 state, u32 rgba)
+{
+    walrus_rhi_encoder_set_state(&s_ctx->encoders[0], state, rgba);
+}
+
+void walrus_rhi_set_stencil(u32 fstencil, u32 bstencil)
+{
+    walrus_rhi_encoder_set_stencil(&s_ctx->encoders[0], fstencil, bstencil);
+}
+
+void walrus_rhi_set_scissor(i32 x, i32 y, u32 width, u32 height)
+{
+    walrus_rhi_encoder_set_scissor(&s_ctx->encoders[0], x, y, width, height);
+}
+
+void walrus_rhi_set_transform(mat4 const transform)
+{
+    walrus_rhi_encoder_set_transform(&s_ctx->encoders[0], transform);
+}
+
+void walrus_rhi_set_uniform(Walrus_UniformHandle handle, u32 offset, u32 size, void const* data)
+{
+    walrus_rhi_encoder_set_uniform(&s_ctx->encoders[0], handle, offset, size, data);
+}
+
+void walrus_rhi_set_vertex_count(u32 num_vertices)
+{
+    walrus_rhi_encoder_set_vertex_count(&s_ctx->encoders[0], num_vertices);
+}
+
+void walrus_rhi_set_vertex_buffer(u8 stream_id, Walrus_BufferHandle handle, Walrus_LayoutHandle layout_handle,
+                                  u32 offset, u32 num_vertices)
+{
+    walrus_rhi_encoder_set_vertex_buffer(&s_ctx->encoders[0], stream_id, handle, layout_handle, offset, num_vertices);
+}
+
+void walrus_rhi_set_transient_vertex_buffer(u8 stream_id, Walrus_TransientBuffer* buffer,
+                                            Walrus_LayoutHandle layout_handle, u32 offset, u32 num_vertices)
+{
+    walrus_rhi_encoder_set_transient_vertex_buffer(&s_ctx->encoders[0], stream_id, buffer, layout_handle, offset,
+                                                   num_vertices);
+}
+
+void walrus_rhi_set_instance_buffer(Walrus_BufferHandle handle, Walrus_LayoutHandle layout_handle, u32 offset,
+                                    u32 num_instance)
+{
+    walrus_rhi_encoder_set_instance_buffer(&s_ctx->encoders[0], handle, layout_handle, offset, num_instance);
+}
+
+void walrus_rhi_set_transient_instance_buffer(Walrus_TransientBuffer* buffer, Walrus_LayoutHandle layout_handle,
+                                              u32 offset, u32 num_instance)
+{
+    walrus_rhi_encoder_set_transient_instance_buffer(&s_ctx->encoders[0], buffer, layout_handle, offset, num_instance);
+}
+
+void walrus_rhi_set_index_buffer(Walrus_BufferHandle handle, u32 offset, u32 num_indices)
+{
+    walrus_rhi_encoder_set_index_buffer(&s_ctx->encoders[0], handle, offset, num_indices);
+}
+
+void walrus_rhi_set_index32_buffer(Walrus_BufferHandle handle, u32 offset, u32 num_indices)
+{
+    walrus_rhi_encoder_set_index32_buffer(&s_ctx->encoders[0], handle, offset, num_indices);
+}
+
+void walrus_rhi_set_transient_index_buffer(Walrus_TransientBuffer* buffer, u32 offset, u32 num_indices)
+{
+    walrus_rhi_encoder_set_transient_index_buffer(&s_ctx->encoders[0], buffer, offset, num_indices);
+}
+
+void walrus_rhi_set_transient_buffer(u8 binding, Walrus_TransientBuffer const* buffer)
+{
+    walrus_rhi_encoder_set_transient_buffer(&s_ctx->encoders[0], binding, buffer);
+}
+
+void walrus_rhi_set_block_buffer(u8 binding, Walrus_BufferHandle handle, u32 offset, u32 size)
+{
+    walrus_rhi_encoder_set_block_buffer(&s_ctx->encoders[0], binding, handle, offset, size);
+}
+
+void walrus_rhi_set_texture(u8 unit, Walrus_TextureHandle texture)
+{
+    walrus_rhi_encoder_set_texture(&s_ctx->encoders[0], unit, texture);
+}
+
+void walrus_rhi_set_image(uint8_t unit, Walrus_TextureHandle handle, u8 mip, Walrus_DataAccess access,
+                          Walrus_PixelFormat format)
+{
+    walrus_rhi_encoder_set_image(&s_ctx->encoders[0], unit, handle, mip, access, format);
+}
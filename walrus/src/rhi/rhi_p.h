@@ -2,6 +2,7 @@
 
 #include <core/hash.h>
 #include <core/semaphore.h>
+#include <core/mutex.h>
 #include <core/cpoly.h>
 
 #include "frame.h"
@@ -87,6 +88,27 @@ typedef struct {
     Walrus_TextureHandle th[WR_RHI_MAX_FRAMEBUFFER_ATTACHMENTS];
 } FramebufferRef;
 
+struct Walrus_RhiEncoder {
+    RenderDraw    draw;
+    RenderCompute compute;
+    RenderBind    bind;
+    Sortkey       key;
+
+    VertexStream streams[WR_RHI_MAX_VERTEX_STREAM];
+    u32          num_vertices[WR_RHI_MAX_VERTEX_STREAM];
+
+    // Last bind set added to the submit frame, consecutive draws usually share it
+    u32 bind_set;
+    u32 bind_hash;
+
+    // Next sequence in each view for this frame, kept by the encoder so that no other encoder changes its order
+    u16 seqs[WR_RHI_MAX_VIEWS];
+
+    u32 uniform_begin;
+    u32 uniform_end;
+    u8  uniform_idx;
+};
+
 typedef struct {
     bool initialized;
     bool exit;
@@ -94,27 +116,26 @@ typedef struct {
     Walrus_RhiCreateInfo info;
 
     Walrus_RhiCapabilities caps;
+    Walrus_RhiStats        stats;
 
     Walrus_Semaphore *api_sem;
     Walrus_Semaphore *render_sem;
 
     Walrus_Resolution resolution;
 
-    RenderDraw    draw;
-    RenderCompute compute;
-    RenderBind    bind;
+    Walrus_RhiEncoder encoders[WR_RHI_MAX_ENCODERS];
+    bool              encoder_used[WR_RHI_MAX_ENCODERS];
+    u32               num_encoders;
+    Walrus_Mutex     *encoder_mutex;
 
-    Sortkey      key;
-    RenderFrame  frames[2];
+    RenderFrame  frames[WR_RHI_MAX_FRAMES];
+    u8           num_frames;
     RenderFrame *submit_frame;
     RenderFrame *render_frame;
 
     RenderView views[WR_RHI_MAX_VIEWS];
-    u32        seqs[WR_RHI_MAX_VIEWS];
     u16        view_map[WR_RHI_MAX_VIEWS];
 
-    u32 num_vertices[WR_RHI_MAX_VERTEX_STREAM];
-
     Walrus_HandleAlloc *shaders;
     Walrus_HandleAlloc *programs;
     Walrus_HashTable   *shader_map;
@@ -132,8 +153,6 @@ typedef struct {
     FramebufferRef      fb_refs[WR_RHI_MAX_FRAMEBUFFERS];
 
     Walrus_HashTable *uniform_map;
-    u32               uniform_begin;
-    u32               uniform_end;
 
     VertexLayoutRef   vertex_layout_ref[WR_RHI_MAX_VERTEX_LAYOUTS];
     Walrus_HashTable *vertex_layout_table;
@@ -0,0 +1,214 @@
+#include "state_diff.h"
+#include "rhi_p.h"
+
+#include <core/math.h>
+
+#include <string.h>
+
+// Fixed function categories and the state bits they are derived from
+static u64 const s_flag_masks[] = {
+    WR_RHI_STATE_BLEND_MASK,                             // STATE_DIRTY_BLEND
+    0,                                                   // STATE_DIRTY_BLEND_FACTOR
+    WR_RHI_STATE_DEPTH_TEST_MASK | WR_RHI_STATE_WRITE_Z, // STATE_DIRTY_DEPTH
+    WR_RHI_STATE_WRITE_MASK,                             // STATE_DIRTY_WRITE
+    WR_RHI_STATE_CULL_MASK,                              // STATE_DIRTY_CULL
+    0,                                                   // STATE_DIRTY_STENCIL
+    WR_RHI_STATE_DRAW_MASK,                              // STATE_DIRTY_PRIMITIVE
+};
+
+static bool blend_uses_factor(u64 state_flags)
+{
+    u32 const blend = (u32)((state_flags & WR_RHI_STATE_BLEND_MASK) >> WR_RHI_STATE_BLEND_SHIFT);
+    for (u32 i = 0; i < 4; ++i) {
+        u64 const factor = (u64)((blend >> (i * 4)) & 0xf) << WR_RHI_STATE_BLEND_SHIFT;
+        if (factor == WR_RHI_STATE_BLEND_FACTOR || factor == WR_RHI_STATE_BLEND_INV_FACTOR) {
+            return true;
+        }
+    }
+    return false;
+}
+
+static bool binding_equal(Binding const *lhs, Binding const *rhs)
+{
+    return lhs->id == rhs->id && lhs->type == rhs->type && lhs->sampler_flags == rhs->sampler_flags &&
+           lhs->format == rhs->format && lhs->access == rhs->access && lhs->mip == rhs->mip;
+}
+
+static bool block_binding_equal(BlockBinding const *lhs, BlockBinding const *rhs)
+{
+    return lhs->handle.id == rhs->handle.id && lhs->offset == rhs->offset && lhs->size == rhs->size;
+}
+
+static bool stream_equal(VertexStream const *lhs, VertexStream const *rhs)
+{
+    return lhs->handle.id == rhs->handle.id && lhs->layout_handle.id == rhs->layout_handle.id &&
+           lhs->offset == rhs->offset;
+}
+
+static u32 diff_textures(StateCache const *cache, RenderBind const *bind)
+{
+    bool const force = cache->invalid & STATE_DIRTY_TEXTURES || cache->bind == NULL;
+
+    u32 mask = 0;
+    for (u32 unit = 0, bits = bind->binding_mask; bits != 0; bits >>= 1, ++unit) {
+        u32 const ntz = walrus_u32cnttz(bits);
+        bits >>= ntz;
+        unit += ntz;
+
+        Binding const *binding = &bind->bindings[unit];
+        if (binding->id != WR_INVALID_HANDLE && (force || !binding_equal(binding, &cache->bind->bindings[unit]))) {
+            mask |= 1u << unit;
+        }
+    }
+    return mask;
+}
+
+static u16 diff_blocks(StateCache const *cache, RenderBind const *bind)
+{
+    bool const force = cache->invalid & STATE_DIRTY_BLOCKS || cache->bind == NULL;
+
+    u16 mask = 0;
+    for (u32 slot = 0, bits = bind->block_mask; bits != 0; bits >>= 1, ++slot) {
+        u32 const ntz = walrus_u32cnttz(bits);
+        bits >>= ntz;
+        slot += ntz;
+
+        BlockBinding const *block = &bind->block_bindings[slot];
+        if (block->handle.id != WR_INVALID_HANDLE &&
+            (force || !block_binding_equal(block, &cache->bind->block_bindings[slot]))) {
+            mask |= 1u << slot;
+        }
+    }
+    return mask;
+}
+
+static bool diff_attributes(StateCache *cache, RenderFrame const *frame, RenderDraw const *draw)
+{
+    bool changed = cache->invalid & STATE_DIRTY_ATTRIBUTES || cache->stream_mask != draw->stream_mask ||
+                   cache->instance_buffer.id != draw->instance_buffer.id ||
+                   cache->instance_layout.id != draw->instance_layout.id ||
+                   cache->instance_offset != draw->instance_offset;
+
+    // A mask of UINT16_MAX means the draw only has a vertex count and no streams
+    u32 const mask = draw->stream_mask != UINT16_MAX ? draw->stream_mask : 0;
+    for (u32 id = 0, stream_mask = mask; 0 != stream_mask; stream_mask >>= 1, ++id) {
+        u32 const ntz = walrus_u32cnttz(stream_mask);
+        stream_mask >>= ntz;
+        id += ntz;
+
+        VertexStream const *stream = frame_get_stream(frame, draw, id);
+        if (!stream_equal(&cache->streams[id], stream)) {
+            cache->streams[id] = *stream;
+            changed            = true;
+        }
+    }
+
+    cache->stream_mask     = draw->stream_mask;
+    cache->instance_buffer = draw->instance_buffer;
+    cache->instance_layout = draw->instance_layout;
+    cache->instance_offset = draw->instance_offset;
+
+    return changed;
+}
+
+void state_cache_reset(StateCache *cache)
+{
+    memset(cache, 0xff, sizeof(StateCache));
+    cache->bind    = NULL;
+    cache->invalid = STATE_DIRTY_ALL;
+}
+
+void state_cache_invalidate(StateCache *cache, u32 dirty)
+{
+    cache->invalid |= dirty;
+}
+
+void state_cache_begin_view(StateCache *cache, RenderView const *view)
+{
+    cache->invalid |= STATE_DIRTY_SCISSOR;
+    if (view->clear.flags & (WR_RHI_CLEAR_COLOR | WR_RHI_CLEAR_DEPTH)) {
+        cache->invalid |= STATE_DIRTY_WRITE;
+    }
+}
+
+void state_cache_diff_draw(StateCache *cache, RenderFrame const *frame, Walrus_ProgramHandle program,
+                           RenderDraw const *draw, RenderBind const *bind, StateDelta *delta)
+{
+    u32 const invalid = cache->invalid;
+
+    memset(delta, 0, sizeof(StateDelta));
+
+    delta->changed_flags   = cache->state_flags ^ draw->state_flags;
+    delta->changed_stencil = cache->stencil ^ draw->stencil;
+    for (u32 i = 0; i < walrus_count_of(s_flag_masks); ++i) {
+        if (invalid & (1 << i)) {
+            delta->changed_flags |= s_flag_masks[i];
+        }
+        if (delta->changed_flags & s_flag_masks[i]) {
+            delta->dirty |= 1 << i;
+        }
+    }
+    if (invalid & STATE_DIRTY_STENCIL) {
+        delta->changed_stencil = pack_stencil(WR_RHI_STENCIL_MASK, WR_RHI_STENCIL_MASK);
+    }
+    if (delta->changed_stencil != 0) {
+        delta->dirty |= STATE_DIRTY_STENCIL;
+    }
+    cache->state_flags = draw->state_flags;
+    cache->stencil     = draw->stencil;
+
+    if (blend_uses_factor(draw->state_flags) &&
+        (invalid & STATE_DIRTY_BLEND_FACTOR || cache->blend_factor != draw->blend_factor)) {
+        delta->dirty |= STATE_DIRTY_BLEND_FACTOR;
+        cache->blend_factor = draw->blend_factor;
+    }
+
+    if (invalid & STATE_DIRTY_SCISSOR || !viewrect_equal(&cache->scissor, &draw->scissor)) {
+        delta->dirty |= STATE_DIRTY_SCISSOR;
+        cache->scissor = draw->scissor;
+    }
+
+    if (invalid & STATE_DIRTY_PROGRAM || cache->program.id != program.id) {
+        delta->dirty |= STATE_DIRTY_PROGRAM;
+        cache->program = program;
+    }
+
+    if (invalid & (STATE_DIRTY_TEXTURES | STATE_DIRTY_BLOCKS) || cache->bind != bind) {
+        delta->texture_mask = diff_textures(cache, bind);
+        delta->block_mask   = diff_blocks(cache, bind);
+        cache->bind         = bind;
+    }
+    if (delta->texture_mask != 0) {
+        delta->dirty |= STATE_DIRTY_TEXTURES;
+    }
+    if (delta->block_mask != 0) {
+        delta->dirty |= STATE_DIRTY_BLOCKS;
+    }
+
+    if (diff_attributes(cache, frame, draw)) {
+        delta->dirty |= STATE_DIRTY_ATTRIBUTES;
+    }
+
+    if (invalid & STATE_DIRTY_INDEX_BUFFER || cache->index_buffer.id != draw->index_buffer.id) {
+        delta->dirty |= STATE_DIRTY_INDEX_BUFFER;
+        cache->index_buffer = draw->index_buffer;
+    }
+
+    cache->invalid = 0;
+}
+
+void state_delta_count(StateDelta const *delta, Walrus_RhiStats *stats)
+{
+    stats->state_changes += walrus_u32cntbits(delta->dirty & STATE_DIRTY_FIXED_FUNCTION);
+    stats->texture_binds += walrus_u32cntbits(delta->texture_mask);
+    stats->block_binds += walrus_u32cntbits(delta->block_mask);
+    if (delta->dirty & STATE_DIRTY_PROGRAM) {
+        ++stats->program_changes;
+    }
+    if (delta->dirty & STATE_DIRTY_ATTRIBUTES) {
+        ++stats->attribute_binds;
+    }
+    if (delta->dirty & STATE_DIRTY_INDEX_BUFFER) {
+        ++stats->index_binds;
+    }
+}
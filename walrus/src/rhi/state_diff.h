@@ -0,0 +1,67 @@
+#pragma once
+
+#include "frame.h"
+
+// Backend independent tracking of the state applied by a renderer, so that consecutive draws only emit what changed
+typedef enum {
+    STATE_DIRTY_BLEND        = 1 << 0,
+    STATE_DIRTY_BLEND_FACTOR = 1 << 1,
+    STATE_DIRTY_DEPTH        = 1 << 2,
+    STATE_DIRTY_WRITE        = 1 << 3,
+    STATE_DIRTY_CULL         = 1 << 4,
+    STATE_DIRTY_STENCIL      = 1 << 5,
+    STATE_DIRTY_PRIMITIVE    = 1 << 6,
+    STATE_DIRTY_SCISSOR      = 1 << 7,
+    STATE_DIRTY_PROGRAM      = 1 << 8,
+    STATE_DIRTY_TEXTURES     = 1 << 9,
+    STATE_DIRTY_BLOCKS       = 1 << 10,
+    STATE_DIRTY_ATTRIBUTES   = 1 << 11,
+    STATE_DIRTY_INDEX_BUFFER = 1 << 12,
+
+    STATE_DIRTY_FIXED_FUNCTION = (1 << 8) - 1,
+    STATE_DIRTY_ALL            = (1 << 13) - 1
+} StateDirty;
+
+typedef struct {
+    u32 dirty;
+    // State and stencil bits to re-apply, only meaningful for the fixed function dirty bits
+    u64 changed_flags;
+    u64 changed_stencil;
+    // Units and block bindings whose new binding is valid and differs from the applied one
+    u32 texture_mask;
+    u16 block_mask;
+} StateDelta;
+
+typedef struct {
+    // Categories whose applied value is unknown to the cache, they are emitted by the next diff
+    u32 invalid;
+
+    u64                  state_flags;
+    u64                  stencil;
+    u32                  blend_factor;
+    ViewRect             scissor;
+    Walrus_ProgramHandle program;
+
+    // Bind sets are deduplicated per frame, so the same set means the same bindings
+    RenderBind const *bind;
+
+    u16                 stream_mask;
+    VertexStream        streams[WR_RHI_MAX_VERTEX_STREAM];
+    u32                 instance_offset;
+    Walrus_BufferHandle instance_buffer;
+    Walrus_LayoutHandle instance_layout;
+    Walrus_BufferHandle index_buffer;
+} StateCache;
+
+void state_cache_reset(StateCache *cache);
+
+// Marks state that was changed behind the cache's back, e.g. by clears or compute dispatches
+void state_cache_invalidate(StateCache *cache, u32 dirty);
+
+// Clearing a view touches the write masks and the scissor test, and the view's scissor applies to every draw
+void state_cache_begin_view(StateCache *cache, RenderView const *view);
+
+void state_cache_diff_draw(StateCache *cache, RenderFrame const *frame, Walrus_ProgramHandle program,
+                           RenderDraw const *draw, RenderBind const *bind, StateDelta *delta);
+
+void state_delta_count(StateDelta const *delta, Walrus_RhiStats *stats);
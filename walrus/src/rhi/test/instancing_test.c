@@ -0,0 +1,94 @@
+#include <rhi/rhi.h>
+#include <core/string.h>
+
+#include <cglm/affine.h>
+#include <stdio.h>
+
+#define EXPECT(e)                                                          \
+    if (!(e)) {                                                            \
+        printf("%s:%d: expectation failed: %s\n", __FILE__, __LINE__, #e); \
+        return 1;                                                          \
+    }
+
+static Walrus_ProgramHandle s_program;
+static Walrus_UniformHandle s_color;
+
+static void draw(u64 state, f32 x, f32 color)
+{
+    mat4 transform = GLM_MAT4_IDENTITY_INIT;
+    glm_translate_x(transform, x);
+
+    walrus_rhi_set_transform(transform);
+    walrus_rhi_set_state(state, 0);
+    walrus_rhi_set_uniform(s_color, 0, sizeof(f32), &color);
+    walrus_rhi_set_vertex_count(3);
+    walrus_rhi_submit(0, s_program, 0, WR_RHI_DISCARD_ALL);
+}
+
+static i32 instancing_test(void)
+{
+    // Identical draws with different transforms become one instanced draw
+    for (u32 i = 0; i < 8; ++i) {
+        draw(WR_RHI_STATE_DEFAULT, i, 0);
+    }
+    // A different state starts another instanced draw
+    for (u32 i = 0; i < 3; ++i) {
+        draw(WR_RHI_STATE_DEFAULT | WR_RHI_STATE_BLEND_ALPHA, i, 0);
+    }
+    // Different uniform values are never merged
+    draw(WR_RHI_STATE_DEFAULT, 0, 1);
+    walrus_rhi_frame();
+
+    Walrus_RhiStats const *stats = walrus_rhi_get_stats();
+    EXPECT(stats->draw_calls == 3);
+    EXPECT(stats->merged_draws == 7 + 2);
+    EXPECT(stats->num_instances == 8 + 3 + 1);
+
+    // The default view mode keeps every draw
+    walrus_rhi_set_view_mode(0, WR_RHI_VIEWMODE_DEFAULT);
+    for (u32 i = 0; i < 8; ++i) {
+        draw(WR_RHI_STATE_DEFAULT, i, 0);
+    }
+    walrus_rhi_frame();
+
+    EXPECT(stats->draw_calls == 8);
+    EXPECT(stats->merged_draws == 0);
+
+    return 0;
+}
+
+i32 main(void)
+{
+    Walrus_RhiCreateInfo info;
+    info.resolution    = (Walrus_Resolution){1280, 720, 0};
+    info.flags         = WR_RHI_FLAG_NULL;
+    info.single_thread = true;
+    info.num_frames    = 1;
+
+    if (walrus_rhi_init(&info) != WR_RHI_SUCCESS) {
+        return 1;
+    }
+
+    // The null backend never compiles shaders, the sources only need to be distinct
+    char *vs = walrus_str_dup("vs");
+    char *fs = walrus_str_dup("fs");
+
+    Walrus_ShaderHandle shaders[2] = {walrus_rhi_create_shader(WR_RHI_SHADER_VERTEX, vs),
+                                      walrus_rhi_create_shader(WR_RHI_SHADER_FRAGMENT, fs)};
+    s_program                      = walrus_rhi_create_program(shaders, 2, true);
+    walrus_str_free(vs);
+    walrus_str_free(fs);
+
+    s_color = walrus_rhi_create_uniform("u_color", WR_RHI_UNIFORM_FLOAT, 1);
+
+    walrus_rhi_set_view_mode(0, WR_RHI_VIEWMODE_INSTANCING);
+    walrus_rhi_frame();
+
+    i32 r = instancing_test();
+
+    walrus_rhi_destroy_uniform(s_color);
+    walrus_rhi_destroy_program(s_program);
+    walrus_rhi_shutdown();
+
+    return r;
+}
@@ -0,0 +1,61 @@
+#include <rhi/rhi.h>
+#include <core/string.h>
+
+#include <stdio.h>
+
+#define EXPECT(e)                                                          \
+    if (!(e)) {                                                            \
+        printf("%s:%d: expectation failed: %s\n", __FILE__, __LINE__, #e); \
+        return 1;                                                          \
+    }
+
+static i32 null_renderer_test(void)
+{
+    // The null backend never compiles shaders, the sources only need to be distinct
+    char *vs = walrus_str_dup("vs");
+    char *fs = walrus_str_dup("fs");
+
+    Walrus_ShaderHandle  shaders[2] = {walrus_rhi_create_shader(WR_RHI_SHADER_VERTEX, vs),
+                                       walrus_rhi_create_shader(WR_RHI_SHADER_FRAGMENT, fs)};
+    Walrus_ProgramHandle program    = walrus_rhi_create_program(shaders, 2, true);
+    walrus_str_free(vs);
+    walrus_str_free(fs);
+    EXPECT(program.id != WR_INVALID_HANDLE);
+
+    // A frame submitted without a GPU is still sorted and walked
+    walrus_rhi_set_view_rect(0, 0, 0, 1280, 720);
+    walrus_rhi_set_vertex_count(3);
+    walrus_rhi_submit(0, program, 0, WR_RHI_DISCARD_ALL);
+    walrus_rhi_frame();
+
+    Walrus_RhiStats const *stats = walrus_rhi_get_stats();
+    EXPECT(stats->draw_calls == 1);
+    EXPECT(stats->num_vertices == 3);
+
+    // Nothing is left over for the next frame
+    walrus_rhi_frame();
+    EXPECT(stats->draw_calls == 0);
+
+    walrus_rhi_destroy_program(program);
+
+    return 0;
+}
+
+i32 main(void)
+{
+    Walrus_RhiCreateInfo info;
+    info.resolution    = (Walrus_Resolution){1280, 720, 0};
+    info.flags         = WR_RHI_FLAG_NULL;
+    info.single_thread = true;
+    info.num_frames    = 1;
+
+    if (walrus_rhi_init(&info) != WR_RHI_SUCCESS) {
+        return 1;
+    }
+
+    i32 r = null_renderer_test();
+
+    walrus_rhi_shutdown();
+
+    return r;
+}
@@ -0,0 +1,138 @@
+#include <rhi/rhi.h>
+#include <core/string.h>
+
+#include "null_renderer.h"
+
+#include <stdio.h>
+
+#define EXPECT(e)                                                          \
+    if (!(e)) {                                                            \
+        printf("%s:%d: expectation failed: %s\n", __FILE__, __LINE__, #e); \
+        return 1;                                                          \
+    }
+
+static Walrus_ProgramHandle s_program;
+static Walrus_TextureHandle s_textures[2];
+
+static void draw(u64 state, u8 num_textures)
+{
+    walrus_rhi_set_state(state, 0);
+    for (u8 i = 0; i < num_textures; ++i) {
+        walrus_rhi_set_texture(i, s_textures[i]);
+    }
+    walrus_rhi_set_vertex_count(3);
+    walrus_rhi_submit(0, s_program, 0, WR_RHI_DISCARD_ALL);
+}
+
+static i32 state_diff_test(void)
+{
+    // Identical consecutive draws must not emit anything
+    draw(WR_RHI_STATE_DEFAULT, 1);
+    draw(WR_RHI_STATE_DEFAULT, 1);
+    // Only the blend state changes
+    draw(WR_RHI_STATE_DEFAULT | WR_RHI_STATE_BLEND_ALPHA, 1);
+    // Only the second texture unit changes
+    draw(WR_RHI_STATE_DEFAULT | WR_RHI_STATE_BLEND_ALPHA, 2);
+    // Back to the first draw, blend and nothing else, the texture in unit 1 is left bound
+    draw(WR_RHI_STATE_DEFAULT, 1);
+    walrus_rhi_frame();
+
+    EXPECT(null_renderer->num_deltas == 5);
+
+    StateDelta const *deltas = null_renderer->deltas;
+    EXPECT(deltas[0].dirty == (STATE_DIRTY_ALL & ~(STATE_DIRTY_BLEND_FACTOR | STATE_DIRTY_BLOCKS)));
+    EXPECT(deltas[0].texture_mask == 1);
+
+    EXPECT(deltas[1].dirty == 0);
+
+    EXPECT(deltas[2].dirty == STATE_DIRTY_BLEND);
+    EXPECT(deltas[2].changed_flags == WR_RHI_STATE_BLEND_ALPHA);
+
+    EXPECT(deltas[3].dirty == STATE_DIRTY_TEXTURES);
+    EXPECT(deltas[3].texture_mask == 2);
+
+    EXPECT(deltas[4].dirty == STATE_DIRTY_BLEND);
+
+    Walrus_RhiStats const *stats = walrus_rhi_get_stats();
+    EXPECT(stats->draw_calls == 5);
+    EXPECT(stats->program_changes == 1);
+    EXPECT(stats->texture_binds == 2);
+    EXPECT(stats->attribute_binds == 1);
+    EXPECT(stats->index_binds == 1);
+    EXPECT(stats->state_changes == 7 + 2);
+
+    return 0;
+}
+
+static void encoder_draw(Walrus_RhiEncoder *encoder, u64 state)
+{
+    walrus_rhi_encoder_set_state(encoder, state, 0);
+    walrus_rhi_encoder_set_texture(encoder, 0, s_textures[0]);
+    walrus_rhi_encoder_set_vertex_count(encoder, 3);
+    walrus_rhi_encoder_submit(encoder, 0, s_program, 0, WR_RHI_DISCARD_ALL);
+}
+
+static i32 encoder_order_test(void)
+{
+    // Interleaved submits to a sequential view come out grouped by encoder, in slot order, each in its own order
+    Walrus_RhiEncoder *first  = walrus_rhi_begin_encoder();
+    Walrus_RhiEncoder *second = walrus_rhi_begin_encoder();
+    EXPECT(first != NULL && second != NULL);
+    for (u32 i = 0; i < 3; ++i) {
+        encoder_draw(second, WR_RHI_STATE_DEFAULT);
+        encoder_draw(first, WR_RHI_STATE_DEFAULT | WR_RHI_STATE_BLEND_ALPHA);
+    }
+    walrus_rhi_end_encoder(second);
+    walrus_rhi_end_encoder(first);
+    walrus_rhi_frame();
+
+    EXPECT(null_renderer->num_deltas == 6);
+    StateDelta const *deltas = null_renderer->deltas;
+    for (u32 i = 1; i < 6; ++i) {
+        EXPECT(deltas[i].dirty == (i == 3 ? STATE_DIRTY_BLEND : 0));
+    }
+
+    return 0;
+}
+
+i32 main(void)
+{
+    Walrus_RhiCreateInfo info;
+    info.resolution    = (Walrus_Resolution){1280, 720, 0};
+    info.flags         = WR_RHI_FLAG_NULL;
+    info.single_thread = true;
+    info.num_frames    = 1;
+
+    if (walrus_rhi_init(&info) != WR_RHI_SUCCESS) {
+        return 1;
+    }
+
+    // The null backend never compiles shaders, the sources only need to be distinct
+    char *vs = walrus_str_dup("vs");
+    char *fs = walrus_str_dup("fs");
+
+    Walrus_ShaderHandle shaders[2] = {walrus_rhi_create_shader(WR_RHI_SHADER_VERTEX, vs),
+                                      walrus_rhi_create_shader(WR_RHI_SHADER_FRAGMENT, fs)};
+    s_program                      = walrus_rhi_create_program(shaders, 2, true);
+    walrus_str_free(vs);
+    walrus_str_free(fs);
+
+    for (u32 i = 0; i < 2; ++i) {
+        s_textures[i] = walrus_rhi_create_texture2d(1, 1, WR_RHI_FORMAT_RGBA8, 0, 0, NULL);
+    }
+    walrus_rhi_set_view_mode(0, WR_RHI_VIEWMODE_SEQUENTIAL);
+    walrus_rhi_frame();
+
+    i32 r = state_diff_test();
+    if (r == 0) {
+        r = encoder_order_test();
+    }
+
+    walrus_rhi_destroy_program(s_program);
+    for (u32 i = 0; i < 2; ++i) {
+        walrus_rhi_destroy_texture(s_textures[i]);
+    }
+    walrus_rhi_shutdown();
+
+    return r;
+}
@@ -0,0 +1,167 @@
+#include "uniform_buffer.h"
+
+#include <core/macro.h>
+
+#include <stdio.h>
+#include <string.h>
+
+#define EXPECT(e)                                                          \
+    if (!(e)) {                                                            \
+        printf("%s:%d: expectation failed: %s\n", __FILE__, __LINE__, #e); \
+        return 1;                                                          \
+    }
+
+#define NUM_UNIFORMS 16
+#define NUM_RANGES   512
+#define MAX_WRITES   12
+#define VALUE_SIZE   64
+
+// Values a range leaves in every uniform, with the bytes it touched
+typedef struct {
+    u8 value[NUM_UNIFORMS][VALUE_SIZE];
+    u8 touched[NUM_UNIFORMS][VALUE_SIZE];
+} UniformState;
+
+typedef struct {
+    u32 begin;
+    u32 end;
+} Range;
+
+// Sizes of a bool, a float, a vec2, a vec3, a vec4 and a mat4
+static u32 const s_sizes[] = {1, 4, 8, 12, 16, 64};
+
+static u64 s_rng = 0x9e3779b97f4a7c15ull;
+
+static u32 randu(u32 max)
+{
+    s_rng ^= s_rng << 13;
+    s_rng ^= s_rng >> 7;
+    s_rng ^= s_rng << 17;
+    return (s_rng >> 32) % max;
+}
+
+static void state_set(UniformState *state, u32 uniform, u32 offset, u32 size, void const *data)
+{
+    memcpy(&state->value[uniform][offset], data, size);
+    memset(&state->touched[uniform][offset], 1, size);
+}
+
+static UniformState s_expected[NUM_RANGES];
+static Range        s_ranges[NUM_RANGES];
+
+i32 main(void)
+{
+    // Small chunks so that plenty of records jump to the next chunk
+    UniformBuffer *buffer     = uniform_buffer_create(4 << 10);
+    u32            num_writes = 0;
+    u32            old_size   = 0;
+
+    memset(s_expected, 0, sizeof(s_expected));
+    for (u32 i = 0; i < NUM_RANGES; ++i) {
+        s_ranges[i].begin = buffer->pos;
+        u32 const writes  = randu(MAX_WRITES);
+        for (u32 j = 0; j < writes; ++j) {
+            // Few distinct values so that a uniform is often set again to what it holds
+            u32 const uniform = randu(NUM_UNIFORMS);
+            u32 const size    = s_sizes[randu(walrus_count_of(s_sizes))];
+            u32 const offset  = randu(3) == 0 ? randu((VALUE_SIZE - size) / 4 + 1) * 4 : 0;
+            u8        data[VALUE_SIZE];
+            memset(data, randu(2), size);
+
+            Walrus_UniformHandle handle = {uniform};
+            uniform_buffer_write_uniform(buffer, s_ranges[i].begin, WR_RHI_UNIFORM_FLOAT, handle, offset, size, data);
+            state_set(&s_expected[i], uniform, offset, size, data);
+
+            // Operation, offset and size words followed by the payload
+            old_size += 3 * sizeof(u64) + size;
+            ++num_writes;
+        }
+        s_ranges[i].end = buffer->pos;
+    }
+    u32 const new_size = buffer->pos;
+    uniform_buffer_finish(buffer);
+
+    printf("%u writes, %u bytes -> %u bytes in %u chunks\n", num_writes, old_size, new_size, buffer->num_chunks);
+    EXPECT(buffer->num_chunks > 1);
+    EXPECT(new_size < old_size * 2 / 3);
+
+    // Ranges are replayed in any order, as sorted draws are, and each one sets what it was asked to
+    u32 num_records = 0;
+    for (u32 k = 0; k < NUM_RANGES; ++k) {
+        u32 const    i = (k * 7) % NUM_RANGES;
+        UniformState replayed;
+        memset(&replayed, 0, sizeof(replayed));
+
+        Walrus_UniformType   type;
+        Walrus_UniformHandle handle;
+        u32                  offset;
+        u32                  size;
+        void const          *data;
+        uniform_buffer_start(buffer, s_ranges[i].begin);
+        while (buffer->pos < s_ranges[i].end &&
+               uniform_buffer_read_uniform(buffer, &type, &handle, &offset, &size, &data)) {
+            EXPECT(type == WR_RHI_UNIFORM_FLOAT);
+            EXPECT(handle.id < NUM_UNIFORMS && offset + size <= VALUE_SIZE);
+            state_set(&replayed, handle.id, offset, size, data);
+            ++num_records;
+        }
+        EXPECT(buffer->pos == s_ranges[i].end);
+
+        EXPECT(memcmp(replayed.touched, s_expected[i].touched, sizeof(replayed.touched)) == 0);
+        EXPECT(memcmp(replayed.value, s_expected[i].value, sizeof(replayed.value)) == 0);
+    }
+    printf("%u records replayed\n", num_records);
+    EXPECT(num_records < num_writes);
+
+    // The whole stream reads back up to its end marker
+    Walrus_UniformType   type;
+    Walrus_UniformHandle handle;
+    u32                  offset;
+    u32                  size;
+    void const          *data;
+    u32                  num_read = 0;
+    uniform_buffer_start(buffer, 0);
+    while (uniform_buffer_read_uniform(buffer, &type, &handle, &offset, &size, &data)) {
+        ++num_read;
+    }
+    EXPECT(num_read == num_records);
+
+    // Setting a uniform again to the value it holds in the range is dropped, another value or range records it
+    uniform_buffer_reset(buffer);
+    u32 const            values[2] = {1, 2};
+    Walrus_UniformHandle a         = {0};
+    Walrus_UniformHandle b         = {1};
+    uniform_buffer_write_uniform(buffer, 0, WR_RHI_UNIFORM_UINT, a, 0, sizeof(u32), &values[0]);
+    uniform_buffer_write_uniform(buffer, 0, WR_RHI_UNIFORM_UINT, b, 0, sizeof(u32), &values[0]);
+    uniform_buffer_write_uniform(buffer, 0, WR_RHI_UNIFORM_UINT, a, 0, sizeof(u32), &values[0]);
+    EXPECT(buffer->pos == 4 * sizeof(u32));
+    uniform_buffer_write_uniform(buffer, 0, WR_RHI_UNIFORM_UINT, a, 0, sizeof(u32), &values[1]);
+    uniform_buffer_write_uniform(buffer, 0, WR_RHI_UNIFORM_UINT, a, 0, sizeof(u32), &values[1]);
+    EXPECT(buffer->pos == 6 * sizeof(u32));
+    u32 const begin = buffer->pos;
+    uniform_buffer_write_uniform(buffer, begin, WR_RHI_UNIFORM_UINT, a, 0, sizeof(u32), &values[1]);
+    EXPECT(buffer->pos == 8 * sizeof(u32));
+
+    uniform_buffer_destroy(buffer);
+
+    // Far more chunks than the buffer started with, every record reads back in order
+    buffer = uniform_buffer_create(64);
+    for (u32 i = 0; i < NUM_RANGES * 4; ++i) {
+        Walrus_UniformHandle handle = {i % NUM_UNIFORMS};
+        u32 const            value[4] = {i, i, i, i};
+        uniform_buffer_write_uniform(buffer, buffer->pos, WR_RHI_UNIFORM_UINT, handle, 0, sizeof(value), value);
+    }
+    uniform_buffer_finish(buffer);
+    EXPECT(buffer->num_chunks > 256);
+
+    num_read = 0;
+    while (uniform_buffer_read_uniform(buffer, &type, &handle, &offset, &size, &data)) {
+        EXPECT(handle.id == num_read % NUM_UNIFORMS && *(u32 const *)data == num_read);
+        ++num_read;
+    }
+    EXPECT(num_read == NUM_RANGES * 4);
+
+    uniform_buffer_destroy(buffer);
+
+    return 0;
+}
@@ -6,61 +6,109 @@
 
 #include <string.h>
 
-UniformBuffer *uniform_buffer_create(u64 size)
+// Header word of a record: handle, type, payload size and whether an offset word follows. A uniform handle record
+// packs its count instead of the size and is always followed by the location.
+#define HEADER_HANDLE_NBITS 12
+#define HEADER_HANDLE_MASK  ((1u << HEADER_HANDLE_NBITS) - 1)
+
+#define HEADER_TYPE_SHIFT HEADER_HANDLE_NBITS
+#define HEADER_TYPE_NBITS 4
+#define HEADER_TYPE_MASK  ((1u << HEADER_TYPE_NBITS) - 1)
+
+#define HEADER_SIZE_SHIFT (HEADER_TYPE_SHIFT + HEADER_TYPE_NBITS)
+#define HEADER_SIZE_NBITS 15
+#define HEADER_SIZE_MASK  ((1u << HEADER_SIZE_NBITS) - 1)
+
+#define HEADER_OFFSET_BIT (1u << 31)
+
+#if WR_RHI_MAX_UNIFORMS > (1 << HEADER_HANDLE_NBITS)
+#error "Uniform handles do not fit in the uniform buffer header"
+#endif
+
+static u32 align_word(u32 size)
 {
-    UniformBuffer *buffer = walrus_malloc(offsetof(UniformBuffer, data) + size);
-    buffer->pos                  = 0;
-    buffer->size                 = size;
-    return buffer;
+    return (size + 3) & ~3u;
 }
 
-void uniform_buffer_update(UniformBuffer **buffer, u32 threshold, u32 grow)
+static u32 header_encode(Walrus_UniformType type, Walrus_UniformHandle handle, u32 size)
 {
-    UniformBuffer *ptr = *buffer;
+    return handle.id | (u32)type << HEADER_TYPE_SHIFT | size << HEADER_SIZE_SHIFT;
+}
 
-    u32 space_left = ptr->size - ptr->pos;
-    if (threshold >= space_left) {
-        walrus_trace("uniform buffer resize");
-        u32 new_size = ptr->size + grow;
-        ptr          = walrus_realloc(ptr, offsetof(UniformBuffer, data) + new_size);
-        ptr->size    = new_size;
-        *buffer      = ptr;
-    }
+static u32 header_size(u32 header)
+{
+    return (header >> HEADER_SIZE_SHIFT) & HEADER_SIZE_MASK;
 }
 
-void uniform_buffer_destroy(UniformBuffer *buffer)
+static u8 *chunk_at(UniformBuffer const *buffer, u32 pos)
 {
-    walrus_free(buffer);
+    return buffer->chunks[pos / buffer->chunk_size] + pos % buffer->chunk_size;
 }
 
-void uniform_buffer_write(UniformBuffer *buffer, void const *data, u64 size)
+UniformBuffer *uniform_buffer_create(u32 chunk_size)
 {
-    walrus_assert_msg(buffer->pos + size < buffer->size, "uniform_buffer_write go out of bound!");
+    UniformBuffer *buffer = walrus_new(UniformBuffer, 1);
+    buffer->chunk_size    = align_word(chunk_size);
+    buffer->max_chunks    = 1;
+    buffer->chunks        = walrus_new(u8 *, buffer->max_chunks);
+    buffer->chunks[0]     = walrus_malloc(buffer->chunk_size);
+    buffer->num_chunks    = 1;
+    buffer->size          = buffer->chunk_size;
+    uniform_buffer_reset(buffer);
+    return buffer;
+}
 
-    if (buffer->pos + size < buffer->size) {
-        memcpy(buffer->data + buffer->pos, data, size);
-        buffer->pos += size;
+void uniform_buffer_destroy(UniformBuffer *buffer)
+{
+    for (u32 i = 0; i < buffer->num_chunks; ++i) {
+        walrus_free(buffer->chunks[i]);
     }
+    walrus_free(buffer->chunks);
+    walrus_free(buffer);
 }
-void uniform_buffer_write_value(UniformBuffer *buffer, u64 value)
+
+void uniform_buffer_reset(UniformBuffer *buffer)
 {
-    uniform_buffer_write(buffer, &value, sizeof(u64));
+    buffer->pos = 0;
+    memset(buffer->last, 0, sizeof(buffer->last));
 }
 
-void const *uniform_buffer_read(UniformBuffer *buffer, u64 size)
+// Room for `size` contiguous bytes, the rest of a chunk too small for them is skipped
+static void *reserve(UniformBuffer *buffer, u32 size)
 {
-    walrus_assert_msg(buffer->pos < buffer->size, "uniform_buffer_read out of bound: %d (size: %d)", buffer->pos,
-                      buffer->size);
+    walrus_assert_msg(size <= buffer->chunk_size, "uniform record of %u bytes is larger than a chunk", size);
 
-    void const *data = buffer->data + buffer->pos;
-    buffer->pos += size;
+    u32 const left = buffer->chunk_size - buffer->pos % buffer->chunk_size;
+    if (size > left) {
+        *(u32 *)chunk_at(buffer, buffer->pos) = UNIFORM_BUFFER_NEXT;
+        buffer->pos += left;
+    }
 
+    u32 const chunk = buffer->pos / buffer->chunk_size;
+    if (chunk >= buffer->num_chunks) {
+        if (buffer->num_chunks == buffer->max_chunks) {
+            buffer->max_chunks *= 2;
+            buffer->chunks = walrus_realloc(buffer->chunks, buffer->max_chunks * sizeof(u8 *));
+        }
+        walrus_trace("uniform buffer grows to %u chunks", chunk + 1);
+        buffer->chunks[buffer->num_chunks++] = walrus_malloc(buffer->chunk_size);
+        buffer->size += buffer->chunk_size;
+    }
+
+    void *data = chunk_at(buffer, buffer->pos);
+    buffer->pos += size;
     return data;
 }
 
-u64 uniform_buffer_read_value(UniformBuffer *buffer)
+// Header of the record at the read position, following the jumps to the next chunk
+static u32 const *read_header(UniformBuffer *buffer)
 {
-    return *(u64 *)uniform_buffer_read(buffer, sizeof(u64));
+    u32 const *header = (u32 const *)chunk_at(buffer, buffer->pos);
+    if (*header == UNIFORM_BUFFER_NEXT) {
+        buffer->pos += buffer->chunk_size - buffer->pos % buffer->chunk_size;
+        header = (u32 const *)chunk_at(buffer, buffer->pos);
+    }
+    return header;
 }
 
 void uniform_buffer_start(UniformBuffer *buffer, u32 pos)
@@ -70,59 +118,97 @@ void uniform_buffer_start(UniformBuffer *buffer, u32 pos)
 
 void uniform_buffer_finish(UniformBuffer *buffer)
 {
-    uniform_buffer_write_value(buffer, UNIFORM_BUFFER_END);
+    *(u32 *)reserve(buffer, sizeof(u32)) = UNIFORM_BUFFER_END;
     buffer->pos = 0;
 }
 
-void uniform_buffer_write_uniform(UniformBuffer *buffer, Walrus_UniformType type, Walrus_UniformHandle handle,
-                                  u32 offset, u32 size, void const *data)
+void uniform_buffer_write_uniform(UniformBuffer *buffer, u32 begin, Walrus_UniformType type,
+                                  Walrus_UniformHandle handle, u32 offset, u32 size, void const *data)
+{
+    walrus_assert(handle.id < WR_RHI_MAX_UNIFORMS);
+    walrus_assert_msg(size <= HEADER_SIZE_MASK, "uniform write of %u bytes is too large", size);
+
+    u32 const last = buffer->last[handle.id];
+    if (last > begin) {
+        u32 const *header      = (u32 const *)chunk_at(buffer, last - 1);
+        bool const has_offset  = *header & HEADER_OFFSET_BIT;
+        u32 const  last_offset = has_offset ? header[1] : 0;
+        if (header_size(*header) == size && last_offset == offset && memcmp(header + 1 + has_offset, data, size) == 0) {
+            return;
+        }
+    }
+
+    bool const has_offset = offset != 0;
+    u32 const  payload    = align_word(size);
+    u32 const  record     = (1 + has_offset) * sizeof(u32) + payload;
+    u32       *words      = reserve(buffer, record);
+
+    buffer->last[handle.id] = buffer->pos - record + 1;
+
+    words[0] = header_encode(type, handle, size) | (has_offset ? HEADER_OFFSET_BIT : 0);
+    if (has_offset) {
+        words[1] = offset;
+    }
+    u8 *dst = (u8 *)(words + 1 + has_offset);
+    memcpy(dst, data, size);
+    memset(dst + size, 0, payload - size);
+}
+
+bool uniform_buffer_read_uniform(UniformBuffer *buffer, Walrus_UniformType *type, Walrus_UniformHandle *handle,
+                                 u32 *offset, u32 *size, void const **data)
 {
-    uniform_buffer_write_value(buffer, uniform_encode_op(type, handle.id, 0));
-    uniform_buffer_write_value(buffer, offset);
-    uniform_buffer_write_value(buffer, size);
-    uniform_buffer_write(buffer, data, size);
+    u32 const *header = read_header(buffer);
+    if (*header == UNIFORM_BUFFER_END) {
+        return false;
+    }
+
+    bool const has_offset = *header & HEADER_OFFSET_BIT;
+    *type                 = (*header >> HEADER_TYPE_SHIFT) & HEADER_TYPE_MASK;
+    handle->id            = *header & HEADER_HANDLE_MASK;
+    *size                 = header_size(*header);
+    *offset               = has_offset ? header[1] : 0;
+    *data                 = header + 1 + has_offset;
+    buffer->pos += (1 + has_offset) * sizeof(u32) + align_word(*size);
+
+    return true;
 }
 
 void uniform_buffer_write_uniform_handle(UniformBuffer *buffer, Walrus_UniformType type, u32 loc,
                                          Walrus_UniformHandle handle, u8 num)
 {
-    u64 op = uniform_encode_op(type, loc, num);
-    uniform_buffer_write_value(buffer, op);
-    uniform_buffer_write(buffer, &handle, sizeof(handle));
-}
+    walrus_assert(handle.id < WR_RHI_MAX_UNIFORMS);
 
-#define OP_TYPE_NBITS (8)
-#define OP_TYPE_SHIFT (64 - OP_TYPE_NBITS)
-#define OP_TYPE_MASK  ((((u64)1 << OP_TYPE_NBITS) - 1) << OP_TYPE_SHIFT)
+    u32 *words = reserve(buffer, 2 * sizeof(u32));
+    words[0]   = header_encode(type, handle, num);
+    words[1]   = loc;
+}
 
-#define OP_LOC_NBITS (32)
-#define OP_LOC_SHIFT (OP_TYPE_SHIFT - OP_LOC_NBITS)
-#define OP_LOC_MASK  ((((u64)1 << OP_LOC_NBITS) - 1) << OP_LOC_SHIFT)
+bool uniform_buffer_read_uniform_handle(UniformBuffer *buffer, Walrus_UniformType *type, u32 *loc,
+                                        Walrus_UniformHandle *handle, u8 *num)
+{
+    u32 const *header = read_header(buffer);
+    if (*header == UNIFORM_BUFFER_END) {
+        return false;
+    }
 
-#define OP_NUM_NBITS (8)
-#define OP_NUM_SHIFT (OP_LOC_SHIFT - OP_NUM_NBITS)
-#define OP_NUM_MASK  ((((u64)1 << OP_NUM_NBITS) - 1) << OP_NUM_SHIFT)
+    *type      = (*header >> HEADER_TYPE_SHIFT) & HEADER_TYPE_MASK;
+    handle->id = *header & HEADER_HANDLE_MASK;
+    *num       = header_size(*header);
+    *loc       = header[1];
+    buffer->pos += 2 * sizeof(u32);
 
-u64 uniform_encode_op(Walrus_UniformType type, u32 loc, u8 num)
-{
-    const u64 _type = (u64)type << OP_TYPE_SHIFT;
-    const u64 _loc  = (u64)loc << OP_LOC_SHIFT;
-    const u64 _num  = (u64)num << OP_NUM_SHIFT;
-    return _type | _loc | _num;
+    return true;
 }
 
-void uniform_decode_op(Walrus_UniformType *type, u32 *loc, u8 *num, u64 op)
+// Ranges across chunks compare as different, which only costs a missed merge
+bool uniform_buffer_equal(UniformBuffer const *lhs, u32 lhs_begin, UniformBuffer const *rhs, u32 rhs_begin, u32 size)
 {
-    if (type) {
-        const u64 _type = (op & OP_TYPE_MASK) >> OP_TYPE_SHIFT;
-        *type           = _type;
-    }
-    if (num) {
-        const u64 _num = (op & OP_NUM_MASK) >> OP_NUM_SHIFT;
-        *num           = _num;
+    if (size == 0) {
+        return true;
     }
-    if (loc) {
-        const u64 _loc = (op & OP_LOC_MASK) >> OP_LOC_SHIFT;
-        *loc           = _loc;
+    if (lhs_begin / lhs->chunk_size != (lhs_begin + size - 1) / lhs->chunk_size ||
+        rhs_begin / rhs->chunk_size != (rhs_begin + size - 1) / rhs->chunk_size) {
+        return false;
     }
+    return memcmp(chunk_at(lhs, lhs_begin), chunk_at(rhs, rhs_begin), size) == 0;
 }
@@ -1,34 +1,47 @@
 #pragma once
 
+#include <rhi/rhi_defines.h>
 #include <rhi/type.h>
 
-#define UNIFORM_BUFFER_END UINT64_MAX
+// Records start with a packed header word, these two never decode to a valid uniform type
+#define UNIFORM_BUFFER_END  UINT32_MAX
+#define UNIFORM_BUFFER_NEXT (UINT32_MAX - 1)
 
+// Records are 4 bytes aligned and never straddle two chunks, positions address the chunks as one range so that a
+// record never moves once written. Chunks are allocated on demand and kept for the next frames, the array pointing to
+// them doubles when it is full.
 typedef struct {
-    u32 size;
-    u32 pos;
-    u8  data[1];
+    u32  size;
+    u32  pos;
+    u32  chunk_size;
+    u32  num_chunks;
+    u32  max_chunks;
+    u8** chunks;
+
+    // Position + 1 of the last record of every uniform since the reset, 0 if none
+    u32 last[WR_RHI_MAX_UNIFORMS];
 } UniformBuffer;
 
-UniformBuffer* uniform_buffer_create(u64 size);
-
-void uniform_buffer_update(UniformBuffer** buffer, u32 threshold, u32 grow);
+UniformBuffer* uniform_buffer_create(u32 chunk_size);
 
 void uniform_buffer_destroy(UniformBuffer* buffer);
 
-void uniform_buffer_write(UniformBuffer* buffer, void const* data, u64 size);
-void uniform_buffer_write_value(UniformBuffer* buffer, u64 value);
-
-void const* uniform_buffer_read(UniformBuffer* buffer, u64 size);
-u64         uniform_buffer_read_value(UniformBuffer* buffer);
+// Rewinds the writer and forgets the records seen for redundancy
+void uniform_buffer_reset(UniformBuffer* buffer);
 
 void uniform_buffer_start(UniformBuffer* buffer, u32 pos);
 void uniform_buffer_finish(UniformBuffer* buffer);
 
-void uniform_buffer_write_uniform(UniformBuffer* buffer, Walrus_UniformType type, Walrus_UniformHandle handle,
-                                  u32 offset, u32 size, void const* data);
+// Skipped when the same bytes of the uniform were already set to `data` by a record written at `begin` or later
+void uniform_buffer_write_uniform(UniformBuffer* buffer, u32 begin, Walrus_UniformType type,
+                                  Walrus_UniformHandle handle, u32 offset, u32 size, void const* data);
+// Returns false at the end of the buffer
+bool uniform_buffer_read_uniform(UniformBuffer* buffer, Walrus_UniformType* type, Walrus_UniformHandle* handle,
+                                 u32* offset, u32* size, void const** data);
+
 void uniform_buffer_write_uniform_handle(UniformBuffer* buffer, Walrus_UniformType type, u32 loc,
                                          Walrus_UniformHandle handle, u8 num);
+bool uniform_buffer_read_uniform_handle(UniformBuffer* buffer, Walrus_UniformType* type, u32* loc,
+                                        Walrus_UniformHandle* handle, u8* num);
 
-u64  uniform_encode_op(Walrus_UniformType type, u32 loc, u8 num);
-void uniform_decode_op(Walrus_UniformType* type, u32* loc, u8* num, u64 op);
+bool uniform_buffer_equal(UniformBuffer const* lhs, u32 lhs_begin, UniformBuffer const* rhs, u32 rhs_begin, u32 size);